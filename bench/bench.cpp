@@ -0,0 +1,375 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bench.cpp
+ *
+ *  The benchmark runner: State, registration and main().
+ *
+ *  usage: bpbench [--filter TEXT] [--min-time SEC] [--repetitions N]
+ *                 [--json] [--list]
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include "bputil/bpstrutil.h"
+
+#ifndef BPBENCH_BUILD_TYPE
+#define BPBENCH_BUILD_TYPE ""
+#endif
+
+
+namespace bpbench {
+
+
+namespace {
+
+
+struct Entry
+{
+    std::string     sName;
+    BenchFunc       pfn;
+    long            arg;
+};
+
+
+std::vector<Entry>&
+registry()
+{
+    static std::vector<Entry> s_entries;
+    return s_entries;
+}
+
+
+unsigned long long
+nowNanos()
+{
+#ifdef WIN32
+    static LARGE_INTEGER s_freq;
+    if (!s_freq.QuadPart) QueryPerformanceFrequency( &s_freq );
+    LARGE_INTEGER now;
+    QueryPerformanceCounter( &now );
+    return (unsigned long long)
+        ((double) now.QuadPart * 1e9 / (double) s_freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+
+} // anonymous namespace
+
+
+volatile const void* g_pSink = NULL;
+
+void
+doNotOptimize( const void* p )
+{
+    g_pSink = p;
+}
+
+
+Registrar::Registrar( const char* cszName, BenchFunc pfn, long arg )
+{
+    Entry e;
+    e.sName = cszName;
+    if (arg >= 0) {
+        char buf[32];
+        snprintf( buf, sizeof(buf), "/%ld", arg );
+        e.sName += buf;
+    }
+    e.pfn = pfn;
+    e.arg = arg;
+    registry().push_back( e );
+}
+
+
+State::State( unsigned long long nIters, long arg ) :
+    m_nIters( nIters ), m_arg( arg ), m_bRunning( false ),
+    m_nStart( 0 ), m_nAllocsAtStart( 0 ), m_nBytesAtStart( 0 ),
+    m_nNanos( 0 ), m_nAllocs( 0 ), m_nBytes( 0 )
+{
+}
+
+
+void
+State::start()
+{
+    m_nNanos = m_nAllocs = m_nBytes = 0;
+    resumeTiming();
+}
+
+
+void
+State::stop()
+{
+    pauseTiming();
+}
+
+
+void
+State::pauseTiming()
+{
+    if (!m_bRunning) return;
+    unsigned long long now = nowNanos();
+    AllocCounts c = allocCounts();
+    m_nNanos += now - m_nStart;
+    m_nAllocs += c.allocs - m_nAllocsAtStart;
+    m_nBytes += c.bytes - m_nBytesAtStart;
+    m_bRunning = false;
+}
+
+
+void
+State::resumeTiming()
+{
+    if (m_bRunning) return;
+    AllocCounts c = allocCounts();
+    m_nAllocsAtStart = c.allocs;
+    m_nBytesAtStart = c.bytes;
+    m_bRunning = true;
+    m_nStart = nowNanos();
+}
+
+
+} // bpbench
+
+
+namespace {
+
+
+struct Options
+{
+    Options() : dMinTime( 0.5 ), nRepetitions( 3 ),
+                bJson( false ), bList( false ) {}
+
+    std::string     sFilter;
+    double          dMinTime;
+    unsigned int    nRepetitions;
+    bool            bJson;
+    bool            bList;
+};
+
+
+struct Result
+{
+    std::string         sName;
+    unsigned long long  nIters;
+    double              dNsPerOp;           // median over repetitions
+    double              dNsPerOpMin;
+    double              dAllocsPerOp;
+    double              dBytesPerOp;
+};
+
+
+void
+usage()
+{
+    fprintf( stderr,
+"usage: bpbench [options]\n"
+"  --filter TEXT       run benchmarks whose names contain TEXT\n"
+"  --min-time SEC      target time per repetition (default 0.5)\n"
+"  --repetitions N     timed runs per benchmark (default 3)\n"
+"  --json              print results as JSON\n"
+"  --list              list benchmark names\n" );
+}
+
+
+bool
+parseOptions( int argc, char** argv, Options& opts )
+{
+    for (int i = 1; i < argc; i++) {
+        std::string sOpt = argv[i];
+        if (sOpt == "--json") opts.bJson = true;
+        else if (sOpt == "--list") opts.bList = true;
+        else if (i + 1 < argc && sOpt == "--filter") opts.sFilter = argv[++i];
+        else if (i + 1 < argc && sOpt == "--min-time") {
+            opts.dMinTime = atof( argv[++i] );
+            if (opts.dMinTime <= 0) return false;
+        }
+        else if (i + 1 < argc && sOpt == "--repetitions") {
+            opts.nRepetitions = (unsigned int) atoi( argv[++i] );
+            if (opts.nRepetitions == 0) return false;
+        }
+        else return false;
+    }
+    return true;
+}
+
+
+// Grow the iteration count until one run takes dMinTime.
+unsigned long long
+calibrate( bpbench::BenchFunc pfn, long arg, double dMinTime )
+{
+    const double dTarget = dMinTime * 1e9;
+    unsigned long long n = 1;
+    for (;;) {
+        bpbench::State state( n, arg );
+        state.start();
+        pfn( state );
+        state.stop();
+        double dNanos = (double) state.elapsedNanos();
+        if (dNanos >= dTarget || n >= 1000000000ULL) return n;
+
+        // Aim a little past the target, growing at least 2x and at
+        // most 100x per step.
+        double dNext = dNanos > 0 ? dTarget * 1.2 / (dNanos / n) : n * 100.0;
+        if (dNext < n * 2.0) dNext = n * 2.0;
+        if (dNext > n * 100.0) dNext = n * 100.0;
+        n = (unsigned long long) dNext;
+    }
+}
+
+
+Result
+runOne( const std::string& sName, bpbench::BenchFunc pfn, long arg,
+        const Options& opts )
+{
+    Result r;
+    r.sName = sName;
+    r.nIters = calibrate( pfn, arg, opts.dMinTime );
+
+    std::vector<double> vNsPerOp;
+    for (unsigned int i = 0; i < opts.nRepetitions; i++) {
+        bpbench::State state( r.nIters, arg );
+        state.start();
+        pfn( state );
+        state.stop();
+        vNsPerOp.push_back( (double) state.elapsedNanos() / r.nIters );
+        r.dAllocsPerOp = (double) state.allocations() / r.nIters;
+        r.dBytesPerOp = (double) state.allocatedBytes() / r.nIters;
+    }
+    std::sort( vNsPerOp.begin(), vNsPerOp.end() );
+    r.dNsPerOp = vNsPerOp[vNsPerOp.size() / 2];
+    r.dNsPerOpMin = vNsPerOp[0];
+    return r;
+}
+
+
+std::string
+compilerString()
+{
+    char buf[64];
+#if defined(__clang__)
+    snprintf( buf, sizeof(buf), "clang %d.%d.%d", __clang_major__,
+              __clang_minor__, __clang_patchlevel__ );
+#elif defined(__GNUC__)
+    snprintf( buf, sizeof(buf), "gcc %d.%d.%d", __GNUC__, __GNUC_MINOR__,
+              __GNUC_PATCHLEVEL__ );
+#elif defined(_MSC_VER)
+    snprintf( buf, sizeof(buf), "msvc %d", _MSC_VER );
+#else
+    snprintf( buf, sizeof(buf), "unknown" );
+#endif
+    return buf;
+}
+
+
+void
+printJson( const Options& opts, const std::vector<Result>& vResults )
+{
+    char szDate[32];
+    time_t now = time( NULL );
+    strftime( szDate, sizeof(szDate), "%Y-%m-%dT%H:%M:%SZ", gmtime( &now ) );
+
+    std::string s = "{\"context\":{\"date\":";
+    bplus::strutil::quoteJsonString( szDate, s );
+    s += ",\"compiler\":";
+    bplus::strutil::quoteJsonString( compilerString(), s );
+    s += ",\"buildType\":";
+    bplus::strutil::quoteJsonString( BPBENCH_BUILD_TYPE, s );
+    char buf[256];
+    snprintf( buf, sizeof(buf), ",\"minTime\":%g,\"repetitions\":%u}",
+              opts.dMinTime, opts.nRepetitions );
+    s += buf;
+
+    s += ",\"benchmarks\":[";
+    for (size_t i = 0; i < vResults.size(); i++) {
+        const Result& r = vResults[i];
+        if (i) s += ",";
+        s += "\n{\"name\":";
+        bplus::strutil::quoteJsonString( r.sName, s );
+        snprintf( buf, sizeof(buf),
+                  ",\"iterations\":%llu,\"nsPerOp\":%.2f,\"nsPerOpMin\":%.2f"
+                  ",\"allocsPerOp\":%.2f,\"bytesPerOp\":%.1f}",
+                  r.nIters, r.dNsPerOp, r.dNsPerOpMin, r.dAllocsPerOp,
+                  r.dBytesPerOp );
+        s += buf;
+    }
+    s += "\n]}";
+    printf( "%s\n", s.c_str() );
+}
+
+
+} // anonymous namespace
+
+
+int
+main( int argc, char** argv )
+{
+    Options opts;
+    if (!parseOptions( argc, argv, opts )) {
+        usage();
+        return 2;
+    }
+
+    const std::vector<bpbench::Entry>& entries = bpbench::registry();
+    std::vector<Result> vResults;
+    if (!opts.bJson && !opts.bList) {
+        printf( "%-40s %12s %12s %10s %10s\n", "benchmark", "iterations",
+                "ns/op", "allocs/op", "bytes/op" );
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        const bpbench::Entry& e = entries[i];
+        if (!opts.sFilter.empty()
+            && e.sName.find( opts.sFilter ) == std::string::npos) {
+            continue;
+        }
+        if (opts.bList) {
+            printf( "%s\n", e.sName.c_str() );
+            continue;
+        }
+        Result r = runOne( e.sName, e.pfn, e.arg, opts );
+        if (!opts.bJson) {
+            printf( "%-40s %12llu %12.1f %10.2f %10.1f\n", r.sName.c_str(),
+                    r.nIters, r.dNsPerOp, r.dAllocsPerOp, r.dBytesPerOp );
+            fflush( stdout );
+        }
+        vResults.push_back( r );
+    }
+    if (opts.bJson) printJson( opts, vResults );
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bench.h
+ *
+ *  A small benchmark runner.  A benchmark is a function that performs
+ *  its operation state.iterations() times; the runner picks the count
+ *  so each run takes a useful amount of time, and reports nanoseconds
+ *  and heap allocations per operation.
+ *
+ *      static void
+ *      mapAdd( bpbench::State& state )
+ *      {
+ *          for (unsigned long long i = 0; i < state.iterations(); i++) {
+ *              ...
+ *          }
+ *      }
+ *      BP_BENCHMARK_ARG( mapAdd, 16 );     // reported as "mapAdd/16"
+ *
+ *  Setup inside the function can be excluded from both time and
+ *  allocation counts with pauseTiming()/resumeTiming().
+ */
+
+#ifndef BPBENCH_BENCH_H_
+#define BPBENCH_BENCH_H_
+
+#include <string>
+
+
+namespace bpbench {
+
+
+class State
+{
+public:
+    State( unsigned long long nIters, long arg );
+
+    unsigned long long  iterations() const { return m_nIters; }
+
+    // The value given to BP_BENCHMARK_ARG, or -1.
+    long                arg() const { return m_arg; }
+
+    void                pauseTiming();
+    void                resumeTiming();
+
+    // Results, for the runner.
+    unsigned long long  elapsedNanos() const { return m_nNanos; }
+    unsigned long long  allocations() const { return m_nAllocs; }
+    unsigned long long  allocatedBytes() const { return m_nBytes; }
+
+    void                start();
+    void                stop();
+
+private:
+    unsigned long long  m_nIters;
+    long                m_arg;
+    bool                m_bRunning;
+    unsigned long long  m_nStart;
+    unsigned long long  m_nAllocsAtStart;
+    unsigned long long  m_nBytesAtStart;
+    unsigned long long  m_nNanos;
+    unsigned long long  m_nAllocs;
+    unsigned long long  m_nBytes;
+};
+
+
+typedef void (*BenchFunc)( State& state );
+
+// Adds a benchmark to the list run by main().  Use the macros.
+class Registrar
+{
+public:
+    Registrar( const char* cszName, BenchFunc pfn, long arg );
+};
+
+
+// Heap allocation counts for the calling thread, maintained by
+// bench_alloc.cpp.
+struct AllocCounts
+{
+    unsigned long long  allocs;
+    unsigned long long  bytes;
+};
+AllocCounts         allocCounts();
+
+// Keeps the compiler from discarding a result.
+void                doNotOptimize( const void* p );
+
+
+} // bpbench
+
+
+#define BP_BENCH_CAT2( a, b ) a##b
+#define BP_BENCH_CAT( a, b ) BP_BENCH_CAT2( a, b )
+
+#define BP_BENCHMARK( func ) \
+static bpbench::Registrar BP_BENCH_CAT( s_benchReg, __LINE__ )( \
+    #func, func, -1 )
+
+#define BP_BENCHMARK_ARG( func, arg ) \
+static bpbench::Registrar BP_BENCH_CAT( s_benchReg, __LINE__ )( \
+    #func, func, arg )
+
+
+#endif // BPBENCH_BENCH_H_
@@ -0,0 +1,174 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bench_alloc.cpp
+ *
+ *  Counts heap allocations made by the benchmarking thread.  With glibc
+ *  the malloc family is interposed, which also catches the framework's
+ *  own malloc/realloc calls (BPElement arrays) and everything operator
+ *  new does.  Elsewhere only operator new is counted.
+ */
+
+#include "bench.h"
+
+#include <stdlib.h>
+#include <new>
+
+
+namespace {
+
+// Only the thread running benchmarks counts; per-thread counters keep
+// library threads (e.g. a thread pool) out of the figures.
+#if defined(__GNUC__)
+__thread unsigned long long t_nAllocs = 0;
+__thread unsigned long long t_nBytes = 0;
+#elif defined(_MSC_VER)
+__declspec(thread) unsigned long long t_nAllocs = 0;
+__declspec(thread) unsigned long long t_nBytes = 0;
+#endif
+
+inline void
+count( size_t n )
+{
+    t_nAllocs++;
+    t_nBytes += n;
+}
+
+} // anonymous namespace
+
+
+bpbench::AllocCounts
+bpbench::allocCounts()
+{
+    AllocCounts c;
+    c.allocs = t_nAllocs;
+    c.bytes = t_nBytes;
+    return c;
+}
+
+
+#if defined(__GLIBC__)
+
+extern "C" {
+
+void* __libc_malloc( size_t );
+void* __libc_calloc( size_t, size_t );
+void* __libc_realloc( void*, size_t );
+void* __libc_memalign( size_t, size_t );
+void  __libc_free( void* );
+
+void*
+malloc( size_t n )
+{
+    count( n );
+    return __libc_malloc( n );
+}
+
+void*
+calloc( size_t n, size_t size )
+{
+    count( n * size );
+    return __libc_calloc( n, size );
+}
+
+// A realloc counts as an allocation: it usually moves.
+void*
+realloc( void* p, size_t n )
+{
+    count( n );
+    return __libc_realloc( p, n );
+}
+
+void*
+memalign( size_t align, size_t n )
+{
+    count( n );
+    return __libc_memalign( align, n );
+}
+
+void*
+aligned_alloc( size_t align, size_t n )
+{
+    count( n );
+    return __libc_memalign( align, n );
+}
+
+int
+posix_memalign( void** pp, size_t align, size_t n )
+{
+    count( n );
+    void* p = __libc_memalign( align, n );
+    if (!p) return 12;      // ENOMEM
+    *pp = p;
+    return 0;
+}
+
+void
+free( void* p )
+{
+    __libc_free( p );
+}
+
+} // extern "C"
+
+#else
+
+#if __cplusplus >= 201103L
+#define BPBENCH_THROWS_BAD_ALLOC
+#define BPBENCH_NOTHROW noexcept
+#else
+#define BPBENCH_THROWS_BAD_ALLOC throw( std::bad_alloc )
+#define BPBENCH_NOTHROW throw()
+#endif
+
+void*
+operator new( size_t n ) BPBENCH_THROWS_BAD_ALLOC
+{
+    count( n );
+    void* p = malloc( n ? n : 1 );
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void*
+operator new[]( size_t n ) BPBENCH_THROWS_BAD_ALLOC
+{
+    count( n );
+    void* p = malloc( n ? n : 1 );
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void
+operator delete( void* p ) BPBENCH_NOTHROW
+{
+    free( p );
+}
+
+void
+operator delete[]( void* p ) BPBENCH_NOTHROW
+{
+    free( p );
+}
+
+#endif
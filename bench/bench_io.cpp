@@ -0,0 +1,190 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bench_io.cpp
+ *
+ *  Reading a whole file: through an ifstream into a std::string, as
+ *  services have done, against scanning a MappedFile.  Each operation
+ *  opens the file, sums its bytes and closes it; the file is written
+ *  once, to the current directory, and is likely in the page cache.
+ *
+ *  Reading a file in 64KB chunks: one pread() after another, against
+ *  keeping them all in flight through an AsyncFile.  With the file in
+ *  the page cache both are bound by copying; queue depth pays off on
+ *  storage that has to be waited for.
+ */
+
+#include "bench.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "bputil/bpasyncfile.h"
+#include "bputil/bpmappedfile.h"
+
+
+namespace {
+
+
+std::map<long, std::string> s_files;
+
+void
+removeFiles()
+{
+    std::map<long, std::string>::const_iterator it;
+    for (it = s_files.begin(); it != s_files.end(); ++it) {
+        remove( it->second.c_str() );
+    }
+}
+
+
+// A file of nBytes, made on first use.
+const std::string&
+fileOfSize( long nBytes )
+{
+    std::string& sPath = s_files[nBytes];
+    if (sPath.empty()) {
+        if (s_files.size() == 1) atexit( removeFiles );
+        std::ostringstream ss;
+        ss << "bpbench-io-" << nBytes << ".tmp";
+        sPath = ss.str();
+        std::ofstream out( sPath.c_str(), std::ios::binary );
+        for (long i = 0; i < nBytes; i++) out.put( (char) (i * 31) );
+    }
+    return sPath;
+}
+
+
+unsigned long
+sum( const char* p, size_t n )
+{
+    unsigned long nSum = 0;
+    for (size_t i = 0; i < n; i++) nSum += (unsigned char) p[i];
+    return nSum;
+}
+
+
+void
+fileReadStream( bpbench::State& state )
+{
+    state.pauseTiming();
+    std::string sPath = fileOfSize( state.arg() );
+    state.resumeTiming();
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        std::ifstream in( sPath.c_str(), std::ios::binary );
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        std::string s = ss.str();
+        unsigned long nSum = sum( s.data(), s.size() );
+        bpbench::doNotOptimize( &nSum );
+    }
+}
+BP_BENCHMARK_ARG( fileReadStream, 64 * 1024 );
+BP_BENCHMARK_ARG( fileReadStream, 16 * 1024 * 1024 );
+
+
+void
+fileMapped( bpbench::State& state )
+{
+    state.pauseTiming();
+    std::string s = fileOfSize( state.arg() );
+    bplus::tPathString sPath( s.begin(), s.end() );
+    state.resumeTiming();
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bplus::io::MappedFile file;
+        file.open( sPath );
+        file.advise( bplus::io::MappedFile::Sequential );
+        unsigned long nSum = sum( file.data(), file.size() );
+        bpbench::doNotOptimize( &nSum );
+    }
+}
+BP_BENCHMARK_ARG( fileMapped, 64 * 1024 );
+BP_BENCHMARK_ARG( fileMapped, 16 * 1024 * 1024 );
+
+
+const size_t kChunk = 64 * 1024;
+
+
+void
+fileChunksPread( bpbench::State& state )
+{
+    state.pauseTiming();
+    std::string sPath = fileOfSize( state.arg() );
+    std::string sBuf( (size_t) state.arg(), '\0' );
+    state.resumeTiming();
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        int fd = open( sPath.c_str(), O_RDONLY );
+        for (size_t off = 0; off < sBuf.size(); off += kChunk) {
+            ssize_t n = pread( fd, &sBuf[off], kChunk, off );
+            bpbench::doNotOptimize( &n );
+        }
+        close( fd );
+    }
+}
+BP_BENCHMARK_ARG( fileChunksPread, 16 * 1024 * 1024 );
+
+
+void
+countChunk( const bplus::io::IoResult&, void* cookie )
+{
+    bplus::sync::atomicAdd( (volatile long*) cookie, -1 );
+}
+
+
+void
+fileChunksAsync( bpbench::State& state )
+{
+    state.pauseTiming();
+    std::string sPath = fileOfSize( state.arg() );
+    std::string sBuf( (size_t) state.arg(), '\0' );
+    bplus::io::AsyncFile::Options opts;
+    opts.queueDepth = 256;
+    bplus::io::AsyncFile file( opts );
+    char* pBuf = &sBuf[0];
+    size_t nBuf = sBuf.size();
+    file.registerBuffers( &pBuf, &nBuf, 1 );
+    state.resumeTiming();
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        int fd = open( sPath.c_str(), O_RDONLY );
+        volatile long nLeft = (long) ((nBuf + kChunk - 1) / kChunk);
+        for (size_t off = 0; off < nBuf; off += kChunk) {
+            file.read( fd, pBuf + off, kChunk, off, countChunk,
+                       (void*) &nLeft );
+        }
+        file.submit();
+        while (bplus::sync::atomicLoad( &nLeft ) > 0) {
+            bplus::sync::cpuRelax();
+        }
+        close( fd );
+    }
+}
+BP_BENCHMARK_ARG( fileChunksAsync, 16 * 1024 * 1024 );
+
+
+} // anonymous namespace
@@ -0,0 +1,212 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bench_service.cpp
+ *
+ *  The service plumbing: argument validation, generating a service
+ *  definition, and a call through BP_SERVICE dispatch from the C entry
+ *  point to the method and back.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+#include "bpservice/bpservice.h"
+#include "bpservice/bpservicedescription.h"
+
+
+namespace {
+
+
+class BenchService : public bplus::service::Service
+{
+public:
+    BP_SERVICE( BenchService )
+
+    void ping( const bplus::service::Transaction& tran, const bplus::Map& )
+    {
+        tran.complete( bplus::Null() );
+    }
+
+    void echo( const bplus::service::Transaction& tran,
+               const bplus::Map& args )
+    {
+        tran.complete( args );
+    }
+};
+
+
+void corePostResults( unsigned int, const BPElement* ) {}
+void corePostError( unsigned int, const char*, const char* ) {}
+void coreLog( unsigned int, const char*, ... ) {}
+void coreInvoke( unsigned int, BPCallBack, const BPElement* ) {}
+
+const BPCFunctionTable s_coreFuncs = {
+    corePostResults, corePostError, coreLog, coreInvoke, NULL, NULL
+};
+
+
+} // anonymous namespace
+
+
+BP_SERVICE_DESC( BenchService, "BenchService", "1.0.0", "Benchmarks." )
+ADD_BP_METHOD( BenchService, ping, "Completes at once." )
+ADD_BP_METHOD( BenchService, echo, "Returns its arguments." )
+ADD_BP_METHOD_ARG( echo, "text", String, true, "Some text." )
+ADD_BP_METHOD_ARG( echo, "count", Integer, false, "A number." )
+ADD_BP_METHOD_ARG( echo, "flags", List, false, "Some flags." )
+END_BP_SERVICE_DESC
+
+
+namespace {
+
+
+// Loaded, initialized and allocated once, as the daemon would.
+void*
+benchInstance()
+{
+    static void* s_pInstance = NULL;
+    if (!s_pInstance) {
+        const BPPFunctionTable* pEntry = BPPGetEntryPoints();
+        pEntry->initializeFunc( &s_coreFuncs, (BPPath) ".", (BPPath) ".",
+                                NULL );
+        pEntry->allocateFunc( &s_pInstance, (BPString) "http://localhost",
+                              (BPPath) ".", (BPPath) ".", (BPPath) ".",
+                              (BPString) "en_US", (BPString) "bpbench", 0 );
+    }
+    return s_pInstance;
+}
+
+
+bplus::Map*
+makeEchoArgs()
+{
+    bplus::Map* pArgs = new bplus::Map;
+    pArgs->add( "text", new bplus::String( "hello, world" ) );
+    pArgs->add( "count", new bplus::Integer( 42 ) );
+    bplus::List* pFlags = new bplus::List;
+    pFlags->append( new bplus::String( "verbose" ) );
+    pFlags->append( new bplus::String( "dry-run" ) );
+    pArgs->add( "flags", pFlags );
+    return pArgs;
+}
+
+
+void
+dispatchPing( bpbench::State& state )
+{
+    state.pauseTiming();
+    void* pInst = benchInstance();
+    BPPInvokePtr pfnInvoke = BPPGetEntryPoints()->invokeFunc;
+    bplus::Map args;
+    state.resumeTiming();
+
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        pfnInvoke( pInst, "ping", (unsigned int) i + 1, args.elemPtr() );
+    }
+}
+BP_BENCHMARK( dispatchPing );
+
+
+void
+dispatchEcho( bpbench::State& state )
+{
+    state.pauseTiming();
+    void* pInst = benchInstance();
+    BPPInvokePtr pfnInvoke = BPPGetEntryPoints()->invokeFunc;
+    bplus::Map* pArgs = makeEchoArgs();
+    state.resumeTiming();
+
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        pfnInvoke( pInst, "echo", (unsigned int) i + 1, pArgs->elemPtr() );
+    }
+
+    state.pauseTiming();
+    delete pArgs;
+}
+BP_BENCHMARK( dispatchEcho );
+
+
+void
+validateArguments( bpbench::State& state )
+{
+    bplus::service::Function func;
+    func.setName( "echo" );
+    bplus::service::Argument text( "text", bplus::service::Argument::String );
+    text.setRequired( true );
+    func.addArgument( text );
+    func.addArgument( bplus::service::Argument(
+                          "count", bplus::service::Argument::Integer ) );
+    func.addArgument( bplus::service::Argument(
+                          "flags", bplus::service::Argument::List ) );
+    bplus::Map* pArgs = makeEchoArgs();
+
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        std::string sErr = bplus::service::validateArguments( func, pArgs );
+        bpbench::doNotOptimize( sErr.data() );
+    }
+    delete pArgs;
+}
+BP_BENCHMARK( validateArguments );
+
+
+// A description of arg functions with three arguments each.
+void
+toBPServiceDefinition( bpbench::State& state )
+{
+    bplus::service::Description desc;
+    desc.setName( "BenchService" );
+    desc.setVersion( "1.2.3" );
+    desc.setDocString( "A service with a number of functions." );
+    for (long f = 0; f < state.arg(); f++) {
+        char szName[32];
+        snprintf( szName, sizeof(szName), "function%ld", f );
+        bplus::service::Function func;
+        func.setName( szName );
+        func.setDocString( "Does something useful with its arguments." );
+        static const bplus::service::Argument::Type s_types[] = {
+            bplus::service::Argument::String,
+            bplus::service::Argument::Integer,
+            bplus::service::Argument::CallBack
+        };
+        for (int a = 0; a < 3; a++) {
+            char szArg[32];
+            snprintf( szArg, sizeof(szArg), "arg%d", a );
+            bplus::service::Argument arg( szArg, s_types[a] );
+            arg.setDocString( "An argument." );
+            func.addArgument( arg );
+        }
+        desc.addFunction( func );
+    }
+
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bpbench::doNotOptimize( desc.toBPServiceDefinition() );
+    }
+}
+BP_BENCHMARK_ARG( toBPServiceDefinition, 4 );
+BP_BENCHMARK_ARG( toBPServiceDefinition, 32 );
+
+
+} // anonymous namespace
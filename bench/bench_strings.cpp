@@ -0,0 +1,130 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bench_strings.cpp
+ *
+ *  String handling: JSON quoting, URL parsing and version comparison.
+ */
+
+#include "bench.h"
+
+#include <string>
+
+#include "bputil/bpsemanticversion.h"
+#include "bputil/bpstrutil.h"
+#include "bputil/bpurl.h"
+
+
+namespace {
+
+
+void
+quoteJsonAscii( bpbench::State& state )
+{
+    std::string sIn( state.arg(), 'x' );
+    std::string sOut;
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        sOut.clear();
+        bplus::strutil::quoteJsonString( sIn, sOut );
+        bpbench::doNotOptimize( sOut.data() );
+    }
+}
+BP_BENCHMARK_ARG( quoteJsonAscii, 16 );
+BP_BENCHMARK_ARG( quoteJsonAscii, 1024 );
+
+
+// Three characters in eight need escaping.
+void
+quoteJsonEscapes( bpbench::State& state )
+{
+    std::string sIn;
+    const char* cszChunk = "ab\"de\\g\n";
+    while (sIn.size() < (size_t) state.arg()) sIn += cszChunk;
+    std::string sOut;
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        sOut.clear();
+        bplus::strutil::quoteJsonString( sIn, sOut );
+        bpbench::doNotOptimize( sOut.data() );
+    }
+}
+BP_BENCHMARK_ARG( quoteJsonEscapes, 1024 );
+
+
+const char* const s_cszUrl =
+    "https://user@photos.example.com:8443/albums/2010/summer/index.html"
+    "?sort=date&page=3#top";
+
+void
+urlParse( bpbench::State& state )
+{
+    std::string sUrl( s_cszUrl );
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bplus::url::Url url;
+        bpbench::doNotOptimize( (void*) (size_t) url.parse( sUrl ) );
+    }
+}
+BP_BENCHMARK( urlParse );
+
+
+void
+urlViewParse( bpbench::State& state )
+{
+    bplus::StringView sUrl( s_cszUrl );
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bplus::url::UrlView url;
+        bpbench::doNotOptimize( (void*) (size_t) url.parse( sUrl ) );
+    }
+}
+BP_BENCHMARK( urlViewParse );
+
+
+void
+semanticVersionCompare( bpbench::State& state )
+{
+    bplus::SemanticVersion a, b, c;
+    a.parse( "2.10.3" );
+    b.parse( "2.10.17" );
+    c.parse( "3.0.0" );
+    int nSum = 0;
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        // make the versions opaque, so the compares aren't hoisted
+        bpbench::doNotOptimize( &a );
+        nSum += a.compare( b ) + b.compare( c ) + c.compare( a );
+    }
+    bpbench::doNotOptimize( (void*) (size_t) nSum );
+}
+BP_BENCHMARK( semanticVersionCompare );
+
+
+void
+semanticVersionParse( bpbench::State& state )
+{
+    bplus::SemanticVersion v;
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bpbench::doNotOptimize( (void*) (size_t) v.parse( "2.10.17" ) );
+    }
+}
+BP_BENCHMARK( semanticVersionParse );
+
+
+} // anonymous namespace
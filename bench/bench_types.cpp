@@ -0,0 +1,221 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bench_types.cpp
+ *
+ *  bplus::Object hierarchies: building from BPElements, Map and List
+ *  operations and path lookups.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "bputil/bpstrutil.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace {
+
+
+bplus::tPathString
+toPath( const std::string& s )
+{
+#ifdef WIN32
+    return bplus::strutil::utf8ToWide( s );
+#else
+    return s;
+#endif
+}
+
+
+// A directory listing, the shape of argument trees services commonly
+// receive: a list of n maps of mixed scalars, each with a small list.
+bplus::Map*
+makeListing( long n )
+{
+    bplus::Map* pRoot = new bplus::Map;
+    bplus::List* pFiles = new bplus::List;
+    for (long i = 0; i < n; i++) {
+        char szName[64];
+        snprintf( szName, sizeof(szName), "IMG_%04ld.jpg", i );
+        bplus::Map* pFile = new bplus::Map;
+        pFile->add( "name", new bplus::String( szName ) );
+        pFile->add( "path", new bplus::Path(
+                                toPath( std::string( "/photos/" ) + szName ) ) );
+        pFile->add( "size", new bplus::Integer( 1000 + i * 37 ) );
+        pFile->add( "mtime", new bplus::Double( 1.27e9 + i ) );
+        pFile->add( "hidden", new bplus::Bool( false ) );
+        bplus::List* pTags = new bplus::List;
+        pTags->append( new bplus::String( "holiday" ) );
+        pTags->append( new bplus::String( "beach" ) );
+        pFile->add( "tags", pTags );
+        pFiles->append( pFile );
+    }
+    pRoot->add( "files", pFiles );
+    pRoot->add( "recursive", new bplus::Bool( true ) );
+    pRoot->add( "callback", new bplus::CallBack( 7 ) );
+    return pRoot;
+}
+
+
+std::vector<std::string>
+makeKeys( long n )
+{
+    std::vector<std::string> vKeys;
+    for (long i = 0; i < n; i++) {
+        char buf[32];
+        snprintf( buf, sizeof(buf), "key%ld", i );
+        vKeys.push_back( buf );
+    }
+    return vKeys;
+}
+
+
+void
+objectBuild( bpbench::State& state )
+{
+    state.pauseTiming();
+    bplus::Map* pSrc = makeListing( state.arg() );
+    state.resumeTiming();
+
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bplus::Object* pObj = bplus::Object::build( pSrc->elemPtr() );
+        bpbench::doNotOptimize( pObj );
+        delete pObj;
+    }
+
+    state.pauseTiming();
+    delete pSrc;
+}
+BP_BENCHMARK_ARG( objectBuild, 1 );
+BP_BENCHMARK_ARG( objectBuild, 10 );
+BP_BENCHMARK_ARG( objectBuild, 100 );
+
+
+void
+mapAdd( bpbench::State& state )
+{
+    std::vector<std::string> vKeys = makeKeys( state.arg() );
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bplus::Map m;
+        for (size_t k = 0; k < vKeys.size(); k++) {
+            m.add( vKeys[k].c_str(), new bplus::Integer( (long long) k ) );
+        }
+        bpbench::doNotOptimize( &m );
+    }
+}
+BP_BENCHMARK_ARG( mapAdd, 4 );
+BP_BENCHMARK_ARG( mapAdd, 16 );
+BP_BENCHMARK_ARG( mapAdd, 64 );
+
+
+// One lookup per iteration, cycling through every key.
+void
+mapValue( bpbench::State& state )
+{
+    std::vector<std::string> vKeys = makeKeys( state.arg() );
+    bplus::Map m;
+    for (size_t k = 0; k < vKeys.size(); k++) {
+        m.add( vKeys[k].c_str(), new bplus::Integer( (long long) k ) );
+    }
+    size_t k = 0;
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bpbench::doNotOptimize( m.value( vKeys[k].c_str() ) );
+        if (++k == vKeys.size()) k = 0;
+    }
+}
+BP_BENCHMARK_ARG( mapValue, 4 );
+BP_BENCHMARK_ARG( mapValue, 16 );
+BP_BENCHMARK_ARG( mapValue, 64 );
+
+
+// Empty a map of arg entries, front to back; refilling is not timed.
+void
+mapKill( bpbench::State& state )
+{
+    std::vector<std::string> vKeys = makeKeys( state.arg() );
+    bplus::Map m;
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        state.pauseTiming();
+        for (size_t k = 0; k < vKeys.size(); k++) {
+            m.add( vKeys[k].c_str(), new bplus::Integer( (long long) k ) );
+        }
+        state.resumeTiming();
+        for (size_t k = 0; k < vKeys.size(); k++) {
+            m.kill( vKeys[k].c_str() );
+        }
+    }
+}
+BP_BENCHMARK_ARG( mapKill, 4 );
+BP_BENCHMARK_ARG( mapKill, 16 );
+BP_BENCHMARK_ARG( mapKill, 64 );
+
+
+void
+listAppend( bpbench::State& state )
+{
+    long n = state.arg();
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bplus::List l;
+        for (long k = 0; k < n; k++) {
+            l.append( new bplus::Integer( k ) );
+        }
+        bpbench::doNotOptimize( &l );
+    }
+}
+BP_BENCHMARK_ARG( listAppend, 4 );
+BP_BENCHMARK_ARG( listAppend, 64 );
+BP_BENCHMARK_ARG( listAppend, 1024 );
+
+
+// A four level path through maps of eight keys each.
+void
+objectGet( bpbench::State& state )
+{
+    bplus::Map* pRoot = new bplus::Map;
+    bplus::Map* pMap = pRoot;
+    for (int depth = 0; depth < 4; depth++) {
+        for (int k = 0; k < 7; k++) {
+            char buf[32];
+            snprintf( buf, sizeof(buf), "sibling%d", k );
+            pMap->add( buf, new bplus::Integer( k ) );
+        }
+        bplus::Map* pChild = new bplus::Map;
+        pMap->add( depth < 3 ? "settings" : "leaf", pChild );
+        pMap = pChild;
+    }
+    pMap->add( "value", new bplus::String( "found" ) );
+
+    for (unsigned long long i = 0; i < state.iterations(); i++) {
+        bpbench::doNotOptimize(
+            pRoot->get( "settings/settings/settings/leaf/value" ) );
+    }
+    delete pRoot;
+}
+BP_BENCHMARK( objectGet );
+
+
+} // anonymous namespace
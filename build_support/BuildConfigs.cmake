@@ -0,0 +1,45 @@
+# BuildConfigs.cmake -- default compiler and linker settings for services
+# built on this framework, and for the framework's own tools and
+# benchmarks.  From a service's CMakeLists.txt:
+#
+#   include(path/to/bp-service-framework/build_support/BuildConfigs.cmake)
+#   add_library(MyService MODULE ...)
+#   target_link_libraries(MyService ${BP_THREAD_LIBS})
+#
+# This adds the framework's include directory, defines the platform
+# macro the headers test for (WIN32, MACOSX or LINUX), and defaults to
+# a Release build.  BP_SERVICE_FRAMEWORK_DIR is set to the framework
+# root.
+
+if (BP_BUILD_CONFIGS_INCLUDED)
+  return()
+endif ()
+set(BP_BUILD_CONFIGS_INCLUDED TRUE)
+
+get_filename_component(BP_SERVICE_FRAMEWORK_DIR
+                       "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+include_directories("${BP_SERVICE_FRAMEWORK_DIR}/include")
+
+if (NOT CMAKE_BUILD_TYPE AND NOT CMAKE_CONFIGURATION_TYPES)
+  set(CMAKE_BUILD_TYPE Release CACHE STRING
+      "Debug, Release, RelWithDebInfo or MinSizeRel" FORCE)
+endif ()
+
+if (WIN32)
+  add_definitions(-DWIN32 -DWINDOWS -D_WINDOWS -DUNICODE -D_UNICODE
+                  -D_CRT_SECURE_NO_WARNINGS -DNOMINMAX)
+  set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} /EHsc /W3")
+else ()
+  if (APPLE)
+    add_definitions(-DMACOSX)
+  else ()
+    add_definitions(-DLINUX)
+  endif ()
+  # The headers still use std::auto_ptr and friends, which newer
+  # standard libraries flag as deprecated.
+  set(CMAKE_CXX_FLAGS
+      "${CMAKE_CXX_FLAGS} -Wall -fPIC -Wno-deprecated-declarations")
+endif ()
+
+find_package(Threads REQUIRED)
+set(BP_THREAD_LIBS ${CMAKE_THREAD_LIBS_INIT})
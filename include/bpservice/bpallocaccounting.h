@@ -0,0 +1,312 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpallocaccounting.h
+ *
+ *  Heap allocation accounting for a service's calls.
+ *
+ *  Each call is split into stages -- validating it, building its
+ *  arguments, the method body, and releasing the arguments -- and the
+ *  allocations in each are counted with bplus::memory::AllocScope.
+ *  Counts are totalled per method, and each instance's live bytes are
+ *  followed from call to call: what it still holds once a call returns
+ *  (its steady state) and the most it held during one.  Destroyed
+ *  instances are folded into a summary, with whatever their destructors
+ *  left unfreed counted as leaked.  Work a method hands to other
+ *  threads is not counted.
+ *
+ *  See Service::enableAllocAccounting().
+ */
+
+#ifndef BPALLOCACCOUNTING_H_
+#define BPALLOCACCOUNTING_H_
+
+#include <map>
+#include <string>
+
+#include "bputil/bpalloccount.h"
+#include "bputil/bpsync.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace service {
+
+
+class AllocAccounting
+{
+public:
+    enum Stage {
+        StageValidate,
+        StageArgs,
+        StageBody,          // the method, and the transaction
+        StageRelease,
+        NumStages
+    };
+
+    // One call's counts, filled in by an AllocScope over each stage.
+    struct Invocation
+    {
+        bplus::memory::AllocCounts  stages[NumStages];
+    };
+
+    struct MethodStats
+    {
+        MethodStats() : calls( 0 ), peakBytes( 0 ) {}
+
+        unsigned long long          calls;
+        bplus::memory::AllocCounts  stages[NumStages];  // summed
+        long long                   peakBytes;  // most live in one call
+    };
+
+    struct InstanceStats
+    {
+        InstanceStats() : calls( 0 ), liveBytes( 0 ), peakLiveBytes( 0 ) {}
+
+        unsigned long long          calls;
+        long long                   liveBytes;      // after the last call
+        long long                   peakLiveBytes;
+    };
+
+    // Instances already destroyed.
+    struct DestroyedStats
+    {
+        DestroyedStats() : instances( 0 ), calls( 0 ), peakLiveBytes( 0 ),
+                           leakedBytes( 0 ) {}
+
+        unsigned long long          instances;
+        unsigned long long          calls;
+        long long                   peakLiveBytes;  // the most of any
+        long long                   leakedBytes;    // summed
+    };
+
+    // Counts for stage of *pInv, or NULL (an inactive scope) if pInv is.
+    static bplus::memory::AllocCounts* stageCounts( Invocation* pInv,
+                                                    Stage stage );
+
+    static const char*  stageName( Stage stage );
+
+    // Allocations made creating an instance count towards its live bytes.
+    void            addConstruct( unsigned int instanceId,
+                                  const bplus::memory::AllocCounts& counts );
+    void            addInvocation( unsigned int instanceId,
+                                   const char* cszMethod,
+                                   const Invocation& inv );
+    // destroy counts what the instance's destruction allocated and
+    // freed.
+    void            removeInstance( unsigned int instanceId,
+                                    const bplus::memory::AllocCounts& destroy );
+
+    std::map<std::string, MethodStats>      methodStats() const;
+    std::map<unsigned int, InstanceStats>   instanceStats() const;
+    DestroyedStats  destroyedStats() const;
+
+    // Stats as a map of "methods" (by name, with a map per stage),
+    // "instances" (a list) and "destroyed", e.g. for returning from a
+    // method.
+    // Caller owns returned pointer.
+    bplus::Object*  statsToBPObject() const;
+
+private:
+    mutable bplus::sync::Mutex              m_lock;
+    std::map<std::string, MethodStats>      m_methods;
+    std::map<unsigned int, InstanceStats>   m_instances;
+    DestroyedStats                          m_destroyed;
+};
+
+
+inline bplus::memory::AllocCounts*
+AllocAccounting::stageCounts( Invocation* pInv, Stage stage )
+{
+    return pInv ? &pInv->stages[stage] : NULL;
+}
+
+
+inline const char*
+AllocAccounting::stageName( Stage stage )
+{
+    static const char* s_names[NumStages] = {
+        "validate", "args", "body", "release"
+    };
+    return s_names[stage];
+}
+
+
+inline void
+AllocAccounting::addConstruct( unsigned int instanceId,
+                               const bplus::memory::AllocCounts& counts )
+{
+    bplus::sync::Lock lock( m_lock );
+    InstanceStats& inst = m_instances[instanceId];
+    if (inst.liveBytes + counts.peakBytes > inst.peakLiveBytes) {
+        inst.peakLiveBytes = inst.liveBytes + counts.peakBytes;
+    }
+    inst.liveBytes += counts.liveBytes();
+}
+
+
+inline void
+AllocAccounting::addInvocation( unsigned int instanceId,
+                                const char* cszMethod,
+                                const Invocation& inv )
+{
+    // The stages run in turn, so the call's peak is the highest any
+    // stage reached on top of what the ones before it left live.
+    long long nLive = 0;
+    long long nPeak = 0;
+    for (int i = 0; i < NumStages; i++) {
+        if (nLive + inv.stages[i].peakBytes > nPeak) {
+            nPeak = nLive + inv.stages[i].peakBytes;
+        }
+        nLive += inv.stages[i].liveBytes();
+    }
+
+    bplus::sync::Lock lock( m_lock );
+    MethodStats& method = m_methods[cszMethod];
+    method.calls++;
+    for (int i = 0; i < NumStages; i++) {
+        bplus::memory::AllocCounts& sum = method.stages[i];
+        const bplus::memory::AllocCounts& c = inv.stages[i];
+        sum.allocs += c.allocs;
+        sum.frees += c.frees;
+        sum.bytesAllocated += c.bytesAllocated;
+        sum.bytesFreed += c.bytesFreed;
+        if (c.peakBytes > sum.peakBytes) sum.peakBytes = c.peakBytes;
+    }
+    if (nPeak > method.peakBytes) method.peakBytes = nPeak;
+
+    InstanceStats& inst = m_instances[instanceId];
+    inst.calls++;
+    if (inst.liveBytes + nPeak > inst.peakLiveBytes) {
+        inst.peakLiveBytes = inst.liveBytes + nPeak;
+    }
+    inst.liveBytes += nLive;
+}
+
+
+inline void
+AllocAccounting::removeInstance( unsigned int instanceId,
+                                 const bplus::memory::AllocCounts& destroy )
+{
+    bplus::sync::Lock lock( m_lock );
+    std::map<unsigned int, InstanceStats>::iterator it =
+        m_instances.find( instanceId );
+    if (it == m_instances.end()) return;
+    const InstanceStats& inst = it->second;
+    m_destroyed.instances++;
+    m_destroyed.calls += inst.calls;
+    if (inst.peakLiveBytes > m_destroyed.peakLiveBytes) {
+        m_destroyed.peakLiveBytes = inst.peakLiveBytes;
+    }
+    long long nLeaked = inst.liveBytes + destroy.liveBytes();
+    if (nLeaked > 0) m_destroyed.leakedBytes += nLeaked;
+    m_instances.erase( it );
+}
+
+
+inline std::map<std::string, AllocAccounting::MethodStats>
+AllocAccounting::methodStats() const
+{
+    bplus::sync::Lock lock( m_lock );
+    return m_methods;
+}
+
+
+inline std::map<unsigned int, AllocAccounting::InstanceStats>
+AllocAccounting::instanceStats() const
+{
+    bplus::sync::Lock lock( m_lock );
+    return m_instances;
+}
+
+
+inline AllocAccounting::DestroyedStats
+AllocAccounting::destroyedStats() const
+{
+    bplus::sync::Lock lock( m_lock );
+    return m_destroyed;
+}
+
+
+inline bplus::Object*
+AllocAccounting::statsToBPObject() const
+{
+    std::map<std::string, MethodStats> methods = methodStats();
+    std::map<unsigned int, InstanceStats> instances = instanceStats();
+    DestroyedStats destroyed = destroyedStats();
+
+    bplus::Map* pMethods = new bplus::Map;
+    std::map<std::string, MethodStats>::const_iterator itM;
+    for (itM = methods.begin(); itM != methods.end(); ++itM) {
+        const MethodStats& ms = itM->second;
+        bplus::Map* pMethod = new bplus::Map;
+        pMethod->add( "calls", new bplus::Integer( ms.calls ) );
+        pMethod->add( "peakBytes", new bplus::Integer( ms.peakBytes ) );
+        bplus::Map* pStages = new bplus::Map;
+        for (int i = 0; i < NumStages; i++) {
+            const bplus::memory::AllocCounts& c = ms.stages[i];
+            bplus::Map* pStage = new bplus::Map;
+            pStage->add( "allocs", new bplus::Integer( c.allocs ) );
+            pStage->add( "frees", new bplus::Integer( c.frees ) );
+            pStage->add( "bytes", new bplus::Integer( c.bytesAllocated ) );
+            pStage->add( "bytesFreed", new bplus::Integer( c.bytesFreed ) );
+            pStages->add( stageName( (Stage) i ), pStage );
+        }
+        pMethod->add( "stages", pStages );
+        pMethods->add( itM->first, pMethod );
+    }
+
+    bplus::List* pInstances = new bplus::List;
+    std::map<unsigned int, InstanceStats>::const_iterator itI;
+    for (itI = instances.begin(); itI != instances.end(); ++itI) {
+        const InstanceStats& is = itI->second;
+        bplus::Map* pInst = new bplus::Map;
+        pInst->add( "id", new bplus::Integer( itI->first ) );
+        pInst->add( "calls", new bplus::Integer( is.calls ) );
+        pInst->add( "liveBytes", new bplus::Integer( is.liveBytes ) );
+        pInst->add( "peakLiveBytes",
+                    new bplus::Integer( is.peakLiveBytes ) );
+        pInstances->append( pInst );
+    }
+
+    bplus::Map* pDestroyed = new bplus::Map;
+    pDestroyed->add( "instances", new bplus::Integer( destroyed.instances ) );
+    pDestroyed->add( "calls", new bplus::Integer( destroyed.calls ) );
+    pDestroyed->add( "peakLiveBytes",
+                     new bplus::Integer( destroyed.peakLiveBytes ) );
+    pDestroyed->add( "leakedBytes",
+                     new bplus::Integer( destroyed.leakedBytes ) );
+
+    bplus::Map* pMap = new bplus::Map;
+    pMap->add( "methods", pMethods );
+    pMap->add( "instances", pInstances );
+    pMap->add( "destroyed", pDestroyed );
+    return pMap;
+}
+
+
+} // service
+} // bplus
+
+
+#endif // BPALLOCACCOUNTING_H_
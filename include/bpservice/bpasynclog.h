@@ -0,0 +1,475 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpasynclog.h
+ *
+ *  An asynchronous front-end for the core's log function.
+ *
+ *  Each logging thread writes its records -- a format string pointer,
+ *  the captured arguments and copies of any strings -- into a ring
+ *  buffer of its own, with no locks and no formatting.  A background
+ *  thread collects the records from every ring, formats them and
+ *  forwards them to the log function in batches.  When a ring is full,
+ *  records are dropped and counted rather than blocking the caller.
+ */
+
+#ifndef BPASYNCLOG_H_
+#define BPASYNCLOG_H_
+
+#include <string.h>
+#include <string>
+
+#include "bpserviceapi/bpcfunctions.h"
+#include "bputil/bpatomic.h"
+#include "bputil/bplogformat.h"
+#include "bputil/bpsync.h"
+#include "bputil/bpthread.h"
+#include "bputil/bpthreadpool.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace service {
+
+
+class AsyncLog
+{
+public:
+    struct Stats
+    {
+        unsigned long long written;     // records queued
+        unsigned long long delivered;   // records sent to the log function
+        unsigned long long dropped;     // records lost to full rings
+        unsigned long long batches;     // non-empty collection passes
+        unsigned long long rings;       // threads that have logged
+    };
+
+    // pfnLog receives each record as pfnLog( level, "%s", text ).
+    // Each logging thread gets a ring of about nRingBytes.
+    explicit AsyncLog( BPCLogFuncPtr pfnLog, size_t nRingBytes = 64 * 1024 );
+
+    // Stops the background thread and delivers whatever is queued.  No
+    // thread may be writing when the log is destroyed.
+    ~AsyncLog();
+
+    // Start the background thread.
+    bool            start();
+
+    // Stop the background thread, after it delivers what is queued.
+    void            stop();
+
+    // Deliver everything queued so far from the calling thread.
+    void            flush();
+
+    // Queue a record.  fmt is kept by pointer, so it must outlive the
+    // log (a string literal, typically).  String arguments are copied.
+    void            write( unsigned int level, const char* fmt,
+                           const bplus::logging::Arg* args,
+                           unsigned int nArgs );
+
+    Stats           stats() const;
+
+    // Stats as a map of integers, e.g. for returning from a method.
+    // Caller owns returned pointer.
+    bplus::Object*  statsToBPObject() const;
+
+private:
+    // A single-producer, single-consumer byte ring.  Positions count
+    // bytes ever written / read, so their difference is the fill.
+    struct Ring
+    {
+        Ring*           pNext;
+        unsigned int    tid;
+        char*           pBuf;
+        unsigned long   nSize;          // a power of two
+        volatile long   nWritePos;      // advanced by the owning thread
+        volatile long   nReadPos;       // advanced by the collector
+        bplus::sync::AtomicCounter nDropped;
+    };
+
+    // Records are 8 byte aligned: a header, nArgs slots, then the
+    // strings, each NUL terminated.
+    struct RecordHeader
+    {
+        unsigned int    size;           // whole record, padded
+        unsigned int    level;          // s_padLevel for filler
+        const char*     fmt;
+        unsigned int    nArgs;
+        unsigned int    reserved;
+    };
+
+    struct ArgSlot
+    {
+        unsigned int    type;
+        unsigned int    len;
+        union {
+            long long           i;
+            unsigned long long  u;
+            double              d;
+            const void*         p;
+        } val;
+    };
+
+    enum { s_maxArgs = 16, s_maxStringBytes = 4096 };
+    static const unsigned int s_padLevel = 0xffffffff;
+
+    Ring*           ringForCurrentThread();
+    unsigned int    collect();
+    unsigned int    collectRing( Ring* pRing );
+    bool            anyPending();
+    static void*    collectorMain( void* cookie );
+
+    BPCLogFuncPtr   m_pfnLog;
+    unsigned long   m_nRingBytes;
+    long            m_nSerial;          // tells logs apart in TLS
+    bplus::sync::AtomicPtr<Ring> m_pRings;
+    bplus::sync::Mutex m_collectLock;   // one collector at a time
+    bplus::sync::Event m_wakeup;
+    bplus::sync::AtomicFlag m_bSleeping;
+    bplus::sync::AtomicFlag m_bStopping;
+    bplus::thread::Thread m_thread;
+    bool            m_bRunning;
+
+    bplus::sync::AtomicCounter m_nWritten;
+    bplus::sync::AtomicCounter m_nDelivered;
+    bplus::sync::AtomicCounter m_nDropped;
+    bplus::sync::AtomicCounter m_nBatches;
+    bplus::sync::AtomicCounter m_nRings;
+
+    AsyncLog( const AsyncLog& );
+    AsyncLog& operator=( const AsyncLog& );
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+
+inline
+AsyncLog::AsyncLog( BPCLogFuncPtr pfnLog, size_t nRingBytes ) :
+    m_pfnLog( pfnLog ),
+    m_nRingBytes( 1024 ),
+    m_nSerial( 0 ),
+    m_pRings( NULL ),
+    m_collectLock(),
+    m_wakeup( true, false ),
+    m_bSleeping( false ),
+    m_bStopping( false ),
+    m_thread(),
+    m_bRunning( false )
+{
+    while (m_nRingBytes < nRingBytes) m_nRingBytes <<= 1;
+
+    static volatile long s_nSerial = 0;
+    m_nSerial = bplus::sync::atomicAdd( &s_nSerial, 1 );
+}
+
+
+inline
+AsyncLog::~AsyncLog()
+{
+    stop();
+    flush();
+    Ring* pRing = m_pRings.load();
+    while (pRing) {
+        Ring* pNext = pRing->pNext;
+        delete [] pRing->pBuf;
+        delete pRing;
+        pRing = pNext;
+    }
+}
+
+
+inline bool
+AsyncLog::start()
+{
+    if (m_bRunning) return true;
+    m_bStopping.clear();
+    bplus::thread::ThreadOptions opts;
+    opts.name = "bp-log";
+    m_bRunning = m_thread.run( collectorMain, this, opts );
+    return m_bRunning;
+}
+
+
+inline void
+AsyncLog::stop()
+{
+    if (!m_bRunning) return;
+    m_bStopping.testAndSet();
+    m_wakeup.set();
+    m_thread.join();
+    m_bRunning = false;
+}
+
+
+inline void
+AsyncLog::flush()
+{
+    (void) collect();
+}
+
+
+inline AsyncLog::Ring*
+AsyncLog::ringForCurrentThread()
+{
+    static BP_THREAD_LOCAL long s_nSerial = 0;
+    static BP_THREAD_LOCAL Ring* s_pRing = NULL;
+    if (s_nSerial == m_nSerial) return s_pRing;
+
+    // A ring left by an exited thread with the same id is free to reuse.
+    unsigned int tid = bplus::thread::Thread::currentThreadID();
+    Ring* pRing = m_pRings.load( bplus::sync::MemoryOrderAcquire );
+    while (pRing && pRing->tid != tid) pRing = pRing->pNext;
+
+    if (!pRing) {
+        pRing = new Ring;
+        pRing->tid = tid;
+        pRing->pBuf = new char[m_nRingBytes];
+        pRing->nSize = m_nRingBytes;
+        pRing->nWritePos = 0;
+        pRing->nReadPos = 0;
+        Ring* pHead;
+        do {
+            pHead = m_pRings.load( bplus::sync::MemoryOrderRelaxed );
+            pRing->pNext = pHead;
+        } while (!m_pRings.compareExchange( pHead, pRing ));
+        m_nRings.increment( bplus::sync::MemoryOrderRelaxed );
+    }
+
+    s_nSerial = m_nSerial;
+    s_pRing = pRing;
+    return pRing;
+}
+
+
+inline void
+AsyncLog::write( unsigned int level, const char* fmt,
+                 const bplus::logging::Arg* args, unsigned int nArgs )
+{
+    using namespace bplus::sync;
+    Ring* pRing = ringForCurrentThread();
+    if (nArgs > (unsigned) s_maxArgs) nArgs = s_maxArgs;
+
+    unsigned long nNeed = sizeof(RecordHeader) + nArgs * sizeof(ArgSlot);
+    for (unsigned int i = 0; i < nArgs; i++) {
+        if (args[i].type == bplus::logging::Arg::TypeString) {
+            unsigned int len = args[i].len < (unsigned) s_maxStringBytes
+                               ? args[i].len : (unsigned) s_maxStringBytes;
+            nNeed += len + 1;
+        }
+    }
+    nNeed = (nNeed + 7) & ~7UL;
+
+    unsigned long w = (unsigned long) atomicLoad( &pRing->nWritePos,
+                                                  MemoryOrderRelaxed );
+    unsigned long r = (unsigned long) atomicLoad( &pRing->nReadPos,
+                                                  MemoryOrderAcquire );
+    unsigned long off = w & (pRing->nSize - 1);
+    unsigned long nToEnd = pRing->nSize - off;
+    unsigned long nTotal = nNeed <= nToEnd ? nNeed : nToEnd + nNeed;
+    if (nNeed > pRing->nSize / 2 || pRing->nSize - (w - r) < nTotal) {
+        pRing->nDropped.increment( MemoryOrderRelaxed );
+        return;
+    }
+
+    if (nNeed > nToEnd) {
+        // doesn't fit before the end: pad to it and start over at 0
+        RecordHeader* pPad = (RecordHeader*) (pRing->pBuf + off);
+        pPad->size = (unsigned int) nToEnd;
+        pPad->level = s_padLevel;
+        off = 0;
+    }
+
+    RecordHeader* pHdr = (RecordHeader*) (pRing->pBuf + off);
+    pHdr->size = (unsigned int) nNeed;
+    pHdr->level = level;
+    pHdr->fmt = fmt;
+    pHdr->nArgs = nArgs;
+    pHdr->reserved = 0;
+    ArgSlot* pSlots = (ArgSlot*) (pHdr + 1);
+    char* pStr = (char*) (pSlots + nArgs);
+    for (unsigned int i = 0; i < nArgs; i++) {
+        pSlots[i].type = args[i].type;
+        pSlots[i].len = args[i].len;
+        if (args[i].type == bplus::logging::Arg::TypeString) {
+            unsigned int len = args[i].len < (unsigned) s_maxStringBytes
+                               ? args[i].len : (unsigned) s_maxStringBytes;
+            memcpy( pStr, args[i].val.s, len );
+            pStr[len] = 0;
+            pSlots[i].len = len;
+            pStr += len + 1;
+        } else {
+            pSlots[i].val.u = args[i].val.u;
+        }
+    }
+
+    // Publish, then wake the collector if it's asleep.  Both are
+    // sequentially consistent so that either we see it sleeping or it
+    // sees our record when it checks before sleeping.
+    atomicStore( &pRing->nWritePos, (long) (w + nTotal ), MemoryOrderSeqCst );
+    m_nWritten.increment( MemoryOrderRelaxed );
+    if (m_bSleeping.isSet( MemoryOrderSeqCst )) {
+        m_wakeup.set();
+    }
+}
+
+
+inline unsigned int
+AsyncLog::collectRing( Ring* pRing )
+{
+    using namespace bplus::sync;
+    using bplus::logging::Arg;
+
+    unsigned long r = (unsigned long) atomicLoad( &pRing->nReadPos,
+                                                  MemoryOrderRelaxed );
+    unsigned long w = (unsigned long) atomicLoad( &pRing->nWritePos,
+                                                  MemoryOrderAcquire );
+    unsigned int nDelivered = 0;
+    std::string sText;
+    Arg args[s_maxArgs] = { 0, 0, 0, 0, 0, 0, 0, 0,
+                            0, 0, 0, 0, 0, 0, 0, 0 };
+    while (r != w) {
+        const RecordHeader* pHdr = (const RecordHeader*)
+            (pRing->pBuf + (r & (pRing->nSize - 1)));
+        if (pHdr->level != s_padLevel) {
+            const ArgSlot* pSlots = (const ArgSlot*) (pHdr + 1);
+            const char* pStr = (const char*) (pSlots + pHdr->nArgs);
+            unsigned int n = pHdr->nArgs;
+            for (unsigned int i = 0; i < n; i++) {
+                args[i].type = (Arg::Type) pSlots[i].type;
+                args[i].len = pSlots[i].len;
+                if (args[i].type == Arg::TypeString) {
+                    args[i].val.s = pStr;
+                    pStr += pSlots[i].len + 1;
+                } else {
+                    args[i].val.u = pSlots[i].val.u;
+                }
+            }
+            sText.clear();
+            bplus::logging::format( sText, pHdr->fmt, args, n );
+            if (m_pfnLog) {
+                m_pfnLog( pHdr->level, "%s", sText.c_str() );
+            }
+            nDelivered++;
+        }
+        r += pHdr->size;
+    }
+    atomicStore( &pRing->nReadPos, (long) r, MemoryOrderRelease );
+
+    long nDropped = pRing->nDropped.exchange( 0, MemoryOrderRelaxed );
+    if (nDropped > 0) {
+        m_nDropped.add( nDropped, MemoryOrderRelaxed );
+        if (m_pfnLog) {
+            m_pfnLog( BP_WARN, "%ld log messages dropped by thread %u",
+                      nDropped, pRing->tid );
+        }
+    }
+    return nDelivered;
+}
+
+
+inline unsigned int
+AsyncLog::collect()
+{
+    bplus::sync::ScopedLock<bplus::sync::Mutex> lock( m_collectLock );
+    unsigned int nDelivered = 0;
+    for (Ring* pRing = m_pRings.load( bplus::sync::MemoryOrderAcquire );
+         pRing; pRing = pRing->pNext) {
+        nDelivered += collectRing( pRing );
+    }
+    if (nDelivered) {
+        m_nDelivered.add( nDelivered, bplus::sync::MemoryOrderRelaxed );
+        m_nBatches.increment( bplus::sync::MemoryOrderRelaxed );
+    }
+    return nDelivered;
+}
+
+
+inline bool
+AsyncLog::anyPending()
+{
+    using namespace bplus::sync;
+    for (Ring* pRing = m_pRings.load( MemoryOrderAcquire );
+         pRing; pRing = pRing->pNext) {
+        if (atomicLoad( &pRing->nWritePos, MemoryOrderSeqCst )
+            != atomicLoad( &pRing->nReadPos, MemoryOrderRelaxed )) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+inline void*
+AsyncLog::collectorMain( void* cookie )
+{
+    AsyncLog* self = (AsyncLog*) cookie;
+    while (!self->m_bStopping.isSet()) {
+        if (self->collect()) continue;
+
+        self->m_bSleeping.testAndSet( bplus::sync::MemoryOrderSeqCst );
+        if (!self->anyPending() && !self->m_bStopping.isSet()) {
+            // the timeout bounds the wait for dropped-record reports,
+            // which don't wake us
+            (void) self->m_wakeup.timeWait( 250 );
+        }
+        self->m_bSleeping.clear( bplus::sync::MemoryOrderSeqCst );
+    }
+    (void) self->collect();
+    return NULL;
+}
+
+
+inline AsyncLog::Stats
+AsyncLog::stats() const
+{
+    using bplus::sync::MemoryOrderRelaxed;
+    Stats s;
+    s.written = (unsigned long) m_nWritten.load( MemoryOrderRelaxed );
+    s.delivered = (unsigned long) m_nDelivered.load( MemoryOrderRelaxed );
+    s.dropped = (unsigned long) m_nDropped.load( MemoryOrderRelaxed );
+    s.batches = (unsigned long) m_nBatches.load( MemoryOrderRelaxed );
+    s.rings = (unsigned long) m_nRings.load( MemoryOrderRelaxed );
+    return s;
+}
+
+
+inline bplus::Object*
+AsyncLog::statsToBPObject() const
+{
+    Stats s = stats();
+    bplus::Map* pMap = new bplus::Map;
+    pMap->add( "written", new bplus::Integer( s.written ) );
+    pMap->add( "delivered", new bplus::Integer( s.delivered ) );
+    pMap->add( "dropped", new bplus::Integer( s.dropped ) );
+    pMap->add( "batches", new bplus::Integer( s.batches ) );
+    pMap->add( "rings", new bplus::Integer( s.rings ) );
+    return pMap;
+}
+
+
+} // service
+} // bplus
+
+
+#endif // BPASYNCLOG_H_
@@ -0,0 +1,271 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpbinarylog.h
+ *
+ *  Structured logging that defers formatting entirely.
+ *
+ *  A log site -- level, printf-style format and source location -- is
+ *  declared once with BP_LOG_SITE and is constant data.  Logging at a
+ *  site writes a compact binary record (site id, thread id, instance id,
+ *  timestamp and the raw argument values) into a memory-mapped segment
+ *  file.  Nothing is formatted in the process; the bplogdecode tool
+ *  renders segments as text or JSON afterwards.
+ *
+ *  Each segment file is self-describing: the first time a site is used
+ *  in a segment, its definition is written there too.  The definition
+ *  carries the argument types the site was first logged with, so the
+ *  usual event, logged with the same types, records values only.
+ */
+
+#ifndef BPBINARYLOG_H_
+#define BPBINARYLOG_H_
+
+#include <string>
+#include <vector>
+
+#include "bputil/bpatomic.h"
+#include "bputil/bplogformat.h"
+#include "bputil/bppathstring.h"
+#include "bputil/bpstrutil.h"
+#include "bputil/bpsync.h"
+#include "bputil/bpthread.h"
+#include "bputil/bptimeutil.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace service {
+
+
+// A log site.  Declare with BP_LOG_SITE; the members are internal.
+struct LogSite
+{
+    unsigned int    level;
+    const char*     fmt;
+    const char*     file;
+    unsigned int    line;
+    volatile long   id;             // assigned on first use
+    volatile long   definedIn;      // serial of segment last defined in
+    volatile long   layout;         // argument types of first use
+};
+
+// Declares a static LogSite called name, e.g.
+//     BP_LOG_SITE( s_siteLoaded, BP_INFO, "loaded %s in %d ms" );
+//     ...
+//     blog( s_siteLoaded, sName, nMsec );
+#define BP_LOG_SITE( name, level, fmt ) \
+static bplus::service::LogSite name = \
+    { level, fmt, __FILE__, __LINE__, 0, 0, 0 }
+
+
+class BinaryLog
+{
+public:
+    struct Stats
+    {
+        unsigned long long records;     // events written
+        unsigned long long bytes;       // bytes written, all segments
+        unsigned long long dropped;     // events lost, all segments full
+        unsigned long long segments;    // segment files opened
+    };
+
+    BinaryLog();
+    ~BinaryLog();
+
+    // Create segment files sPathPrefix.0.bplog, sPathPrefix.1.bplog, ...
+    // of nSegmentBytes each, moving to the next as each fills.  After
+    // nMaxSegments, records are dropped and counted.
+    bool            open( const bplus::tPathString& sPathPrefix,
+                          size_t nSegmentBytes = 8 * 1024 * 1024,
+                          unsigned int nMaxSegments = 8 );
+
+    // Unmap and trim the segment files.  No thread may be writing.
+    void            close();
+
+    bool            isOpen() const;
+
+    // Record an event at site.  Callable from any thread, lock-free
+    // except when a segment fills.  String arguments are copied in.
+    void            write( LogSite& site, unsigned int instanceId,
+                           const bplus::logging::Arg* args,
+                           unsigned int nArgs );
+
+    Stats           stats() const;
+
+    // Stats as a map of integers, e.g. for returning from a method.
+    // Caller owns returned pointer.
+    bplus::Object*  statsToBPObject() const;
+
+// On-disk layout.  Everything is native byte order and 8 byte aligned.
+public:
+    enum {
+        s_version = 2,
+        s_kindSite = 1,
+        s_kindEvent = 2,            // argument types are the site's
+        s_kindTypedEvent = 3        // argument types are in the event
+    };
+
+    struct FileHeader
+    {
+        char                magic[8];       // "BPBLOG\0\0"
+        unsigned int        version;
+        unsigned int        headerSize;
+        unsigned long long  wallMicrosAtOpen;
+        unsigned long long  monoMicrosAtOpen;
+        unsigned int        pid;
+        unsigned int        segment;
+    };
+
+    // Followed by a SiteBody or EventBody.  size is written last, so a
+    // zero size marks the end of the committed records.
+    struct RecordHeader
+    {
+        unsigned int        size;           // whole record, padded
+        unsigned short      kind;
+        unsigned short      nArgs;
+    };
+
+    // Followed by the format and file name, each NUL terminated, then
+    // the header's nArgs type bytes (bplus::logging::Arg::Type), padded
+    // to 8.
+    struct SiteBody
+    {
+        unsigned int        siteId;
+        unsigned int        level;
+        unsigned int        line;
+        unsigned int        fmtLen;
+        unsigned int        fileLen;
+        unsigned int        reserved;
+    };
+
+    // For s_kindTypedEvent, followed by nArgs type bytes, padded to 8.
+    // Then each value: 8 bytes for numbers and pointers; for strings a
+    // 4 byte length and the bytes, NUL terminated and padded to 8.
+    struct EventBody
+    {
+        unsigned int        siteId;
+        unsigned int        tid;
+        unsigned int        instanceId;
+        unsigned int        reserved;
+        unsigned long long  monoMicros;
+    };
+
+    // Reads back a segment, e.g. one mapped or loaded by a decoder.
+    class Reader
+    {
+    public:
+        struct Site
+        {
+            Site() : level( 0 ), line( 0 ) {}
+            unsigned int    level;
+            unsigned int    line;
+            std::string     fmt;
+            std::string     file;
+            std::vector<unsigned char> types;   // for untyped events
+        };
+
+        struct Event
+        {
+            unsigned int        siteId;
+            const Site*         pSite;      // NULL if undefined
+            unsigned int        tid;
+            unsigned int        instanceId;
+            unsigned long long  wallMicros;
+            std::vector<bplus::logging::Arg> args;  // strings point
+                                                    // into the data
+        };
+
+        // pData must stay valid while the Reader is in use.  Returns
+        // false from valid() if it doesn't start with a FileHeader.
+        Reader( const char* pData, size_t nBytes );
+
+        bool            valid() const { return m_bValid; }
+        const FileHeader& header() const { return m_header; }
+
+        // Advance to the next event.  Returns false at the end.
+        bool            next( Event& oEvent );
+
+    private:
+        bool            parseEvent( const RecordHeader* pRec,
+                                    Event& oEvent ) const;
+
+        const char*     m_pData;
+        size_t          m_nBytes;
+        size_t          m_nPos;
+        bool            m_bValid;
+        FileHeader      m_header;
+        std::vector<Site> m_sites;          // by id
+        std::vector<bool> m_haveSite;
+    };
+
+private:
+    struct Segment
+    {
+        long            serial;
+        char*           pBase;
+        long            nCapacity;
+        volatile long   nUsed;
+#ifdef WIN32
+        void*           hFile;
+        void*           hMapping;
+#else
+        int             fd;
+#endif
+    };
+
+    Segment*        openSegment( unsigned int nIndex );
+    void            closeSegment( Segment* pSeg );
+    void            rotate( Segment* pFull );
+    static long     siteId( LogSite& site );
+    static long     siteLayout( LogSite& site, long nLayout );
+    static size_t   eventSize( const bplus::logging::Arg* args,
+                               unsigned int nArgs, bool bTyped );
+    static size_t   siteSize( const LogSite& site, unsigned int nTypes );
+
+    bplus::tPathString              m_sPathPrefix;
+    size_t                          m_nSegmentBytes;
+    unsigned int                    m_nMaxSegments;
+    bplus::sync::AtomicPtr<Segment> m_pCurrent;
+    std::vector<Segment*>           m_segments;     // under m_rotateLock
+    bplus::sync::Mutex              m_rotateLock;
+
+    bplus::sync::AtomicCounter      m_nRecords;
+    bplus::sync::AtomicCounter      m_nBytes;
+    bplus::sync::AtomicCounter      m_nDropped;
+
+    BinaryLog( const BinaryLog& );
+    BinaryLog& operator=( const BinaryLog& );
+};
+
+
+} // service
+} // bplus
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the implementations.
+#include "impl/bpbinarylogimpl.h"
+
+
+#endif // BPBINARYLOG_H_
@@ -0,0 +1,452 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpcompletionchannel.h
+ *
+ *  A channel through which worker threads hand finished transactions
+ *  back for posting to the core.
+ *
+ *  Workers push (transaction, result) pairs onto a lock-free MPSC queue
+ *  instead of calling into the core themselves, so they never contend
+ *  with one another on the core's result posting path.  A single
+ *  drainer -- a dedicated thread, the core's main thread, or any thread
+ *  calling drain() -- posts everything queued in one pass.
+ *
+ *  The channel also records how long completions sat in the queue.
+ */
+
+#ifndef BPCOMPLETIONCHANNEL_H_
+#define BPCOMPLETIONCHANNEL_H_
+
+#include "bppendingcompletion.h"
+#include "bptransaction.h"
+#include "bputil/bpmpscqueue.h"
+#include "bputil/bpsync.h"
+#include "bputil/bpthread.h"
+#include "bputil/bptimeutil.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace service {
+
+
+class CompletionChannel
+{
+public:
+    struct Stats
+    {
+        unsigned long long posted;          // completions queued
+        unsigned long long delivered;       // completions sent to core
+        unsigned long long batches;         // non-empty drain passes
+        unsigned long long largestBatch;
+        unsigned long long totalDelayMicros;   // sum of time queued
+        unsigned long long maxDelayMicros;
+    };
+
+    CompletionChannel();
+
+    // Stops any drainer thread, waits out a main-thread drain already
+    // under way, and delivers whatever is still queued.
+    ~CompletionChannel();
+
+// Producer side, callable from any thread.
+public:
+    // Queue a successful completion.  The result is copied.
+    void            complete( const Transaction& tran,
+                              const bplus::Object& result );
+
+    // Queue a successful completion, taking ownership of result.
+    void            complete( const Transaction& tran,
+                              bplus::Object* result );
+
+    // Queue a failure.  Error strings are copied.
+    void            error( const Transaction& tran,
+                           const char* szError = 0,
+                           const char* szVerboseError = 0 );
+
+// Drain side.  Only one thread may drain at a time: use exactly one of
+// the following mechanisms.
+public:
+    // Post up to maxBatch queued completions (0 means all) from the
+    // calling thread.  Returns the number posted.
+    unsigned int    drain( unsigned int maxBatch = 0 );
+
+    // Start a dedicated thread that drains as completions arrive.
+    bool            startDrainer();
+
+    // Stop the drainer thread, after it delivers what is queued.
+    void            stopDrainer();
+
+    // Drain on the core's main thread.  Whenever completions are queued
+    // and no drain is pending, a drain is requested through
+    // pCoreFuncs->invokeOnMainThread.  Since that callback carries no
+    // context, only one channel per service may use this mode.
+    void            drainOnMainThread( const BPCFunctionTable* pCoreFuncs );
+
+// Diagnostics
+public:
+    Stats           stats() const;
+
+    // Stats as a map of integers, e.g. for returning from a method.
+    // Caller owns returned pointer.
+    bplus::Object*  statsToBPObject() const;
+
+private:
+    struct Completion
+    {
+        Completion( const Transaction& t ) : tran( t ), queuedAt( 0 ) {}
+        Transaction                 tran;
+        detail::PendingCompletion   pending;
+        unsigned long long          queuedAt;
+    };
+
+    void            post( Completion* pComp );
+    unsigned long long deliver( Completion* pComp, unsigned long long now );
+    void            wakeDrainer();
+    static void*    drainerMain( void* cookie );
+    static void     mainThreadDrain();
+
+    // The channel draining on the main thread.  A main-thread drain
+    // runs holding nBusy, so a channel going away can wait it out.
+    struct MainThread
+    {
+        void* volatile      pChannel;
+        volatile long       nBusy;
+    };
+    static MainThread&  mainThread();
+    static void     lockMainThread();
+    static void     unlockMainThread();
+
+    bplus::sync::MPSCQueue<Completion*> m_queue;
+
+    bplus::sync::Mutex          m_mutex;
+    bplus::sync::Condition      m_cond;
+    bplus::thread::Thread       m_drainer;
+    bool                        m_bDrainerRunning;
+    volatile long               m_waiting;
+    volatile long               m_stop;
+
+    const BPCFunctionTable* volatile m_pMainThreadCore;
+    volatile long               m_mainThreadScheduled;
+
+    volatile long               m_posted;
+    mutable bplus::sync::Mutex  m_statsMutex;
+    Stats                       m_stats;
+
+// Prevent copying
+private:
+    CompletionChannel( const CompletionChannel& );
+    CompletionChannel& operator=( const CompletionChannel& );
+};
+
+
+//////////////////////////////////////////////////////////////////////
+// Implementation
+
+inline
+CompletionChannel::CompletionChannel() :
+    m_bDrainerRunning( false ),
+    m_waiting( 0 ),
+    m_stop( 0 ),
+    m_pMainThreadCore( NULL ),
+    m_mainThreadScheduled( 0 ),
+    m_posted( 0 )
+{
+    memset( &m_stats, 0, sizeof(m_stats) );
+}
+
+
+inline
+CompletionChannel::~CompletionChannel()
+{
+    stopDrainer();
+
+    // After this no main-thread drain is using us or will, leaving
+    // this thread the only consumer.
+    lockMainThread();
+    if (sync::atomicLoadPtr( &mainThread().pChannel ) == this) {
+        sync::atomicStorePtr( &mainThread().pChannel, NULL );
+    }
+    unlockMainThread();
+
+    drain();
+}
+
+
+inline void
+CompletionChannel::complete( const Transaction& tran,
+                             const bplus::Object& result )
+{
+    complete( tran, result.clone() );
+}
+
+
+inline void
+CompletionChannel::complete( const Transaction& tran,
+                             bplus::Object* result )
+{
+    Completion* pComp = new Completion( tran );
+    pComp->pending.pResult = result;
+    post( pComp );
+}
+
+
+inline void
+CompletionChannel::error( const Transaction& tran,
+                          const char* szError,
+                          const char* szVerboseError )
+{
+    Completion* pComp = new Completion( tran );
+    pComp->pending.setError( szError, szVerboseError );
+    post( pComp );
+}
+
+
+inline void
+CompletionChannel::post( Completion* pComp )
+{
+    pComp->queuedAt = bplus::timeutil::monotonicMicros();
+    m_queue.push( pComp );
+    sync::atomicAdd( &m_posted, 1 );
+    wakeDrainer();
+}
+
+
+inline void
+CompletionChannel::wakeDrainer()
+{
+    // Pairs with the fence in drainerMain: either the drainer sees our
+    // push, or we see that it is waiting.
+    sync::atomicFence();
+    if (sync::atomicLoad( &m_waiting, sync::MemoryOrderAcquire )) {
+        bplus::sync::Lock lock( m_mutex );
+        m_cond.signal();
+    }
+
+    const BPCFunctionTable* pCore = (const BPCFunctionTable*)
+        sync::atomicLoadPtr( (void* volatile*) &m_pMainThreadCore,
+                             sync::MemoryOrderAcquire );
+    if (pCore && sync::atomicCompareExchange( &m_mainThreadScheduled, 0, 1 ))
+    {
+        pCore->invokeOnMainThread( mainThreadDrain );
+    }
+}
+
+
+// Posts pComp to the core and frees it.  Returns how long it was queued.
+inline unsigned long long
+CompletionChannel::deliver( Completion* pComp, unsigned long long now )
+{
+    pComp->pending.post( pComp->tran );
+
+    unsigned long long delay = now - pComp->queuedAt;
+    delete pComp->pending.pResult;
+    delete pComp;
+    return delay;
+}
+
+
+inline unsigned int
+CompletionChannel::drain( unsigned int maxBatch )
+{
+    unsigned int nDelivered = 0;
+    Completion* pComp = NULL;
+    unsigned long long now = 0;
+    unsigned long long totalDelay = 0;
+    unsigned long long maxDelay = 0;
+
+    // Tally locally and fold into m_stats afterwards, so a stats()
+    // caller never waits on the core.
+    while ((maxBatch == 0 || nDelivered < maxBatch) && m_queue.pop( pComp )) {
+        if (nDelivered == 0) {
+            // one clock read per batch is accurate enough
+            now = bplus::timeutil::monotonicMicros();
+        }
+        unsigned long long delay = deliver( pComp, now );
+        totalDelay += delay;
+        if (delay > maxDelay) maxDelay = delay;
+        nDelivered++;
+    }
+
+    if (nDelivered > 0) {
+        bplus::sync::Lock lock( m_statsMutex );
+        m_stats.delivered += nDelivered;
+        m_stats.batches++;
+        if (nDelivered > m_stats.largestBatch) {
+            m_stats.largestBatch = nDelivered;
+        }
+        m_stats.totalDelayMicros += totalDelay;
+        if (maxDelay > m_stats.maxDelayMicros) {
+            m_stats.maxDelayMicros = maxDelay;
+        }
+    }
+
+    return nDelivered;
+}
+
+
+inline bool
+CompletionChannel::startDrainer()
+{
+    if (m_bDrainerRunning) return true;
+    sync::atomicStore( &m_stop, 0, sync::MemoryOrderRelease );
+    bplus::thread::ThreadOptions opts;
+    opts.name = "bp-completions";
+    m_bDrainerRunning = m_drainer.run( drainerMain, this, opts );
+    return m_bDrainerRunning;
+}
+
+
+inline void
+CompletionChannel::stopDrainer()
+{
+    if (!m_bDrainerRunning) return;
+    {
+        bplus::sync::Lock lock( m_mutex );
+        sync::atomicStore( &m_stop, 1, sync::MemoryOrderRelease );
+        m_cond.signal();
+    }
+    m_drainer.join();
+    m_bDrainerRunning = false;
+}
+
+
+inline void*
+CompletionChannel::drainerMain( void* cookie )
+{
+    CompletionChannel* pChan = (CompletionChannel*) cookie;
+
+    for (;;) {
+        pChan->drain();
+
+        bplus::sync::Lock lock( pChan->m_mutex );
+        sync::atomicAdd( &pChan->m_waiting, 1 );
+        sync::atomicFence();
+        bool bEmpty = pChan->m_queue.empty();
+        if (bEmpty && sync::atomicLoad( &pChan->m_stop,
+                                        sync::MemoryOrderAcquire )) {
+            sync::atomicAdd( &pChan->m_waiting, -1 );
+            break;
+        }
+        if (bEmpty) {
+            pChan->m_cond.wait( &pChan->m_mutex );
+        }
+        sync::atomicAdd( &pChan->m_waiting, -1 );
+    }
+
+    return NULL;
+}
+
+
+inline CompletionChannel::MainThread&
+CompletionChannel::mainThread()
+{
+    // constant initialized, so safe whichever thread gets here first
+    static MainThread s_main = { NULL, 0 };
+    return s_main;
+}
+
+
+inline void
+CompletionChannel::lockMainThread()
+{
+    while (!sync::atomicCompareExchange( &mainThread().nBusy, 0, 1 )) {
+        bplus::thread::Thread::yield();
+    }
+}
+
+
+inline void
+CompletionChannel::unlockMainThread()
+{
+    sync::atomicStore( &mainThread().nBusy, 0, sync::MemoryOrderRelease );
+}
+
+
+inline void
+CompletionChannel::drainOnMainThread( const BPCFunctionTable* pCoreFuncs )
+{
+    lockMainThread();
+    sync::atomicStorePtr( &mainThread().pChannel, this );
+    unlockMainThread();
+    sync::atomicStorePtr( (void* volatile*) &m_pMainThreadCore,
+                          (void*) pCoreFuncs, sync::MemoryOrderRelease );
+
+    // Anything queued before now is the drain's to find: the queue is
+    // only looked at by its consumer.
+    if (sync::atomicCompareExchange( &m_mainThreadScheduled, 0, 1 )) {
+        pCoreFuncs->invokeOnMainThread( mainThreadDrain );
+    }
+}
+
+
+inline void
+CompletionChannel::mainThreadDrain()
+{
+    lockMainThread();
+    CompletionChannel* pChan = (CompletionChannel*)
+        sync::atomicLoadPtr( &mainThread().pChannel,
+                             sync::MemoryOrderAcquire );
+    if (pChan) {
+        // Clear the flag first so a post racing with this drain
+        // schedules another one rather than being stranded.
+        sync::atomicStore( &pChan->m_mainThreadScheduled, 0,
+                           sync::MemoryOrderRelease );
+        sync::atomicFence();
+        pChan->drain();
+    }
+    unlockMainThread();
+}
+
+
+inline CompletionChannel::Stats
+CompletionChannel::stats() const
+{
+    bplus::sync::Lock lock( m_statsMutex );
+    Stats s = m_stats;
+    s.posted = (unsigned long long) sync::atomicLoad( &m_posted );
+    return s;
+}
+
+
+inline bplus::Object*
+CompletionChannel::statsToBPObject() const
+{
+    Stats s = stats();
+    bplus::Map* m = new bplus::Map;
+    m->add( "posted", new bplus::Integer( s.posted ) );
+    m->add( "delivered", new bplus::Integer( s.delivered ) );
+    m->add( "batches", new bplus::Integer( s.batches ) );
+    m->add( "largestBatch", new bplus::Integer( s.largestBatch ) );
+    m->add( "totalDelayMicros", new bplus::Integer( s.totalDelayMicros ) );
+    m->add( "maxDelayMicros", new bplus::Integer( s.maxDelayMicros ) );
+    return m;
+}
+
+
+} // service
+} // bplus
+
+
+#endif // BPCOMPLETIONCHANNEL_H_
@@ -0,0 +1,165 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpinvocationtrace.h
+ *
+ *  Records the calls a service receives, and how each ends, to a
+ *  compact binary trace file, so real traffic can be replayed against
+ *  a new build offline (see tools/bpharness/bpreplay).
+ *
+ *  A trace is a header followed by records.  Invoke records carry the
+ *  function name, tid, instance id, time since the trace was opened and
+ *  the arguments, encoded losslessly.  Results, errors and callbacks
+ *  carry the tid, time and the encoded size of what was posted (errors
+ *  their strings), which is enough to check a replay without storing
+ *  every result.
+ *
+ *  Integers in the format are LEB128 varints, signed values zigzag
+ *  encoded.
+ */
+
+#ifndef BPINVOCATIONTRACE_H_
+#define BPINVOCATIONTRACE_H_
+
+#include <stdio.h>
+#include <string>
+
+#include "bpserviceapi/bptypes.h"
+#include "bputil/bppathstring.h"
+#include "bputil/bpsync.h"
+#include "bputil/bptimeutil.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace service {
+
+
+class InvocationTrace
+{
+public:
+    enum RecordKind {
+        KindInvoke = 1,
+        KindResults = 2,
+        KindError = 3,
+        KindCallback = 4
+    };
+
+    InvocationTrace();
+    ~InvocationTrace();
+
+    // Create (truncate) the trace file.  The service name and version
+    // go in the header.
+    bool            open( const bplus::tPathString& sPath,
+                          const std::string& sService,
+                          const std::string& sVersion );
+    void            close();
+    bool            isOpen() const;
+
+    // Write out buffered records.
+    void            flush();
+
+    // Recorders.  Callable from any thread.
+    void            recordInvoke( unsigned int tid, unsigned int instanceId,
+                                  const char* cszFunction,
+                                  const BPElement* pArgs );
+    void            recordResults( unsigned int tid,
+                                   const BPElement* pResults );
+    void            recordError( unsigned int tid, const char* cszError,
+                                 const char* cszVerbose );
+    void            recordCallback( unsigned int tid, long long callbackId,
+                                    const BPElement* pParams );
+
+    // Element encoding, shared with the Reader.
+    static void     encodeElement( const BPElement* pElem, std::string& sOut );
+    static size_t   encodedSize( const BPElement* pElem );
+
+    // Reads a trace held in memory.
+    class Reader
+    {
+    public:
+        struct Record
+        {
+            Record() : kind( 0 ), micros( 0 ), tid( 0 ), instanceId( 0 ),
+                       callbackId( 0 ), size( 0 ), pArgs( NULL ) {}
+            ~Record() { delete pArgs; }
+
+            int                 kind;           // a RecordKind
+            unsigned long long  micros;         // since the trace opened
+            unsigned int        tid;
+            unsigned int        instanceId;     // KindInvoke
+            std::string         function;       // KindInvoke
+            long long           callbackId;     // KindCallback
+            unsigned long long  size;           // encoded result/params
+            std::string         error;          // KindError
+            std::string         verboseError;   // KindError
+            bplus::Object*      pArgs;          // KindInvoke, owned
+
+        private:
+            Record( const Record& );
+            Record& operator=( const Record& );
+        };
+
+        Reader( const char* pData, size_t nBytes );
+
+        // False if the data doesn't start with a trace header.
+        bool            valid() const { return m_bValid; }
+        const std::string& service() const { return m_sService; }
+        const std::string& version() const { return m_sVersion; }
+        unsigned long long wallMicrosAtOpen() const { return m_nWallMicros; }
+
+        // Read the next record into rec.  Returns false at the end or
+        // at a truncated or malformed record.
+        bool            next( Record& rec );
+
+    private:
+        const char*         m_p;
+        const char*         m_pEnd;
+        bool                m_bValid;
+        std::string         m_sService;
+        std::string         m_sVersion;
+        unsigned long long  m_nWallMicros;
+    };
+
+private:
+    void            write( int kind, const std::string& sPayload );
+
+    FILE*               m_pFile;
+    unsigned long long  m_nStartMicros;
+    bplus::sync::Mutex  m_lock;
+
+    InvocationTrace( const InvocationTrace& );
+    InvocationTrace& operator=( const InvocationTrace& );
+};
+
+
+} // service
+} // bplus
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the implementations.
+#include "impl/bpinvocationtraceimpl.h"
+
+
+#endif // BPINVOCATIONTRACE_H_
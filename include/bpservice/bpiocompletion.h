@@ -0,0 +1,166 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+/*
+ *  bpiocompletion.h
+ *
+ *  Helpers for services using a bplus::io::AsyncFile: handlers that
+ *  end a transaction, or invoke a client callback, as soon as a file
+ *  operation ends, on the engine's thread, with no hop through another
+ *  queue.
+ *
+ *      file.read( fd, buf, n, 0, completeOnIo( tran, digestOf, pCtx ) );
+ *      file.submit();
+ *
+ *  Failed operations end transactions with BPE_IO_ERROR and the
+ *  system's description of the error.
+ */
+
+#ifndef BPIOCOMPLETION_H_
+#define BPIOCOMPLETION_H_
+
+#include "bpcallback.h"
+#include "bptransaction.h"
+#include "bpserviceapi/bperror.h"
+#include "bputil/bpasyncfile.h"
+#include "bputil/bpstrutil.h"
+
+
+namespace bplus {
+namespace service {
+
+
+// Builds the object to deliver for a successful operation.  The caller
+// takes ownership of the returned object.
+typedef bplus::Object* (*IoResultFunc)( const bplus::io::IoResult& result,
+                                        void* pContext );
+
+// A handler completing tran when the operation ends: with what
+// pfnResult makes of it, or by default the number of bytes moved as an
+// Integer.
+bplus::io::IoHandler* completeOnIo( const Transaction& tran,
+                                    IoResultFunc pfnResult = 0,
+                                    void* pContext = 0 );
+
+// A handler invoking cb when the operation ends, with what pfnArgs
+// makes of it, or by default { bytes, offset } on success and
+// { error } on failure.  The transaction stays open.
+bplus::io::IoHandler* invokeOnIo( const Callback& cb,
+                                  IoResultFunc pfnArgs = 0,
+                                  void* pContext = 0 );
+
+
+//////////////////////////////////////////////////////////////////////
+// Implementation
+
+namespace detail {
+
+class IoTransactionHandler : public bplus::io::IoHandler
+{
+public:
+    IoTransactionHandler( const Transaction& tran, IoResultFunc pfn,
+                          void* pContext ) :
+        m_tran( tran ), m_pfn( pfn ), m_pContext( pContext ) {}
+
+    void complete( const bplus::io::IoResult& result )
+    {
+        if (result.error) {
+            m_tran.error( BPE_IO_ERROR,
+                          bplus::strutil::errorString( result.error ).c_str() );
+            return;
+        }
+        if (!m_pfn) {
+            m_tran.complete( bplus::Integer( (BPInteger) result.bytes ) );
+            return;
+        }
+        bplus::Object* pResult = m_pfn( result, m_pContext );
+        if (pResult) {
+            m_tran.complete( *pResult );
+            delete pResult;
+        } else {
+            m_tran.error( BPE_INTERNAL_ERROR, 0 );
+        }
+    }
+
+private:
+    Transaction     m_tran;
+    IoResultFunc    m_pfn;
+    void*           m_pContext;
+};
+
+class IoCallbackHandler : public bplus::io::IoHandler
+{
+public:
+    IoCallbackHandler( const Callback& cb, IoResultFunc pfn,
+                       void* pContext ) :
+        m_cb( cb ), m_pfn( pfn ), m_pContext( pContext ) {}
+
+    void complete( const bplus::io::IoResult& result )
+    {
+        bplus::Object* pArgs = 0;
+        if (m_pfn) {
+            pArgs = m_pfn( result, m_pContext );
+        } else {
+            bplus::Map* pMap = new bplus::Map;
+            if (result.error) {
+                pMap->add( "error", new bplus::String(
+                    bplus::strutil::errorString( result.error ) ) );
+            } else {
+                pMap->add( "bytes", new bplus::Integer( (BPInteger) result.bytes ) );
+                pMap->add( "offset", new bplus::Integer( (BPInteger) result.offset ) );
+            }
+            pArgs = pMap;
+        }
+        if (pArgs) {
+            m_cb.invoke( *pArgs );
+            delete pArgs;
+        }
+    }
+
+private:
+    Callback        m_cb;
+    IoResultFunc    m_pfn;
+    void*           m_pContext;
+};
+
+} // detail
+
+
+inline bplus::io::IoHandler*
+completeOnIo( const Transaction& tran, IoResultFunc pfnResult,
+              void* pContext )
+{
+    return new detail::IoTransactionHandler( tran, pfnResult, pContext );
+}
+
+
+inline bplus::io::IoHandler*
+invokeOnIo( const Callback& cb, IoResultFunc pfnArgs, void* pContext )
+{
+    return new detail::IoCallbackHandler( cb, pfnArgs, pContext );
+}
+
+
+} // service
+} // bplus
+
+
+#endif // BPIOCOMPLETION_H_
@@ -0,0 +1,147 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bploopcompletion.h
+ *
+ *  Helpers for services built around a bplus::io::EventLoop: end a
+ *  transaction, or invoke a client callback, from the loop's thread.
+ *
+ *  Each helper copies what it is given and posts the work to the loop,
+ *  so it may be called from any thread, and results are delivered in
+ *  order with the loop's own I/O callbacks.  From a loop callback the
+ *  plain Transaction and Callback methods may be used directly.  Work
+ *  posted to a loop that is stopping still gets done, see
+ *  EventLoop::stop().
+ *
+ *  Linux only, like EventLoop.
+ */
+
+#ifndef BPLOOPCOMPLETION_H_
+#define BPLOOPCOMPLETION_H_
+
+#include "bpcallback.h"
+#include "bppendingcompletion.h"
+#include "bptransaction.h"
+#include "bputil/bpeventloop.h"
+
+
+namespace bplus {
+namespace service {
+
+
+// Complete tran with a copy of result, on the loop thread.
+void completeOnLoop( bplus::io::EventLoop& loop,
+                     const Transaction& tran,
+                     const bplus::Object& result );
+
+// Fail tran on the loop thread.  Error strings are copied.
+void errorOnLoop( bplus::io::EventLoop& loop,
+                  const Transaction& tran,
+                  const char* szError = 0,
+                  const char* szVerboseError = 0 );
+
+// Invoke cb with a copy of args, on the loop thread.
+void invokeOnLoop( bplus::io::EventLoop& loop,
+                   const Callback& cb,
+                   const bplus::Object& args );
+
+
+//////////////////////////////////////////////////////////////////////
+// Implementation
+
+namespace detail {
+
+struct LoopCompletion
+{
+    LoopCompletion( const Transaction& t ) : tran( t ) {}
+    ~LoopCompletion() { delete pending.pResult; }
+
+    Transaction         tran;
+    PendingCompletion   pending;
+
+    static void run( void* cookie )
+    {
+        LoopCompletion* p = (LoopCompletion*) cookie;
+        p->pending.post( p->tran );
+        delete p;
+    }
+};
+
+struct LoopInvocation
+{
+    LoopInvocation( const Callback& c, const bplus::Object& a ) :
+        cb( c ), pArgs( a.clone() ) {}
+    ~LoopInvocation() { delete pArgs; }
+
+    Callback        cb;
+    bplus::Object*  pArgs;
+
+    static void run( void* cookie )
+    {
+        LoopInvocation* p = (LoopInvocation*) cookie;
+        p->cb.invoke( *p->pArgs );
+        delete p;
+    }
+};
+
+} // detail
+
+
+inline void
+completeOnLoop( bplus::io::EventLoop& loop,
+                const Transaction& tran,
+                const bplus::Object& result )
+{
+    detail::LoopCompletion* p = new detail::LoopCompletion( tran );
+    p->pending.pResult = result.clone();
+    loop.post( detail::LoopCompletion::run, p );
+}
+
+
+inline void
+errorOnLoop( bplus::io::EventLoop& loop,
+             const Transaction& tran,
+             const char* szError,
+             const char* szVerboseError )
+{
+    detail::LoopCompletion* p = new detail::LoopCompletion( tran );
+    p->pending.setError( szError, szVerboseError );
+    loop.post( detail::LoopCompletion::run, p );
+}
+
+
+inline void
+invokeOnLoop( bplus::io::EventLoop& loop,
+              const Callback& cb,
+              const bplus::Object& args )
+{
+    loop.post( detail::LoopInvocation::run,
+               new detail::LoopInvocation( cb, args ) );
+}
+
+
+} // service
+} // bplus
+
+
+#endif // BPLOOPCOMPLETION_H_
@@ -0,0 +1,100 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bppendingcompletion.h
+ *
+ *  The end of a transaction, captured to be posted later, usually from
+ *  another thread: a result, or an error with copies of its strings.
+ *  Shared by the completion channel, the event loop helpers and result
+ *  streams.  Not for direct use by services.
+ */
+
+#ifndef BPPENDINGCOMPLETION_H_
+#define BPPENDINGCOMPLETION_H_
+
+#include <string>
+
+#include "bptransaction.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace service {
+namespace detail {
+
+
+// Plain data, so it can sit in containers and queues.  pResult isn't
+// owned: whoever holds the record frees it once posted or dropped.
+struct PendingCompletion
+{
+    PendingCompletion() : pResult( NULL ), bHasError( false ),
+                          bHasVerbose( false ) {}
+
+    bplus::Object*  pResult;        // NULL for an error
+    bool            bHasError;
+    bool            bHasVerbose;
+    std::string     sError;
+    std::string     sVerbose;
+
+    // Make this an error.  Either string may be NULL.
+    void            setError( const char* szError,
+                              const char* szVerboseError );
+
+    // Complete or fail tran accordingly.
+    void            post( const Transaction& tran ) const;
+};
+
+
+//////////////////////////////////////////////////////////////////////
+// Implementation
+
+inline void
+PendingCompletion::setError( const char* szError,
+                             const char* szVerboseError )
+{
+    pResult = NULL;
+    bHasError = szError != NULL;
+    sError = szError ? szError : "";
+    bHasVerbose = szVerboseError != NULL;
+    sVerbose = szVerboseError ? szVerboseError : "";
+}
+
+
+inline void
+PendingCompletion::post( const Transaction& tran ) const
+{
+    if (pResult) {
+        tran.complete( *pResult );
+    } else {
+        tran.error( bHasError ? sError.c_str() : 0,
+                    bHasVerbose ? sVerbose.c_str() : 0 );
+    }
+}
+
+
+} // detail
+} // service
+} // bplus
+
+
+#endif // BPPENDINGCOMPLETION_H_
@@ -0,0 +1,736 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+/*
+ *  bpresultstream.h
+ *
+ *  Streaming results.  Transaction::complete() delivers one object, so
+ *  a method returning a large listing or a long text must build all
+ *  of it before the client sees any.  A ResultStream instead sends the
+ *  result in chunks as it is produced:
+ *
+ *      ResultStream stream( tran, *args.value( "chunk" ) );
+ *      while (more rows)
+ *          if (stream.append( row ) == ResultStream::Closed) return;
+ *      stream.end();
+ *
+ *  The BrowserPlus core has no streaming entry point, so chunks travel
+ *  as invocations of a callback argument of the method, in order:
+ *
+ *      { stream: id, seq: n, items: [ ... ] }          list slices
+ *      { stream: id, seq: n, offset: o, data: "..." }  text ranges
+ *
+ *  and the transaction's result is the terminator:
+ *
+ *      { stream: id, chunks: n, items: n, bytes: n [, summary: ...] }
+ *
+ *  Flow control: with Options::window set, at most that many chunks
+ *  are sent ahead of the client's acknowledgements, which come back
+ *  through a method of the service calling acknowledge() (see
+ *  ResultStreamTable).  While the window is full, producers are told
+ *  Paused and should wait -- waitWritable() or onWritable() -- rather
+ *  than buffer more.  Closed means the stream ended or the transaction
+ *  finished otherwise (its deadline expired, say); stop producing.
+ *
+ *  Copies of a ResultStream share their state, and any thread may use
+ *  one.  Chunks go to the core outside the stream's lock, in order, so
+ *  producers don't wait on one another's deliveries.  If the last copy
+ *  goes away before end() or fail(), the transaction fails with
+ *  BPE_INTERNAL_ERROR.  After end() the stream keeps itself alive until
+ *  its terminator is sent or its transaction otherwise finishes, so a
+ *  producer may end() and return with chunks still awaiting acks.
+ */
+
+#ifndef BPRESULTSTREAM_H_
+#define BPRESULTSTREAM_H_
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bpcallback.h"
+#include "bppendingcompletion.h"
+#include "bptransaction.h"
+#include "bputil/bpsync.h"
+#include "bputil/bptimeutil.h"
+#include "bputil/bptr1.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace service {
+
+
+class ResultStream
+{
+public:
+    struct Options
+    {
+        Options() : maxChunkItems( 256 ), maxChunkBytes( 64 * 1024 ),
+                    window( 0 ) {}
+
+        // A chunk is sent once it holds this many list items...
+        unsigned int    maxChunkItems;
+        // ...or this many bytes of text.
+        size_t          maxChunkBytes;
+        // Chunks sent and not acknowledged, at most.  0 sends without
+        // waiting for acknowledgements.
+        unsigned int    window;
+    };
+
+    enum Status
+    {
+        Open,       // produce away
+        Paused,     // the window is full: wait before producing more
+        Closed      // ended or failed: further data is dropped
+    };
+
+    typedef void (*WritableFunc)( void* cookie );
+
+    // cb must be a bplus::CallBack at runtime, else std::bad_cast.
+    ResultStream( const Transaction& tran, const bplus::Object& cb,
+                  const Options& options = Options() );
+
+    // Identifies the stream in its chunks; the transaction's id.
+    unsigned int    id() const;
+
+    // Add an item to the list slice being built.  The pointer form
+    // takes ownership of pItem.
+    Status          append( const bplus::Object& item );
+    Status          append( bplus::Object* pItem );
+
+    // Add UTF-8 text.  Chunks split between characters, never inside
+    // one.  Binary data must be encoded (base64, say) by the producer.
+    Status          write( const char* pData, size_t nBytes );
+    Status          write( const std::string& s );
+
+    // Send whatever has been added, without waiting for a chunk to
+    // fill.
+    Status          flush();
+
+    // Send what remains and complete the transaction with the
+    // terminator, to which a copy of pSummary is added if given.
+    // While the window is full the terminator waits for the client to
+    // catch up.  Returns false if the stream was already closed.
+    bool            end( const bplus::Object* pSummary = 0 );
+
+    // Drop what hasn't been sent and fail the transaction.
+    void            fail( const char* szError = 0,
+                          const char* szVerboseError = 0 );
+
+    Status          status() const;
+
+    // The client has received chunks up to and including seq.
+    void            acknowledge( unsigned int seq );
+
+    // Block until the stream isn't Paused, or msec pass.  Returns the
+    // status then.
+    Status          waitWritable( unsigned int msec );
+
+    // Call fn( cookie ) once, when the stream is next not Paused --
+    // on the thread making that so, or now, on this one, if it isn't
+    // Paused already.  Replaces any earlier request.
+    void            onWritable( WritableFunc fn, void* cookie );
+
+private:
+    // Something to hand the core, in order, outside the lock.
+    struct Outgoing
+    {
+        Outgoing() : pChunk( NULL ) {}
+
+        bplus::Map*                 pChunk;     // a chunk, else...
+        detail::PendingCompletion   end;        // ...terminator or error
+    };
+
+    struct State
+    {
+        State( const Transaction& t, const bplus::Object& c,
+               const Options& o );
+        ~State();
+
+        Transaction                 tran;
+        Callback                    cb;
+        Options                     opts;
+
+        bplus::sync::Mutex          mutex;
+        bplus::sync::Condition      cond;
+        bplus::List*                pItems;         // slice being built
+        std::string                 sText;          // text not yet sent
+        unsigned long long          nTextOffset;    // ...and its offset
+        std::deque<bplus::Map*>     ready;          // waiting for window
+        std::deque<Outgoing>        outbox;         // cleared to send
+        bool                        bSending;       // someone's sending
+        unsigned int                nSealed;
+        unsigned int                nSent;
+        unsigned int                nAcked;
+        unsigned long long          nItems;
+        unsigned long long          nBytes;
+        bplus::Object*              pSummary;
+        bool                        bEnding;
+        bool                        bClosed;
+        // Set while an ended stream waits to send its terminator.
+        std::tr1::shared_ptr<State> pSelf;
+        WritableFunc                pfnWritable;
+        void*                       pWritableCookie;
+    };
+
+    explicit ResultStream( const std::tr1::shared_ptr<State>& pState );
+
+    static Status   statusOf( const State& st );
+    bool            isClosed();
+    void            closeIfFinishedLocked();
+    bplus::Map*     newChunkLocked();
+    void            sealItemsLocked();
+    void            sealTextLocked( size_t nBytes );
+    void            pumpLocked();
+    void            dropLocked();
+    void            deliver();
+    void            notify( bool bWasPaused );
+
+    std::tr1::shared_ptr<State>     m_pState;
+
+    friend class ResultStreamTable;
+};
+
+
+//////////////////////////////////////////////////////////////////////
+// ResultStreamTable
+//
+// The open streams of a service instance, so a method the client calls
+// to acknowledge chunks can find the stream they came from:
+//
+//     void ack( const Transaction& tran, const bplus::Map& args )
+//     {
+//         m_streams.acknowledge( (long long) *args.value( "stream" ),
+//                                (long long) *args.value( "seq" ) );
+//         tran.complete( bplus::Null() );
+//     }
+//
+// The table doesn't keep streams alive: one its producer abandons
+// still fails its transaction.  Closed and abandoned streams, and those
+// whose transactions finished otherwise, are dropped as others are
+// added.
+//
+class ResultStreamTable
+{
+public:
+    void            add( const ResultStream& stream );
+
+    // False if no open stream has the id.
+    bool            acknowledge( unsigned int id, unsigned int seq );
+
+private:
+    typedef std::tr1::weak_ptr<ResultStream::State>     tStateRef;
+
+    bplus::sync::Mutex                  m_mutex;
+    std::map<unsigned int, tStateRef>   m_streams;
+};
+
+
+//////////////////////////////////////////////////////////////////////
+// Implementation
+
+inline
+ResultStream::State::State( const Transaction& t, const bplus::Object& c,
+                            const Options& o ) :
+    tran( t ),
+    cb( t, c ),
+    opts( o ),
+    pItems( NULL ),
+    nTextOffset( 0 ),
+    bSending( false ),
+    nSealed( 0 ),
+    nSent( 0 ),
+    nAcked( 0 ),
+    nItems( 0 ),
+    nBytes( 0 ),
+    pSummary( NULL ),
+    bEnding( false ),
+    bClosed( false ),
+    pfnWritable( NULL ),
+    pWritableCookie( NULL )
+{
+    if (opts.maxChunkItems == 0) opts.maxChunkItems = 1;
+    // room for the longest UTF-8 character
+    if (opts.maxChunkBytes < 4) opts.maxChunkBytes = 4;
+}
+
+
+// Every handle is gone, so nobody is sending and the outbox is empty.
+// An ended stream holds a handle to itself until closed, so !bClosed
+// here means the producer never called end() (nor finished the
+// transaction itself).
+inline
+ResultStream::State::~State()
+{
+    if (!bClosed && !tran.isFinished()) {
+        tran.error( BPE_INTERNAL_ERROR, "result stream abandoned" );
+    }
+    delete pItems;
+    for (size_t i = 0; i < ready.size(); i++) delete ready[i];
+    delete pSummary;
+}
+
+
+inline
+ResultStream::ResultStream( const Transaction& tran, const bplus::Object& cb,
+                            const Options& options ) :
+    m_pState( new State( tran, cb, options ) )
+{
+}
+
+
+inline
+ResultStream::ResultStream( const std::tr1::shared_ptr<State>& pState ) :
+    m_pState( pState )
+{
+}
+
+
+inline unsigned int
+ResultStream::id() const
+{
+    return m_pState->tran.tid();
+}
+
+
+inline ResultStream::Status
+ResultStream::append( const bplus::Object& item )
+{
+    return append( item.clone() );
+}
+
+
+inline ResultStream::Status
+ResultStream::append( bplus::Object* pItem )
+{
+    State& st = *m_pState;
+    {
+        bplus::sync::Lock lock( st.mutex );
+        closeIfFinishedLocked();
+        if (statusOf( st ) == Closed) {
+            delete pItem;
+            return Closed;
+        }
+        if (!st.sText.empty()) sealTextLocked( st.sText.size() );
+        if (!st.pItems) st.pItems = new bplus::List;
+        st.pItems->append( pItem );
+        st.nItems++;
+        if (st.pItems->size() < st.opts.maxChunkItems) return statusOf( st );
+        sealItemsLocked();
+        pumpLocked();
+    }
+    deliver();
+    return status();
+}
+
+
+inline ResultStream::Status
+ResultStream::write( const char* pData, size_t nBytes )
+{
+    State& st = *m_pState;
+    {
+        bplus::sync::Lock lock( st.mutex );
+        closeIfFinishedLocked();
+        if (statusOf( st ) == Closed) return Closed;
+        if (st.pItems) sealItemsLocked();
+        st.sText.append( pData, nBytes );
+        st.nBytes += nBytes;
+        if (st.sText.size() < st.opts.maxChunkBytes) return statusOf( st );
+
+        while (st.sText.size() >= st.opts.maxChunkBytes) {
+            // back up to the start of a character
+            size_t n = st.opts.maxChunkBytes;
+            while (n > 0 && (st.sText[n] & 0xC0) == 0x80) n--;
+            if (n == 0) n = st.opts.maxChunkBytes;
+            sealTextLocked( n );
+        }
+        pumpLocked();
+    }
+    deliver();
+    return status();
+}
+
+
+inline ResultStream::Status
+ResultStream::write( const std::string& s )
+{
+    return write( s.data(), s.size() );
+}
+
+
+inline ResultStream::Status
+ResultStream::flush()
+{
+    State& st = *m_pState;
+    {
+        bplus::sync::Lock lock( st.mutex );
+        closeIfFinishedLocked();
+        if (statusOf( st ) == Closed) return Closed;
+        if (st.pItems) sealItemsLocked();
+        if (!st.sText.empty()) sealTextLocked( st.sText.size() );
+        pumpLocked();
+    }
+    deliver();
+    return status();
+}
+
+
+inline bool
+ResultStream::end( const bplus::Object* pSummary )
+{
+    State& st = *m_pState;
+    bool bWasPaused;
+    {
+        bplus::sync::Lock lock( st.mutex );
+        closeIfFinishedLocked();
+        Status s = statusOf( st );
+        if (s == Closed) return false;
+        bWasPaused = s == Paused;
+        if (st.pItems) sealItemsLocked();
+        if (!st.sText.empty()) sealTextLocked( st.sText.size() );
+        st.pSummary = pSummary ? pSummary->clone() : NULL;
+        st.bEnding = true;
+        pumpLocked();
+        // the terminator waits for acks: outlive the producer's handle
+        if (!st.bClosed) st.pSelf = m_pState;
+    }
+    deliver();
+    // producers waiting for room learn the stream is closed
+    notify( bWasPaused );
+    return true;
+}
+
+
+inline void
+ResultStream::fail( const char* szError, const char* szVerboseError )
+{
+    State& st = *m_pState;
+    bool bWasPaused;
+    {
+        bplus::sync::Lock lock( st.mutex );
+        if (st.bClosed) return;
+        bWasPaused = statusOf( st ) == Paused;
+        dropLocked();
+
+        // after any chunk already being sent
+        Outgoing out;
+        out.end.setError( szError, szVerboseError );
+        st.outbox.push_back( out );
+    }
+    deliver();
+    notify( bWasPaused );
+}
+
+
+inline ResultStream::Status
+ResultStream::status() const
+{
+    bplus::sync::Lock lock( m_pState->mutex );
+    return statusOf( *m_pState );
+}
+
+
+inline void
+ResultStream::acknowledge( unsigned int seq )
+{
+    State& st = *m_pState;
+    bool bWasPaused;
+    {
+        bplus::sync::Lock lock( st.mutex );
+        closeIfFinishedLocked();
+        if (st.nSent == 0 || seq + 1 <= st.nAcked) return;
+        bWasPaused = statusOf( st ) == Paused;
+        if (seq >= st.nSent) seq = st.nSent - 1;
+        st.nAcked = seq + 1;
+        pumpLocked();
+    }
+    deliver();
+    notify( bWasPaused );
+}
+
+
+inline ResultStream::Status
+ResultStream::waitWritable( unsigned int msec )
+{
+    State& st = *m_pState;
+    unsigned long long deadline =
+        bplus::timeutil::monotonicMicros() + msec * 1000ULL;
+    bplus::sync::Lock lock( st.mutex );
+    Status s;
+    while ((s = statusOf( st )) == Paused) {
+        if (!st.cond.waitUntil( &st.mutex, deadline )
+            && bplus::timeutil::monotonicMicros() >= deadline)
+        {
+            break;
+        }
+    }
+    return s;
+}
+
+
+inline void
+ResultStream::onWritable( WritableFunc fn, void* cookie )
+{
+    State& st = *m_pState;
+    {
+        bplus::sync::Lock lock( st.mutex );
+        if (statusOf( st ) == Paused) {
+            st.pfnWritable = fn;
+            st.pWritableCookie = cookie;
+            return;
+        }
+    }
+    fn( cookie );
+}
+
+
+inline ResultStream::Status
+ResultStream::statusOf( const State& st )
+{
+    if (st.bClosed || st.bEnding || st.tran.isFinished()) return Closed;
+    if (!st.ready.empty()) return Paused;
+    if (st.opts.window && st.nSent - st.nAcked >= st.opts.window) {
+        return Paused;
+    }
+    return Open;
+}
+
+
+// Closed for good, as opposed to merely not accepting data: an ending
+// stream still takes acks.
+inline bool
+ResultStream::isClosed()
+{
+    bplus::sync::Lock lock( m_pState->mutex );
+    closeIfFinishedLocked();
+    return m_pState->bClosed;
+}
+
+
+// A transaction finished by other means (its deadline, say) lets go of
+// what's buffered.
+inline void
+ResultStream::closeIfFinishedLocked()
+{
+    State& st = *m_pState;
+    if (!st.bClosed && st.tran.isFinished()) dropLocked();
+}
+
+
+inline bplus::Map*
+ResultStream::newChunkLocked()
+{
+    State& st = *m_pState;
+    bplus::Map* pChunk = new bplus::Map;
+    pChunk->add( "stream", new bplus::Integer( st.tran.tid() ) );
+    pChunk->add( "seq", new bplus::Integer( st.nSealed++ ) );
+    return pChunk;
+}
+
+
+inline void
+ResultStream::sealItemsLocked()
+{
+    State& st = *m_pState;
+    bplus::Map* pChunk = newChunkLocked();
+    pChunk->add( "items", st.pItems );
+    st.pItems = NULL;
+    st.ready.push_back( pChunk );
+}
+
+
+inline void
+ResultStream::sealTextLocked( size_t nBytes )
+{
+    State& st = *m_pState;
+    bplus::Map* pChunk = newChunkLocked();
+    pChunk->add( "offset", new bplus::Integer( (BPInteger) st.nTextOffset ) );
+    pChunk->add( "data", new bplus::String( st.sText.data(),
+                                            (unsigned int) nBytes ) );
+    st.sText.erase( 0, nBytes );
+    st.nTextOffset += nBytes;
+    st.ready.push_back( pChunk );
+}
+
+
+// Clear the chunks the window allows for sending, then the terminator
+// once everything has gone.
+inline void
+ResultStream::pumpLocked()
+{
+    State& st = *m_pState;
+    if (st.bClosed) return;
+    while (!st.ready.empty()
+           && (!st.opts.window || st.nSent - st.nAcked < st.opts.window))
+    {
+        Outgoing out;
+        out.pChunk = st.ready.front();
+        st.ready.pop_front();
+        st.outbox.push_back( out );
+        st.nSent++;
+    }
+
+    if (st.bEnding && st.ready.empty()) {
+        bplus::Map* pEnd = new bplus::Map;
+        pEnd->add( "stream", new bplus::Integer( st.tran.tid() ) );
+        pEnd->add( "chunks", new bplus::Integer( st.nSent ) );
+        pEnd->add( "items", new bplus::Integer( (BPInteger) st.nItems ) );
+        pEnd->add( "bytes", new bplus::Integer( (BPInteger) st.nBytes ) );
+        if (st.pSummary) {
+            pEnd->add( "summary", st.pSummary );
+            st.pSummary = NULL;
+        }
+        Outgoing out;
+        out.end.pResult = pEnd;
+        st.outbox.push_back( out );
+        st.bClosed = true;
+        // our caller's handle keeps the state alive past this
+        st.pSelf.reset();
+    }
+}
+
+
+inline void
+ResultStream::dropLocked()
+{
+    State& st = *m_pState;
+    delete st.pItems;
+    st.pItems = NULL;
+    st.sText.clear();
+    for (size_t i = 0; i < st.ready.size(); i++) delete st.ready[i];
+    st.ready.clear();
+    for (size_t i = 0; i < st.outbox.size(); i++) {
+        delete st.outbox[i].pChunk;
+        delete st.outbox[i].end.pResult;
+    }
+    st.outbox.clear();
+    delete st.pSummary;
+    st.pSummary = NULL;
+    st.bClosed = true;
+    st.pSelf.reset();
+}
+
+
+// Hand the outbox to the core, unlocked.  One thread sends at a time,
+// keeping chunks in order; others just leave theirs in the outbox for
+// it to pick up.
+inline void
+ResultStream::deliver()
+{
+    State& st = *m_pState;
+    std::deque<Outgoing> batch;
+    st.mutex.lock();
+    if (st.bSending) {
+        st.mutex.unlock();
+        return;
+    }
+    st.bSending = true;
+    while (!st.outbox.empty()) {
+        batch.swap( st.outbox );
+        st.mutex.unlock();
+        for (size_t i = 0; i < batch.size(); i++) {
+            Outgoing& out = batch[i];
+            // once finished elsewhere, a second answer would reach the
+            // core
+            if (!st.tran.isFinished()) {
+                if (out.pChunk) st.cb.invoke( *out.pChunk );
+                else out.end.post( st.tran );
+            }
+            delete out.pChunk;
+            delete out.end.pResult;
+        }
+        batch.clear();
+        st.mutex.lock();
+    }
+    st.bSending = false;
+    st.mutex.unlock();
+}
+
+
+// Wake producers if the stream has stopped being Paused.
+inline void
+ResultStream::notify( bool bWasPaused )
+{
+    State& st = *m_pState;
+    WritableFunc fn = NULL;
+    void* cookie = NULL;
+    {
+        bplus::sync::Lock lock( st.mutex );
+        if (!bWasPaused || statusOf( st ) == Paused) return;
+        st.cond.broadcast();
+        fn = st.pfnWritable;
+        cookie = st.pWritableCookie;
+        st.pfnWritable = NULL;
+    }
+    if (fn) fn( cookie );
+}
+
+
+inline void
+ResultStreamTable::add( const ResultStream& stream )
+{
+    // released after the lock, in case one is the last copy
+    std::vector<std::tr1::shared_ptr<ResultStream::State> > live;
+    bplus::sync::Lock lock( m_mutex );
+    std::map<unsigned int, tStateRef>::iterator it = m_streams.begin();
+    while (it != m_streams.end()) {
+        live.push_back( it->second.lock() );
+        if (!live.back() || ResultStream( live.back() ).isClosed()) {
+            m_streams.erase( it++ );
+        } else {
+            ++it;
+        }
+    }
+    m_streams[stream.id()] = stream.m_pState;
+}
+
+
+inline bool
+ResultStreamTable::acknowledge( unsigned int id, unsigned int seq )
+{
+    std::tr1::shared_ptr<ResultStream::State> pState;
+    {
+        bplus::sync::Lock lock( m_mutex );
+        std::map<unsigned int, tStateRef>::iterator it = m_streams.find( id );
+        if (it == m_streams.end()) return false;
+        pState = it->second.lock();
+        if (!pState) {
+            m_streams.erase( it );
+            return false;
+        }
+    }
+    // should the producer let go meanwhile, this last copy abandons the
+    // stream -- outside the table's lock
+    ResultStream stream( pState );
+    pState.reset();
+    if (stream.isClosed()) return false;
+    stream.acknowledge( seq );
+    return true;
+}
+
+
+} // service
+} // bplus
+
+
+#endif // BPRESULTSTREAM_H_
@@ -30,10 +30,22 @@
 #ifndef BPSERVICE_H_
 #define BPSERVICE_H_
 
+#include <map>
+#include <string>
 #include "bpserviceapi/bppfunctions.h"
+#include "bpallocaccounting.h"
+#include "bpasynclog.h"
+#include "bpbinarylog.h"
+#include "bpinvocationtrace.h"
 #include "bpservicedescription.h"
+#include "bpstaticdescription.h"
 #include "bptransaction.h"
+#include "bputil/bpjson.h"
 #include "bputil/bppathstring.h"
+#include "bputil/bpthreadpool.h"
+#include "bputil/bptimerwheel.h"
+#include "bputil/bporiginpolicy.h"
+#include "bputil/bpurl.h"
 
 namespace bplus {
 namespace service {
@@ -57,7 +69,7 @@ class Service
 // Construction/Destruction    
 public:
     // ctor
-    Service() {}
+    Service() : m_nInstanceId( 0 ) {}
 
     // Additional initialization.
     // This method is called immediately after the instance has been
@@ -76,20 +88,157 @@ public:
     static void         log( unsigned int level,
                              const std::string& sLog );
 
+    // printf-style logging of up to six arguments.  Messages below the
+    // log level are discarded before anything is formatted.  With async
+    // logging on, the arguments are captured (strings copied) and
+    // formatting happens on the logging thread, so fmt must outlive the
+    // service -- use a string literal.
+    static void         logf( unsigned int level, const char* fmt );
+    template <class A1>
+    static void         logf( unsigned int level, const char* fmt,
+                              const A1& a1 );
+    template <class A1, class A2>
+    static void         logf( unsigned int level, const char* fmt,
+                              const A1& a1, const A2& a2 );
+    template <class A1, class A2, class A3>
+    static void         logf( unsigned int level, const char* fmt,
+                              const A1& a1, const A2& a2, const A3& a3 );
+    template <class A1, class A2, class A3, class A4>
+    static void         logf( unsigned int level, const char* fmt,
+                              const A1& a1, const A2& a2, const A3& a3,
+                              const A4& a4 );
+    template <class A1, class A2, class A3, class A4, class A5>
+    static void         logf( unsigned int level, const char* fmt,
+                              const A1& a1, const A2& a2, const A3& a3,
+                              const A4& a4, const A5& a5 );
+    template <class A1, class A2, class A3, class A4, class A5, class A6>
+    static void         logf( unsigned int level, const char* fmt,
+                              const A1& a1, const A2& a2, const A3& a3,
+                              const A4& a4, const A5& a5, const A6& a6 );
+
+    // Messages below level are dropped by log() and logf() before any
+    // work is done.  Defaults to BP_DEBUG, i.e. everything.
+    static void         setLogLevel( unsigned int level );
+    static bool         isLogEnabled( unsigned int level );
+
+    // Send log() and logf() output through an AsyncLog: callers only
+    // copy their arguments into a per-thread ring, and a background
+    // thread formats and forwards to the core.  Full rings drop messages
+    // (counted, and reported in the log).  Queued messages are flushed
+    // once onShutdown() has returned.  Typically called from
+    // onInitialize().
+    static bool         enableAsyncLog( size_t nRingBytes = 64 * 1024 );
+
+    // The AsyncLog in use, or NULL.
+    static AsyncLog*    asyncLog();
+
+    // Send blog() output to a BinaryLog writing segment files
+    // sPathPrefix.0.bplog, sPathPrefix.1.bplog, ...  Decode them with
+    // the bplogdecode tool.  The log is closed once onShutdown() has
+    // returned.  Returns true if a binary log is already open.
+    // Typically called from finalConstruct() with a prefix under
+    // tempDir(); later calls are no-ops.
+    static bool         openBinaryLog( const bplus::tPathString& sPathPrefix,
+                                       size_t nSegmentBytes = 8 * 1024 * 1024,
+                                       unsigned int nMaxSegments = 8 );
+
+    // The BinaryLog in use, or NULL.
+    static BinaryLog*   binaryLog();
+
+    // Record every call from here on, with how it ended, to an
+    // InvocationTrace at sPath, for replay with the bpreplay tool.  The
+    // trace is closed once onShutdown() has returned.  Returns true if
+    // a trace is already being recorded.  Typically called from
+    // finalConstruct() with a path under tempDir(); later calls are
+    // no-ops.
+    static bool         enableInvocationTrace(
+                            const bplus::tPathString& sPath );
+
+    // The InvocationTrace in use, or NULL.
+    static InvocationTrace* invocationTrace();
+
+    // Count the heap allocations each call makes, by method and stage,
+    // and follow each instance's live bytes (see bpallocaccounting.h).
+    // Needs BP_COUNT_ALLOCATIONS (bputil/bpalloccount.h) expanded in one
+    // of the service's source files; returns false without it.  Stats
+    // are logged once onShutdown() has returned.  Typically called from
+    // onInitialize().
+    static bool         enableAllocAccounting();
+
+    // The AllocAccounting in use, or NULL.
+    static AllocAccounting* allocAccounting();
+
     // Returns service name in the form: "name version".
     static std::string  fullName();
 
+    // A work-stealing thread pool shared by all instances, created on
+    // first use with one worker per hardware core.  It is shut down,
+    // after running any queued work, once onShutdown() has returned.
+    static bplus::thread::Pool& threadPool();
+
+    // A timer wheel shared by all instances, started on first use.
+    // Use it for transaction deadlines (Transaction::setDeadline) and
+    // scheduled callbacks.  It is stopped once onShutdown() has
+    // returned, discarding timers that have not fired.
+    static bplus::thread::TimerWheel& timers();
+
+    // When enabled, every string argument (map keys included) is
+    // checked for well-formed UTF-8 before invoke() is called, and
+    // calls carrying bad strings fail with BPE_INVALID_PARAMETERS.
+    // Off by default.  Typically set from onInitialize().
+    static void         setValidateUtf8( bool bValidate );
+
+    // Origin rules checked against clientOrigin() in bppInvoke, before
+    // arguments are decoded.  Rejected calls fail with
+    // BPE_PERMISSION_DENIED.  originPolicy() applies to every method and
+    // originPolicy( "name" ) additionally to the named one.  Set them up
+    // in onInitialize(), or with ALLOW_BP_METHOD_ORIGIN and
+    // DENY_BP_METHOD_ORIGIN alongside ADD_BP_METHOD; they must not
+    // change once calls are arriving.
+    static bplus::url::OriginPolicy& originPolicy(
+                                        const char* cszFuncName = NULL );
+
 // Methods to access intance-specific attributes
 // Note: Do not call these from constructor of classes derived from
 //       this class - use finalConstruct for that purpose.
 public:
     const std::string&         clientUri();
+    // The normalized origin of clientUri(), invalid if it doesn't parse.
+    // Parsed results are shared by all instances.
+    const bplus::url::Origin&  clientOrigin();
     const bplus::tPathString&  serviceDir();
     const bplus::tPathString&  dataDir();
     const bplus::tPathString&  tempDir();
     const std::string&         locale();
     const std::string&         userAgent();
     int                        clientPid();
+    // A small number identifying this instance in binary log records,
+    // unique for the life of the process.
+    unsigned int               instanceId();
+
+    // Log at a site declared with BP_LOG_SITE, with up to six arguments.
+    // With a binary log open (openBinaryLog()) the arguments are
+    // recorded raw, tagged with the site, thread and instanceId(), and
+    // formatted only when decoded; otherwise this behaves as logf() with
+    // the site's level and format.
+    void            blog( LogSite& site );
+    template <class A1>
+    void            blog( LogSite& site, const A1& a1 );
+    template <class A1, class A2>
+    void            blog( LogSite& site, const A1& a1, const A2& a2 );
+    template <class A1, class A2, class A3>
+    void            blog( LogSite& site, const A1& a1, const A2& a2,
+                          const A3& a3 );
+    template <class A1, class A2, class A3, class A4>
+    void            blog( LogSite& site, const A1& a1, const A2& a2,
+                          const A3& a3, const A4& a4 );
+    template <class A1, class A2, class A3, class A4, class A5>
+    void            blog( LogSite& site, const A1& a1, const A2& a2,
+                          const A3& a3, const A4& a4, const A5& a5 );
+    template <class A1, class A2, class A3, class A4, class A5, class A6>
+    void            blog( LogSite& site, const A1& a1, const A2& a2,
+                          const A3& a3, const A4& a4, const A5& a5,
+                          const A6& a6 );
 
 // Overridable Methods
 protected:
@@ -132,6 +281,14 @@ private:
                                unsigned int tid,
                                const BPElement* pArgs );
 
+    // The call itself, its stages counted into *pInv if pInv is set.
+    static void     dispatch( Service* pInst,
+                              const char* cszFuncName,
+                              unsigned int tid,
+                              const BPElement* pArgs,
+                              const BPCFunctionTable* pFuncs,
+                              AllocAccounting::Invocation* pInv );
+
     static void     bppCancel(void* instance, unsigned int tid);
 
     static int      bppInstall(const BPPath serviceDir, const BPPath dataDir);
@@ -139,6 +296,38 @@ private:
     static int      bppUninstall(const BPPath serviceDir, const BPPath dataDir);
     
     static void     setupDescription();
+
+    // Fill s_description from a static definition, once, for whoever
+    // asks first.
+    static void     expandDescription();
+
+    static void     tracePostResults( unsigned int tid,
+                                      const BPElement* pResults );
+    static void     tracePostError( unsigned int tid, const char* cszError,
+                                    const char* cszVerbose );
+    static void     traceInvokeCallback( unsigned int tid, BPCallBack cb,
+                                         const BPElement* pParams );
+
+    static void     writeLog( unsigned int level, const char* fmt,
+                              const bplus::logging::Arg* args,
+                              unsigned int nArgs );
+
+    void            writeBinaryLog( LogSite& site,
+                                    const bplus::logging::Arg* args,
+                                    unsigned int nArgs );
+
+    static bool     isOriginAllowed( const bplus::url::Origin& origin,
+                                     const char* cszFuncName );
+
+    // Returns the constant definition of a service declared with
+    // BP_STATIC_SERVICE_DESC, or NULL for one declared with
+    // BP_SERVICE_DESC.
+    static const BPServiceDefinition* staticDefinition();
+
+    // For a BP_STATIC_SERVICE_DESC service, the first dispatch entry
+    // that doesn't name the function described in its place (see
+    // mismatchedStaticMethod), else NULL.
+    static const char*  staticDispatchMismatch();
     
     static Service* createInstance();
 
@@ -163,6 +352,20 @@ protected:
     static bplus::tPathString       s_dependentDir;
     static bplus::Object*           s_pDependentParams;
     static Description              s_description;
+    static volatile long            s_nDescriptionState;
+    static bplus::thread::Pool*     s_pThreadPool;
+    static bplus::thread::TimerWheel* s_pTimerWheel;
+    static bool                     s_bValidateUtf8;
+    static volatile long            s_nLogLevel;
+    static AsyncLog*                s_pAsyncLog;
+    static BinaryLog*               s_pBinaryLog;
+    static InvocationTrace*         s_pInvocationTrace;
+    static AllocAccounting*         s_pAllocAccounting;
+    // s_pCoreFuncs, with posts recorded to s_pInvocationTrace first.
+    static BPCFunctionTable         s_tracingCoreFuncs;
+    static bplus::url::OriginCache  s_originCache;
+    static bplus::url::OriginPolicy s_originPolicy;
+    static bplus::url::OriginPolicyTable s_methodOriginPolicies;
 
 // Internal Methods
 private:
@@ -173,12 +376,14 @@ private:
 // Instance-specific State    
 private:    
     std::string            m_clientUri;
+    bplus::url::Origin     m_clientOrigin;
     bplus::tPathString     m_serviceDir;
     bplus::tPathString     m_dataDir;
     bplus::tPathString     m_tempDir;
     std::string            m_locale;
     std::string            m_userAgent;
     int                    m_clientPid;
+    unsigned int           m_nInstanceId;
     
 // Prevent copying
 private:
@@ -31,6 +31,7 @@
 
 #include <list>
 #include <map>
+#include <vector>
 
 #include "bputil/bpsemanticversion.h"
 #include "bputil/bptypeutil.h"
@@ -43,6 +44,40 @@ namespace bplus {
 namespace service {
 
 
+/**
+ * an open addressed hash index from names to positions in a vector
+ * of named elements (anything with a name() accessor).  Lookups do
+ * not allocate.  When a name is inserted more than once, the first
+ * position wins.
+ */
+class NameIndex
+{
+public:
+    NameIndex();
+
+    void clear();
+
+    /** index element 'ix' of 'items' by its name */
+    template <class T>
+    void insert(const std::vector<T> & items, unsigned int ix);
+
+    /** re-index all of 'items' */
+    template <class T>
+    void rebuild(const std::vector<T> & items);
+
+    /** position of the element named 'name' in 'items', or -1 */
+    template <class T>
+    int find(const std::vector<T> & items, const char * name) const;
+
+    static unsigned int hash(const char * name);
+
+private:
+    // 0 means empty, otherwise position + 1.
+    std::vector<unsigned int> m_slots;
+    unsigned int m_count;
+};
+
+
 /**
  * an in memory representation of an argument to a function on a service
  */ 
@@ -68,7 +103,7 @@ public:
     Argument(const char * name, Type type);
     ~Argument();
 
-    std::string name() const;
+    const std::string & name() const;
     void setName(const char * name);
 
     Type type() const;
@@ -83,7 +118,7 @@ public:
     bool required() const;
     void setRequired(bool required);
 
-    std::string docString() const;
+    const std::string & docString() const;
     void setDocString(const char * docString);    
 
     /** re-initialize the class */
@@ -97,7 +132,7 @@ public:
      * that will not change until toBPServiceDefinition is called again,
      * or the instance is deleted.
      */
-    void toBPArgumentDefinition(BPArgumentDefinition * argDef);
+    void toBPArgumentDefinition(BPArgumentDefinition * argDef) const;
 
 private:
     std::string m_name;    
@@ -117,15 +152,21 @@ public:
     Function & operator=(const Function & f);
     ~Function();    
 
-    std::string name() const;
+    const std::string & name() const;
     void setName(const char * name);
 
-    std::list<Argument> arguments() const;
+    /** arguments in declaration order */
+    const std::vector<Argument> & arguments() const;
+    void setArguments(const std::vector<Argument> & arguments);    
     void setArguments(const std::list<Argument> & arguments);    
     void addArgument(const Argument& argument);
     bool getArgument(const char * name, Argument & oArg) const;
 
-    std::string docString() const;
+    /** get pointer to the named argument, or NULL if not found.
+     *  The pointer is valid until the argument list is modified. */
+    const Argument * argument(const char * name) const;
+
+    const std::string & docString() const;
     void setDocString(const char * docString);    
 
     /** re-initialize the class */
@@ -144,7 +185,8 @@ public:
 private:
     std::string m_name;
     std::string m_docString;    
-    std::list<Argument> m_arguments;
+    std::vector<Argument> m_arguments;
+    NameIndex m_argIndex;
 
     BPArgumentDefinition * m_adefs;
 };
@@ -160,7 +202,7 @@ public:
     Description & operator=(const Description & f);
     ~Description();    
 
-    std::string name() const;
+    const std::string & name() const;
     void setName(const char * name);
 
     /** get a string representation of major, minor, and
@@ -189,10 +231,12 @@ public:
     /** set service micro version */
     void setMicroVersion(int microVersion);    
 
-    std::string docString() const;
+    const std::string & docString() const;
     void setDocString(const char * docString);    
 
-    std::list<Function> functions() const;
+    /** functions in declaration order */
+    const std::vector<Function> & functions() const;
+    void setFunctions(const std::vector<Function> & functions);    
     void setFunctions(const std::list<Function> & functions);    
 
     /** add a function to the current list */
@@ -203,7 +247,8 @@ public:
     /** get the function description */
     bool getFunction(const char * funcName, Function & oFunc) const;
 
-    /** get pointer to requested function or 0 if not found */
+    /** get pointer to requested function or 0 if not found.
+     *  The pointer is valid until the function list is modified. */
     Function* getFunction(const char * funcName ) const;
 
     /** generate a bp::Object representation of the service description.
@@ -225,9 +270,18 @@ public:
      * interface.  This pointer will point to memory managed by this class,
      * that will not change until toBPServiceDefinition is called again,
      * or the instance is deleted.
+     *
+     * The definition is laid out in a single contiguous block: the
+     * BPServiceDefinition header, then the function table, then all
+     * argument tables, then a pool holding every string.  All internal
+     * pointers refer into that block, see relocateBPServiceDefinition().
      */
     const BPServiceDefinition * toBPServiceDefinition(void);
 
+    /** size in bytes of the block last generated by
+     *  toBPServiceDefinition, or 0 if none has been generated */
+    size_t definitionSize() const;
+
     /** Does this service description describe a built in service? */
     bool isBuiltIn() const;
     void setIsBuiltIn(bool isBuiltIn);
@@ -242,16 +296,29 @@ private:
     std::string             m_name;
     SemanticVersion         m_version;
     std::string             m_docString;
-    std::list<Function>     m_functions;
+    std::vector<Function>   m_functions;
+    NameIndex               m_funcIndex;
     
     // true for built in services, added using the
     // ServiceRegistry::registerService() call
     bool m_builtIn;
 
     BPServiceDefinition*    m_def;
+    size_t                  m_defSize;
     void freeDef();
 };
 
+/**
+ * fix up the internal pointers of a contiguous service definition
+ * (as generated by Description::toBPServiceDefinition) that has been
+ * byte-copied from 'from' to 'to'.  Both blocks must be the same size.
+ * After relocation the copy is self-contained and may be hashed,
+ * compared with memcmp against another relocated copy at the same
+ * address, or cached independently of the originating Description.
+ */
+void relocateBPServiceDefinition(BPServiceDefinition * to,
+                                 const BPServiceDefinition * from);
+
 /**
  * validate arguments given a bp::Map containing arguments and a
  * function description describing a function's interface.
@@ -0,0 +1,124 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/**
+ * bpstaticdescription.h
+ *
+ * Support types for services which declare their interface with the
+ * BP_STATIC_SERVICE_DESC family of macros (see bpserviceimpl.h).
+ *
+ * Those macros expand to constant-initialized BPServiceDefinition,
+ * BPFunctionDefinition and BPArgumentDefinition tables plus a constant
+ * dispatch table, so loading the service does no work beyond handing
+ * the harness a pointer.
+ */
+
+#ifndef BPSTATICDESCRIPTION_H_
+#define BPSTATICDESCRIPTION_H_
+
+#include <string.h>
+
+#include "bpserviceapi/bpdefinition.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace service {
+
+class Transaction;
+
+
+/**
+ * One entry in a service's constant dispatch table.
+ * Tables are terminated by an entry with a NULL name.
+ */
+template <class T>
+struct StaticMethod
+{
+    typedef void (T::* tInvokableFunc)( const Transaction& tran,
+                                        const bplus::Map& args );
+
+    const char *    name;
+    tInvokableFunc  func;
+};
+
+
+/**
+ * find the named method in a NULL-name terminated dispatch table.
+ * returns NULL if not present.
+ */
+template <class T>
+inline const StaticMethod<T> *
+findStaticMethod( const StaticMethod<T> * table, const char * cszName )
+{
+    if (cszName == NULL) return NULL;
+    for (const StaticMethod<T> * p = table; p->name != NULL; p++) {
+        if (!strcmp(p->name, cszName)) return p;
+    }
+    return NULL;
+}
+
+
+/**
+ * check a dispatch table against the description's functions, entry
+ * by entry.  returns the first dispatch entry's name that differs from
+ * the function described at the same position (or "" for a missing
+ * entry), or NULL if the two agree.
+ */
+template <class T>
+inline const char *
+mismatchedStaticMethod( const StaticMethod<T> * table,
+                        const BPFunctionDefinition * funcs, size_t nFuncs )
+{
+    for (size_t i = 0; i < nFuncs; i++) {
+        if (table[i].name == NULL) return "";
+        if (strcmp(table[i].name, funcs[i].functionName)) {
+            return table[i].name;
+        }
+    }
+    return table[nFuncs].name;
+}
+
+
+} // service
+} // bplus
+
+
+// Map the Argument::Type names accepted by ADD_BP_METHOD_ARG onto
+// BPType values, so BP_STATIC_ARG can take the same spelling and still
+// produce a constant expression.  None collapses to Null, just as in
+// Argument::toBPArgumentDefinition().
+#define BP_STATIC_ARGTYPE_None          BPTNull
+#define BP_STATIC_ARGTYPE_Null          BPTNull
+#define BP_STATIC_ARGTYPE_Boolean       BPTBoolean
+#define BP_STATIC_ARGTYPE_Integer       BPTInteger
+#define BP_STATIC_ARGTYPE_Double        BPTDouble
+#define BP_STATIC_ARGTYPE_String        BPTString
+#define BP_STATIC_ARGTYPE_Map           BPTMap
+#define BP_STATIC_ARGTYPE_List          BPTList
+#define BP_STATIC_ARGTYPE_CallBack      BPTCallBack
+#define BP_STATIC_ARGTYPE_Path          BPTNativePath
+#define BP_STATIC_ARGTYPE_WritablePath  BPTWritableNativePath
+#define BP_STATIC_ARGTYPE_Any           BPTAny
+
+
+#endif // BPSTATICDESCRIPTION_H_
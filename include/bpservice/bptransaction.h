@@ -32,8 +32,10 @@
 
 #include "bputil/bppathstring.h"
 //#include "bputil/bpstrutil.h"
+#include "bputil/bptimerwheel.h"
 #include "bputil/bptypeutil.h"
 #include "bpserviceapi/bpcfunctions.h"
+#include "bpserviceapi/bperror.h"
 
 
 namespace bplus {
@@ -45,18 +47,33 @@ namespace service {
 //
 // Represents an active service transaction.
 //
+// Copies of a Transaction share their state.  The first of complete(),
+// error() or an expired deadline ends the transaction.  Once a deadline
+// has expired, later complete() and error() calls are dropped (and
+// logged) rather than answering the core twice.  Otherwise the guard
+// doesn't apply: a second complete() or error() still reaches the core,
+// as it always has, so double completions stay visible there.
+//
+// A Transaction that is never copied and never given a deadline -- the
+// usual synchronous call -- allocates nothing.
+//
 class Transaction
 {
 public:    
     // ctor
     Transaction( const BPCFunctionTable* pCoreFuncs, unsigned int tid );
+    Transaction( const Transaction& other );
+    Transaction& operator=( const Transaction& other );
+    ~Transaction();
 
 public:
     // End the transaction, indicating success, with the specified result.
+    // Dropped, with a warning logged, if the deadline has expired.
     void            complete( const bplus::Object& result ) const;
 
     // End the transaction, indicating failure.
     // Terse and verbose error descriptions may be provided.
+    // Dropped, with a warning logged, if the deadline has expired.
     void            error( const char* szError = 0,
                            const char* szVerboseError = 0 ) const;
 
@@ -73,10 +90,54 @@ public:
                                 const bplus::Object& args,
                                 BPUserResponseCallbackFuncPtr responseCallback,
                                 void* context );
-    
+
+    // Fail the transaction with BPE_TIMED_OUT if it has not ended
+    // within msec.  Replaces any earlier deadline.  Returns false if
+    // the transaction has already ended.
+    bool            setDeadline( bplus::thread::TimerWheel& wheel,
+                                 unsigned int msec ) const;
+
+    // True once the transaction has ended, by any means.
+    bool            isFinished() const;
+
+    // True if the transaction's deadline expired.  Long running work
+    // should check this and give up, its result would be dropped.
+    bool            isCancelled() const;
+
+    // The core's id for the transaction.
+    unsigned int    tid() const;
+
 private:
-    const BPCFunctionTable* m_pCoreFuncs;
-    unsigned int            m_nTid;
+    enum { kOpen, kFinished, kTimedOut, kShared };
+
+    // Made on the first copy or deadline; until then m_nState alone
+    // tracks the transaction.
+    struct State
+    {
+        explicit State( long n ) : nRefs( 1 ), nState( n ), pWheel( NULL ),
+                                   timer( 0 ), pTimerTran( NULL ) {}
+        volatile long               nRefs;
+        volatile long               nState;
+        bplus::sync::SpinLock       deadlineLock;
+        bplus::thread::TimerWheel*  pWheel;
+        bplus::thread::TimerId      timer;
+        Transaction*                pTimerTran;     // the timer's cookie
+    };
+
+    State*          sharedState() const;
+    State*          state() const;
+    long            currentState() const;
+    void            release();
+    bool            finish() const;
+    void            logDropped( const char* szWhat ) const;
+    void            cancelDeadline( State& st ) const;
+    static void     onDeadline( void* cookie );
+    static void     onDeadlineDiscarded( void* cookie );
+
+    const BPCFunctionTable*         m_pCoreFuncs;
+    unsigned int                    m_nTid;
+    mutable volatile long           m_nState;   // kShared once m_pState
+    mutable State* volatile         m_pState;   //   is being made
 };
 
 
@@ -84,15 +145,55 @@ inline
 Transaction::Transaction( const BPCFunctionTable* pCoreFuncs,
                           unsigned int tid ) :
 m_pCoreFuncs( pCoreFuncs ),
-m_nTid( tid )
+m_nTid( tid ),
+m_nState( kOpen ),
+m_pState( NULL )
+{
+}
+
+
+inline
+Transaction::Transaction( const Transaction& other ) :
+m_pCoreFuncs( other.m_pCoreFuncs ),
+m_nTid( other.m_nTid ),
+m_nState( kShared ),
+m_pState( other.sharedState() )
+{
+    bplus::sync::atomicAdd( &m_pState->nRefs, 1 );
+}
+
+
+inline Transaction&
+Transaction::operator=( const Transaction& other )
+{
+    if (this != &other) {
+        State* pState = other.sharedState();
+        bplus::sync::atomicAdd( &pState->nRefs, 1 );
+        release();
+        m_pCoreFuncs = other.m_pCoreFuncs;
+        m_nTid = other.m_nTid;
+        m_nState = kShared;
+        m_pState = pState;
+    }
+    return *this;
+}
+
+
+inline
+Transaction::~Transaction()
 {
+    release();
 }
 
 
 inline void
 Transaction::complete( const bplus::Object& oResult ) const
 {
-    m_pCoreFuncs->postResults( m_nTid, oResult.elemPtr() );
+    if (finish()) {
+        m_pCoreFuncs->postResults( m_nTid, oResult.elemPtr() );
+    } else {
+        logDropped( "result" );
+    }
 }
 
 
@@ -100,7 +201,11 @@ inline void
 Transaction::error( const char* szError,
                     const char* szVerboseError ) const
 {
-    m_pCoreFuncs->postError( m_nTid, szError, szVerboseError );
+    if (finish()) {
+        m_pCoreFuncs->postError( m_nTid, szError, szVerboseError );
+    } else {
+        logDropped( "error" );
+    }
 }
 
 
@@ -130,6 +235,194 @@ Transaction::promptUser( const bplus::tPathString& sPathToHTMLDialog,
 }
 
 
+inline bool
+Transaction::setDeadline( bplus::thread::TimerWheel& wheel,
+                          unsigned int msec ) const
+{
+    if (currentState() != kOpen) return false;
+    State& st = *sharedState();
+    bplus::sync::ScopedLock<bplus::sync::SpinLock> lock( st.deadlineLock );
+    if (bplus::sync::atomicLoad( &st.nState ) != kOpen) {
+        return false;
+    }
+    cancelDeadline( st );
+
+    // The timer holds its own copy, keeping our state alive until it
+    // either fires or is cancelled.
+    st.pTimerTran = new Transaction( *this );
+    st.pWheel = &wheel;
+    st.timer = wheel.schedule( msec, onDeadline, st.pTimerTran,
+                               onDeadlineDiscarded );
+    return true;
+}
+
+
+inline bool
+Transaction::isFinished() const
+{
+    return currentState() != kOpen;
+}
+
+
+inline bool
+Transaction::isCancelled() const
+{
+    return currentState() == kTimedOut;
+}
+
+
+inline unsigned int
+Transaction::tid() const
+{
+    return m_nTid;
+}
+
+
+// The shared state, made now if need be.  Whoever moves m_nState to
+// kShared makes it; anyone racing waits for it to appear.
+inline Transaction::State*
+Transaction::sharedState() const
+{
+    State* p = state();
+    if (p) return p;
+
+    long n = bplus::sync::atomicLoad( &m_nState );
+    while (n != kShared
+           && !bplus::sync::atomicCompareExchange( &m_nState, n, kShared ))
+    {
+        n = bplus::sync::atomicLoad( &m_nState );
+    }
+    if (n != kShared) {
+        p = new State( n );
+        bplus::sync::atomicStorePtr( (void* volatile*) &m_pState, p,
+                                     bplus::sync::MemoryOrderRelease );
+        return p;
+    }
+    for (unsigned int spins = 0; !(p = state()); spins++) {
+        if (spins < 64) bplus::sync::cpuRelax();
+        else bplus::thread::Thread::yield();
+    }
+    return p;
+}
+
+
+inline Transaction::State*
+Transaction::state() const
+{
+    return (State*) bplus::sync::atomicLoadPtr(
+        (void* const volatile*) &m_pState, bplus::sync::MemoryOrderAcquire );
+}
+
+
+inline long
+Transaction::currentState() const
+{
+    State* p = state();
+    if (!p) {
+        long n = bplus::sync::atomicLoad( &m_nState,
+                                          bplus::sync::MemoryOrderAcquire );
+        if (n != kShared) return n;
+        p = sharedState();
+    }
+    return bplus::sync::atomicLoad( &p->nState,
+                                    bplus::sync::MemoryOrderAcquire );
+}
+
+
+inline void
+Transaction::release()
+{
+    if (m_pState && bplus::sync::atomicAdd( &m_pState->nRefs, -1 ) == 0) {
+        delete m_pState;
+    }
+    m_pState = NULL;
+}
+
+
+// Mark the transaction finished.  Returns false only if its deadline
+// has already expired and answered the core.
+inline bool
+Transaction::finish() const
+{
+    // Nobody else can see a transaction without shared state, and
+    // without shared state there's no deadline.
+    if (!state()) {
+        if (bplus::sync::atomicCompareExchange( &m_nState, kOpen, kFinished )) {
+            return true;
+        }
+        if (bplus::sync::atomicLoad( &m_nState ) != kShared) return true;
+    }
+
+    State& st = *sharedState();
+    if (!bplus::sync::atomicCompareExchange( &st.nState, kOpen, kFinished )) {
+        return bplus::sync::atomicLoad( &st.nState ) != kTimedOut;
+    }
+    bplus::sync::ScopedLock<bplus::sync::SpinLock> lock( st.deadlineLock );
+    cancelDeadline( st );
+    return true;
+}
+
+
+inline void
+Transaction::logDropped( const char* szWhat ) const
+{
+    if (m_pCoreFuncs->log) {
+        m_pCoreFuncs->log( BP_WARN,
+                           "transaction %u: %s dropped, deadline expired",
+                           m_nTid, szWhat );
+    }
+}
+
+
+// Caller holds st.deadlineLock.
+inline void
+Transaction::cancelDeadline( State& st ) const
+{
+    if (!st.pWheel) return;
+    // If the timer is already running, onDeadline owns (and frees) its
+    // cookie.
+    if (st.pWheel->cancel( st.timer )) {
+        delete st.pTimerTran;
+    }
+    st.pWheel = NULL;
+    st.timer = 0;
+    st.pTimerTran = NULL;
+}
+
+
+inline void
+Transaction::onDeadline( void* cookie )
+{
+    Transaction* pTran = (Transaction*) cookie;
+    if (bplus::sync::atomicCompareExchange( &pTran->m_pState->nState,
+                                            kOpen, kTimedOut ))
+    {
+        pTran->m_pCoreFuncs->postError( pTran->m_nTid, BPE_TIMED_OUT,
+                                        "transaction deadline expired" );
+    }
+    delete pTran;
+}
+
+
+// The wheel stopped before the deadline came.  Forget the wheel, so a
+// later finish() doesn't reach for it, and release the timer's copy.
+inline void
+Transaction::onDeadlineDiscarded( void* cookie )
+{
+    Transaction* pTran = (Transaction*) cookie;
+    State& st = *pTran->m_pState;
+    {
+        bplus::sync::ScopedLock<bplus::sync::SpinLock> lock( st.deadlineLock );
+        if (st.pTimerTran == pTran) {
+            st.pWheel = NULL;
+            st.timer = 0;
+            st.pTimerTran = NULL;
+        }
+    }
+    delete pTran;
+}
+
+
 } // service
 } // bplus
 
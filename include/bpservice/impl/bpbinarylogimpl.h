@@ -0,0 +1,666 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpbinarylogimpl.h
+ *
+ *  Inline implementation file for bpbinarylog.h.
+ *
+ *  Note: This file is included by bpbinarylog.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPBINARYLOGIMPL_H_
+#define BPBINARYLOGIMPL_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#ifndef BP_THREAD_LOCAL
+#ifdef WIN32
+#define BP_THREAD_LOCAL __declspec(thread)
+#else
+#define BP_THREAD_LOCAL __thread
+#endif
+#endif
+
+
+namespace bplus {
+namespace service {
+namespace detail {
+
+
+inline size_t
+pad8( size_t n )
+{
+    return (n + 7) & ~(size_t) 7;
+}
+
+
+// Site ids and segment serials are unique across every BinaryLog in the
+// process, so a static LogSite can't confuse one log's segment with
+// another's.
+inline long
+nextBinaryLogSerial( bool bSite )
+{
+    static volatile long s_nSites = 0;
+    static volatile long s_nSegments = 0;
+    return bplus::sync::atomicAdd( bSite ? &s_nSites : &s_nSegments, 1 );
+}
+
+
+// A thread's id doesn't change, and fetching it is a system call.
+inline unsigned int
+currentThreadIdCached()
+{
+    static BP_THREAD_LOCAL unsigned int s_tid = 0;
+    if (!s_tid) s_tid = bplus::thread::Thread::currentThreadID();
+    return s_tid;
+}
+
+
+// Argument types packed into a LogSite's layout: the count plus one in
+// the low 4 bits, then 3 bits a type.  -1 when they don't fit.
+inline long
+argLayout( const bplus::logging::Arg* args, unsigned int nArgs )
+{
+    if (nArgs > 9) return -1;
+    long n = (long) nArgs + 1;
+    for (unsigned int i = 0; i < nArgs; i++) {
+        n |= (long) args[i].type << (4 + 3 * i);
+    }
+    return n;
+}
+
+
+inline unsigned int
+layoutArgs( long nLayout )
+{
+    return nLayout == -1 ? 0 : (unsigned int) (nLayout & 0xF) - 1;
+}
+
+
+inline unsigned char
+layoutType( long nLayout, unsigned int i )
+{
+    return (unsigned char) ((nLayout >> (4 + 3 * i)) & 7);
+}
+
+
+inline unsigned int
+currentProcessId()
+{
+#ifdef WIN32
+    return (unsigned int) GetCurrentProcessId();
+#else
+    return (unsigned int) getpid();
+#endif
+}
+
+
+inline bplus::tPathString
+segmentPath( const bplus::tPathString& sPrefix, unsigned int nIndex )
+{
+    char buf[32];
+    snprintf( buf, sizeof(buf), ".%u.bplog", nIndex );
+#ifdef WIN32
+    return sPrefix + bplus::strutil::utf8ToWide( buf );
+#else
+    return sPrefix + buf;
+#endif
+}
+
+
+} // detail
+
+
+////////////////////////////////////////////////////////////////////////////////
+// BinaryLog
+//
+
+inline
+BinaryLog::BinaryLog() :
+    m_nSegmentBytes( 0 ),
+    m_nMaxSegments( 0 )
+{
+}
+
+
+inline
+BinaryLog::~BinaryLog()
+{
+    close();
+}
+
+
+inline bool
+BinaryLog::open( const bplus::tPathString& sPathPrefix,
+                 size_t nSegmentBytes, unsigned int nMaxSegments )
+{
+    close();
+
+    // A segment must hold at least one large record, and reservations
+    // are made in a long.
+    if (nSegmentBytes < 64 * 1024) nSegmentBytes = 64 * 1024;
+    if (nSegmentBytes > 0x40000000) nSegmentBytes = 0x40000000;
+    if (nMaxSegments == 0) nMaxSegments = 1;
+
+    m_sPathPrefix = sPathPrefix;
+    m_nSegmentBytes = detail::pad8( nSegmentBytes );
+    m_nMaxSegments = nMaxSegments;
+    m_nRecords.store( 0 );
+    m_nBytes.store( 0 );
+    m_nDropped.store( 0 );
+
+    Segment* pSeg = openSegment( 0 );
+    if (!pSeg) return false;
+    m_segments.push_back( pSeg );
+    m_pCurrent.store( pSeg, bplus::sync::MemoryOrderRelease );
+    return true;
+}
+
+
+inline void
+BinaryLog::close()
+{
+    m_pCurrent.store( NULL );
+    bplus::sync::ScopedLock<bplus::sync::Mutex> lock( m_rotateLock );
+    for (size_t i = 0; i < m_segments.size(); i++) {
+        closeSegment( m_segments[i] );
+    }
+    m_segments.clear();
+}
+
+
+inline bool
+BinaryLog::isOpen() const
+{
+    bplus::sync::ScopedLock<bplus::sync::Mutex> lock(
+        const_cast<bplus::sync::Mutex&>( m_rotateLock ) );
+    return !m_segments.empty();
+}
+
+
+inline BinaryLog::Segment*
+BinaryLog::openSegment( unsigned int nIndex )
+{
+    bplus::tPathString sPath = detail::segmentPath( m_sPathPrefix, nIndex );
+    Segment* pSeg = new Segment;
+    pSeg->serial = detail::nextBinaryLogSerial( false );
+    pSeg->nCapacity = (long) m_nSegmentBytes;
+    pSeg->pBase = NULL;
+
+#ifdef WIN32
+    pSeg->hMapping = NULL;
+    pSeg->hFile = CreateFileW( sPath.c_str(), GENERIC_READ | GENERIC_WRITE,
+                               FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL, NULL );
+    if (pSeg->hFile != INVALID_HANDLE_VALUE) {
+        unsigned long long n = m_nSegmentBytes;
+        pSeg->hMapping = CreateFileMappingW( (HANDLE) pSeg->hFile, NULL,
+                                             PAGE_READWRITE,
+                                             (DWORD) (n >> 32),
+                                             (DWORD) n, NULL );
+        if (pSeg->hMapping) {
+            pSeg->pBase = (char*) MapViewOfFile( (HANDLE) pSeg->hMapping,
+                                                 FILE_MAP_WRITE, 0, 0,
+                                                 m_nSegmentBytes );
+        }
+    }
+#else
+    pSeg->fd = ::open( sPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600 );
+    if (pSeg->fd >= 0
+        && ftruncate( pSeg->fd, (off_t) m_nSegmentBytes ) == 0) {
+        void* p = mmap( NULL, m_nSegmentBytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, pSeg->fd, 0 );
+        if (p != MAP_FAILED) pSeg->pBase = (char*) p;
+    }
+#endif
+
+    if (!pSeg->pBase) {
+        pSeg->nUsed = 0;
+        closeSegment( pSeg );
+        return NULL;
+    }
+
+    // The file is zero filled, so every record after the last committed
+    // one reads as size 0.
+    FileHeader* pHdr = (FileHeader*) pSeg->pBase;
+    memcpy( pHdr->magic, "BPBLOG\0\0", 8 );
+    pHdr->version = s_version;
+    pHdr->headerSize = (unsigned int) detail::pad8( sizeof(FileHeader) );
+    pHdr->wallMicrosAtOpen = bplus::timeutil::wallClockMicros();
+    pHdr->monoMicrosAtOpen = bplus::timeutil::monotonicMicros();
+    pHdr->pid = detail::currentProcessId();
+    pHdr->segment = nIndex;
+    pSeg->nUsed = (long) pHdr->headerSize;
+    return pSeg;
+}
+
+
+inline void
+BinaryLog::closeSegment( Segment* pSeg )
+{
+    // Trim the unused, zero filled tail.
+    size_t nUsed = (size_t) pSeg->nUsed;
+    if (nUsed > (size_t) pSeg->nCapacity) nUsed = (size_t) pSeg->nCapacity;
+
+#ifdef WIN32
+    if (pSeg->pBase) UnmapViewOfFile( pSeg->pBase );
+    if (pSeg->hMapping) CloseHandle( (HANDLE) pSeg->hMapping );
+    if (pSeg->hFile != INVALID_HANDLE_VALUE) {
+        if (pSeg->pBase) {
+            LARGE_INTEGER li;
+            li.QuadPart = (LONGLONG) nUsed;
+            if (SetFilePointerEx( (HANDLE) pSeg->hFile, li, NULL,
+                                  FILE_BEGIN )) {
+                SetEndOfFile( (HANDLE) pSeg->hFile );
+            }
+        }
+        CloseHandle( (HANDLE) pSeg->hFile );
+    }
+#else
+    if (pSeg->pBase) {
+        munmap( pSeg->pBase, (size_t) pSeg->nCapacity );
+        if (ftruncate( pSeg->fd, (off_t) nUsed ) != 0) {
+            // leave the file full size; the reader stops at the
+            // first empty record either way
+        }
+    }
+    if (pSeg->fd >= 0) ::close( pSeg->fd );
+#endif
+
+    delete pSeg;
+}
+
+
+inline void
+BinaryLog::rotate( Segment* pFull )
+{
+    bplus::sync::ScopedLock<bplus::sync::Mutex> lock( m_rotateLock );
+
+    // Someone else may have rotated while we waited, or close() run.
+    if (m_pCurrent.load() != pFull || m_segments.empty()) return;
+
+    Segment* pNext = NULL;
+    if (m_segments.size() < m_nMaxSegments) {
+        pNext = openSegment( (unsigned int) m_segments.size() );
+    }
+    if (pNext) m_segments.push_back( pNext );
+
+    // Full segments stay mapped until close(): slower writers may still
+    // be copying into them.  With no next segment, further writes drop.
+    m_pCurrent.store( pNext, bplus::sync::MemoryOrderRelease );
+}
+
+
+inline long
+BinaryLog::siteId( LogSite& site )
+{
+    long id = bplus::sync::atomicLoad( &site.id,
+                                       bplus::sync::MemoryOrderAcquire );
+    if (id) return id;
+
+    // Racing threads may both draw a number; the first to publish wins
+    // and the other number is simply never used.
+    long nNew = detail::nextBinaryLogSerial( true );
+    if (bplus::sync::atomicCompareExchange( &site.id, 0, nNew )) return nNew;
+    return bplus::sync::atomicLoad( &site.id,
+                                    bplus::sync::MemoryOrderAcquire );
+}
+
+
+// The first use fixes a site's layout, racing like siteId().
+inline long
+BinaryLog::siteLayout( LogSite& site, long nLayout )
+{
+    long n = bplus::sync::atomicLoad( &site.layout,
+                                      bplus::sync::MemoryOrderAcquire );
+    if (n) return n;
+    if (bplus::sync::atomicCompareExchange( &site.layout, 0, nLayout )) {
+        return nLayout;
+    }
+    return bplus::sync::atomicLoad( &site.layout,
+                                    bplus::sync::MemoryOrderAcquire );
+}
+
+
+inline size_t
+BinaryLog::siteSize( const LogSite& site, unsigned int nTypes )
+{
+    return detail::pad8( sizeof(RecordHeader) + sizeof(SiteBody)
+                         + strlen( site.fmt ) + 1
+                         + strlen( site.file ) + 1 + nTypes );
+}
+
+
+inline size_t
+BinaryLog::eventSize( const bplus::logging::Arg* args, unsigned int nArgs,
+                      bool bTyped )
+{
+    size_t n = sizeof(RecordHeader) + sizeof(EventBody);
+    if (bTyped) n += detail::pad8( nArgs );
+    for (unsigned int i = 0; i < nArgs; i++) {
+        if (args[i].type == bplus::logging::Arg::TypeString) {
+            n += detail::pad8( 4 + args[i].len + 1 );
+        } else {
+            n += 8;
+        }
+    }
+    return n;
+}
+
+
+inline void
+BinaryLog::write( LogSite& site, unsigned int instanceId,
+                  const bplus::logging::Arg* args, unsigned int nArgs )
+{
+    using namespace bplus::sync;
+
+    if (nArgs > 0xFFFF) nArgs = 0xFFFF;
+    long id = siteId( site );
+    long nLayout = detail::argLayout( args, nArgs );
+    long nSiteLayout = siteLayout( site, nLayout );
+    unsigned int nSiteTypes = detail::layoutArgs( nSiteLayout );
+    bool bTyped = nLayout == -1 || nLayout != nSiteLayout;
+    size_t nEvent = eventSize( args, nArgs, bTyped );
+    unsigned long long now = bplus::timeutil::monotonicMicros();
+
+    for (;;) {
+        Segment* pSeg = m_pCurrent.load( MemoryOrderAcquire );
+        if (!pSeg) break;
+
+        // Include the site's definition the first time it's used in
+        // this segment.  It is marked defined only once written, so a
+        // race just writes a harmless duplicate.
+        bool bDefine = atomicLoad( &site.definedIn, MemoryOrderAcquire )
+                       != pSeg->serial;
+        size_t nSite = bDefine ? siteSize( site, nSiteTypes ) : 0;
+        long nTotal = (long) (nSite + nEvent);
+
+        // Too big to be worth a fresh segment.
+        if (nTotal > pSeg->nCapacity / 2) break;
+
+        long nEnd = atomicAdd( &pSeg->nUsed, nTotal, MemoryOrderRelaxed );
+        if (nEnd > pSeg->nCapacity) {
+            rotate( pSeg );
+            continue;
+        }
+        char* p = pSeg->pBase + (nEnd - nTotal);
+
+        if (bDefine) {
+            RecordHeader* pRec = (RecordHeader*) p;
+            SiteBody* pBody = (SiteBody*) (pRec + 1);
+            pRec->kind = s_kindSite;
+            pRec->nArgs = (unsigned short) nSiteTypes;
+            pBody->siteId = (unsigned int) id;
+            pBody->level = site.level;
+            pBody->line = site.line;
+            pBody->fmtLen = (unsigned int) strlen( site.fmt );
+            pBody->fileLen = (unsigned int) strlen( site.file );
+            pBody->reserved = 0;
+            char* pStr = (char*) (pBody + 1);
+            memcpy( pStr, site.fmt, pBody->fmtLen + 1 );
+            memcpy( pStr + pBody->fmtLen + 1, site.file, pBody->fileLen + 1 );
+            unsigned char* pTypes =
+                (unsigned char*) pStr + pBody->fmtLen + pBody->fileLen + 2;
+            for (unsigned int i = 0; i < nSiteTypes; i++) {
+                pTypes[i] = detail::layoutType( nSiteLayout, i );
+            }
+            atomicFence( MemoryOrderRelease );
+            pRec->size = (unsigned int) nSite;
+            p += nSite;
+        }
+
+        RecordHeader* pRec = (RecordHeader*) p;
+        EventBody* pBody = (EventBody*) (pRec + 1);
+        pRec->kind = bTyped ? s_kindTypedEvent : s_kindEvent;
+        pRec->nArgs = (unsigned short) nArgs;
+        pBody->siteId = (unsigned int) id;
+        pBody->tid = detail::currentThreadIdCached();
+        pBody->instanceId = instanceId;
+        pBody->reserved = 0;
+        pBody->monoMicros = now;
+
+        char* pVal = (char*) (pBody + 1);
+        if (bTyped) {
+            for (unsigned int i = 0; i < nArgs; i++) {
+                pVal[i] = (char) args[i].type;
+            }
+            pVal += detail::pad8( nArgs );
+        }
+        for (unsigned int i = 0; i < nArgs; i++) {
+            if (args[i].type == bplus::logging::Arg::TypeString) {
+                unsigned int nLen = args[i].len;
+                memcpy( pVal, &nLen, 4 );
+                memcpy( pVal + 4, args[i].val.s, nLen );
+                pVal[4 + nLen] = 0;
+                pVal += detail::pad8( 4 + nLen + 1 );
+            } else {
+                memcpy( pVal, &args[i].val, 8 );
+                pVal += 8;
+            }
+        }
+        atomicFence( MemoryOrderRelease );
+        pRec->size = (unsigned int) nEvent;
+
+        if (bDefine) {
+            atomicStore( &site.definedIn, pSeg->serial, MemoryOrderRelease );
+        }
+        m_nRecords.increment( MemoryOrderRelaxed );
+        m_nBytes.add( nTotal, MemoryOrderRelaxed );
+        return;
+    }
+
+    m_nDropped.increment( MemoryOrderRelaxed );
+}
+
+
+inline BinaryLog::Stats
+BinaryLog::stats() const
+{
+    Stats s;
+    s.records = (unsigned long long) m_nRecords.load( bplus::sync::MemoryOrderRelaxed );
+    s.bytes = (unsigned long long) m_nBytes.load( bplus::sync::MemoryOrderRelaxed );
+    s.dropped = (unsigned long long) m_nDropped.load( bplus::sync::MemoryOrderRelaxed );
+    bplus::sync::ScopedLock<bplus::sync::Mutex> lock(
+        const_cast<bplus::sync::Mutex&>( m_rotateLock ) );
+    s.segments = m_segments.size();
+    return s;
+}
+
+
+inline bplus::Object*
+BinaryLog::statsToBPObject() const
+{
+    Stats s = stats();
+    bplus::Map* m = new bplus::Map;
+    m->add( "records", new bplus::Integer( (long long) s.records ) );
+    m->add( "bytes", new bplus::Integer( (long long) s.bytes ) );
+    m->add( "dropped", new bplus::Integer( (long long) s.dropped ) );
+    m->add( "segments", new bplus::Integer( (long long) s.segments ) );
+    return m;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// BinaryLog::Reader
+//
+
+inline
+BinaryLog::Reader::Reader( const char* pData, size_t nBytes ) :
+    m_pData( pData ),
+    m_nBytes( nBytes ),
+    m_nPos( 0 ),
+    m_bValid( false )
+{
+    memset( &m_header, 0, sizeof(m_header) );
+    if (nBytes < sizeof(FileHeader)) return;
+    memcpy( &m_header, pData, sizeof(FileHeader) );
+    if (memcmp( m_header.magic, "BPBLOG", 6 ) != 0
+        || m_header.version != s_version
+        || m_header.headerSize < sizeof(FileHeader)
+        || m_header.headerSize > nBytes) {
+        return;
+    }
+    m_bValid = true;
+    m_nPos = m_header.headerSize;
+
+    // Site definitions may follow their first events when threads race,
+    // so collect them all up front.
+    size_t nPos = m_nPos;
+    while (nPos + sizeof(RecordHeader) <= m_nBytes) {
+        const RecordHeader* pRec = (const RecordHeader*) (m_pData + nPos);
+        if (pRec->size < sizeof(RecordHeader)
+            || pRec->size > m_nBytes - nPos) {
+            break;
+        }
+        if (pRec->kind == s_kindSite
+            && pRec->size >= sizeof(RecordHeader) + sizeof(SiteBody)) {
+            const SiteBody* pBody = (const SiteBody*) (pRec + 1);
+            size_t nStrings = pRec->size - sizeof(RecordHeader)
+                              - sizeof(SiteBody);
+            if ((size_t) pBody->fmtLen + pBody->fileLen + 2 + pRec->nArgs
+                    <= nStrings
+                && pBody->siteId < 0x1000000) {
+                const char* pStr = (const char*) (pBody + 1);
+                if (pBody->siteId >= m_sites.size()) {
+                    m_sites.resize( pBody->siteId + 1 );
+                    m_haveSite.resize( pBody->siteId + 1, false );
+                }
+                Site& s = m_sites[pBody->siteId];
+                s.level = pBody->level;
+                s.line = pBody->line;
+                s.fmt.assign( pStr, pBody->fmtLen );
+                s.file.assign( pStr + pBody->fmtLen + 1, pBody->fileLen );
+                const unsigned char* pTypes = (const unsigned char*) pStr
+                                              + pBody->fmtLen
+                                              + pBody->fileLen + 2;
+                s.types.assign( pTypes, pTypes + pRec->nArgs );
+                m_haveSite[pBody->siteId] = true;
+            }
+        }
+        nPos += pRec->size;
+    }
+}
+
+
+inline bool
+BinaryLog::Reader::next( Event& oEvent )
+{
+    if (!m_bValid) return false;
+    while (m_nPos + sizeof(RecordHeader) <= m_nBytes) {
+        const RecordHeader* pRec = (const RecordHeader*) (m_pData + m_nPos);
+        if (pRec->size < sizeof(RecordHeader)
+            || pRec->size > m_nBytes - m_nPos) {
+            break;
+        }
+        m_nPos += pRec->size;
+        if ((pRec->kind == s_kindEvent || pRec->kind == s_kindTypedEvent)
+            && parseEvent( pRec, oEvent )) {
+            return true;
+        }
+    }
+    m_nPos = m_nBytes;
+    return false;
+}
+
+
+inline bool
+BinaryLog::Reader::parseEvent( const RecordHeader* pRec,
+                               Event& oEvent ) const
+{
+    const char* pEnd = (const char*) pRec + pRec->size;
+    const EventBody* pBody = (const EventBody*) (pRec + 1);
+    const char* pVal = (const char*) (pBody + 1);
+    if (pVal > pEnd) return false;
+
+    oEvent.siteId = pBody->siteId;
+    oEvent.pSite = (pBody->siteId < m_sites.size()
+                    && m_haveSite[pBody->siteId])
+                   ? &m_sites[pBody->siteId] : NULL;
+
+    // Untyped events take their types from the site.
+    const unsigned char* pTypes;
+    if (pRec->kind == s_kindTypedEvent) {
+        pTypes = (const unsigned char*) pVal;
+        pVal += detail::pad8( pRec->nArgs );
+        if (pVal > pEnd) return false;
+    } else {
+        if (!oEvent.pSite || oEvent.pSite->types.size() != pRec->nArgs) {
+            return false;
+        }
+        pTypes = oEvent.pSite->types.empty() ? NULL
+                                              : &oEvent.pSite->types[0];
+    }
+    oEvent.tid = pBody->tid;
+    oEvent.instanceId = pBody->instanceId;
+    oEvent.wallMicros = m_header.wallMicrosAtOpen
+                        + (pBody->monoMicros - m_header.monoMicrosAtOpen);
+    oEvent.args.clear();
+
+    for (unsigned int i = 0; i < pRec->nArgs; i++) {
+        bplus::logging::Arg a( 0 );
+        switch (pTypes[i]) {
+            case bplus::logging::Arg::TypeInt:
+            case bplus::logging::Arg::TypeUInt:
+            case bplus::logging::Arg::TypeDouble:
+            case bplus::logging::Arg::TypePointer:
+                if (pVal + 8 > pEnd) return false;
+                a.type = (bplus::logging::Arg::Type) pTypes[i];
+                memcpy( &a.val, pVal, 8 );
+                pVal += 8;
+                break;
+            case bplus::logging::Arg::TypeString: {
+                if (pVal + 4 > pEnd) return false;
+                unsigned int nLen;
+                memcpy( &nLen, pVal, 4 );
+                if ((size_t) (pEnd - pVal) < 5 + (size_t) nLen) return false;
+                a.type = bplus::logging::Arg::TypeString;
+                a.len = nLen;
+                a.val.s = pVal + 4;
+                pVal += detail::pad8( 4 + nLen + 1 );
+                break;
+            }
+            default:
+                return false;
+        }
+        oEvent.args.push_back( a );
+    }
+    return true;
+}
+
+
+} // service
+} // bplus
+
+
+#endif // BPBINARYLOGIMPL_H_
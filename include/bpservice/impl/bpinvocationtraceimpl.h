@@ -0,0 +1,558 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpinvocationtraceimpl.h
+ *
+ *  Inline implementation file for bpinvocationtrace.h.
+ *
+ *  Note: This file is included by bpinvocationtrace.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPINVOCATIONTRACEIMPL_H_
+#define BPINVOCATIONTRACEIMPL_H_
+
+#include <string.h>
+#include <memory>
+
+#include "bputil/bpstrutil.h"
+
+
+namespace bplus {
+namespace service {
+namespace detail {
+
+
+enum TraceTag {
+    TagNull = 0,
+    TagFalse,
+    TagTrue,
+    TagInteger,
+    TagDouble,
+    TagString,
+    TagMap,
+    TagList,
+    TagCallBack,
+    TagPath,
+    TagWritablePath
+};
+
+static const char s_traceMagic[8] = { 'B', 'P', 'T', 'R', 'A', 'C', 'E', '1' };
+
+
+inline void
+putVarint( std::string& sOut, unsigned long long n )
+{
+    while (n >= 0x80) {
+        sOut += (char) ((n & 0x7f) | 0x80);
+        n >>= 7;
+    }
+    sOut += (char) n;
+}
+
+
+inline size_t
+varintSize( unsigned long long n )
+{
+    size_t nBytes = 1;
+    while (n >= 0x80) {
+        n >>= 7;
+        nBytes++;
+    }
+    return nBytes;
+}
+
+
+inline unsigned long long
+zigzag( long long n )
+{
+    return ((unsigned long long) n << 1) ^ (unsigned long long) (n >> 63);
+}
+
+
+inline long long
+unzigzag( unsigned long long n )
+{
+    return (long long) (n >> 1) ^ -(long long) (n & 1);
+}
+
+
+inline void
+putString( std::string& sOut, const char* csz, size_t nLen )
+{
+    putVarint( sOut, nLen );
+    sOut.append( csz, nLen );
+}
+
+
+inline bool
+getVarint( const char*& p, const char* pEnd, unsigned long long& n )
+{
+    n = 0;
+    for (unsigned int nShift = 0; p != pEnd && nShift < 64; nShift += 7) {
+        unsigned char c = (unsigned char) *p++;
+        n |= (unsigned long long) (c & 0x7f) << nShift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+
+inline bool
+getString( const char*& p, const char* pEnd, std::string& s )
+{
+    unsigned long long n;
+    if (!getVarint( p, pEnd, n ) || n > (unsigned long long) (pEnd - p)) {
+        return false;
+    }
+    s.assign( p, (size_t) n );
+    p += n;
+    return true;
+}
+
+
+inline std::string
+pathToUtf8( const BPPath path )
+{
+#if defined(WIN32) || defined(WINDOWS) || defined(_WINDOWS)
+    return bplus::strutil::wideToUtf8( path );
+#else
+    return path;
+#endif
+}
+
+
+inline bplus::tPathString
+utf8ToPath( const std::string& s )
+{
+#if defined(WIN32) || defined(WINDOWS) || defined(_WINDOWS)
+    return bplus::strutil::utf8ToWide( s );
+#else
+    return s;
+#endif
+}
+
+
+// NULL on malformed input.
+inline bplus::Object*
+decodeElement( const char*& p, const char* pEnd, unsigned int nDepth )
+{
+    if (p == pEnd || nDepth > 256) return NULL;
+    unsigned long long n;
+    std::string s;
+    switch (*p++) {
+        case TagNull:  return new bplus::Null;
+        case TagFalse: return new bplus::Bool( false );
+        case TagTrue:  return new bplus::Bool( true );
+        case TagInteger:
+            if (!getVarint( p, pEnd, n )) return NULL;
+            return new bplus::Integer( unzigzag( n ) );
+        case TagCallBack:
+            if (!getVarint( p, pEnd, n )) return NULL;
+            return new bplus::CallBack( unzigzag( n ) );
+        case TagDouble: {
+            double d;
+            if (pEnd - p < (long) sizeof(d)) return NULL;
+            memcpy( &d, p, sizeof(d) );
+            p += sizeof(d);
+            return new bplus::Double( d );
+        }
+        case TagString:
+            if (!getString( p, pEnd, s )) return NULL;
+            return new bplus::String( s );
+        case TagPath:
+            if (!getString( p, pEnd, s )) return NULL;
+            return new bplus::Path( utf8ToPath( s ) );
+        case TagWritablePath:
+            if (!getString( p, pEnd, s )) return NULL;
+            return new bplus::WritablePath( utf8ToPath( s ) );
+        case TagMap: {
+            if (!getVarint( p, pEnd, n )) return NULL;
+            std::auto_ptr<bplus::Map> pMap( new bplus::Map );
+            for (unsigned long long i = 0; i < n; i++) {
+                if (!getString( p, pEnd, s )) return NULL;
+                bplus::Object* pVal = decodeElement( p, pEnd, nDepth + 1 );
+                if (!pVal) return NULL;
+                pMap->add( s, pVal );
+            }
+            return pMap.release();
+        }
+        case TagList: {
+            if (!getVarint( p, pEnd, n )) return NULL;
+            std::auto_ptr<bplus::List> pList( new bplus::List );
+            for (unsigned long long i = 0; i < n; i++) {
+                bplus::Object* pVal = decodeElement( p, pEnd, nDepth + 1 );
+                if (!pVal) return NULL;
+                pList->append( pVal );
+            }
+            return pList.release();
+        }
+    }
+    return NULL;
+}
+
+
+} // detail
+
+
+////////////////////////////////////////////////////////////////////////////////
+// InvocationTrace
+//
+
+inline
+InvocationTrace::InvocationTrace() :
+    m_pFile( NULL ),
+    m_nStartMicros( 0 )
+{
+}
+
+
+inline
+InvocationTrace::~InvocationTrace()
+{
+    close();
+}
+
+
+inline bool
+InvocationTrace::open( const bplus::tPathString& sPath,
+                       const std::string& sService,
+                       const std::string& sVersion )
+{
+    close();
+
+    bplus::sync::Lock lock( m_lock );
+#if defined(WIN32) || defined(WINDOWS) || defined(_WINDOWS)
+    m_pFile = _wfopen( sPath.c_str(), L"wb" );
+#else
+    m_pFile = fopen( sPath.c_str(), "wb" );
+#endif
+    if (!m_pFile) return false;
+    setvbuf( m_pFile, NULL, _IOFBF, 64 * 1024 );
+
+    m_nStartMicros = bplus::timeutil::monotonicMicros();
+    std::string sHeader( detail::s_traceMagic, sizeof(detail::s_traceMagic) );
+    detail::putVarint( sHeader, bplus::timeutil::wallClockMicros() );
+    detail::putString( sHeader, sService.data(), sService.size() );
+    detail::putString( sHeader, sVersion.data(), sVersion.size() );
+    fwrite( sHeader.data(), 1, sHeader.size(), m_pFile );
+    return true;
+}
+
+
+inline void
+InvocationTrace::close()
+{
+    bplus::sync::Lock lock( m_lock );
+    if (m_pFile) {
+        fclose( m_pFile );
+        m_pFile = NULL;
+    }
+}
+
+
+inline bool
+InvocationTrace::isOpen() const
+{
+    bplus::sync::Lock lock( const_cast<bplus::sync::Mutex&>( m_lock ) );
+    return m_pFile != NULL;
+}
+
+
+inline void
+InvocationTrace::flush()
+{
+    bplus::sync::Lock lock( m_lock );
+    if (m_pFile) fflush( m_pFile );
+}
+
+
+// Records are [kind][payload length][payload], so a reader can skip
+// kinds it doesn't know.
+inline void
+InvocationTrace::write( int kind, const std::string& sPayload )
+{
+    std::string sHead;
+    sHead += (char) kind;
+    detail::putVarint( sHead, sPayload.size() );
+
+    bplus::sync::Lock lock( m_lock );
+    if (!m_pFile) return;
+    fwrite( sHead.data(), 1, sHead.size(), m_pFile );
+    fwrite( sPayload.data(), 1, sPayload.size(), m_pFile );
+}
+
+
+inline void
+InvocationTrace::recordInvoke( unsigned int tid, unsigned int instanceId,
+                               const char* cszFunction,
+                               const BPElement* pArgs )
+{
+    std::string s;
+    detail::putVarint( s, bplus::timeutil::monotonicMicros() - m_nStartMicros );
+    detail::putVarint( s, tid );
+    detail::putVarint( s, instanceId );
+    detail::putString( s, cszFunction, strlen( cszFunction ) );
+    encodeElement( pArgs, s );
+    write( KindInvoke, s );
+}
+
+
+inline void
+InvocationTrace::recordResults( unsigned int tid, const BPElement* pResults )
+{
+    std::string s;
+    detail::putVarint( s, bplus::timeutil::monotonicMicros() - m_nStartMicros );
+    detail::putVarint( s, tid );
+    detail::putVarint( s, encodedSize( pResults ) );
+    write( KindResults, s );
+}
+
+
+inline void
+InvocationTrace::recordError( unsigned int tid, const char* cszError,
+                              const char* cszVerbose )
+{
+    if (!cszError) cszError = "";
+    if (!cszVerbose) cszVerbose = "";
+    std::string s;
+    detail::putVarint( s, bplus::timeutil::monotonicMicros() - m_nStartMicros );
+    detail::putVarint( s, tid );
+    detail::putString( s, cszError, strlen( cszError ) );
+    detail::putString( s, cszVerbose, strlen( cszVerbose ) );
+    write( KindError, s );
+}
+
+
+inline void
+InvocationTrace::recordCallback( unsigned int tid, long long callbackId,
+                                 const BPElement* pParams )
+{
+    std::string s;
+    detail::putVarint( s, bplus::timeutil::monotonicMicros() - m_nStartMicros );
+    detail::putVarint( s, tid );
+    detail::putVarint( s, detail::zigzag( callbackId ) );
+    detail::putVarint( s, encodedSize( pParams ) );
+    write( KindCallback, s );
+}
+
+
+inline void
+InvocationTrace::encodeElement( const BPElement* pElem, std::string& sOut )
+{
+    if (!pElem) {
+        sOut += (char) detail::TagNull;
+        return;
+    }
+    switch (pElem->type) {
+        case BPTBoolean:
+            sOut += (char) (pElem->value.booleanVal ? detail::TagTrue
+                                                    : detail::TagFalse);
+            break;
+        case BPTInteger:
+            sOut += (char) detail::TagInteger;
+            detail::putVarint( sOut, detail::zigzag( pElem->value.integerVal ) );
+            break;
+        case BPTCallBack:
+            sOut += (char) detail::TagCallBack;
+            detail::putVarint( sOut, detail::zigzag( pElem->value.callbackVal ) );
+            break;
+        case BPTDouble: {
+            sOut += (char) detail::TagDouble;
+            sOut.append( (const char*) &pElem->value.doubleVal,
+                         sizeof(pElem->value.doubleVal) );
+            break;
+        }
+        case BPTString: {
+            const char* csz = pElem->value.stringVal ? pElem->value.stringVal
+                                                     : "";
+            sOut += (char) detail::TagString;
+            detail::putString( sOut, csz, strlen( csz ) );
+            break;
+        }
+        case BPTNativePath:
+        case BPTWritableNativePath: {
+            std::string s = detail::pathToUtf8( pElem->value.pathVal );
+            sOut += (char) (pElem->type == BPTNativePath
+                            ? detail::TagPath : detail::TagWritablePath);
+            detail::putString( sOut, s.data(), s.size() );
+            break;
+        }
+        case BPTMap: {
+            const BPMap& m = pElem->value.mapVal;
+            sOut += (char) detail::TagMap;
+            detail::putVarint( sOut, m.size );
+            for (unsigned int i = 0; i < m.size; i++) {
+                detail::putString( sOut, m.elements[i].key,
+                                   strlen( m.elements[i].key ) );
+                encodeElement( m.elements[i].value, sOut );
+            }
+            break;
+        }
+        case BPTList: {
+            const BPList& l = pElem->value.listVal;
+            sOut += (char) detail::TagList;
+            detail::putVarint( sOut, l.size );
+            for (unsigned int i = 0; i < l.size; i++) {
+                encodeElement( l.elements[i], sOut );
+            }
+            break;
+        }
+        default:
+            sOut += (char) detail::TagNull;
+            break;
+    }
+}
+
+
+inline size_t
+InvocationTrace::encodedSize( const BPElement* pElem )
+{
+    if (!pElem) return 1;
+    size_t n;
+    switch (pElem->type) {
+        case BPTInteger:
+            return 1 + detail::varintSize(
+                           detail::zigzag( pElem->value.integerVal ) );
+        case BPTCallBack:
+            return 1 + detail::varintSize(
+                           detail::zigzag( pElem->value.callbackVal ) );
+        case BPTDouble:
+            return 1 + sizeof(double);
+        case BPTString:
+            n = pElem->value.stringVal ? strlen( pElem->value.stringVal ) : 0;
+            return 1 + detail::varintSize( n ) + n;
+        case BPTNativePath:
+        case BPTWritableNativePath:
+            n = detail::pathToUtf8( pElem->value.pathVal ).size();
+            return 1 + detail::varintSize( n ) + n;
+        case BPTMap: {
+            const BPMap& m = pElem->value.mapVal;
+            n = 1 + detail::varintSize( m.size );
+            for (unsigned int i = 0; i < m.size; i++) {
+                size_t nKey = strlen( m.elements[i].key );
+                n += detail::varintSize( nKey ) + nKey
+                     + encodedSize( m.elements[i].value );
+            }
+            return n;
+        }
+        case BPTList: {
+            const BPList& l = pElem->value.listVal;
+            n = 1 + detail::varintSize( l.size );
+            for (unsigned int i = 0; i < l.size; i++) {
+                n += encodedSize( l.elements[i] );
+            }
+            return n;
+        }
+        default:
+            return 1;
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// InvocationTrace::Reader
+//
+
+inline
+InvocationTrace::Reader::Reader( const char* pData, size_t nBytes ) :
+    m_p( pData ),
+    m_pEnd( pData + nBytes ),
+    m_bValid( false ),
+    m_nWallMicros( 0 )
+{
+    if (nBytes < sizeof(detail::s_traceMagic)
+        || memcmp( pData, detail::s_traceMagic,
+                   sizeof(detail::s_traceMagic) ) != 0) {
+        return;
+    }
+    m_p += sizeof(detail::s_traceMagic);
+    m_bValid = detail::getVarint( m_p, m_pEnd, m_nWallMicros )
+               && detail::getString( m_p, m_pEnd, m_sService )
+               && detail::getString( m_p, m_pEnd, m_sVersion );
+}
+
+
+inline bool
+InvocationTrace::Reader::next( Record& rec )
+{
+    while (m_bValid && m_p != m_pEnd) {
+        int kind = (unsigned char) *m_p++;
+        unsigned long long nLen;
+        if (!detail::getVarint( m_p, m_pEnd, nLen )
+            || nLen > (unsigned long long) (m_pEnd - m_p)) {
+            break;
+        }
+        const char* p = m_p;
+        const char* pEnd = m_p + nLen;
+        m_p = pEnd;
+
+        delete rec.pArgs;
+        rec.pArgs = NULL;
+        rec.kind = kind;
+        unsigned long long n;
+        if (!detail::getVarint( p, pEnd, rec.micros )
+            || !detail::getVarint( p, pEnd, n )) {
+            break;
+        }
+        rec.tid = (unsigned int) n;
+
+        bool bOk = true;
+        switch (kind) {
+            case KindInvoke:
+                bOk = detail::getVarint( p, pEnd, n )
+                      && detail::getString( p, pEnd, rec.function );
+                rec.instanceId = (unsigned int) n;
+                if (bOk) {
+                    rec.pArgs = detail::decodeElement( p, pEnd, 0 );
+                    bOk = rec.pArgs != NULL;
+                }
+                break;
+            case KindResults:
+                bOk = detail::getVarint( p, pEnd, rec.size );
+                break;
+            case KindError:
+                bOk = detail::getString( p, pEnd, rec.error )
+                      && detail::getString( p, pEnd, rec.verboseError );
+                break;
+            case KindCallback:
+                bOk = detail::getVarint( p, pEnd, n )
+                      && detail::getVarint( p, pEnd, rec.size );
+                rec.callbackId = detail::unzigzag( n );
+                break;
+            default:
+                continue;       // from a newer writer; skip it
+        }
+        if (!bOk) break;
+        return true;
+    }
+    m_bValid = false;
+    return false;
+}
+
+
+} // service
+} // bplus
+
+
+#endif // BPINVOCATIONTRACEIMPL_H_
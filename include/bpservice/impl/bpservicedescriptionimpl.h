@@ -30,13 +30,88 @@
 #define BPSERVICEDESCRIPTIONIMPL_H_
 
 #include <assert.h>
-#include <set>
 #include <sstream>
 
 
 using bplus::service::Argument;
 using bplus::service::Function;
 using bplus::service::Description;
+using bplus::service::NameIndex;
+
+
+//////////////////
+// NameIndex
+
+inline
+NameIndex::NameIndex()
+    : m_count(0)
+{
+}
+
+inline void
+NameIndex::clear()
+{
+    m_slots.clear();
+    m_count = 0;
+}
+
+// FNV-1a
+inline unsigned int
+NameIndex::hash(const char * name)
+{
+    unsigned int h = 2166136261u;
+    for (const unsigned char * p = (const unsigned char *) name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+template <class T>
+inline void
+NameIndex::insert(const std::vector<T> & items, unsigned int ix)
+{
+    // keep the load factor at or below one half
+    if ((m_count + 1) * 2 > m_slots.size()) {
+        m_slots.assign(m_slots.empty() ? 8 : m_slots.size() * 2, 0);
+        m_count = 0;
+        for (unsigned int i = 0; i < ix; i++) insert(items, i);
+    }
+
+    const char * name = items[ix].name().c_str();
+    unsigned int mask = m_slots.size() - 1;
+    unsigned int i = hash(name) & mask;
+    while (m_slots[i] != 0) {
+        if (!strcmp(items[m_slots[i] - 1].name().c_str(), name)) return;
+        i = (i + 1) & mask;
+    }
+    m_slots[i] = ix + 1;
+    m_count++;
+}
+
+template <class T>
+inline void
+NameIndex::rebuild(const std::vector<T> & items)
+{
+    clear();
+    for (unsigned int i = 0; i < items.size(); i++) insert(items, i);
+}
+
+template <class T>
+inline int
+NameIndex::find(const std::vector<T> & items, const char * name) const
+{
+    if (name == NULL || m_slots.empty()) return -1;
+    unsigned int mask = m_slots.size() - 1;
+    unsigned int i = hash(name) & mask;
+    while (m_slots[i] != 0) {
+        if (!strcmp(items[m_slots[i] - 1].name().c_str(), name)) {
+            return (int) m_slots[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
 
 
 inline
@@ -59,7 +134,7 @@ Argument::~Argument()
 {
 }
 
-inline std::string
+inline const std::string &
 Argument::name() const
 {
     return m_name;
@@ -95,7 +170,7 @@ Argument::setRequired(bool required)
     m_required = required;
 }
 
-inline std::string
+inline const std::string &
 Argument::docString() const
 {
     return m_docString;
@@ -183,7 +258,7 @@ Argument::fromBPArgumentDefinition(const BPArgumentDefinition * def)
 }
 
 inline void
-Argument::toBPArgumentDefinition(BPArgumentDefinition * argDef)
+Argument::toBPArgumentDefinition(BPArgumentDefinition * argDef) const
 {
     argDef->name = (char *) m_name.c_str();
     argDef->docString = (char *) m_docString.c_str();
@@ -213,6 +288,7 @@ inline Function::Function(const Function & f)
     : m_name(f.m_name),
       m_docString(f.m_docString),
       m_arguments(f.m_arguments),
+      m_argIndex(f.m_argIndex),
       m_adefs(NULL) // generated on demand, don't copy
 {
 }
@@ -223,6 +299,7 @@ Function::operator=(const Function & f)
     m_name = f.m_name;
     m_docString = f.m_docString;
     m_arguments = f.m_arguments;
+    m_argIndex = f.m_argIndex;
     if (m_adefs) free(m_adefs);
     m_adefs = NULL;
     return *this;
@@ -236,7 +313,7 @@ inline Function::~Function()
     }
 }
 
-inline std::string
+inline const std::string &
 Function::name() const
 {
     return m_name;
@@ -248,44 +325,52 @@ Function::setName(const char * name)
     m_name = name;
 }
 
-inline std::list<Argument>
+inline const std::vector<Argument> &
 Function::arguments() const
 {
     return m_arguments;
 }
 
+inline const Argument *
+Function::argument(const char * name) const
+{
+    int ix = m_argIndex.find(m_arguments, name);
+    return (ix < 0) ? NULL : &m_arguments[ix];
+}
+
 inline bool
 Function::getArgument(const char * name, Argument &oArg) const
 {
-    std::list<Argument>::const_iterator it;
-    
-    for (it = m_arguments.begin(); it != m_arguments.end(); it++)
-    {
-        if (!it->name().compare(name)) 
-        {
-            oArg = *it;
-            return true;
-        }
-    }
-    
-    return false;
+    const Argument * pArg = argument(name);
+    if (pArg == NULL) return false;
+    oArg = *pArg;
+    return true;
 }
 
 inline void
 Function::addArgument(const Argument& argument)
 {
     m_arguments.push_back(argument);
+    m_argIndex.insert(m_arguments, m_arguments.size() - 1);
 }
 
+inline void
+Function::setArguments(
+    const std::vector<Argument> & arguments) 
+{
+    m_arguments = arguments;
+    m_argIndex.rebuild(m_arguments);
+}
 
 inline void
 Function::setArguments(
     const std::list<Argument> & arguments) 
 {
-    m_arguments = arguments;
+    m_arguments.assign(arguments.begin(), arguments.end());
+    m_argIndex.rebuild(m_arguments);
 }
 
-inline std::string
+inline const std::string &
 Function::docString() const
 {
     return m_docString;
@@ -303,6 +388,7 @@ Function::clear()
     m_name.clear();
     m_docString.clear();
     m_arguments.clear();
+    m_argIndex.clear();
 }
 
 inline bool 
@@ -314,10 +400,11 @@ Function::fromBPFunctionDefinition(const BPFunctionDefinition * def)
     if (def->docString) m_docString.append(def->docString);
 
     // now arguments
+    m_arguments.reserve(def->numArguments);
     for (unsigned int i = 0; i < def->numArguments; i++) {
         Argument a;
         if (a.fromBPArgumentDefinition(def->arguments + i)) {
-            m_arguments.push_back(a);
+            addArgument(a);
         } else {
             clear();
             return false;
@@ -343,12 +430,9 @@ Function::toBPFunctionDefinition(BPFunctionDefinition * func)
         func->arguments = m_adefs = (BPArgumentDefinition *)
             calloc(m_arguments.size(), sizeof(BPArgumentDefinition));    
 
-        std::list<Argument>::iterator i;
-
-        unsigned int x;
-        for (x = 0, i = m_arguments.begin(); i != m_arguments.end(); x++, i++)
+        for (unsigned int x = 0; x < m_arguments.size(); x++)
         {
-            i->toBPArgumentDefinition(m_adefs + x);
+            m_arguments[x].toBPArgumentDefinition(m_adefs + x);
         }
     }
     
@@ -360,7 +444,8 @@ Function::toBPFunctionDefinition(BPFunctionDefinition * func)
 
 inline Description::Description() : 
     m_builtIn(false),
-    m_def(NULL)
+    m_def(NULL),
+    m_defSize(0)
 {
 }
 
@@ -381,7 +466,7 @@ Description::setIsBuiltIn(bool x)
     m_builtIn = x;
 }
 
-inline std::string
+inline const std::string &
 Description::name() const
 {
     return m_name;
@@ -393,7 +478,7 @@ Description::setName(const char * name)
     m_name = name;
 }
 
-inline std::string
+inline const std::string &
 Description::docString() const
 {
     return m_docString;
@@ -405,7 +490,7 @@ Description::setDocString(const char * docString)
     m_docString = docString;
 }
 
-inline std::list<Function>
+inline const std::vector<Function> &
 Description::functions() const
 {
     return m_functions;
@@ -413,54 +498,49 @@ Description::functions() const
 
 inline void
 Description::setFunctions(
-    const std::list<Function> & functions)
+    const std::vector<Function> & functions)
 {
     m_functions = functions;
+    m_funcIndex.rebuild(m_functions);
+}
+
+inline void
+Description::setFunctions(
+    const std::list<Function> & functions)
+{
+    m_functions.assign(functions.begin(), functions.end());
+    m_funcIndex.rebuild(m_functions);
 }
 
 inline void
 bplus::service::Description::addFunction( const Function& function )
 {
     m_functions.push_back( function );
+    m_funcIndex.insert( m_functions, m_functions.size() - 1 );
 }
 
 inline bool
 Description::getFunction(const char * funcName,
                          Function & oFunc) const
 {
-    std::list<Function>::const_iterator it;
-    
-    for (it = m_functions.begin(); it != m_functions.end(); it++)
-    {
-        if (!it->name().compare(funcName)) 
-        {
-            oFunc = *it;
-            return true;
-        }
-    }
-    
-    return false;
+    const Function * pFunc = getFunction(funcName);
+    if (pFunc == NULL) return false;
+    oFunc = *pFunc;
+    return true;
 }
 
 inline bplus::service::Function*
 bplus::service::Description::getFunction(const char * funcName) const
 {
-	std::list<bplus::service::Function>::const_iterator it;
-
-    for (it = m_functions.begin(); it != m_functions.end(); it++) {
-        if (!it->name().compare(funcName)) {
-			return const_cast<bplus::service::Function*>(&(*it));
-        }
-    }
-
-    return NULL;
+    int ix = m_funcIndex.find(m_functions, funcName);
+    if (ix < 0) return NULL;
+    return const_cast<bplus::service::Function*>(&m_functions[ix]);
 }
 
 inline bool
 Description::hasFunction(const char * funcName) const
 {
-    Function f;
-    return getFunction(funcName, f);
+    return getFunction(funcName) != NULL;
 }
 
 inline std::string
@@ -545,7 +625,7 @@ Description::toBPObject() const
         
     List* l = new List;
 
-    std::list<Function>::const_iterator fit;
+    std::vector<Function>::const_iterator fit;
     for (fit = m_functions.begin(); fit != m_functions.end(); fit++)
     {
         Map* funcDesc = new Map;
@@ -556,8 +636,8 @@ Description::toBPObject() const
         }
             
         List* params = new List;
-        std::list<Argument> args = fit->arguments();
-        std::list<Argument>::const_iterator ait;
+        const std::vector<Argument> & args = fit->arguments();
+        std::vector<Argument>::const_iterator ait;
         for (ait = args.begin(); ait != args.end(); ait++)
         {
             Map* param = new Map;
@@ -629,7 +709,7 @@ Description::fromBPObject(const bplus::Object* bp)
                     std::string(*(fm->get("documentation"))).c_str());
             }
             /* now we gotta do params (sheesh) */
-            std::list<Argument> params;
+            std::vector<Argument> params;
             
             if (fm->has("parameters", BPTList)) {          
                 const List* pl =
@@ -663,7 +743,7 @@ Description::fromBPObject(const bplus::Object* bp)
                 }
             }
             func.setArguments(params);
-            m_functions.push_back(func);
+            addFunction(func);
         }
     }
 
@@ -677,6 +757,7 @@ Description::clear()
     m_version = SemanticVersion();
     m_docString.clear();
     m_functions.clear();
+    m_funcIndex.clear();
     m_builtIn = false;
 }
 
@@ -699,10 +780,11 @@ Description::fromBPServiceDefinition(const BPServiceDefinition * def)
     if (def->docString) m_docString.append(def->docString);    
 
     // now functions
+    m_functions.reserve(def->numFunctions);
     for (unsigned int i = 0; i < def->numFunctions; i++) {
         Function f;
         if (f.fromBPFunctionDefinition(def->functions + i)) {
-            m_functions.push_back(f);
+            addFunction(f);
         } else {
             clear();
             return false;
@@ -721,9 +803,10 @@ bplus::service::validateArguments(const Function & desc,
     // n is sufficiently small that it doesn't matter.  let the profiler
     // be the judge.
 
-    // a set that we'll build up for more efficient checking of presence
-    // of required arguments
-    std::set<std::string> haveArgs;
+    // presence flags, indexed by argument position, for checking of
+    // required arguments
+    const std::vector<Argument> & args = desc.arguments();
+    std::vector<bool> haveArgs(args.size(), false);
     
     // a map of arguments which must be modified.  
     // Needed since Safari will often send integer arguments
@@ -738,10 +821,10 @@ bplus::service::validateArguments(const Function & desc,
         const char* name = NULL;
         while ((name = iter.nextKey()) != NULL) 
         {
-            Argument adesc;
+            const Argument * pArg = desc.argument(name);
 
             // unknown argument
-            if (!desc.getArgument(name, adesc))
+            if (pArg == NULL)
             {
                 std::stringstream ss;
                 ss << "argument '" << name << "' not supported by function '"
@@ -751,65 +834,65 @@ bplus::service::validateArguments(const Function & desc,
 
             // argument is known, now check type
             const char * gottype = NULL;
-            if (adesc.type() != Argument::Any) {
+            if (pArg->type() != Argument::Any) {
                 switch (arguments->value(name)->type())
                 {
                     case BPTBoolean:
-                        if (adesc.type() != Argument::Boolean)
+                        if (pArg->type() != Argument::Boolean)
                         {
                             gottype = "boolean";
                         }
                         break;
                     case BPTDouble:
-                        if (adesc.type() != Argument::Double)
+                        if (pArg->type() != Argument::Double)
                         {
                             gottype = "double";
                         }
                         break;
                     case BPTCallBack:
-                        if (adesc.type() != Argument::CallBack)
+                        if (pArg->type() != Argument::CallBack)
                         {
                             gottype = "callback";
                         }
                         break;
                     case BPTInteger:
-                        if (adesc.type() != Argument::Integer)
+                        if (pArg->type() != Argument::Integer)
                         {
                             gottype = "integer";
                         }
                         break;
                     case BPTList:
-                        if (adesc.type() != Argument::List)
+                        if (pArg->type() != Argument::List)
                         {
                             gottype = "list";
                         }
                         break;
                     case BPTMap:
-                        if (adesc.type() != Argument::Map)
+                        if (pArg->type() != Argument::Map)
                         {
                             gottype = "map";
                         }
                         break;
                     case BPTString:
-                        if (adesc.type() != Argument::String)
+                        if (pArg->type() != Argument::String)
                         {
                             gottype = "string";
                         }
                         break;
                     case BPTNativePath:
-                        if (adesc.type() != Argument::Path)
+                        if (pArg->type() != Argument::Path)
                         {
                             gottype = "path";
                         }
                         break;
                     case BPTWritableNativePath:
-                        if (adesc.type() != Argument::WritablePath)
+                        if (pArg->type() != Argument::WritablePath)
                         {
                             gottype = "writablePath";
                         }
                         break;
                     case BPTNull:
-                        if (adesc.type() != Argument::Null)
+                        if (pArg->type() != Argument::Null)
                         {
                             gottype = "null";
                         }
@@ -825,7 +908,7 @@ bplus::service::validateArguments(const Function & desc,
             {
                 // Allow conversion between int and double.  Needed
                 // since Safari often sends integers as doubles
-                std::string expected(Argument::typeAsString(adesc.type()));
+                std::string expected(Argument::typeAsString(pArg->type()));
                 std::string got(gottype);
                 if (!expected.compare("integer") && !got.compare("double")) {
                     const bplus::Double* oldVal = 
@@ -841,14 +924,14 @@ bplus::service::validateArguments(const Function & desc,
                     std::stringstream ss;
                     ss << "argument '" << name
                        << "' should be of type "
-                       << Argument::typeAsString(adesc.type())
+                       << Argument::typeAsString(pArg->type())
                        << ", but is of type " << gottype;
                     return ss.str();
                 }
             }
 
-            // we're cool.  add this to the set of arguments we have
-            haveArgs.insert(name);
+            // we're cool.  note that we have this argument
+            haveArgs[pArg - &args[0]] = true;
         }
 
         // modify args as needed
@@ -859,21 +942,14 @@ bplus::service::validateArguments(const Function & desc,
     }
         
     // verify all required arguments are present
-    std::list<Argument> args = desc.arguments();
-    std::list<Argument>::iterator ait;    
-    for (ait = args.begin(); ait != args.end(); ait++)
+    for (unsigned int i = 0; i < args.size(); i++)
     {
-        if (ait->required())
+        if (args[i].required() && !haveArgs[i])
         {
-            std::set<std::string>::iterator findArg;
-            findArg = haveArgs.find(ait->name());
-            if (findArg == haveArgs.end())
-            {
-                std::stringstream ss;
-                ss << "call to '" << desc.name() << "' requires a '"
-                   << ait->name() << "' argument";
-                return ss.str();
-            }
+            std::stringstream ss;
+            ss << "call to '" << desc.name() << "' requires a '"
+               << args[i].name() << "' argument";
+            return ss.str();
         }
     }
     return std::string();
@@ -929,8 +1005,8 @@ Description::toHumanReadableString() const
            << std::endl;
     }
 
-    std::list<Function> functions = this->functions();
-    std::list<Function>::iterator fit;
+    const std::vector<Function> & functions = this->functions();
+    std::vector<Function>::const_iterator fit;
 
     ss << std::endl;        
     ss << functions.size() << " function(s) supported:" << std::endl;
@@ -947,8 +1023,8 @@ Description::toHumanReadableString() const
         }
         
         // now for arguments
-        std::list<Argument> arguments = fit->arguments();
-        std::list<Argument>::iterator ait;
+        const std::vector<Argument> & arguments = fit->arguments();
+        std::vector<Argument>::const_iterator ait;
 
         if (arguments.size() > 0) {
             ss << std::endl;
@@ -976,40 +1052,135 @@ inline void
 Description::freeDef()
 {
     if (m_def) {
-        if (m_def->functions) free(m_def->functions);
         free(m_def);
         m_def = NULL;
     }
+    m_defSize = 0;
+}
+
+// round a byte count up so the next table in the block is aligned
+// for pointer access
+inline static size_t
+alignDefOffset(size_t n)
+{
+    return (n + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+// copy a string into the definition's string pool, advancing the pool
+inline static BPString
+copyToPool(const std::string & s, char *& pool)
+{
+    BPString rval = pool;
+    memcpy(pool, s.c_str(), s.length() + 1);
+    pool += s.length() + 1;
+    return rval;
 }
 
 inline const BPServiceDefinition*
 Description::toBPServiceDefinition(void)
 {
     freeDef();
-    m_def = (BPServiceDefinition *) calloc(1, sizeof(BPServiceDefinition));
-    assert(m_def != NULL);
 
-    m_def->serviceName = (char *) m_name.c_str();
+    // first pass: size the header, the function table, the argument
+    // tables and the string pool so we can make a single allocation.
+    size_t nArgs = 0;
+    size_t nStrBytes = m_name.length() + 1 + m_docString.length() + 1;
+
+    std::vector<Function>::const_iterator fit;
+    for (fit = m_functions.begin(); fit != m_functions.end(); fit++) {
+        nStrBytes += fit->name().length() + 1 + fit->docString().length() + 1;
+        const std::vector<Argument> & args = fit->arguments();
+        std::vector<Argument>::const_iterator ait;
+        for (ait = args.begin(); ait != args.end(); ait++) {
+            nStrBytes += ait->name().length() + 1
+                       + ait->docString().length() + 1;
+            nArgs++;
+        }
+    }
+
+    size_t funcOff = alignDefOffset(sizeof(BPServiceDefinition));
+    size_t argOff = funcOff + alignDefOffset(m_functions.size() *
+                                             sizeof(BPFunctionDefinition));
+    size_t strOff = argOff + alignDefOffset(nArgs *
+                                            sizeof(BPArgumentDefinition));
+    size_t total = strOff + nStrBytes;
+
+    char * block = (char *) calloc(1, total);
+    assert(block != NULL);
+
+    m_def = (BPServiceDefinition *) block;
+    m_defSize = total;
+    BPFunctionDefinition * funcs = (BPFunctionDefinition *) (block + funcOff);
+    BPArgumentDefinition * adefs = (BPArgumentDefinition *) (block + argOff);
+    char * pool = block + strOff;
+
+    // second pass: fill it in.
+    m_def->serviceName = copyToPool(m_name, pool);
     m_def->majorVersion = m_version.majorVer();
     m_def->minorVersion = m_version.minorVer();    
     m_def->microVersion = m_version.microVer();    
-    m_def->docString = (char *) m_docString.c_str();
+    m_def->docString = copyToPool(m_docString, pool);
+    m_def->numFunctions = m_functions.size();
+    m_def->functions = m_functions.size() ? funcs : NULL;
+
+    for (fit = m_functions.begin(); fit != m_functions.end(); fit++, funcs++) {
+        funcs->functionName = copyToPool(fit->name(), pool);
+        funcs->docString = copyToPool(fit->docString(), pool);
+
+        const std::vector<Argument> & args = fit->arguments();
+        funcs->numArguments = args.size();
+        funcs->arguments = args.size() ? adefs : NULL;
+
+        std::vector<Argument>::const_iterator ait;
+        for (ait = args.begin(); ait != args.end(); ait++, adefs++) {
+            ait->toBPArgumentDefinition(adefs);
+            adefs->name = copyToPool(ait->name(), pool);
+            adefs->docString = copyToPool(ait->docString(), pool);
+        }
+    }
+
+    assert(pool == block + total);
+    
+    return m_def;
+}
 
-    // functions
-    if (m_functions.size()) {
-        m_def->numFunctions = m_functions.size();
-        m_def->functions = (BPFunctionDefinition *)
-            calloc(m_functions.size(), sizeof(BPFunctionDefinition));    
+inline size_t
+Description::definitionSize() const
+{
+    return m_defSize;
+}
 
-        std::list<Function>::iterator i;
+inline void
+bplus::service::relocateBPServiceDefinition(BPServiceDefinition * to,
+                                            const BPServiceDefinition * from)
+{
+    const char * oldBase = (const char *) from;
+    char * newBase = (char *) to;
 
-        unsigned int x;
-        for (x = 0, i = m_functions.begin(); i != m_functions.end(); x++, i++) {
-            i->toBPFunctionDefinition(m_def->functions + x);
+#define BPDEF_RELOCATE(p) \
+    if (p) (p) = (BPString) (newBase + ((const char *) (p) - oldBase))
+
+    BPDEF_RELOCATE(to->serviceName);
+    BPDEF_RELOCATE(to->docString);
+    if (to->functions) {
+        to->functions = (BPFunctionDefinition *)
+            (newBase + ((const char *) to->functions - oldBase));
+    }
+    for (unsigned int i = 0; i < to->numFunctions; i++) {
+        BPFunctionDefinition * f = to->functions + i;
+        BPDEF_RELOCATE(f->functionName);
+        BPDEF_RELOCATE(f->docString);
+        if (f->arguments) {
+            f->arguments = (BPArgumentDefinition *)
+                (newBase + ((const char *) f->arguments - oldBase));
+        }
+        for (unsigned int j = 0; j < f->numArguments; j++) {
+            BPDEF_RELOCATE(f->arguments[j].name);
+            BPDEF_RELOCATE(f->arguments[j].docString);
         }
     }
-    
-    return m_def;
+
+#undef BPDEF_RELOCATE
 }
 
 inline Description::Description(const Description & d) :
@@ -1017,8 +1188,10 @@ inline Description::Description(const Description & d) :
     m_version(d.m_version),    
     m_docString(d.m_docString), 
     m_functions(d.m_functions),
+    m_funcIndex(d.m_funcIndex),
     m_builtIn(d.m_builtIn),
-    m_def(NULL)  // generated on demand, don't copy
+    m_def(NULL),  // generated on demand, don't copy
+    m_defSize(0)
 {
 }
 
@@ -1029,10 +1202,10 @@ Description::operator=(const Description & d)
     m_version = d.m_version;
     m_docString= d.m_docString;
     m_functions = d.m_functions;
+    m_funcIndex = d.m_funcIndex;
     m_builtIn = d.m_builtIn;
 
-    if (m_def) free(m_def); // m_def is demand generated!
-    m_def = NULL;
+    freeDef(); // m_def is demand generated!
 
     return *this;
 }
@@ -38,23 +38,352 @@ inline void
 Service::log( unsigned int level,
               const std::string& sIn )
 {
-    if (s_pCoreFuncs->log) {
+    if (!isLogEnabled( level )) return;
+
+    AsyncLog* pLog = asyncLog();
+    if (pLog) {
+        bplus::logging::Arg arg( sIn );
+        pLog->write( level, "%s", &arg, 1 );
+    } else if (s_pCoreFuncs->log) {
         s_pCoreFuncs->log( level, "%s", sIn.c_str() );
     }
 }
 
 
+inline void
+Service::writeLog( unsigned int level, const char* fmt,
+                   const bplus::logging::Arg* args, unsigned int nArgs )
+{
+    AsyncLog* pLog = asyncLog();
+    if (pLog) {
+        pLog->write( level, fmt, args, nArgs );
+    } else if (s_pCoreFuncs->log) {
+        std::string sText;
+        bplus::logging::format( sText, fmt, args, nArgs );
+        s_pCoreFuncs->log( level, "%s", sText.c_str() );
+    }
+}
+
+
+inline void
+Service::logf( unsigned int level, const char* fmt )
+{
+    if (!isLogEnabled( level )) return;
+    writeLog( level, fmt, NULL, 0 );
+}
+
+
+template <class A1>
+inline void
+Service::logf( unsigned int level, const char* fmt,
+               const A1& a1 )
+{
+    if (!isLogEnabled( level )) return;
+    bplus::logging::Arg args[] = { a1 };
+    writeLog( level, fmt, args, 1 );
+}
+
+
+template <class A1, class A2>
+inline void
+Service::logf( unsigned int level, const char* fmt,
+               const A1& a1, const A2& a2 )
+{
+    if (!isLogEnabled( level )) return;
+    bplus::logging::Arg args[] = { a1, a2 };
+    writeLog( level, fmt, args, 2 );
+}
+
+
+template <class A1, class A2, class A3>
+inline void
+Service::logf( unsigned int level, const char* fmt,
+               const A1& a1, const A2& a2, const A3& a3 )
+{
+    if (!isLogEnabled( level )) return;
+    bplus::logging::Arg args[] = { a1, a2, a3 };
+    writeLog( level, fmt, args, 3 );
+}
+
+
+template <class A1, class A2, class A3, class A4>
+inline void
+Service::logf( unsigned int level, const char* fmt,
+               const A1& a1, const A2& a2, const A3& a3, const A4& a4 )
+{
+    if (!isLogEnabled( level )) return;
+    bplus::logging::Arg args[] = { a1, a2, a3, a4 };
+    writeLog( level, fmt, args, 4 );
+}
+
+
+template <class A1, class A2, class A3, class A4, class A5>
+inline void
+Service::logf( unsigned int level, const char* fmt,
+               const A1& a1, const A2& a2, const A3& a3, const A4& a4,
+               const A5& a5 )
+{
+    if (!isLogEnabled( level )) return;
+    bplus::logging::Arg args[] = { a1, a2, a3, a4, a5 };
+    writeLog( level, fmt, args, 5 );
+}
+
+
+template <class A1, class A2, class A3, class A4, class A5, class A6>
+inline void
+Service::logf( unsigned int level, const char* fmt,
+               const A1& a1, const A2& a2, const A3& a3, const A4& a4,
+               const A5& a5, const A6& a6 )
+{
+    if (!isLogEnabled( level )) return;
+    bplus::logging::Arg args[] = { a1, a2, a3, a4, a5, a6 };
+    writeLog( level, fmt, args, 6 );
+}
+
+
+inline void
+Service::setLogLevel( unsigned int level )
+{
+    bplus::sync::atomicStore( &s_nLogLevel, (long) level,
+                              bplus::sync::MemoryOrderRelaxed );
+}
+
+
+inline bool
+Service::isLogEnabled( unsigned int level )
+{
+    return (long) level >= bplus::sync::atomicLoad(
+                               &s_nLogLevel, bplus::sync::MemoryOrderRelaxed );
+}
+
+
+inline bool
+Service::enableAsyncLog( size_t nRingBytes )
+{
+    if (asyncLog()) return true;
+    if (!s_pCoreFuncs || !s_pCoreFuncs->log) return false;
+
+    AsyncLog* pLog = new AsyncLog( s_pCoreFuncs->log, nRingBytes );
+    if (!pLog->start()) {
+        delete pLog;
+        return false;
+    }
+    void* volatile* ppLog = (void* volatile*) &s_pAsyncLog;
+    if (!bplus::sync::atomicCompareExchangePtr( ppLog, NULL, pLog )) {
+        delete pLog;
+    }
+    return true;
+}
+
+
+inline AsyncLog*
+Service::asyncLog()
+{
+    return (AsyncLog*) bplus::sync::atomicLoadPtr(
+        (void* const volatile*) &s_pAsyncLog,
+        bplus::sync::MemoryOrderAcquire );
+}
+
+
+inline bool
+Service::openBinaryLog( const bplus::tPathString& sPathPrefix,
+                        size_t nSegmentBytes, unsigned int nMaxSegments )
+{
+    if (binaryLog()) return true;
+
+    BinaryLog* pLog = new BinaryLog;
+    if (!pLog->open( sPathPrefix, nSegmentBytes, nMaxSegments )) {
+        delete pLog;
+        return false;
+    }
+    void* volatile* ppLog = (void* volatile*) &s_pBinaryLog;
+    if (!bplus::sync::atomicCompareExchangePtr( ppLog, NULL, pLog )) {
+        delete pLog;
+    }
+    return true;
+}
+
+
+inline BinaryLog*
+Service::binaryLog()
+{
+    return (BinaryLog*) bplus::sync::atomicLoadPtr(
+        (void* const volatile*) &s_pBinaryLog,
+        bplus::sync::MemoryOrderAcquire );
+}
+
+
+inline bool
+Service::enableInvocationTrace( const bplus::tPathString& sPath )
+{
+    if (invocationTrace()) return true;
+    if (!s_pCoreFuncs) return false;
+
+    expandDescription();
+    InvocationTrace* pTrace = new InvocationTrace;
+    if (!pTrace->open( sPath, s_description.name(),
+                       s_description.versionString() )) {
+        delete pTrace;
+        return false;
+    }
+    void* volatile* ppTrace = (void* volatile*) &s_pInvocationTrace;
+    if (!bplus::sync::atomicCompareExchangePtr( ppTrace, NULL, pTrace )) {
+        delete pTrace;
+    }
+    return true;
+}
+
+
+inline InvocationTrace*
+Service::invocationTrace()
+{
+    return (InvocationTrace*) bplus::sync::atomicLoadPtr(
+        (void* const volatile*) &s_pInvocationTrace,
+        bplus::sync::MemoryOrderAcquire );
+}
+
+
+inline bool
+Service::enableAllocAccounting()
+{
+    if (allocAccounting()) return true;
+    if (!bplus::memory::AllocScope::countingInstalled()) return false;
+
+    AllocAccounting* pAccounting = new AllocAccounting;
+    void* volatile* ppAccounting = (void* volatile*) &s_pAllocAccounting;
+    if (!bplus::sync::atomicCompareExchangePtr( ppAccounting, NULL,
+                                                pAccounting )) {
+        delete pAccounting;
+    }
+    return true;
+}
+
+
+inline AllocAccounting*
+Service::allocAccounting()
+{
+    return (AllocAccounting*) bplus::sync::atomicLoadPtr(
+        (void* const volatile*) &s_pAllocAccounting,
+        bplus::sync::MemoryOrderAcquire );
+}
+
+
 inline std::string Service::fullName()
 {
+    expandDescription();
     return s_description.name() + " " + s_description.versionString();
 }
 
 
+// Static descriptions are only expanded into s_description on demand,
+// and any thread may be first to ask.  Others wait for it to finish.
+// (A BP_SERVICE_DESC description is set up in bppInitialize.)
+inline void
+Service::expandDescription()
+{
+    enum { kUnexpanded, kExpanding, kExpanded };
+
+    if (!staticDefinition()) return;
+    if (bplus::sync::atomicLoad( &s_nDescriptionState,
+                                 bplus::sync::MemoryOrderAcquire )
+        == kExpanded) {
+        return;
+    }
+    if (bplus::sync::atomicCompareExchange( &s_nDescriptionState,
+                                            kUnexpanded, kExpanding )) {
+        setupDescription();
+        bplus::sync::atomicStore( &s_nDescriptionState, kExpanded,
+                                  bplus::sync::MemoryOrderRelease );
+        return;
+    }
+    while (bplus::sync::atomicLoad( &s_nDescriptionState,
+                                    bplus::sync::MemoryOrderAcquire )
+           != kExpanded) {
+        bplus::thread::Thread::yield();
+    }
+}
+
+
+inline bplus::thread::Pool&
+Service::threadPool()
+{
+    void* volatile* ppPool = (void* volatile*) &s_pThreadPool;
+    if (!bplus::sync::atomicLoadPtr( ppPool,
+                                     bplus::sync::MemoryOrderAcquire )) {
+        bplus::thread::Pool* pPool = new bplus::thread::Pool;
+        if (!bplus::sync::atomicCompareExchangePtr( ppPool, NULL, pPool )) {
+            delete pPool;
+        }
+    }
+    return *s_pThreadPool;
+}
+
+
+inline bplus::thread::TimerWheel&
+Service::timers()
+{
+    void* volatile* ppWheel = (void* volatile*) &s_pTimerWheel;
+    if (!bplus::sync::atomicLoadPtr( ppWheel,
+                                     bplus::sync::MemoryOrderAcquire )) {
+        bplus::thread::TimerWheel* pWheel = new bplus::thread::TimerWheel;
+        if (bplus::sync::atomicCompareExchangePtr( ppWheel, NULL, pWheel )) {
+            pWheel->start();
+        } else {
+            delete pWheel;
+        }
+    }
+    return *s_pTimerWheel;
+}
+
+
+inline void
+Service::setValidateUtf8( bool bValidate )
+{
+    s_bValidateUtf8 = bValidate;
+}
+
+
+inline bplus::url::OriginPolicy&
+Service::originPolicy( const char* cszFuncName )
+{
+    return cszFuncName ? s_methodOriginPolicies.get( cszFuncName )
+                       : s_originPolicy;
+}
+
+
+inline bool
+Service::isOriginAllowed( const bplus::url::Origin& origin,
+                          const char* cszFuncName )
+{
+    if (!s_originPolicy.isAllowed( origin ))
+    {
+        return false;
+    }
+    if (cszFuncName && !s_methodOriginPolicies.empty())
+    {
+        const bplus::url::OriginPolicy* pPolicy =
+            s_methodOriginPolicies.find( cszFuncName );
+        if (pPolicy && !pPolicy->isAllowed( origin ))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 inline const std::string&
 Service::clientUri()
 {
     return m_clientUri;
 }
+
+
+inline const bplus::url::Origin&
+Service::clientOrigin()
+{
+    return m_clientOrigin;
+}
    
 inline const bplus::tPathString&
 Service::serviceDir()
@@ -98,6 +427,97 @@ Service::clientPid()
 }
 
 
+inline unsigned int
+Service::instanceId()
+{
+    return m_nInstanceId;
+}
+
+
+inline void
+Service::writeBinaryLog( LogSite& site, const bplus::logging::Arg* args,
+                         unsigned int nArgs )
+{
+    BinaryLog* pLog = binaryLog();
+    if (pLog) {
+        pLog->write( site, m_nInstanceId, args, nArgs );
+    } else {
+        writeLog( site.level, site.fmt, args, nArgs );
+    }
+}
+
+
+inline void
+Service::blog( LogSite& site )
+{
+    if (!isLogEnabled( site.level )) return;
+    writeBinaryLog( site, NULL, 0 );
+}
+
+
+template <class A1>
+inline void
+Service::blog( LogSite& site, const A1& a1 )
+{
+    if (!isLogEnabled( site.level )) return;
+    bplus::logging::Arg args[] = { a1 };
+    writeBinaryLog( site, args, 1 );
+}
+
+
+template <class A1, class A2>
+inline void
+Service::blog( LogSite& site, const A1& a1, const A2& a2 )
+{
+    if (!isLogEnabled( site.level )) return;
+    bplus::logging::Arg args[] = { a1, a2 };
+    writeBinaryLog( site, args, 2 );
+}
+
+
+template <class A1, class A2, class A3>
+inline void
+Service::blog( LogSite& site, const A1& a1, const A2& a2, const A3& a3 )
+{
+    if (!isLogEnabled( site.level )) return;
+    bplus::logging::Arg args[] = { a1, a2, a3 };
+    writeBinaryLog( site, args, 3 );
+}
+
+
+template <class A1, class A2, class A3, class A4>
+inline void
+Service::blog( LogSite& site, const A1& a1, const A2& a2, const A3& a3,
+               const A4& a4 )
+{
+    if (!isLogEnabled( site.level )) return;
+    bplus::logging::Arg args[] = { a1, a2, a3, a4 };
+    writeBinaryLog( site, args, 4 );
+}
+
+
+template <class A1, class A2, class A3, class A4, class A5>
+inline void
+Service::blog( LogSite& site, const A1& a1, const A2& a2, const A3& a3,
+               const A4& a4, const A5& a5 )
+{
+    if (!isLogEnabled( site.level )) return;
+    bplus::logging::Arg args[] = { a1, a2, a3, a4, a5 };
+    writeBinaryLog( site, args, 5 );
+}
+
+
+template <class A1, class A2, class A3, class A4, class A5, class A6>
+inline void
+Service::blog( LogSite& site, const A1& a1, const A2& a2, const A3& a3,
+               const A4& a4, const A5& a5, const A6& a6 )
+{
+    if (!isLogEnabled( site.level )) return;
+    bplus::logging::Arg args[] = { a1, a2, a3, a4, a5, a6 };
+    writeBinaryLog( site, args, 6 );
+}
+
+
 
 
 
@@ -164,7 +584,24 @@ Service::bppInitialize( const BPCFunctionTable* pCoreFuncs,
     s_dependentDir      = bplus::strutil::safeStr(dependentDir);
     s_pDependentParams  = bplus::Object::build(pDependentParams);
 
-    setupDescription();
+    s_tracingCoreFuncs              = *pCoreFuncs;
+    s_tracingCoreFuncs.postResults  = tracePostResults;
+    s_tracingCoreFuncs.postError    = tracePostError;
+    s_tracingCoreFuncs.invoke       = traceInvokeCallback;
+
+    // A service declared with BP_STATIC_SERVICE_DESC already has its
+    // definition laid out as constant data.
+    const BPServiceDefinition* pStaticDef = staticDefinition();
+    if (!pStaticDef) {
+        setupDescription();
+    } else if (const char* cszBad = staticDispatchMismatch()) {
+        // A method would be described but never dispatched, or the
+        // other way about: refuse to load rather than fail at call time.
+        log( BP_ERROR, std::string( "static dispatch table doesn't match "
+                                    "the description at \"" )
+                       + cszBad + "\", service not loaded" );
+        return NULL;
+    }
     
     // Call our preprocessor-generated func that knows derived service name.
     // Note: At the moment we allow service initialization to proceed,
@@ -177,7 +614,7 @@ Service::bppInitialize( const BPCFunctionTable* pCoreFuncs,
         log( BP_WARN, sLog );
     }
     
-    return s_description.toBPServiceDefinition();
+    return pStaticDef ? pStaticDef : s_description.toBPServiceDefinition();
 }
 
 
@@ -188,6 +625,44 @@ Service::bppShutdown()
     if (!callShutdownHook()) {
         log( BP_WARN, "onShutdown() failed." );
     }
+
+    // Instances are gone and the service has had its say, so finish
+    // any pool work and stop the workers, then stop the timers, before
+    // we're unloaded.  Pool work may still end transactions, which
+    // cancels their deadlines on the wheel, so the wheel must outlive
+    // the pool.  The logs go last, so their messages get out.
+    if (s_pThreadPool) {
+        delete s_pThreadPool;
+        s_pThreadPool = NULL;
+    }
+    if (s_pTimerWheel) {
+        delete s_pTimerWheel;
+        s_pTimerWheel = NULL;
+    }
+    if (s_pAllocAccounting) {
+        AllocAccounting* pAccounting = s_pAllocAccounting;
+        s_pAllocAccounting = NULL;
+        std::auto_ptr<bplus::Object> pStats( pAccounting->statsToBPObject() );
+        std::string sJson;
+        bplus::json::serialize( pStats->elemPtr(), sJson );
+        log( BP_INFO, "allocation stats: " + sJson );
+        delete pAccounting;
+    }
+    if (s_pInvocationTrace) {
+        InvocationTrace* pTrace = s_pInvocationTrace;
+        s_pInvocationTrace = NULL;
+        delete pTrace;
+    }
+    if (s_pBinaryLog) {
+        BinaryLog* pLog = s_pBinaryLog;
+        s_pBinaryLog = NULL;
+        delete pLog;
+    }
+    if (s_pAsyncLog) {
+        AsyncLog* pLog = s_pAsyncLog;
+        s_pAsyncLog = NULL;
+        delete pLog;
+    }
 }
 
 
@@ -198,20 +673,37 @@ Service::bppAllocate( void** instance,
                       const BPString locale,
                       const BPString userAgent, int clientPid )
 {
-    Service* pInst = createInstance();
-
-    // Our class factory uses Service default constructor.
-    // So we have to set instance attributes manually.
-    pInst->m_clientUri  = uri;
-    pInst->m_serviceDir = serviceDir;
-    pInst->m_dataDir    = dataDir;
-    pInst->m_tempDir    = tempDir;
-    pInst->m_locale     = locale;
-    pInst->m_userAgent  = userAgent;
-    pInst->m_clientPid  = clientPid;
-    
-    // Let derived service do any needed work now that members are setup.
-    pInst->finalConstruct();
+    // Whatever the instance allocates as it's set up, it starts out with.
+    AllocAccounting* pAccounting = allocAccounting();
+    bplus::memory::AllocCounts construct;
+    Service* pInst;
+    {
+        bplus::memory::AllocScope scope( pAccounting ? &construct : NULL );
+        pInst = createInstance();
+
+        // Our class factory uses Service default constructor.
+        // So we have to set instance attributes manually.
+        pInst->m_clientUri  = uri;
+        (void) s_originCache.lookup( pInst->m_clientUri,
+                                     pInst->m_clientOrigin );
+        pInst->m_serviceDir = serviceDir;
+        pInst->m_dataDir    = dataDir;
+        pInst->m_tempDir    = tempDir;
+        pInst->m_locale     = locale;
+        pInst->m_userAgent  = userAgent;
+        pInst->m_clientPid  = clientPid;
+
+        static volatile long s_nInstances = 0;
+        pInst->m_nInstanceId =
+            (unsigned int) bplus::sync::atomicAdd( &s_nInstances, 1 );
+
+        // Let derived service do any needed work now that members are
+        // setup.
+        pInst->finalConstruct();
+    }
+    if (pAccounting) {
+        pAccounting->addConstruct( pInst->m_nInstanceId, construct );
+    }
 
     *instance = (void*) pInst;
 
@@ -222,7 +714,15 @@ Service::bppAllocate( void** instance,
 inline void
 Service::bppDestroy( void* pInstance )
 {
-    delete (Service*) pInstance;
+    Service* pInst = (Service*) pInstance;
+    unsigned int instanceId = pInst->m_nInstanceId;
+    AllocAccounting* pAccounting = allocAccounting();
+    bplus::memory::AllocCounts destroy;
+    {
+        bplus::memory::AllocScope scope( pAccounting ? &destroy : NULL );
+        delete pInst;
+    }
+    if (pAccounting) pAccounting->removeInstance( instanceId, destroy );
 }
 
 
@@ -232,28 +732,121 @@ Service::bppInvoke( void* pvInst,
                     unsigned int tid,
                     const BPElement* pArgs )
 {
-    try
-    {
-        Transaction tran( s_pCoreFuncs, tid );
+    Service* pInst = (Service*) pvInst;
+
+    // With a trace being recorded, posts go through the recording table.
+    InvocationTrace* pTrace = invocationTrace();
+    const BPCFunctionTable* pFuncs = s_pCoreFuncs;
+    if (pTrace) {
+        pTrace->recordInvoke( tid, pInst->m_nInstanceId, cszFuncName, pArgs );
+        pFuncs = &s_tracingCoreFuncs;
+    }
+
+    AllocAccounting* pAccounting = allocAccounting();
+    if (!pAccounting) {
+        dispatch( pInst, cszFuncName, tid, pArgs, pFuncs, NULL );
+        return;
+    }
+    AllocAccounting::Invocation inv;
+    dispatch( pInst, cszFuncName, tid, pArgs, pFuncs, &inv );
+    pAccounting->addInvocation( pInst->m_nInstanceId, cszFuncName, inv );
+}
 
-        std::auto_ptr<bplus::Object> poArgs( bplus::Object::build( pArgs ) );
-        bplus::Map* pmArgs = dynamic_cast<bplus::Map*>( poArgs.get() );
 
-        // Always give invoke() a map.
-        bplus::Map mapEmpty;
-        const bplus::Map& mapref = pmArgs ? *pmArgs : mapEmpty;
+inline void
+Service::dispatch( Service* pInst,
+                   const char* cszFuncName,
+                   unsigned int tid,
+                   const BPElement* pArgs,
+                   const BPCFunctionTable* pFuncs,
+                   AllocAccounting::Invocation* pInv )
+{
+    using bplus::memory::AllocScope;
 
-        ((Service*) pvInst)->invoke( cszFuncName, tran, mapref );
+    try
+    {
+        {
+            AllocScope scope( AllocAccounting::stageCounts(
+                                  pInv, AllocAccounting::StageValidate ) );
+            if (!isOriginAllowed( pInst->m_clientOrigin, cszFuncName ))
+            {
+                pFuncs->postError( tid, BPE_PERMISSION_DENIED,
+                                   "origin not permitted" );
+                return;
+            }
+
+            std::string sBadPath;
+            if (s_bValidateUtf8 && !bplus::validateUtf8( pArgs, &sBadPath ))
+            {
+                std::string sMsg = "invalid UTF-8 in argument: " + sBadPath;
+                pFuncs->postError( tid, BPE_INVALID_PARAMETERS,
+                                   sMsg.c_str() );
+                return;
+            }
+        }
+
+        std::auto_ptr<bplus::Object> poArgs;
+        {
+            AllocScope scope( AllocAccounting::stageCounts(
+                                  pInv, AllocAccounting::StageArgs ) );
+            poArgs.reset( bplus::Object::build( pArgs ) );
+        }
+
+        {
+            AllocScope scope( AllocAccounting::stageCounts(
+                                  pInv, AllocAccounting::StageBody ) );
+            Transaction tran( pFuncs, tid );
+            bplus::Map* pmArgs = dynamic_cast<bplus::Map*>( poArgs.get() );
+
+            // Always give invoke() a map.
+            bplus::Map mapEmpty;
+            const bplus::Map& mapref = pmArgs ? *pmArgs : mapEmpty;
+
+            pInst->invoke( cszFuncName, tran, mapref );
+        }
+
+        AllocScope scope( AllocAccounting::stageCounts(
+                              pInv, AllocAccounting::StageRelease ) );
+        poArgs.reset();
     }
     catch (bplus::ConversionException& /*exc*/ )
     {
-        s_pCoreFuncs->postError( tid, "invalid input", "conversion exception" );
+        pFuncs->postError( tid, "invalid input", "conversion exception" );
         return;
     }
     // TODO: other catch's could possibly go here
 }
 
 
+inline void
+Service::tracePostResults( unsigned int tid, const BPElement* pResults )
+{
+    InvocationTrace* pTrace = invocationTrace();
+    if (pTrace) pTrace->recordResults( tid, pResults );
+    s_pCoreFuncs->postResults( tid, pResults );
+}
+
+
+inline void
+Service::tracePostError( unsigned int tid, const char* cszError,
+                         const char* cszVerbose )
+{
+    InvocationTrace* pTrace = invocationTrace();
+    if (pTrace) pTrace->recordError( tid, cszError, cszVerbose );
+    s_pCoreFuncs->postError( tid, cszError, cszVerbose );
+}
+
+
+inline void
+Service::traceInvokeCallback( unsigned int tid, BPCallBack cb,
+                              const BPElement* pParams )
+{
+    InvocationTrace* pTrace = invocationTrace();
+    if (pTrace) pTrace->recordCallback( tid, cb, pParams );
+    s_pCoreFuncs->invoke( tid, cb, pParams );
+}
+
+
 inline void
 Service::bppCancel( void* pInstance, unsigned int tid )
 {
@@ -289,7 +882,7 @@ Service::bppUninstall(const BPPath serviceDir, const BPPath dataDir)
 //
 
 
-#define BP_SERVICE_DEFNS( className ) \
+#define BP_SERVICE_COMMON_DEFNS( className ) \
 extern "C" \
 { \
     const BPPFunctionTable* BPPGetEntryPoints() \
@@ -303,16 +896,28 @@ bplus::tPathString bplus::service::Service::s_serviceDir; \
 bplus::tPathString bplus::service::Service::s_dependentDir; \
 bplus::Object* bplus::service::Service::s_pDependentParams = NULL; \
 bplus::service::Description bplus::service::Service::s_description; \
+volatile long bplus::service::Service::s_nDescriptionState = 0; \
+bplus::thread::Pool* bplus::service::Service::s_pThreadPool = NULL; \
+bplus::thread::TimerWheel* bplus::service::Service::s_pTimerWheel = NULL; \
+bool bplus::service::Service::s_bValidateUtf8 = false; \
+volatile long bplus::service::Service::s_nLogLevel = BP_DEBUG; \
+bplus::service::AsyncLog* bplus::service::Service::s_pAsyncLog = NULL; \
+bplus::service::BinaryLog* bplus::service::Service::s_pBinaryLog = NULL; \
+bplus::service::InvocationTrace* \
+    bplus::service::Service::s_pInvocationTrace = NULL; \
+bplus::service::AllocAccounting* \
+    bplus::service::Service::s_pAllocAccounting = NULL; \
+BPCFunctionTable bplus::service::Service::s_tracingCoreFuncs; \
+bplus::url::OriginCache bplus::service::Service::s_originCache; \
+bplus::url::OriginPolicy bplus::service::Service::s_originPolicy; \
+bplus::url::OriginPolicyTable \
+    bplus::service::Service::s_methodOriginPolicies; \
 \
 bplus::service::Service* bplus::service::Service::createInstance() \
 { \
     return new className(); \
 } \
 \
-typedef void (className::* tInvokableFunc)( const bplus::service::Transaction& tran, \
-                                            const bplus::Map& args ); \
-std::map<std::string, tInvokableFunc> className::s_mapFuncs; \
-\
 inline bool bplus::service::Service::callInitializeHook() \
 { \
     return className::onInitialize(); \
@@ -336,6 +941,24 @@ inline int bplus::service::Service::callUninstallHook(const BPPath serviceDir, \
 }
 
 
+#define BP_SERVICE_DEFNS( className ) \
+BP_SERVICE_COMMON_DEFNS( className ) \
+\
+typedef void (className::* tInvokableFunc)( const bplus::service::Transaction& tran, \
+                                            const bplus::Map& args ); \
+std::map<std::string, tInvokableFunc> className::s_mapFuncs; \
+\
+const BPServiceDefinition* bplus::service::Service::staticDefinition() \
+{ \
+    return NULL; \
+} \
+\
+const char* bplus::service::Service::staticDispatchMismatch() \
+{ \
+    return NULL; \
+}
+
+
 
 //////////////////////////////
 // BP_SERVICE_DESC
@@ -380,6 +1003,21 @@ void bplus::service::Service::setupDescription() \
 }
 
 
+// Restrict a method added with ADD_BP_METHOD to, or exclude it from,
+// callers whose origin matches pattern.  See bplus::url::OriginPolicy
+// for the pattern syntax.
+#define ALLOW_BP_METHOD_ORIGIN( func, pattern ) \
+{ \
+    originPolicy( #func ).allow( pattern ); \
+}
+
+
+#define DENY_BP_METHOD_ORIGIN( func, pattern ) \
+{ \
+    originPolicy( #func ).deny( pattern ); \
+}
+
+
 #define END_BP_SERVICE_DESC \
 }
 
@@ -410,4 +1048,163 @@ void invoke( const char* cszFuncName, \
 }
 
 
+//////////////////////////////
+// BP_STATIC_SERVICE_DESC
+//
+// An alternative to BP_SERVICE_DESC where the service definition and
+// the dispatch table are constant data, laid out by the compiler.
+// Loading such a service does no work beyond returning a pointer.
+//
+// Usage (argument blocks must precede the description, and the dispatch
+// table must follow it):
+//
+//   class MyService : public bplus::service::Service
+//   {
+//   public:
+//       BP_STATIC_SERVICE( MyService )
+//       void greet( const bplus::service::Transaction& tran,
+//                   const bplus::Map& args );
+//       void ping( const bplus::service::Transaction& tran,
+//                  const bplus::Map& args );
+//   };
+//
+//   BP_STATIC_METHOD_ARGS( MyService, greet )
+//       BP_STATIC_ARG( "name", String, true, "Who to greet." )
+//   END_BP_STATIC_METHOD_ARGS
+//
+//   BP_STATIC_SERVICE_DESC( MyService, "MyService", 1, 0, 0, "Greets." )
+//       BP_STATIC_METHOD( MyService, greet, "Greet someone." )
+//       BP_STATIC_METHOD_NOARGS( MyService, ping, "Are you there?" )
+//   END_BP_STATIC_SERVICE_DESC( MyService )
+//
+//   BP_STATIC_DISPATCH( MyService )
+//       BP_STATIC_DISPATCH_METHOD( MyService, greet )
+//       BP_STATIC_DISPATCH_METHOD( MyService, ping )
+//   END_BP_STATIC_DISPATCH( MyService )
+//
+// Argument types are spelled as for ADD_BP_METHOD_ARG.
+// s_description is only populated if something asks for it
+// (e.g. fullName()).
+//
+
+#define BP_STATIC_METHOD_ARGS( className, funcName ) \
+static const BPArgumentDefinition s_bpStaticArgs_##className##_##funcName[] = \
+{
+
+
+#define BP_STATIC_ARG( argName, argType, reqd, docString ) \
+    { (BPString) argName, (BPString) docString, \
+      BP_STATIC_ARGTYPE_##argType, (reqd) ? BP_TRUE : BP_FALSE },
+
+
+#define END_BP_STATIC_METHOD_ARGS \
+};
+
+
+#define BP_STATIC_SERVICE_DESC( className, serviceName, \
+                                major, minor, micro, docString ) \
+BP_SERVICE_COMMON_DEFNS( className ) \
+\
+static const char s_bpStaticName_##className[] = serviceName; \
+static const char s_bpStaticDoc_##className[] = docString; \
+enum { \
+    bpStaticMajor_##className = major, \
+    bpStaticMinor_##className = minor, \
+    bpStaticMicro_##className = micro \
+}; \
+static const BPFunctionDefinition s_bpStaticFuncs_##className[] = \
+{
+
+
+#define BP_STATIC_METHOD( className, funcName, docString ) \
+    { (BPString) #funcName, (BPString) docString, \
+      sizeof(s_bpStaticArgs_##className##_##funcName) / \
+          sizeof(BPArgumentDefinition), \
+      (BPArgumentDefinition *) s_bpStaticArgs_##className##_##funcName },
+
+
+#define BP_STATIC_METHOD_NOARGS( className, funcName, docString ) \
+    { (BPString) #funcName, (BPString) docString, 0, NULL },
+
+
+#define END_BP_STATIC_SERVICE_DESC( className ) \
+}; \
+\
+static const BPServiceDefinition s_bpStaticDef_##className = \
+{ \
+    (BPString) s_bpStaticName_##className, \
+    bpStaticMajor_##className, \
+    bpStaticMinor_##className, \
+    bpStaticMicro_##className, \
+    (BPString) s_bpStaticDoc_##className, \
+    sizeof(s_bpStaticFuncs_##className) / sizeof(BPFunctionDefinition), \
+    (BPFunctionDefinition *) s_bpStaticFuncs_##className \
+}; \
+\
+const BPServiceDefinition* bplus::service::Service::staticDefinition() \
+{ \
+    return &s_bpStaticDef_##className; \
+} \
+\
+void bplus::service::Service::setupDescription() \
+{ \
+    s_description.fromBPServiceDefinition( &s_bpStaticDef_##className ); \
+}
+
+
+#define BP_STATIC_DISPATCH( className ) \
+const bplus::service::StaticMethod<className> \
+className::s_bpStaticMethods[] = \
+{
+
+
+#define BP_STATIC_DISPATCH_METHOD( className, funcName ) \
+    { #funcName, &className::funcName },
+
+
+// Terminates the table, and fails to compile if the dispatch table
+// and the description disagree on the number of methods.  Names are
+// compared, in order, when the service loads: bppInitialize fails on a
+// mismatch.
+#define END_BP_STATIC_DISPATCH( className ) \
+    { NULL, NULL } \
+}; \
+\
+typedef char bpStaticDispatchCheck_##className[ \
+    (sizeof(className::s_bpStaticMethods) / \
+         sizeof(bplus::service::StaticMethod<className>) - 1 == \
+     sizeof(s_bpStaticFuncs_##className) / \
+         sizeof(BPFunctionDefinition)) ? 1 : -1 ]; \
+\
+const char* bplus::service::Service::staticDispatchMismatch() \
+{ \
+    return bplus::service::mismatchedStaticMethod( \
+        className::s_bpStaticMethods, s_bpStaticFuncs_##className, \
+        sizeof(s_bpStaticFuncs_##className) / \
+            sizeof(BPFunctionDefinition) ); \
+}
+
+
+//////////////////////////////
+// BP_STATIC_SERVICE
+//
+// In-class counterpart of BP_SERVICE for services using
+// BP_STATIC_SERVICE_DESC.
+#define BP_STATIC_SERVICE( className ) \
+static const bplus::service::StaticMethod<className> s_bpStaticMethods[]; \
+\
+void invoke( const char* cszFuncName, \
+             const bplus::service::Transaction& tran, \
+             const bplus::Map& args ) \
+{ \
+    const bplus::service::StaticMethod<className>* pMethod = \
+        bplus::service::findStaticMethod( s_bpStaticMethods, cszFuncName ); \
+    if (!pMethod) { \
+        tran.error( "invalid input", "method does not exist" ); \
+        return; \
+    } \
+    (this->*(pMethod->func))( tran, args ); \
+}
+
+
 #endif // BPSERVICEIMPL_H_
@@ -46,6 +46,12 @@ extern "C" {
  *  completion of the function execution.  Be more specific when
  *  possible */
 #define BPE_INTERNAL_ERROR "internalError"
+/** the function did not complete within its deadline */
+#define BPE_TIMED_OUT "timedOut"
+/** the calling page's origin is not permitted to use the function */
+#define BPE_PERMISSION_DENIED "permissionDenied"
+/** reading or writing a file failed */
+#define BPE_IO_ERROR "ioError"
 
 #ifdef __cplusplus
 };
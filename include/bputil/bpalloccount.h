@@ -0,0 +1,304 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpalloccount.h
+ *
+ *  Per-thread heap allocation counting.  An AllocScope directs counts
+ *  of the allocations and frees made on its thread into an AllocCounts
+ *  for as long as it is open; scopes nest, the innermost one counting.
+ *
+ *  Counts come from replacement operator new and delete, which a
+ *  library opts into by expanding BP_COUNT_ALLOCATIONS once at file
+ *  scope.  They are meant to see the allocations made by code compiled
+ *  into that library (header-only framework code included), not the
+ *  rest of the process.  On Linux that takes linking the library with
+ *  -Wl,-Bsymbolic-functions, or the runtime's operators, loaded first,
+ *  take the library's calls; shared libraries on Windows and Mac OS X
+ *  bind to their own definitions already.  Allocations made inside the
+ *  C++ runtime's own compiled code (some std::string growth, for one)
+ *  are not seen, though they may be seen freed, so live byte figures
+ *  are approximate.
+ */
+
+#ifndef BPALLOCCOUNT_H_
+#define BPALLOCCOUNT_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+
+#if defined(WIN32)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#ifndef BP_THREAD_LOCAL
+#ifdef WIN32
+#define BP_THREAD_LOCAL __declspec(thread)
+#else
+#define BP_THREAD_LOCAL __thread
+#endif
+#endif
+
+
+namespace bplus {
+namespace memory {
+
+
+struct AllocCounts
+{
+    AllocCounts() : allocs(0), frees(0), bytesAllocated(0), bytesFreed(0),
+                    peakBytes(0) {}
+
+    unsigned long long allocs;
+    unsigned long long frees;
+    unsigned long long bytesAllocated;
+    unsigned long long bytesFreed;
+    /** the most bytesAllocated - bytesFreed reached */
+    long long peakBytes;
+
+    long long liveBytes() const
+    {
+        return (long long) bytesAllocated - (long long) bytesFreed;
+    }
+};
+
+
+class AllocScope
+{
+  public:
+    /** count this thread's allocations into *pCounts until destroyed.
+     *  a NULL pCounts makes an inactive scope, for callers that count
+     *  only some of the time. */
+    explicit AllocScope(AllocCounts * pCounts);
+    ~AllocScope();
+
+    /** called by the counting operators */
+    static void noteAlloc(size_t nBytes);
+    static void noteFree(size_t nBytes);
+
+    /** true if BP_COUNT_ALLOCATIONS is in this library, so scopes
+     *  will see anything */
+    static bool countingInstalled();
+
+  private:
+    static AllocCounts *& current();
+
+    AllocCounts * m_pCounts;
+    AllocCounts * m_pPrev;
+
+    AllocScope(const AllocScope &);
+    AllocScope & operator=(const AllocScope &);
+};
+
+
+namespace detail {
+
+/** malloc with operator new's failure handling.  NULL only when
+ *  bNoThrow. */
+void * countedAlloc(size_t nBytes, bool bNoThrow);
+void countedFree(void * p);
+bool & countingInstalledFlag();
+
+} // namespace detail
+
+
+//////////////////////////////////////////////////////////////////////
+// Implementation
+
+inline
+AllocScope::AllocScope(AllocCounts * pCounts) :
+    m_pCounts(pCounts), m_pPrev(NULL)
+{
+    if (m_pCounts) {
+        m_pPrev = current();
+        current() = m_pCounts;
+    }
+}
+
+inline
+AllocScope::~AllocScope()
+{
+    if (m_pCounts) current() = m_pPrev;
+}
+
+inline AllocCounts *&
+AllocScope::current()
+{
+    static BP_THREAD_LOCAL AllocCounts * s_pCurrent = NULL;
+    return s_pCurrent;
+}
+
+inline void
+AllocScope::noteAlloc(size_t nBytes)
+{
+    AllocCounts * p = current();
+    if (!p) return;
+    p->allocs++;
+    p->bytesAllocated += nBytes;
+    long long nLive = p->liveBytes();
+    if (nLive > p->peakBytes) p->peakBytes = nLive;
+}
+
+inline void
+AllocScope::noteFree(size_t nBytes)
+{
+    AllocCounts * p = current();
+    if (!p) return;
+    p->frees++;
+    p->bytesFreed += nBytes;
+}
+
+inline bool
+AllocScope::countingInstalled()
+{
+    return detail::countingInstalledFlag();
+}
+
+
+namespace detail {
+
+// The block's usable size stands in for the requested size, so a free
+// counts exactly what its allocation did.
+inline size_t
+blockSize(void * p)
+{
+#if defined(WIN32)
+    return _msize(p);
+#elif defined(__APPLE__)
+    return malloc_size(p);
+#else
+    return malloc_usable_size(p);
+#endif
+}
+
+inline void *
+countedAlloc(size_t nBytes, bool bNoThrow)
+{
+    void * p;
+    while ((p = malloc(nBytes ? nBytes : 1)) == NULL) {
+        std::new_handler pfn = std::set_new_handler(NULL);
+        std::set_new_handler(pfn);
+        if (!pfn) {
+            if (bNoThrow) return NULL;
+            throw std::bad_alloc();
+        }
+        pfn();
+    }
+    AllocScope::noteAlloc(blockSize(p));
+    return p;
+}
+
+inline void
+countedFree(void * p)
+{
+    if (!p) return;
+    AllocScope::noteFree(blockSize(p));
+    free(p);
+}
+
+inline bool &
+countingInstalledFlag()
+{
+    static bool s_bInstalled = false;
+    return s_bInstalled;
+}
+
+} // namespace detail
+
+
+} // namespace memory
+} // namespace bplus
+
+
+//////////////////////////////////////////////////////////////////////
+// The counting operators.  Expand BP_COUNT_ALLOCATIONS once, at file
+// scope, in one source file of the library to be counted.
+
+#if __cplusplus >= 201103L
+#define BP_ALLOC_THROWS
+#define BP_ALLOC_NOTHROW noexcept
+#else
+#define BP_ALLOC_THROWS throw(std::bad_alloc)
+#define BP_ALLOC_NOTHROW throw()
+#endif
+
+#if defined(__cpp_sized_deallocation)
+#define BP_COUNT_SIZED_DELETE \
+void operator delete(void * p, size_t) BP_ALLOC_NOTHROW \
+{ \
+    bplus::memory::detail::countedFree(p); \
+} \
+void operator delete[](void * p, size_t) BP_ALLOC_NOTHROW \
+{ \
+    bplus::memory::detail::countedFree(p); \
+}
+#else
+#define BP_COUNT_SIZED_DELETE
+#endif
+
+#define BP_COUNT_ALLOCATIONS \
+void * operator new(size_t n) BP_ALLOC_THROWS \
+{ \
+    return bplus::memory::detail::countedAlloc(n, false); \
+} \
+void * operator new[](size_t n) BP_ALLOC_THROWS \
+{ \
+    return bplus::memory::detail::countedAlloc(n, false); \
+} \
+void * operator new(size_t n, \
+                    const std::nothrow_t &) BP_ALLOC_NOTHROW \
+{ \
+    return bplus::memory::detail::countedAlloc(n, true); \
+} \
+void * operator new[](size_t n, \
+                      const std::nothrow_t &) BP_ALLOC_NOTHROW \
+{ \
+    return bplus::memory::detail::countedAlloc(n, true); \
+} \
+void operator delete(void * p) BP_ALLOC_NOTHROW \
+{ \
+    bplus::memory::detail::countedFree(p); \
+} \
+void operator delete[](void * p) BP_ALLOC_NOTHROW \
+{ \
+    bplus::memory::detail::countedFree(p); \
+} \
+void operator delete(void * p, \
+                     const std::nothrow_t &) BP_ALLOC_NOTHROW \
+{ \
+    bplus::memory::detail::countedFree(p); \
+} \
+void operator delete[](void * p, \
+                       const std::nothrow_t &) BP_ALLOC_NOTHROW \
+{ \
+    bplus::memory::detail::countedFree(p); \
+} \
+BP_COUNT_SIZED_DELETE \
+static const bool s_bpAllocCountingInstalled = \
+    (bplus::memory::detail::countingInstalledFlag() = true);
+
+#endif // BPALLOCCOUNT_H_
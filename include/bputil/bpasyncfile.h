@@ -0,0 +1,259 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpasyncfile.h
+ *
+ *  Asynchronous file I/O.  An AsyncFile engine reads and writes at
+ *  offsets in any number of open files and calls back when each
+ *  operation ends, so a service working through many files -- hashing,
+ *  thumbnailing, extracting -- keeps a deep queue of I/O in flight
+ *  without a thread blocked on each.
+ *
+ *  On Linux the engine drives an io_uring: operations are queued in
+ *  the submission ring and handed to the kernel together by submit(),
+ *  and one engine thread reaps completions.  Where io_uring is missing
+ *  (older kernels, seccomp sandboxes, other systems) a small pool of
+ *  threads runs blocking pread()/pwrite() instead.  The API and
+ *  callback semantics are the same either way.
+ *
+ *  Not available on Windows.
+ */
+
+#ifndef BPASYNCFILE_H_
+#define BPASYNCFILE_H_
+
+#ifdef WIN32
+#error "bplus::io::AsyncFile is not available on Windows"
+#endif
+
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+#include "bputil/bpsync.h"
+#include "bputil/bpthread.h"
+#include "bputil/bpthreadpool.h"
+
+
+namespace bplus {
+namespace io {
+
+
+/** how an operation ended */
+struct IoResult
+{
+    /** 0, or the errno value the operation failed with */
+    int error;
+    /** bytes transferred.  As with pread(), a read may return fewer
+     *  bytes than asked for, and 0 at end of file. */
+    size_t bytes;
+    /** the operation's buffer and file offset */
+    char * buffer;
+    unsigned long long offset;
+};
+
+/** called once per operation, on an engine thread.  Callbacks may
+ *  start further operations but should not block. */
+typedef void (*IoCallback)(const IoResult & result, void * cookie);
+
+/** \overload an object told of an operation's end.  The engine takes
+ *  ownership and deletes it after complete() returns. */
+class IoHandler
+{
+  public:
+    virtual ~IoHandler() {}
+    virtual void complete(const IoResult & result) = 0;
+};
+
+
+class AsyncFile
+{
+  public:
+    struct Options
+    {
+        Options() : queueDepth(128), fallbackThreads(4),
+                    forceFallback(false) {}
+
+        /** operations the kernel is given at once.  More may be
+         *  started; they wait in the engine until there is room. */
+        unsigned int queueDepth;
+        /** threads running operations when io_uring isn't available */
+        unsigned int fallbackThreads;
+        /** use the thread pool even where io_uring is available */
+        bool forceFallback;
+    };
+
+    struct Stats
+    {
+        unsigned long long started;     // operations accepted
+        unsigned long long completed;   // callbacks run
+        unsigned long long failed;      // ...with a non-zero error
+        unsigned long long fixed;       // run on a registered buffer
+        unsigned long long submits;     // submission system calls
+        unsigned long long maxInFlight; // most operations with the kernel
+    };
+
+    AsyncFile();
+    explicit AsyncFile(const Options & options);
+
+    /** see shutdown() */
+    ~AsyncFile();
+
+    /** true if operations go through io_uring, false if through the
+     *  fallback thread pool */
+    bool usingIoUring() const;
+
+    /**
+     * Register buffers that operations will often use.  Reads and
+     * writes falling wholly within a registered buffer skip the
+     * kernel's per-operation page pinning.  The buffers must stay
+     * valid until the engine is destroyed.  May be called once, before
+     * any operation is started.  On failure -- typically RLIMIT_MEMLOCK
+     * -- errno is set and operations simply run unregistered.
+     */
+    bool registerBuffers(char * const * buffers, const size_t * sizes,
+                         unsigned int count);
+
+    /**
+     * Start reading n bytes at offset in fd into buffer, or writing
+     * them from it.  The descriptor and buffer must stay valid until
+     * the callback.  Operations are queued: they reach the kernel at
+     * the next submit(), or sooner if the queue fills or the engine
+     * makes room for waiting operations.  Returns false, and
+     * never calls back, once shutdown() has begun.  Any thread,
+     * including from a callback.
+     */
+    bool read(int fd, char * buffer, size_t n, unsigned long long offset,
+              IoCallback cb, void * cookie);
+    bool write(int fd, const char * buffer, size_t n,
+               unsigned long long offset, IoCallback cb, void * cookie);
+
+    /** start flushing fd's data and metadata to storage, as fsync() */
+    bool fsync(int fd, IoCallback cb, void * cookie);
+
+    /** \overload */
+    bool read(int fd, char * buffer, size_t n, unsigned long long offset,
+              IoHandler * handler);
+    /** \overload */
+    bool write(int fd, const char * buffer, size_t n,
+               unsigned long long offset, IoHandler * handler);
+    /** \overload */
+    bool fsync(int fd, IoHandler * handler);
+
+    /** hand everything queued to the kernel (or the pool) in one
+     *  go.  Any thread. */
+    void submit();
+
+    /** operations started whose callbacks haven't returned */
+    unsigned long pending() const;
+
+    Stats stats() const;
+
+    /**
+     * Submit what is queued, wait for every operation's callback to
+     * return, and stop the engine's threads.  Safe to call more than
+     * once.  Must not be called from a callback.
+     */
+    void shutdown();
+
+  private:
+    enum OpKind { OpRead, OpWrite, OpFsync, OpWake };
+
+    struct Op {
+        OpKind kind;
+        int fd;
+        char * buffer;
+        size_t n;
+        unsigned long long offset;
+        int bufferIndex;            // registered buffer, or -1
+        IoCallback cb;
+        void * cookie;
+        AsyncFile * engine;
+    };
+
+    struct Registered {
+        char * p;
+        size_t n;
+        unsigned int index;
+        bool operator<(const Registered & r) const { return p < r.p; }
+    };
+
+    struct Ring;
+
+    void init();
+    bool start(Op * op);
+    int registeredIndex(const char * p, size_t n) const;
+    void finish(Op * op, long long result);
+    static void handlerTrampoline(const IoResult & result, void * cookie);
+
+    // the io_uring engine (bpasyncfileimpl_linux.h)
+    bool ringInit();
+    void ringDestroy();
+    bool ringRegister(const std::vector<Registered> & buffers);
+    void ringQueueLocked(Op * op);
+    void ringEnterLocked();
+    void ringWakeLocked();
+    static void * ringThreadMain(void * cookie);
+    void ringReap();
+
+    // the thread pool engine
+    void poolSubmitLocked();
+    static void poolRun(void * cookie);
+
+    Options m_options;
+    Ring * m_pRing;
+    bplus::thread::Pool * m_pPool;
+
+    mutable bplus::sync::Mutex m_mutex;
+    std::deque<Op *> m_backlog;         // waiting for room in the ring
+    std::vector<Op *> m_queued;         // waiting for submit()
+    std::vector<Registered> m_buffers;  // sorted by address
+    bool m_bRegistered;
+    bool m_bStarted;
+    bool m_bShutdown;
+    unsigned int m_inRing;              // with the kernel, under m_mutex
+    volatile long m_pending;
+
+    volatile long m_started;
+    volatile long m_completed;
+    volatile long m_failed;
+    volatile long m_fixed;
+    volatile long m_submits;
+    unsigned int m_maxInRing;
+
+    bplus::thread::Thread m_thread;
+    bool m_bThreadRunning;
+
+    AsyncFile(const AsyncFile &);
+    AsyncFile & operator=(const AsyncFile &);
+};
+
+
+} // namespace io
+} // namespace bplus
+
+
+// #include the inline implementations
+#include "impl/bpasyncfileimpl.h"
+
+#endif // BPASYNCFILE_H_
@@ -0,0 +1,153 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpatomic.h
+ *
+ *  Portable atomic operations on longs and pointers with explicit
+ *  memory ordering, plus small wrappers for counters, flags and
+ *  pointers.  The orderings follow the C++11 model; on platforms whose
+ *  primitives are always full barriers a weaker order is simply
+ *  upgraded.
+ */
+
+#ifndef BPATOMIC_H_
+#define BPATOMIC_H_
+
+#include <stddef.h>
+
+namespace bplus { namespace sync {
+
+enum MemoryOrder {
+    MemoryOrderRelaxed,
+    MemoryOrderAcquire,
+    MemoryOrderRelease,
+    MemoryOrderAcqRel,
+    MemoryOrderSeqCst
+};
+
+long atomicLoad(const volatile long * p,
+                MemoryOrder order = MemoryOrderSeqCst);
+void atomicStore(volatile long * p, long v,
+                 MemoryOrder order = MemoryOrderSeqCst);
+/** returns the previous value */
+long atomicExchange(volatile long * p, long v,
+                    MemoryOrder order = MemoryOrderSeqCst);
+/** add d to *p, returns the new value */
+long atomicAdd(volatile long * p, long d,
+               MemoryOrder order = MemoryOrderSeqCst);
+/** if *p == expected, set it to desired.  returns true on success */
+bool atomicCompareExchange(volatile long * p, long expected, long desired,
+                           MemoryOrder order = MemoryOrderSeqCst);
+
+void * atomicLoadPtr(void * const volatile * p,
+                     MemoryOrder order = MemoryOrderSeqCst);
+void atomicStorePtr(void * volatile * p, void * v,
+                    MemoryOrder order = MemoryOrderSeqCst);
+void * atomicExchangePtr(void * volatile * p, void * v,
+                         MemoryOrder order = MemoryOrderSeqCst);
+bool atomicCompareExchangePtr(void * volatile * p, void * expected,
+                              void * desired,
+                              MemoryOrder order = MemoryOrderSeqCst);
+
+void atomicFence(MemoryOrder order = MemoryOrderSeqCst);
+
+/** a hint to the cpu that we're in a spin-wait loop */
+void cpuRelax();
+
+
+/** an atomic counter */
+class AtomicCounter {
+  public:
+    explicit AtomicCounter(long v = 0) : m_value( v ) { }
+    long load(MemoryOrder o = MemoryOrderSeqCst) const
+        { return atomicLoad(&m_value, o); }
+    void store(long v, MemoryOrder o = MemoryOrderSeqCst)
+        { atomicStore(&m_value, v, o); }
+    long exchange(long v, MemoryOrder o = MemoryOrderSeqCst)
+        { return atomicExchange(&m_value, v, o); }
+    /** returns the new value */
+    long add(long d, MemoryOrder o = MemoryOrderSeqCst)
+        { return atomicAdd(&m_value, d, o); }
+    long increment(MemoryOrder o = MemoryOrderSeqCst)
+        { return atomicAdd(&m_value, 1, o); }
+    long decrement(MemoryOrder o = MemoryOrderSeqCst)
+        { return atomicAdd(&m_value, -1, o); }
+    bool compareExchange(long expected, long desired,
+                         MemoryOrder o = MemoryOrderSeqCst)
+        { return atomicCompareExchange(&m_value, expected, desired, o); }
+  private:
+    volatile long m_value;
+    AtomicCounter(const AtomicCounter &);
+    AtomicCounter& operator=(const AtomicCounter &);
+};
+
+/** an atomic boolean flag */
+class AtomicFlag {
+  public:
+    explicit AtomicFlag(bool b = false) : m_value( b ? 1 : 0 ) { }
+    /** set the flag, returns its previous state */
+    bool testAndSet(MemoryOrder o = MemoryOrderAcquire)
+        { return atomicExchange(&m_value, 1, o) != 0; }
+    void clear(MemoryOrder o = MemoryOrderRelease)
+        { atomicStore(&m_value, 0, o); }
+    bool isSet(MemoryOrder o = MemoryOrderAcquire) const
+        { return atomicLoad(&m_value, o) != 0; }
+  private:
+    volatile long m_value;
+    AtomicFlag(const AtomicFlag &);
+    AtomicFlag& operator=(const AtomicFlag &);
+};
+
+/** an atomic pointer */
+template <class T>
+class AtomicPtr {
+  public:
+    explicit AtomicPtr(T * p = NULL) : m_value( p ) { }
+    T * load(MemoryOrder o = MemoryOrderSeqCst) const
+        { return (T *) atomicLoadPtr(&m_value, o); }
+    void store(T * p, MemoryOrder o = MemoryOrderSeqCst)
+        { atomicStorePtr(&m_value, (void *) p, o); }
+    T * exchange(T * p, MemoryOrder o = MemoryOrderSeqCst)
+        { return (T *) atomicExchangePtr(&m_value, (void *) p, o); }
+    bool compareExchange(T * expected, T * desired,
+                         MemoryOrder o = MemoryOrderSeqCst)
+        { return atomicCompareExchangePtr(&m_value, (void *) expected,
+                                          (void *) desired, o); }
+  private:
+    void * volatile m_value;
+    AtomicPtr(const AtomicPtr &);
+    AtomicPtr& operator=(const AtomicPtr &);
+};
+
+}}
+
+
+// #include the inline implementations
+#ifdef WIN32
+#include "impl/bpatomicimpl_windows.h"
+#else
+#include "impl/bpatomicimpl_unix.h"
+#endif
+
+
+#endif
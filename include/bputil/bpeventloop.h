@@ -0,0 +1,199 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/**
+ *  bpeventloop.h -- a readiness based event loop for services that
+ *  wait on file descriptors.
+ *
+ *  An EventLoop multiplexes any number of descriptors (pipes, sockets,
+ *  inotify handles, ...) on one thread, calling back as they become
+ *  readable or writable.  It also runs timers and functions posted from
+ *  other threads, all on the loop's thread, so loop callbacks never race
+ *  one another.
+ *
+ *  Callbacks run on the loop thread and must not block.
+ *
+ *  Currently implemented over epoll and eventfd, so Linux only.
+ */
+
+#ifndef BPEVENTLOOP_H_
+#define BPEVENTLOOP_H_
+
+#ifndef __linux__
+#error "bplus::io::EventLoop is only available on Linux"
+#endif
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "bputil/bpsync.h"
+#include "bputil/bpthread.h"
+
+
+namespace bplus {
+namespace io {
+
+
+/** readiness events, combined as a bitmask */
+enum {
+    EventRead = 1,
+    EventWrite = 2,
+    /** reported whether or not asked for */
+    EventError = 4,
+    /** reported whether or not asked for */
+    EventHangup = 8
+};
+
+/** called on the loop thread when fd is ready, events says how */
+typedef void (*FdCallback)(int fd, unsigned int events, void * cookie);
+
+/** a function run on the loop thread */
+typedef void (*LoopFunc)(void * cookie);
+
+/** identifies a loop timer.  0 is never a valid id. */
+typedef unsigned long long LoopTimerId;
+
+
+class EventLoop
+{
+  public:
+    EventLoop();
+
+    /** stops the loop, see stop() */
+    ~EventLoop();
+
+    /** false if the kernel objects backing the loop couldn't be
+     *  created, in which case nothing else will work */
+    bool valid() const;
+
+    /** run the loop on a thread of its own */
+    bool start();
+
+    /** \overload start the loop's thread with the given attributes,
+     *  e.g. to pin it to a core.  The name defaults to "bp-evloop". */
+    bool start(const bplus::thread::ThreadOptions & options);
+
+    /** run the loop on the calling thread until stop().  A stopped
+     *  loop may be run (or start()ed) again; a stop() that comes
+     *  before run() is forgotten */
+    void run();
+
+    /** ask the loop to return.  May be called from any thread,
+     *  including from a callback.  If the loop was start()ed, waits
+     *  for its thread unless called on it.  Timers that haven't fired
+     *  are discarded.  Functions already posted still run, on the loop
+     *  thread, before run() returns; any posted later are run by the
+     *  destructor, on its thread, so posted work is never lost. */
+    void stop();
+
+    /** true on the thread running the loop */
+    bool isLoopThread() const;
+
+    /** Watch fd for events (EventRead and/or EventWrite).  Replaces
+     *  any existing watch on fd.  The loop doesn't take ownership of
+     *  fd, unwatch() it before closing it.  Any thread. */
+    bool watch(int fd, unsigned int events, FdCallback cb, void * cookie);
+
+    /** change the events watched on fd.  Any thread. */
+    bool modify(int fd, unsigned int events);
+
+    /** stop watching fd.  Once this returns on the loop thread, or
+     *  the next loop iteration has started, cb won't be called again
+     *  for fd.  Any thread. */
+    void unwatch(int fd);
+
+    /** run func(cookie) on the loop thread after msec.  Any thread. */
+    LoopTimerId runAfter(unsigned int msec, LoopFunc func, void * cookie);
+
+    /** run func(cookie) on the loop thread every msec until
+     *  cancelled.  Any thread. */
+    LoopTimerId runEvery(unsigned int msec, LoopFunc func, void * cookie);
+
+    /** returns true if the timer won't run (again).  Any thread. */
+    bool cancelTimer(LoopTimerId id);
+
+    /** run func(cookie) on the loop thread, soon.  Any thread. */
+    void post(LoopFunc func, void * cookie);
+
+  private:
+    struct Watch {
+        int fd;
+        unsigned int events;
+        FdCallback cb;
+        void * cookie;
+        bool bDead;
+    };
+
+    struct Timer {
+        LoopFunc func;
+        void * cookie;
+        unsigned long long periodMicros;
+    };
+
+    typedef std::pair<unsigned long long, LoopTimerId> TimerKey;
+
+    struct Posted {
+        LoopFunc func;
+        void * cookie;
+    };
+
+    LoopTimerId addTimer(unsigned int msec, unsigned int periodMsec,
+                         LoopFunc func, void * cookie);
+    void wake();
+    int nextTimeout();
+    bool runPosted();
+    void runTimers();
+    void dispatch(Watch * w, unsigned int events);
+    void loop();
+    static void * threadMain(void * cookie);
+
+    int m_epollFd;
+    int m_wakeFd;
+    volatile long m_wakePending;
+    volatile long m_stopping;
+    volatile long m_loopThread;     // pthread_self() of the loop, or 0
+
+    bplus::sync::Mutex m_mutex;
+    std::vector<Watch *> m_watches;         // indexed by fd
+    std::vector<Watch *> m_graveyard;       // freed between iterations
+    std::deque<Posted> m_posted;
+    std::map<TimerKey, Timer> m_timers;
+    std::map<LoopTimerId, unsigned long long> m_timerDeadlines;
+    LoopTimerId m_nextTimerId;
+
+    bplus::thread::Thread m_thread;
+    bool m_bThreadRunning;
+
+    EventLoop(const EventLoop &);
+    EventLoop & operator=(const EventLoop &);
+};
+
+
+} // namespace io
+} // namespace bplus
+
+
+// #include the inline implementations
+#include "impl/bpeventloopimpl_linux.h"
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpjson.h
+ *
+ *  Conversion between JSON text and bplus::Object hierarchies, for
+ *  tools and tests that feed services recorded or hand-written
+ *  arguments.
+ */
+
+#ifndef BPJSON_H_
+#define BPJSON_H_
+
+#include <string>
+#include "bputil/bpstringview.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace json {
+
+
+/**
+ * Parse a JSON document.  Numbers without a fraction or exponent that
+ * fit in 64 bits become Integers, others Doubles.
+ * \returns the root object, owned by the caller, or NULL on malformed
+ *          input, with a description of the problem (and its offset) in
+ *          *psError if non-null.
+ */
+Object* parse(const StringView& sIn, std::string* psError = NULL);
+
+/**
+ * Append elem to sOut as compact JSON.  Paths are written as strings
+ * and callbacks as integers; non-finite doubles as null.
+ */
+void serialize(const BPElement* elem, std::string& sOut);
+
+
+} // json
+} // bplus
+
+
+//////////////////////////////////////////////////////////////////////
+// Get the implementations.
+#include "impl/bpjsonimpl.h"
+
+
+#endif // BPJSON_H_
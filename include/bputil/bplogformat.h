@@ -0,0 +1,109 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bplogformat.h
+ *
+ *  Log arguments captured by value, and printf-style formatting of them
+ *  after the fact.  This lets a logger record a format string and its
+ *  arguments cheaply on the calling thread and produce the text later,
+ *  elsewhere.
+ */
+
+#ifndef BPLOGFORMAT_H_
+#define BPLOGFORMAT_H_
+
+#include <string>
+#include "bputil/bpstringview.h"
+
+
+namespace bplus {
+namespace logging {
+
+
+/**
+ * One captured argument.  Integers, floating point values and pointers
+ * are held by value; strings are referenced and must be copied by
+ * whoever keeps the Arg past the call that made it.
+ */
+struct Arg
+{
+    enum Type {
+        TypeInt,
+        TypeUInt,
+        TypeDouble,
+        TypeString,
+        TypePointer
+    };
+
+    Arg(int v) : type(TypeInt), len(0) { val.i = v; }
+    Arg(long v) : type(TypeInt), len(0) { val.i = v; }
+    Arg(long long v) : type(TypeInt), len(0) { val.i = v; }
+    Arg(unsigned int v) : type(TypeUInt), len(0) { val.u = v; }
+    Arg(unsigned long v) : type(TypeUInt), len(0) { val.u = v; }
+    Arg(unsigned long long v) : type(TypeUInt), len(0) { val.u = v; }
+    Arg(double v) : type(TypeDouble), len(0) { val.d = v; }
+    Arg(const char * s) : type(TypeString),
+                          len(s ? (unsigned int) strlen(s) : 6)
+        { val.s = s ? s : "(null)"; }
+    Arg(const std::string & s) : type(TypeString),
+                                 len((unsigned int) s.size())
+        { val.s = s.c_str(); }
+    Arg(const StringView & s) : type(TypeString),
+                                len((unsigned int) s.size())
+        { val.s = s.data(); }
+    Arg(const void * p) : type(TypePointer), len(0) { val.p = p; }
+
+    Type            type;
+    unsigned int    len;        // string length, for TypeString
+    union {
+        long long           i;
+        unsigned long long  u;
+        double              d;
+        const char *        s;
+        const void *        p;
+    } val;
+};
+
+
+/**
+ * Append fmt to sOut with its conversions filled from args, as
+ * snprintf would.  Conversions take the next argument whatever its
+ * captured type, converting as needed ("%d" of a double truncates, "%s"
+ * of a number prints it), so a mismatch garbles a value rather than
+ * crashing.  Length modifiers are ignored and '*' widths are not
+ * supported.  Conversions with no argument left are copied literally.
+ */
+void format(std::string & sOut, const char * fmt,
+            const Arg * args, unsigned int nArgs);
+
+
+} // logging
+} // bplus
+
+
+//////////////////////////////////////////////////////////////////////
+// Get the implementations.
+#include "impl/bplogformatimpl.h"
+
+
+#endif // BPLOGFORMAT_H_
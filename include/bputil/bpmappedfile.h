@@ -0,0 +1,143 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpmappedfile.h
+ *
+ *  Memory-mapped file access.  A MappedFile maps the whole of a file
+ *  into memory, so a service can hash, scan or patch a file it was
+ *  handed -- a Path or WritablePath argument, typically -- through a
+ *  pointer, without reading it into the heap.  Pages are read in by
+ *  the system as they are touched; advise() tells it what to expect.
+ */
+
+#ifndef BPMAPPEDFILE_H_
+#define BPMAPPEDFILE_H_
+
+#include <stddef.h>
+#include <string>
+
+#include "bputil/bppathstring.h"
+#include "bputil/bpstringview.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bplus {
+namespace io {
+
+
+class MappedFile
+{
+  public:
+    enum Mode {
+        ReadOnly,
+        /** stores through writableData() reach the file */
+        ReadWrite
+    };
+
+    /** access pattern hints for advise() */
+    enum Advice {
+        Normal,
+        Sequential,     // read ahead aggressively, drop pages behind
+        Random,         // don't read ahead
+        WillNeed,       // start reading the range in now
+        DontNeed,       // the range can be dropped from memory
+        HugePage        // back the range with huge pages, where possible
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    /** map the whole of an existing file.  false, with a description in
+     *  *psError if given, on failure. */
+    bool open(const tPathString & path, Mode mode = ReadOnly,
+              std::string * psError = NULL);
+
+    /** map a path argument.  a Path (BPTNativePath) may only be mapped
+     *  ReadOnly; ReadWrite needs a WritablePath. */
+    bool openArgument(const bplus::Object & arg, Mode mode = ReadOnly,
+                      std::string * psError = NULL);
+
+    /** create path, or truncate it, at nBytes of zeros, and map it
+     *  ReadWrite */
+    bool create(const tPathString & path, size_t nBytes,
+                std::string * psError = NULL);
+
+    /** unmap.  ReadWrite changes are left for the system to write
+     *  back; call flush() first to have them written now. */
+    void close();
+
+    bool isOpen() const { return m_bOpen; }
+    Mode mode() const { return m_mode; }
+
+    /** the mapped bytes; NULL for an empty file */
+    const char * data() const { return m_pData; }
+    /** NULL unless mapped ReadWrite */
+    char * writableData() { return m_mode == ReadWrite ? m_pData : NULL; }
+    size_t size() const { return m_nSize; }
+
+    /** the whole file */
+    StringView view() const { return StringView(m_pData, m_nSize); }
+
+    /** the nBytes from offset, clamped to the end of the file */
+    StringView span(size_t offset, size_t nBytes) const
+    {
+        return view().substr(offset, nBytes);
+    }
+
+    /** hint how the bytes from offset on (nBytes of them, or to the
+     *  end) will be used.  false if the hint is unsupported here or
+     *  was declined, which is harmless. */
+    bool advise(Advice advice, size_t offset = 0,
+                size_t nBytes = (size_t) -1);
+
+    /** write ReadWrite changes back to the file now */
+    bool flush();
+
+  private:
+    bool m_bOpen;
+    Mode m_mode;
+    char * m_pData;
+    size_t m_nSize;
+#ifdef WIN32
+    void * m_hFile;         // kept for flush()
+#endif
+
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+};
+
+
+} // namespace io
+} // namespace bplus
+
+
+// #include the inline implementations
+#ifdef WIN32
+#include "impl/bpmappedfileimpl_windows.h"
+#else
+#include "impl/bpmappedfileimpl_unix.h"
+#endif
+#include "impl/bpmappedfileimpl.h"
+
+
+#endif // BPMAPPEDFILE_H_
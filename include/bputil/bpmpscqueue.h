@@ -0,0 +1,137 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpmpscqueue.h
+ *
+ *  An unbounded lock-free multiple-producer, single-consumer queue
+ *  (after Dmitry Vyukov's node based MPSC queue).  Any number of
+ *  threads may push() concurrently; exactly one thread at a time may
+ *  pop().  push() is a single atomic exchange and never blocks.
+ */
+
+#ifndef BPMPSCQUEUE_H_
+#define BPMPSCQUEUE_H_
+
+#include <stddef.h>
+
+#include "bputil/bpatomic.h"
+
+
+namespace bplus {
+namespace sync {
+
+
+template <class T>
+class MPSCQueue
+{
+  public:
+    MPSCQueue();
+    ~MPSCQueue();
+
+    /** enqueue a copy of value.  may be called from any thread. */
+    void push(const T & value);
+
+    /** dequeue the oldest value into oValue.  consumer only.
+     *  returns false if the queue is (momentarily) empty. */
+    bool pop(T & oValue);
+
+    /** consumer only.  note a push in progress may not be visible. */
+    bool empty() const;
+
+  private:
+    struct Node {
+        Node * volatile next;
+        T value;
+    };
+
+    Node * volatile m_tail;     // producers exchange here
+    char m_pad[64 - sizeof(Node *)];
+    Node * m_head;              // consumer side, always a stub
+
+    MPSCQueue(const MPSCQueue &);
+    MPSCQueue & operator=(const MPSCQueue &);
+};
+
+
+template <class T>
+inline
+MPSCQueue<T>::MPSCQueue()
+{
+    Node * stub = new Node;
+    stub->next = NULL;
+    m_head = m_tail = stub;
+}
+
+template <class T>
+inline
+MPSCQueue<T>::~MPSCQueue()
+{
+    while (m_head != NULL) {
+        Node * next = m_head->next;
+        delete m_head;
+        m_head = next;
+    }
+}
+
+template <class T>
+inline void
+MPSCQueue<T>::push(const T & value)
+{
+    Node * n = new Node;
+    n->next = NULL;
+    n->value = value;
+    Node * prev = (Node *) atomicExchangePtr(
+        (void * volatile *) &m_tail, n);
+    // Until this store lands the consumer sees the queue end at prev.
+    atomicStorePtr((void * volatile *) &prev->next, n, MemoryOrderRelease);
+}
+
+template <class T>
+inline bool
+MPSCQueue<T>::pop(T & oValue)
+{
+    Node * head = m_head;
+    Node * next = (Node *) atomicLoadPtr(
+        (void * volatile *) &head->next, MemoryOrderAcquire);
+    if (next == NULL) return false;
+    oValue = next->value;
+    next->value = T();
+    m_head = next;
+    delete head;
+    return true;
+}
+
+template <class T>
+inline bool
+MPSCQueue<T>::empty() const
+{
+    return atomicLoadPtr(
+        (void * volatile *) &m_head->next, MemoryOrderAcquire) == NULL;
+}
+
+
+} // namespace sync
+} // namespace bplus
+
+
+#endif // BPMPSCQUEUE_H_
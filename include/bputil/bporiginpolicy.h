@@ -0,0 +1,150 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bporiginpolicy.h
+ *
+ *  Allow/deny rules over url origins, compiled into a trie of reversed
+ *  host labels so checking an origin costs time proportional to the
+ *  length of its host, however many rules there are.
+ */
+
+#ifndef BPORIGINPOLICY_H_
+#define BPORIGINPOLICY_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "bputil/bpurl.h"
+
+
+namespace bplus {
+namespace url {
+
+
+// A set of origin patterns, each allowing or denying.  A pattern is
+//     [scheme "://"] host [":" port]
+// where host is one of
+//     example.com      exactly that host
+//     *.example.com    any host below example.com (but not example.com)
+//     *                any host
+// and an omitted (or "*") scheme or port matches any.  Hosts compare
+// case-insensitively.
+//
+// An origin is allowed if it matches no deny rule and, when there are
+// any allow rules, matches at least one.  An invalid Origin -- from a
+// client URI such as about:blank or data: that names no host -- is
+// denied by any policy that has rules at all, so a deny list can't be
+// slipped past with an unparseable URI.  So is a host with an empty
+// label, such as ".example.com" or "example..com"; a single trailing
+// dot is ignored.
+//
+// Building a policy is not synchronized.  Once built, any number of
+// threads may check against it.
+class OriginPolicy
+{
+public:
+    OriginPolicy();
+
+    // Returns false, adding nothing, if sPattern is malformed.
+    bool        allow( const std::string& sPattern );
+    bool        deny( const std::string& sPattern );
+
+    bool        isAllowed( const Origin& origin ) const;
+
+    // True if there are no rules (everything is allowed).
+    bool        empty() const { return m_nRules == 0; }
+
+    void        clear();
+
+private:
+    struct Rule
+    {
+        std::string scheme;     // empty for any
+        int         port;       // -1 for any
+        bool        bDeny;
+    };
+
+    typedef std::vector<Rule> tRules;
+
+    struct Node
+    {
+        // sorted by label
+        std::vector< std::pair<std::string, size_t> > children;
+        tRules      exact;          // the host ending at this node
+        tRules      subdomains;     // hosts strictly below it
+    };
+
+    bool        addRule( const std::string& sPattern, bool bDeny );
+    size_t      findChild( size_t nNode, const StringView& sLabel,
+                           size_t* pnInsertAt ) const;
+    static void check( const tRules& rules, const Origin& origin,
+                       bool& bAllowed, bool& bDenied );
+
+    std::vector<Node> m_nodes;      // m_nodes[0] is the root
+    tRules      m_anyHost;
+    size_t      m_nRules;
+    size_t      m_nAllowRules;
+};
+
+
+// Policies by name, as a service's per-method policies.  Looking one
+// up doesn't allocate, and references to policies stay valid as more
+// are added.
+//
+// Adding is not synchronized.  Once built, any number of threads may
+// look policies up.
+class OriginPolicyTable
+{
+public:
+    OriginPolicyTable() {}
+    ~OriginPolicyTable();
+
+    // The policy for sName, added (with no rules) if need be.
+    OriginPolicy&       get( const std::string& sName );
+
+    // NULL if no policy has been added for sName.
+    const OriginPolicy* find( const StringView& sName ) const;
+
+    bool                empty() const { return m_entries.empty(); }
+
+private:
+    size_t      lowerBound( const StringView& sName ) const;
+
+    // sorted by name
+    std::vector< std::pair<std::string, OriginPolicy*> > m_entries;
+
+    OriginPolicyTable( const OriginPolicyTable& );
+    OriginPolicyTable& operator=( const OriginPolicyTable& );
+};
+
+
+} // namespace url
+} // namespace bplus
+
+
+//////////////////////////////////////////////////////////////////////
+// Get the implementations.
+#include "impl/bporiginpolicyimpl.h"
+
+
+#endif // BPORIGINPOLICY_H_
@@ -30,15 +30,23 @@
 #define BPSEMANTICVERSION_H__
 
 #include <string>
+#include <vector>
 
 namespace bplus {
 
 /**
  * A Class for representing, comparing and parsing semantic versions
+ *
+ * The four fields are packed into one 64 bit ordinal, 16 bits each with
+ * major the most significant, so comparing and matching are a masked
+ * integer compare.  Fields range from 0 to 65535; negative means
+ * wildcard.
  */ 
 class SemanticVersion
 {
 public:
+    typedef unsigned long long tOrdinal;
+
     SemanticVersion();
     virtual ~SemanticVersion();    
 
@@ -94,14 +102,57 @@ public:
 	 * Return true if all versions fields are -1
 	 */
 	bool isUnset() const {
-		return m_major == -1 && m_micro == -1 && m_minor == -1 && m_nano == 1;
+		return m_mask == 0;
 	}
 
+    /** The packed fields, with wildcard fields zero.  For versions
+     *  without wildcards, ordinal order is compare() order. */
+    tOrdinal ordinal() const { return m_ordinal; }
+
+    /** 0xffff in each field that is set, 0 in each wildcard */
+    tOrdinal mask() const { return m_mask; }
+
+private:
+    int getField(unsigned int shift) const;
+    void setField(unsigned int shift, int value);
+
+    tOrdinal m_ordinal;
+    tOrdinal m_mask;
+};
+
+
+/**
+ * A set of candidate versions, each tagged with a caller-chosen id,
+ * kept sorted so that finding the newest candidate that matches a
+ * wanted version and minimum version -- what a loop over
+ * SemanticVersion::isNewerMatch finds -- is a binary search.
+ */
+class VersionIndex
+{
+public:
+    VersionIndex();
+
+    void add(const SemanticVersion& version, size_t id);
+
+    size_t size() const { return m_ids.size(); }
+    void reserve(size_t n);
+    void clear();
+
+    /**
+     * Find the newest candidate matching wantver that is at least
+     * wantminver.  Of equal candidates, the one added last wins.
+     * \returns false if there is none.
+     */
+    bool resolve(const SemanticVersion& wantver,
+                 const SemanticVersion& wantminver,
+                 size_t& oId) const;
+
 private:
-    int m_major;
-    int m_minor;
-    int m_micro;
-    int m_nano;
+    // parallel arrays, in ascending ordinal order
+    std::vector<SemanticVersion::tOrdinal> m_ordinals;
+    std::vector<SemanticVersion::tOrdinal> m_masks;
+    std::vector<size_t> m_ids;
+    size_t m_nPartial;      // candidates with wildcard fields
 };
 
 } // namespace bplus
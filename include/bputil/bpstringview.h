@@ -0,0 +1,166 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpstringview.h
+ *
+ *  A non-owning reference to a range of characters, in the spirit of
+ *  C++17's std::string_view, usable with older compilers.  The viewed
+ *  characters must outlive the view and need not be NUL terminated.
+ */
+
+#ifndef BPSTRINGVIEW_H_
+#define BPSTRINGVIEW_H_
+
+#include <string.h>
+#include <string>
+
+
+namespace bplus {
+
+
+class StringView
+{
+  public:
+    StringView() : m_p(""), m_n(0) {}
+    StringView(const char * sz) : m_p(sz ? sz : ""), m_n(sz ? strlen(sz) : 0) {}
+    StringView(const char * p, size_t n) : m_p(p), m_n(n) {}
+    StringView(const std::string & s) : m_p(s.data()), m_n(s.size()) {}
+
+    const char * data() const { return m_p; }
+    size_t size() const { return m_n; }
+    size_t length() const { return m_n; }
+    bool empty() const { return m_n == 0; }
+    const char * begin() const { return m_p; }
+    const char * end() const { return m_p + m_n; }
+    char operator[](size_t i) const { return m_p[i]; }
+
+    /** an owning copy */
+    std::string toString() const { return std::string(m_p, m_n); }
+
+    /** the view of at most n characters starting at pos (clamped to
+     *  the end of the view) */
+    StringView substr(size_t pos, size_t n = std::string::npos) const
+    {
+        if (pos > m_n) pos = m_n;
+        if (n > m_n - pos) n = m_n - pos;
+        return StringView(m_p + pos, n);
+    }
+
+    void removePrefix(size_t n) { if (n > m_n) n = m_n; m_p += n; m_n -= n; }
+    void removeSuffix(size_t n) { if (n > m_n) n = m_n; m_n -= n; }
+
+    /** \returns offset of the first c at or after from, or
+     *           std::string::npos */
+    size_t find(char c, size_t from = 0) const
+    {
+        if (from >= m_n) return std::string::npos;
+        const void * hit = memchr(m_p + from, c, m_n - from);
+        return hit ? (const char *) hit - m_p : std::string::npos;
+    }
+
+    /** \returns offset of the last c, or std::string::npos */
+    size_t rfind(char c) const
+    {
+        for (size_t i = m_n; i > 0; i--) {
+            if (m_p[i - 1] == c) return i - 1;
+        }
+        return std::string::npos;
+    }
+
+    /** \returns offset of the first s at or after from, or
+     *           std::string::npos.  For repeated searches for the same
+     *           pattern see strutil::Needle. */
+    size_t find(const StringView & s, size_t from = 0) const
+    {
+        if (s.m_n == 0) return from <= m_n ? from : std::string::npos;
+        while (from + s.m_n <= m_n) {
+            size_t i = find(s.m_p[0], from);
+            if (i == std::string::npos || i + s.m_n > m_n) break;
+            if (memcmp(m_p + i, s.m_p, s.m_n) == 0) return i;
+            from = i + 1;
+        }
+        return std::string::npos;
+    }
+
+    /** \returns offset of the first character that is in chars */
+    size_t findFirstOf(const StringView & chars, size_t from = 0) const
+    {
+        for (size_t i = from; i < m_n; i++) {
+            if (memchr(chars.m_p, m_p[i], chars.m_n)) return i;
+        }
+        return std::string::npos;
+    }
+
+    bool startsWith(const StringView & s) const
+    {
+        return s.m_n <= m_n && memcmp(m_p, s.m_p, s.m_n) == 0;
+    }
+
+    bool endsWith(const StringView & s) const
+    {
+        return s.m_n <= m_n && memcmp(m_p + m_n - s.m_n, s.m_p, s.m_n) == 0;
+    }
+
+    /** lexicographic, as std::string::compare */
+    int compare(const StringView & s) const
+    {
+        size_t n = m_n < s.m_n ? m_n : s.m_n;
+        int r = n ? memcmp(m_p, s.m_p, n) : 0;
+        if (r != 0) return r;
+        return m_n < s.m_n ? -1 : (m_n > s.m_n ? 1 : 0);
+    }
+
+    /** equality with a NUL terminated string, without measuring it */
+    bool equals(const char * sz) const
+    {
+        for (size_t i = 0; i < m_n; i++) {
+            if (sz[i] != m_p[i] || sz[i] == 0) return false;
+        }
+        return sz[m_n] == 0;
+    }
+
+  private:
+    const char * m_p;
+    size_t m_n;
+};
+
+
+inline bool operator==(const StringView & a, const StringView & b)
+{
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+inline bool operator!=(const StringView & a, const StringView & b)
+{
+    return !(a == b);
+}
+
+inline bool operator<(const StringView & a, const StringView & b)
+{
+    return a.compare(b) < 0;
+}
+
+
+} // namespace bplus
+
+#endif // BPSTRINGVIEW_H_
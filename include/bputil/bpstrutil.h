@@ -37,6 +37,9 @@
 #include <utility>
 #include <vector>
 
+#include "bputil/bpstringview.h"
+#include "bputil/bputf8.h"
+
 namespace bplus {
 namespace strutil {
 
@@ -55,7 +58,8 @@ std::wstring utf8ToWide(const std::string& sIn);
 std::string wideToUtf8(const std::wstring& wsIn);
 
 /**
- * return a copy of sIn with all sOld replaced by sNew.
+ * replace all sOld in sTarget with sNew, in place.
+ * Does nothing if sOld is empty.
  */
 void replace(std::string& sTarget,
              const std::string& sOld,
@@ -89,6 +93,86 @@ splitAndTrim(const std::string& str, const std::string& delim);
 std::string join( const std::vector<std::string>& vsIn,
                   const std::string& sSep );
 
+/**
+ * A substring search pattern, preprocessed (Boyer-Moore-Horspool) so
+ * repeated searches for it are fast.  Build one and reuse it.
+ */
+class Needle
+{
+public:
+    explicit Needle(const StringView& pattern);
+
+    /** \returns offset of the first match in hay at or after from,
+     *           or std::string::npos */
+    size_t find(const StringView& hay, size_t from = 0) const;
+
+    size_t size() const { return m_pattern.size(); }
+    const std::string& pattern() const { return m_pattern; }
+
+private:
+    std::string m_pattern;
+    size_t      m_skip[256];
+};
+
+/**
+ * replace all non-overlapping matches of needle in sTarget with sNew,
+ * in place.  Grows sTarget at most once.
+ * \returns the number of replacements made.
+ */
+size_t replace(std::string& sTarget,
+               const Needle& needle,
+               const StringView& sNew);
+
+/**
+ * Splits a string lazily, without allocating.  Yields the same pieces
+ * as split(), with delim treated as a substring to match:
+ *
+ *     strutil::Splitter sp(sPath, "/");
+ *     for (StringView piece; sp.next(piece); ) {
+ *         ...
+ *     }
+ *
+ * The pieces are views into str, which must outlive them.
+ */
+class Splitter
+{
+public:
+    Splitter(const StringView& str, const StringView& delim);
+
+    /** \returns false once all pieces have been produced */
+    bool next(StringView& oPiece);
+
+private:
+    StringView  m_rest;
+    StringView  m_delim;
+    bool        m_bDone;
+};
+
+/**
+ * Views of sIn without leading and/or trailing whitespace.
+ */
+StringView trimView(const StringView& sIn);
+StringView trimLeftView(const StringView& sIn);
+StringView trimRightView(const StringView& sIn);
+
+/**
+ * join nPieces views into buf using sSep between each.  At most
+ * bufSize-1 characters are written, followed by a NUL.
+ * \returns the length of the full joined string, so a result of
+ *          bufSize or more means buf was too small (as snprintf).
+ */
+size_t join( const StringView* pieces, size_t nPieces,
+             const StringView& sSep,
+             char* buf, size_t bufSize );
+
+/**
+ * join views onto the end of sOut using sSep between each.  Reuses
+ * sOut's capacity, so a string kept across calls stops allocating.
+ */
+void join( const std::vector<StringView>& vIn,
+           const StringView& sSep,
+           std::string& sOut );
+
 /**
  * return an uppercase copy of sIn using default codepage.
  */
@@ -115,6 +199,12 @@ std::string trimRight( const std::string& sSource );
 bool isEqualNoCase( const std::string& s1,
                     const std::string& s2);
 
+/**
+ * return the system's description of errno value nErr.  Unlike
+ * strerror(), safe to call from several threads at once.
+ */
+std::string errorString(int nErr);
+
 /**
  * return whether a string completely matches a wildcard
  * pattern containing '*' as the wildcard character
@@ -146,6 +236,14 @@ inline std::wstring safeStr(const wchar_t* cszIn)
  */
 std::string quoteJsonString(const std::string& str);
 
+/**
+ * append sIn to sOut as a quoted JSON string.  '"', '\\' and all
+ * control characters are escaped (\u00XX where there is no short form).
+ * sOut is grown at most once per call when the input needs little
+ * escaping, so a buffer reused across calls stops allocating.
+ */
+void quoteJsonString(const StringView& sIn, std::string& sOut);
+
 /**
  * Loads a string with the contents of the specified file.
  * Any previous contents of the string are discarded.
@@ -32,18 +32,42 @@
 #ifndef __BPSYNC_H__
 #define __BPSYNC_H__
 
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "bputil/bpatomic.h"
+#include "bputil/bpthread.h"
+#include "bputil/bptimeutil.h"
+
 namespace bplus { namespace sync {
 
+#ifdef WIN32
+typedef CRITICAL_SECTION OSMutex;
+typedef SRWLOCK OSRWLock;
+typedef CONDITION_VARIABLE OSCondition;
+#else
+typedef pthread_mutex_t OSMutex;
+typedef pthread_rwlock_t OSRWLock;
+typedef pthread_cond_t OSCondition;
+#endif
+
 /** a posix style non-recursive mutual exclusion device */
 class Mutex {
   public:
     Mutex();
     ~Mutex();
     void lock();
+    /** returns true if the mutex was acquired */
+    bool tryLock();
     void unlock();
   private:
-    void * m_osDep;
+    OSMutex m_osDep;
     friend class Condition;
+    Mutex(const Mutex &);
+    Mutex& operator=(const Mutex &);
 };
 
 /** standard lock for exception-safe Mutex usage */
@@ -57,6 +81,107 @@ class Lock {
     Lock& operator=(const Lock &);  // prevent copy assign
 };
 
+/** exception-safe locking for any type with lock() and unlock() */
+template <class LockType>
+class ScopedLock {
+  public:
+    ScopedLock(LockType& l) : m_lock( l ) { m_lock.lock(); }
+    ~ScopedLock() { m_lock.unlock(); }
+  private:
+    LockType & m_lock;
+    ScopedLock(const ScopedLock &);
+    ScopedLock& operator=(const ScopedLock &);
+};
+
+/** a mutex which spins briefly before sleeping.  Use for locks that
+ *  are held for short periods but may be contended: a waiter avoids
+ *  the cost of a kernel transition when the holder releases soon.
+ *  On a single processor machine it never spins. */
+class AdaptiveMutex {
+  public:
+    explicit AdaptiveMutex(unsigned int spinCount = 128);
+    ~AdaptiveMutex();
+    void lock();
+    bool tryLock();
+    void unlock();
+  private:
+    OSMutex m_osDep;
+    unsigned int m_spinCount;
+    AdaptiveMutex(const AdaptiveMutex &);
+    AdaptiveMutex& operator=(const AdaptiveMutex &);
+};
+
+/** a busy-waiting lock for critical sections of a few instructions.
+ *  Never sleeps in the kernel, but yields the processor after
+ *  spinning for a while so a preempted holder can run. */
+class SpinLock {
+  public:
+    SpinLock() : m_locked( 0 ) { }
+    void lock()
+    {
+        unsigned int spins = 0;
+        for (;;) {
+            if (!atomicExchange(&m_locked, 1, MemoryOrderAcquire)) return;
+            // wait on a plain load so waiters don't bounce the line
+            while (atomicLoad(&m_locked, MemoryOrderRelaxed)) {
+                if (++spins < 64) cpuRelax();
+                else bplus::thread::Thread::yield();
+            }
+        }
+    }
+    bool tryLock()
+    {
+        return !atomicLoad(&m_locked, MemoryOrderRelaxed)
+            && !atomicExchange(&m_locked, 1, MemoryOrderAcquire);
+    }
+    void unlock() { atomicStore(&m_locked, 0, MemoryOrderRelease); }
+  private:
+    volatile long m_locked;
+    SpinLock(const SpinLock &);
+    SpinLock& operator=(const SpinLock &);
+};
+
+/** a reader-writer lock.  Any number of readers may hold it at once,
+ *  writers hold it exclusively.  Not recursive, and a reader may not
+ *  upgrade to a writer. */
+class RWLock {
+  public:
+    RWLock();
+    ~RWLock();
+    void lockShared();
+    bool tryLockShared();
+    void unlockShared();
+    void lock();
+    bool tryLock();
+    void unlock();
+  private:
+    OSRWLock m_osDep;
+    RWLock(const RWLock &);
+    RWLock& operator=(const RWLock &);
+};
+
+/** exception-safe shared (read) locking of an RWLock */
+class ReadLock {
+  public:
+    ReadLock(RWLock& l) : m_lock( l ) { m_lock.lockShared(); }
+    ~ReadLock() { m_lock.unlockShared(); }
+  private:
+    RWLock & m_lock;
+    ReadLock(const ReadLock &);
+    ReadLock& operator=(const ReadLock &);
+};
+
+/** exception-safe exclusive (write) locking of an RWLock */
+class WriteLock {
+  public:
+    WriteLock(RWLock& l) : m_lock( l ) { m_lock.lock(); }
+    ~WriteLock() { m_lock.unlock(); }
+  private:
+    RWLock & m_lock;
+    WriteLock(const WriteLock &);
+    WriteLock& operator=(const WriteLock &);
+};
+
 /** a posix style condition */
 class Condition {
   public:
@@ -78,8 +203,100 @@ class Condition {
      *           check state upon waking up to catch this case.
      *  \returns true if a signal was recieved, false otherwise */
     bool timeWait(Mutex * m, unsigned int msec);
+    /** wait until a signal is recieved or the monotonic clock reaches
+     *  deadline, a value of bplus::timeutil::monotonicMicros().
+     *  Warning: spurious wakeups as for wait().
+     *  \returns true if a signal was recieved, false otherwise */
+    bool waitUntil(Mutex * m, unsigned long long deadline);
+  private:
+    OSCondition m_osDep;
+    Condition(const Condition &);
+    Condition& operator=(const Condition &);
+};
+
+/** a counting semaphore.  post() and an uncontended wait() are a
+ *  single atomic operation, only waiters that must block touch the
+ *  mutex. */
+class Semaphore {
+  public:
+    explicit Semaphore(unsigned int initial = 0);
+    /** release n units, waking up to n waiters */
+    void post(unsigned int n = 1);
+    /** acquire a unit, blocking until one is available */
+    void wait();
+    /** acquire a unit if one is available now */
+    bool tryWait();
+    /** \returns false if msec pass before a unit is acquired */
+    bool timeWait(unsigned int msec);
+    /** \returns false if the monotonic clock reaches deadline (in
+     *  bplus::timeutil::monotonicMicros() terms) first */
+    bool waitUntil(unsigned long long deadline);
+  private:
+    bool slowWait(bool bTimed, unsigned long long deadline);
+    volatile long m_count;      // below zero: -(number of waiters)
+    unsigned long m_wakeups;    // posts owed to blocked waiters
+    Mutex m_mutex;
+    Condition m_cond;
+    Semaphore(const Semaphore &);
+    Semaphore& operator=(const Semaphore &);
+};
+
+/** a single use countdown.  wait() returns once countDown() has
+ *  been called count times. */
+class Latch {
+  public:
+    explicit Latch(unsigned int count);
+    void countDown(unsigned int n = 1);
+    bool tryWait() const;
+    void wait();
+    bool timeWait(unsigned int msec);
+    bool waitUntil(unsigned long long deadline);
+  private:
+    volatile long m_count;
+    Mutex m_mutex;
+    Condition m_cond;
+    Latch(const Latch &);
+    Latch& operator=(const Latch &);
+};
+
+/** a reusable rendezvous for a fixed number of threads.  There is no
+ *  timed wait: a thread abandoning the barrier would leave the others
+ *  blocked forever. */
+class Barrier {
+  public:
+    explicit Barrier(unsigned int count);
+    /** block until count threads have arrived.  \returns true in
+     *  exactly one thread of each generation (the last to arrive) */
+    bool arriveAndWait();
+  private:
+    unsigned int m_count;
+    unsigned int m_waiting;
+    unsigned long m_generation;
+    Mutex m_mutex;
+    Condition m_cond;
+    Barrier(const Barrier &);
+    Barrier& operator=(const Barrier &);
+};
+
+/** a win32 style event.  A manual reset event stays set, releasing
+ *  every waiter, until reset().  An auto reset event releases a
+ *  single waiter and resets itself. */
+class Event {
+  public:
+    explicit Event(bool bAutoReset = false, bool bInitiallySet = false);
+    void set();
+    void reset();
+    bool isSet() const;
+    void wait();
+    bool timeWait(unsigned int msec);
+    bool waitUntil(unsigned long long deadline);
   private:
-    void * m_osDep;
+    volatile long m_set;
+    bool m_bAutoReset;
+    Mutex m_mutex;
+    Condition m_cond;
+    Event(const Event &);
+    Event& operator=(const Event &);
 };
 
 }}
@@ -91,6 +308,7 @@ class Condition {
 #else
 #include "impl/bpsyncimpl_unix.h"
 #endif
+#include "impl/bpsyncimpl.h"
 
 
 #endif
@@ -29,6 +29,9 @@
 #ifndef BPTHREAD_H_
 #define BPTHREAD_H_
 
+#include <stddef.h>
+#include <string>
+
 namespace bplus {
 namespace thread {
 
@@ -37,6 +40,31 @@ namespace thread {
  *  executing */
 typedef void *(*StartRoutine) (void * cookie);
 
+/** Attributes of a new thread.  Each field left at its default leaves
+ *  that attribute at the platform default.  Attributes a platform can't
+ *  apply are ignored. */
+struct ThreadOptions
+{
+    ThreadOptions() : stackSize(0), affinityMask(0), nice(0) {}
+
+    /** shown by top, ps, perf and debuggers.  Keep it short, Linux
+     *  truncates names to 15 characters. */
+    std::string name;
+
+    /** bytes of stack, rounded up to the platform minimum */
+    size_t stackSize;
+
+    /** bit n allows the thread to run on cpu n (first 64 cpus only).
+     *  Not supported on OS X. */
+    unsigned long long affinityMask;
+
+    /** scheduling priority as a unix nice value, from -20 (highest) to
+     *  19 (lowest).  Raising priority usually requires privileges.
+     *  On Windows this maps onto thread priority levels.  Not supported
+     *  on OS X. */
+    int nice;
+};
+
 class Thread
 {
   public:
@@ -45,18 +73,34 @@ class Thread
 
     bool run(StartRoutine startFunc, void * cookie);
 
+    /** \overload run with the given attributes */
+    bool run(StartRoutine startFunc, void * cookie,
+             const ThreadOptions & options);
+
     /** detach from the running thread, making it unjoinable */
     void detach();
 
     /** block until a thread completes */
     void join();
 
-    /** get a numeric ID for the spawned thread */
+    /** get the operating system's ID for the spawned thread, as
+     *  shown by ps, top and debuggers (gettid() on Linux) */
     unsigned int ID();
 
-    /** get a numeric ID for the current thread */
+    /** get the operating system's ID for the current thread */
     static unsigned int currentThreadID();
 
+    /** name the current thread, see ThreadOptions::name */
+    static void setCurrentThreadName(const std::string & name);
+
+    /** get the number of processors available to run threads,
+     *  at least 1.  On Linux these are the processors in the calling
+     *  thread's affinity mask, which a cpuset or container may limit */
+    static unsigned int hardwareConcurrency();
+
+    /** give up the remainder of the current thread's time slice */
+    static void yield();
+
   private:
     void * m_osSpecific;
 };
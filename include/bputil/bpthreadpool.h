@@ -0,0 +1,156 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/**
+ *  bpthreadpool.h -- a work-stealing pool of worker threads.
+ *
+ *  Each worker owns a Chase-Lev deque.  Workers push and pop at the
+ *  bottom of their own deque without locking and steal from the top of
+ *  other workers' deques when they run dry, so there is no single queue
+ *  for all threads to contend on.  Work submitted from threads outside
+ *  the pool goes through a small injection queue.
+ *
+ *  On top of that, parallelFor and parallelReduce provide fork/join over
+ *  index ranges.  A thread waiting for a fork/join to complete executes
+ *  pool work rather than blocking, so they may be nested.
+ */
+
+#ifndef BPTHREADPOOL_H_
+#define BPTHREADPOOL_H_
+
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+#include "bputil/bpsync.h"
+#include "bputil/bpthread.h"
+
+
+namespace bplus {
+namespace thread {
+
+
+class PoolJoin;
+
+
+/** A unit of work to be run by a Pool */
+class Task
+{
+  public:
+    Task() : m_autoDelete(false) {}
+    virtual ~Task() {}
+    virtual void run() = 0;
+  private:
+    bool m_autoDelete;
+    friend class Pool;
+};
+
+
+class Pool
+{
+  public:
+    /** start a pool of nWorkers threads.  0 means one worker per
+     *  hardware core (see Thread::hardwareConcurrency). */
+    Pool(unsigned int nWorkers = 0);
+
+    /** \overload start workers with the given thread attributes.  The
+     *  worker's index is appended to workerOptions.name, which defaults
+     *  to "bp-pool". */
+    Pool(unsigned int nWorkers, const ThreadOptions & workerOptions);
+
+    /** shuts down the pool, see shutdown() */
+    ~Pool();
+
+    unsigned int workerCount() const;
+
+    /** run a task asynchronously.  The pool takes ownership of the
+     *  task and deletes it after it has run.  Tasks submitted after
+     *  shutdown() are run synchronously on the calling thread. */
+    void submit(Task * task);
+
+    /** \overload run func(cookie) asynchronously */
+    void submit(void (*func)(void *), void * cookie);
+
+    /**
+     * Invoke body(b, e) over consecutive subranges [b, e) covering
+     * [begin, end), each at most 'grain' long, in parallel.  Returns
+     * once every subrange has completed.  Body must be callable
+     * concurrently from several threads.  If a subrange throws, the
+     * first exception is rethrown once they have all completed (built
+     * before C++11, as a std::runtime_error with the same what()).
+     */
+    template <class Body>
+    void parallelFor(size_t begin, size_t end, size_t grain,
+                     const Body & body);
+
+    /**
+     * Compute body(b, e) -> T for each subrange as in parallelFor, then
+     * fold the partial results, in range order, with join(T, T) -> T
+     * starting from 'identity'.
+     */
+    template <class T, class Body, class Join>
+    T parallelReduce(size_t begin, size_t end, size_t grain,
+                     const T & identity, const Body & body,
+                     const Join & join);
+
+    /**
+     * Run all queued tasks, then stop and join the worker threads.
+     * Safe to call more than once.  Must not be called from a worker.
+     */
+    void shutdown();
+
+  private:
+    class WorkDeque;
+    struct Worker;
+
+    void init(unsigned int nWorkers, const ThreadOptions & workerOptions);
+    Task * findWork(Worker * self);
+    bool hasWork() const;
+    void push(Task * task);
+    void execute(Task * task);
+    void helpUntil(PoolJoin & join);
+    void wakeOne();
+    static void * workerMain(void * cookie);
+    static Worker *& currentWorker();
+
+    std::vector<Worker *> m_workers;
+    std::deque<Task *> m_injected;
+    bplus::sync::Mutex m_mutex;
+    bplus::sync::Condition m_cond;
+    volatile long m_sleepers;
+    volatile long m_stopping;
+    bool m_stopped;
+
+    Pool(const Pool &);
+    Pool & operator=(const Pool &);
+};
+
+
+} // namespace thread
+} // namespace bplus
+
+
+// #include the inline implementations
+#include "impl/bpthreadpoolimpl.h"
+
+
+#endif // BPTHREADPOOL_H_
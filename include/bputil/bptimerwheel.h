@@ -0,0 +1,179 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/**
+ *  bptimerwheel.h -- run callbacks at points in the future.
+ *
+ *  A TimerWheel keeps any number of one-shot and periodic timers on one
+ *  thread.  Timers live in a hierarchical timing wheel (Varghese &
+ *  Lauck): four levels of 64 slots, each level's slot spanning a whole
+ *  turn of the level below.  Scheduling and cancelling are O(1), and
+ *  the thread sleeps until the next slot with work in it.
+ *
+ *  Callbacks run on the wheel's thread and must not block for long,
+ *  they delay every timer behind them.  Hand real work to a Pool.
+ */
+
+#ifndef BPTIMERWHEEL_H_
+#define BPTIMERWHEEL_H_
+
+#include <stddef.h>
+#include <vector>
+
+#include "bputil/bpsync.h"
+#include "bputil/bpthread.h"
+
+
+namespace bplus {
+namespace thread {
+
+
+/** the routine a timer invokes when it expires */
+typedef void (*TimerFunc)(void * cookie);
+
+/** identifies a scheduled timer.  0 is never a valid id. */
+typedef unsigned long long TimerId;
+
+
+class TimerWheel
+{
+  public:
+    /** tickMsec is the resolution of the wheel: timers fire no
+     *  earlier than requested and at most about one tick late. */
+    explicit TimerWheel(unsigned int tickMsec = 1);
+
+    /** stops the wheel, see stop() */
+    ~TimerWheel();
+
+    /** start the wheel's thread.  Timers may be scheduled before the
+     *  wheel is started, they fire once it is. */
+    bool start();
+
+    /** \overload start the thread with the given attributes.  The
+     *  name defaults to "bp-timers". */
+    bool start(const ThreadOptions & options);
+
+    /** stop and join the wheel's thread.  Timers that have not fired
+     *  are discarded without being called; those scheduled with a
+     *  dispose function have it called on their cookie instead. */
+    void stop();
+
+    /** call func(cookie) once, delayMsec from now */
+    TimerId schedule(unsigned int delayMsec, TimerFunc func, void * cookie);
+
+    /** \overload if the timer is discarded by stop() (or the wheel's
+     *  destruction) before it fires, dispose(cookie) is called, on the
+     *  stopping thread, so the cookie can be released.  Not called for
+     *  timers that fire or are cancelled. */
+    TimerId schedule(unsigned int delayMsec, TimerFunc func, void * cookie,
+                     TimerFunc dispose);
+
+    /** call func(cookie) every periodMsec, starting periodMsec from
+     *  now, until cancelled.  A period that falls behind (because the
+     *  callback runs long) is skipped rather than fired in a burst. */
+    TimerId schedulePeriodic(unsigned int periodMsec, TimerFunc func,
+                             void * cookie);
+
+    /** Cancel a timer.  Returns true if the timer will not be called
+     *  (again).  Returns false if the id is unknown, if the timer
+     *  already fired, or if it is a one-shot timer whose callback is
+     *  running right now.  May be called from a callback. */
+    bool cancel(TimerId id);
+
+    /** number of timers waiting to fire */
+    size_t pending();
+
+  private:
+    enum {
+        kLevelBits = 6,
+        kSlots = 1 << kLevelBits,
+        kLevels = 4
+    };
+
+    enum NodeState { NodeFree, NodePending, NodeDue, NodeRunning };
+
+    struct Node {
+        TimerFunc func;
+        TimerFunc dispose;              // or NULL
+        void * cookie;
+        unsigned long long expires;     // tick
+        unsigned long long period;      // ticks, 0 for one-shot
+        int prev;
+        int next;
+        int slot;                       // level * kSlots + slot
+        unsigned int gen;
+        NodeState state;
+        bool bCancelled;                // cancelled while running
+    };
+
+    struct Discarded {
+        TimerFunc dispose;
+        void * cookie;
+    };
+
+    TimerId add(unsigned int delayMsec, unsigned int periodMsec,
+                TimerFunc func, void * cookie, TimerFunc dispose);
+    void discard(int ix);
+    void disposeDiscarded();
+    int allocNode();
+    void freeNode(int ix);
+    void link(int ix);
+    void unlink(int ix);
+    void cascade(unsigned int level, unsigned int slot);
+    void advance(unsigned long long now);
+    void fireSlot(unsigned int slot);
+    bool nextWakeTick(unsigned long long & oTick) const;
+    unsigned long long nowTick() const;
+    static void * threadMain(void * cookie);
+    void run();
+
+    unsigned long long m_tickMicros;
+    unsigned long long m_startMicros;
+    unsigned long long m_tick;          // next tick to process
+    unsigned long long m_sleepUntil;    // tick the thread will wake at
+    unsigned long long m_occupied[kLevels];
+    int m_heads[kLevels * kSlots];
+    std::vector<Node> m_nodes;
+    std::vector<int> m_due;             // the slot being fired
+    std::vector<Discarded> m_discarded; // to dispose once unlocked
+    int m_freeList;
+    size_t m_count;
+
+    bplus::sync::Mutex m_mutex;
+    bplus::sync::Condition m_cond;
+    Thread m_thread;
+    bool m_bRunning;
+    bool m_bStopping;
+
+    TimerWheel(const TimerWheel &);
+    TimerWheel & operator=(const TimerWheel &);
+};
+
+
+} // namespace thread
+} // namespace bplus
+
+
+// #include the inline implementations
+#include "impl/bptimerwheelimpl.h"
+
+#endif
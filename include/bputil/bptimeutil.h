@@ -0,0 +1,117 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bptimeutil.h
+ *
+ *  Clock helpers.  Intervals, timeouts and deadlines should be measured
+ *  against the monotonic clock, which is not affected by adjustments to
+ *  the wall clock.
+ */
+
+#ifndef BPTIMEUTIL_H_
+#define BPTIMEUTIL_H_
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+
+namespace bplus {
+namespace timeutil {
+
+/**
+ * microseconds elapsed on a monotonic clock since some unspecified
+ * starting point.  Only differences between values are meaningful.
+ */
+unsigned long long monotonicMicros();
+
+/** \overload in milliseconds */
+unsigned long long monotonicMillis();
+
+/**
+ * microseconds since the Unix epoch on the wall clock, for timestamps
+ * meant for people.  Not for measuring intervals.
+ */
+unsigned long long wallClockMicros();
+
+
+//////////////////////////////////////////////////////////////////////
+// Implementation
+
+inline unsigned long long
+monotonicMicros()
+{
+#if defined(WIN32)
+    static LARGE_INTEGER s_freq = { 0 };
+    if (s_freq.QuadPart == 0) QueryPerformanceFrequency(&s_freq);
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (unsigned long long)
+        ((now.QuadPart / s_freq.QuadPart) * 1000000 +
+         (now.QuadPart % s_freq.QuadPart) * 1000000 / s_freq.QuadPart);
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t s_tb = { 0, 0 };
+    if (s_tb.denom == 0) mach_timebase_info(&s_tb);
+    return mach_absolute_time() * s_tb.numer / s_tb.denom / 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+inline unsigned long long
+monotonicMillis()
+{
+    return monotonicMicros() / 1000;
+}
+
+inline unsigned long long
+wallClockMicros()
+{
+#if defined(WIN32)
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    unsigned long long t = ((unsigned long long) ft.dwHighDateTime << 32)
+                           | ft.dwLowDateTime;
+    // 100ns ticks since 1601 to microseconds since 1970
+    return t / 10 - 11644473600000000ULL;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+
+} // namespace timeutil
+} // namespace bplus
+
+
+#endif // BPTIMEUTIL_H_
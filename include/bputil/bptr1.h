@@ -37,8 +37,10 @@
 #ifdef WIN32
 #include <memory>
 #include <regex>
+#include <unordered_map>
 #else
 #include <tr1/memory>
+#include <tr1/unordered_map>
 // do not include <boost/tr1/regex.hpp>, it breaks objective-c files
 // instead, non-win32 users of regex must include the header
 #endif
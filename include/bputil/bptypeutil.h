@@ -345,6 +345,14 @@ namespace bplus {
      * a known BP object.
      */
     Object * createBPObject(const Map * map);
+
+    /* Check that every string in elem, map keys included, is valid
+     * UTF-8, without building Objects.  On failure psBadPath (if
+     * non-null) receives the slash separated path of the offending
+     * node, e.g. "files/2/name".
+     */
+    bool validateUtf8(const BPElement * elem,
+                      std::string * psBadPath = NULL);
     
 } // namespace bplus
 
@@ -32,6 +32,9 @@
 #define BPURL_H_
 
 #include <string>
+#include "bputil/bpstringview.h"
+#include "bputil/bpsync.h"
+#include "bputil/bptr1.h"
 //#include "bperrorutil.h"
 
 
@@ -50,7 +53,7 @@ bool isUrl( const std::string& sIn );
 
 // Returns the well-known port for the specified scheme.
 // Returns -1 for unrecognized scheme.
-int portFromScheme( const std::string& sScheme );
+int portFromScheme( const StringView& sScheme );
 
 
 
@@ -143,6 +146,108 @@ private:
 };
 
 
+// A url parsed in one pass into ranges of the original buffer, which
+// must outlive the UrlView.  Parsing and the accessors do not allocate.
+// Accepts: scheme "://" [userinfo "@"] host [":" port] [path]
+//          ["?" query] ["#" frag]
+class UrlView
+{
+public:
+    UrlView();
+
+    // Returns false on failure, pointing *pcszErr (if non-null) at a
+    // static description.
+    bool        parse( const StringView& sIn, const char** pcszErr = NULL );
+
+    StringView  str() const { return m_url; }
+    StringView  scheme() const { return view( m_scheme ); }
+    StringView  host() const { return view( m_host ); }
+    StringView  path() const { return view( m_path ); }
+    // Without the leading '?' / '#'.
+    StringView  query() const { return view( m_query ); }
+    StringView  frag() const { return view( m_frag ); }
+
+    // The port given in the url, or portFromScheme(scheme()) if none.
+    int         port() const { return m_nPort; }
+    bool        hasExplicitPort() const { return m_bExplicitPort; }
+
+private:
+    struct Range
+    {
+        unsigned int pos;
+        unsigned int len;
+    };
+
+    StringView  view( const Range& r ) const
+    {
+        return StringView( m_url.data() + r.pos, r.len );
+    }
+
+    StringView  m_url;
+    Range       m_scheme;
+    Range       m_host;
+    Range       m_path;
+    Range       m_query;
+    Range       m_frag;
+    int         m_nPort;
+    bool        m_bExplicitPort;
+};
+
+
+// The normalized (scheme, host, port) of a url: scheme and host are
+// lowercased and the port is always filled in from the scheme if the url
+// didn't give one.
+struct Origin
+{
+    Origin() : scheme(), host(), port( -1 ) {}
+
+    // Returns false, leaving us invalid, if url has no scheme.
+    bool        assign( const UrlView& url );
+
+    bool        valid() const { return !scheme.empty(); }
+
+    // "scheme://host", with ":port" appended unless it's the default.
+    std::string toString() const;
+
+    bool operator==( const Origin& o ) const
+    {
+        return port == o.port && host == o.host && scheme == o.scheme;
+    }
+    bool operator!=( const Origin& o ) const { return !(*this == o); }
+
+    std::string scheme;
+    std::string host;
+    int         port;
+};
+
+
+// A thread-safe cache from url strings (typically Service::clientUri())
+// to their Origins, so repeated origin checks cost a hash lookup under a
+// shared lock rather than a parse.  Urls that fail to parse are cached
+// too.  When full, the cache is emptied and refilled.
+class OriginCache
+{
+public:
+    explicit OriginCache( size_t nMaxEntries = 1024 );
+
+    // Returns false if sUrl doesn't parse.
+    bool        lookup( const std::string& sUrl, Origin& oOrigin );
+
+    size_t      size() const;
+    void        clear();
+
+private:
+    typedef std::tr1::unordered_map<std::string, Origin> tOriginMap;
+
+    mutable bplus::sync::RWLock m_lock;
+    tOriginMap  m_map;
+    size_t      m_nMaxEntries;
+
+    OriginCache( const OriginCache& );
+    OriginCache& operator=( const OriginCache& );
+};
+
+
 } // namespace url
 } // namespace bp
 
@@ -0,0 +1,89 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bputf8.h
+ *
+ *  UTF-8 validation and transcoding to and from UTF-16 and UTF-32.
+ *
+ *  All functions check their input strictly (no overlong forms, no
+ *  surrogate code points, nothing above U+10FFFF) and on failure report
+ *  the offset of the first bad byte or code unit.  Runs of ASCII are
+ *  handled 16 or 32 bytes at a time where SSE2 or AVX2 is available.
+ */
+
+#ifndef BPUTF8_H_
+#define BPUTF8_H_
+
+#include <string>
+#include <vector>
+#include "bputil/bpstringview.h"
+
+
+namespace bplus {
+namespace strutil {
+
+
+/**
+ * \returns true if sIn is well-formed UTF-8.  Otherwise, if pBadOffset
+ *          is non-null it receives the offset of the first bad sequence.
+ */
+bool isValidUtf8(const StringView& sIn, size_t* pBadOffset = NULL);
+
+/**
+ * Decode sIn, appending the code units to out.
+ * \returns false on malformed input, leaving out as it was and setting
+ *          *pBadOffset (if non-null) to the offset of the bad sequence.
+ */
+bool utf8ToUtf16(const StringView& sIn,
+                 std::vector<unsigned short>& out,
+                 size_t* pBadOffset = NULL);
+
+bool utf8ToUtf32(const StringView& sIn,
+                 std::vector<unsigned int>& out,
+                 size_t* pBadOffset = NULL);
+
+/**
+ * Encode nUnits code units as UTF-8, appending to sOut.
+ * \returns false on an unpaired surrogate or out of range value, leaving
+ *          sOut as it was and setting *pBadOffset (if non-null) to the
+ *          index of the bad unit.
+ */
+bool utf16ToUtf8(const unsigned short* pUnits, size_t nUnits,
+                 std::string& sOut,
+                 size_t* pBadOffset = NULL);
+
+bool utf32ToUtf8(const unsigned int* pUnits, size_t nUnits,
+                 std::string& sOut,
+                 size_t* pBadOffset = NULL);
+
+
+} // strutil
+} // bplus
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the implementations.
+#include "impl/bputf8impl.h"
+
+
+#endif // BPUTF8_H_
@@ -0,0 +1,430 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpasyncfileimpl.h
+ *
+ *  Inline implementation file for bpasyncfile.h (portable parts and
+ *  the thread pool engine)
+ *
+ *  Note: This file is included by bpasyncfile.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPASYNCFILEIMPL_H_
+#define BPASYNCFILEIMPL_H_
+
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+
+
+namespace bplus {
+namespace io {
+
+
+namespace detail {
+
+// the most one operation moves, as Linux's read() and write(); longer
+// requests complete short
+const size_t kMaxIoBytes = 0x7ffff000;
+
+} // namespace detail
+
+
+inline
+AsyncFile::AsyncFile()
+    : m_pRing(NULL),
+      m_pPool(NULL),
+      m_bRegistered(false),
+      m_bStarted(false),
+      m_bShutdown(false),
+      m_inRing(0),
+      m_pending(0),
+      m_started(0),
+      m_completed(0),
+      m_failed(0),
+      m_fixed(0),
+      m_submits(0),
+      m_maxInRing(0),
+      m_bThreadRunning(false)
+{
+    init();
+}
+
+
+inline
+AsyncFile::AsyncFile(const Options & options)
+    : m_options(options),
+      m_pRing(NULL),
+      m_pPool(NULL),
+      m_bRegistered(false),
+      m_bStarted(false),
+      m_bShutdown(false),
+      m_inRing(0),
+      m_pending(0),
+      m_started(0),
+      m_completed(0),
+      m_failed(0),
+      m_fixed(0),
+      m_submits(0),
+      m_maxInRing(0),
+      m_bThreadRunning(false)
+{
+    init();
+}
+
+
+inline void
+AsyncFile::init()
+{
+    if (m_options.queueDepth == 0) m_options.queueDepth = 1;
+    if (m_options.queueDepth > 4096) m_options.queueDepth = 4096;
+
+    bplus::thread::ThreadOptions opts;
+    opts.name = "bp-asyncio";
+    if (!m_options.forceFallback && ringInit()) {
+        m_bThreadRunning = m_thread.run(ringThreadMain, this, opts);
+        if (!m_bThreadRunning) ringDestroy();
+    }
+    if (!m_pRing) {
+        unsigned int n = m_options.fallbackThreads;
+        m_pPool = new bplus::thread::Pool(n ? n : 1, opts);
+    }
+}
+
+
+inline
+AsyncFile::~AsyncFile()
+{
+    shutdown();
+    ringDestroy();
+    delete m_pPool;
+}
+
+
+inline bool
+AsyncFile::usingIoUring() const
+{
+    return m_pRing != NULL;
+}
+
+
+inline bool
+AsyncFile::registerBuffers(char * const * buffers, const size_t * sizes,
+                           unsigned int count)
+{
+    bplus::sync::Lock lock(m_mutex);
+    if (m_bRegistered || m_bStarted || m_bShutdown) {
+        errno = EBUSY;
+        return false;
+    }
+
+    std::vector<Registered> v(count);
+    for (unsigned int i = 0; i < count; i++) {
+        v[i].p = buffers[i];
+        v[i].n = sizes[i];
+        v[i].index = i;
+    }
+    // only the ring has a use for them
+    if (m_pRing) {
+        if (!ringRegister(v)) return false;
+        std::sort(v.begin(), v.end());
+        m_buffers.swap(v);
+    }
+    m_bRegistered = true;
+    return true;
+}
+
+
+inline int
+AsyncFile::registeredIndex(const char * p, size_t n) const
+{
+    Registered key;
+    key.p = (char *) p;
+    std::vector<Registered>::const_iterator it =
+        std::upper_bound(m_buffers.begin(), m_buffers.end(), key);
+    if (it == m_buffers.begin()) return -1;
+    --it;
+    if ((size_t) (p - it->p) + n > it->n) return -1;
+    return (int) it->index;
+}
+
+
+inline bool
+AsyncFile::read(int fd, char * buffer, size_t n, unsigned long long offset,
+                IoCallback cb, void * cookie)
+{
+    Op * op = new Op;
+    op->kind = OpRead;
+    op->fd = fd;
+    op->buffer = buffer;
+    op->n = n < detail::kMaxIoBytes ? n : detail::kMaxIoBytes;
+    op->offset = offset;
+    op->cb = cb;
+    op->cookie = cookie;
+    return start(op);
+}
+
+
+inline bool
+AsyncFile::write(int fd, const char * buffer, size_t n,
+                 unsigned long long offset, IoCallback cb, void * cookie)
+{
+    Op * op = new Op;
+    op->kind = OpWrite;
+    op->fd = fd;
+    op->buffer = (char *) buffer;
+    op->n = n < detail::kMaxIoBytes ? n : detail::kMaxIoBytes;
+    op->offset = offset;
+    op->cb = cb;
+    op->cookie = cookie;
+    return start(op);
+}
+
+
+inline bool
+AsyncFile::fsync(int fd, IoCallback cb, void * cookie)
+{
+    Op * op = new Op;
+    op->kind = OpFsync;
+    op->fd = fd;
+    op->buffer = NULL;
+    op->n = 0;
+    op->offset = 0;
+    op->cb = cb;
+    op->cookie = cookie;
+    return start(op);
+}
+
+
+inline bool
+AsyncFile::read(int fd, char * buffer, size_t n, unsigned long long offset,
+                IoHandler * handler)
+{
+    if (read(fd, buffer, n, offset, handlerTrampoline, handler)) return true;
+    delete handler;
+    return false;
+}
+
+
+inline bool
+AsyncFile::write(int fd, const char * buffer, size_t n,
+                 unsigned long long offset, IoHandler * handler)
+{
+    if (write(fd, buffer, n, offset, handlerTrampoline, handler)) return true;
+    delete handler;
+    return false;
+}
+
+
+inline bool
+AsyncFile::fsync(int fd, IoHandler * handler)
+{
+    if (fsync(fd, handlerTrampoline, handler)) return true;
+    delete handler;
+    return false;
+}
+
+
+inline void
+AsyncFile::handlerTrampoline(const IoResult & result, void * cookie)
+{
+    IoHandler * handler = (IoHandler *) cookie;
+    handler->complete(result);
+    delete handler;
+}
+
+
+inline bool
+AsyncFile::start(Op * op)
+{
+    op->engine = this;
+    op->bufferIndex = -1;
+
+    bplus::sync::Lock lock(m_mutex);
+    if (m_bShutdown) {
+        delete op;
+        return false;
+    }
+    m_bStarted = true;
+    if (m_pRing && op->kind != OpFsync && !m_buffers.empty()) {
+        op->bufferIndex = registeredIndex(op->buffer, op->n);
+    }
+    bplus::sync::atomicAdd(&m_pending, 1);
+    bplus::sync::atomicAdd(&m_started, 1);
+
+    if (m_pRing) {
+        if (m_inRing < m_options.queueDepth && m_backlog.empty()) {
+            ringQueueLocked(op);
+        } else {
+            m_backlog.push_back(op);
+        }
+    } else {
+        m_queued.push_back(op);
+        if (m_queued.size() >= m_options.queueDepth) poolSubmitLocked();
+    }
+    return true;
+}
+
+
+inline void
+AsyncFile::finish(Op * op, long long result)
+{
+    IoResult r;
+    r.error = result < 0 ? (int) -result : 0;
+    r.bytes = result < 0 ? 0 : (size_t) result;
+    r.buffer = op->buffer;
+    r.offset = op->offset;
+    op->cb(r, op->cookie);
+
+    if (r.error) bplus::sync::atomicAdd(&m_failed, 1);
+    bplus::sync::atomicAdd(&m_completed, 1);
+    delete op;
+    bplus::sync::atomicAdd(&m_pending, -1);
+}
+
+
+inline void
+AsyncFile::submit()
+{
+    bplus::sync::Lock lock(m_mutex);
+    if (m_pRing) ringEnterLocked();
+    else poolSubmitLocked();
+}
+
+
+inline unsigned long
+AsyncFile::pending() const
+{
+    return (unsigned long) bplus::sync::atomicLoad(&m_pending);
+}
+
+
+inline AsyncFile::Stats
+AsyncFile::stats() const
+{
+    Stats s;
+    s.started = (unsigned long) bplus::sync::atomicLoad(&m_started);
+    s.completed = (unsigned long) bplus::sync::atomicLoad(&m_completed);
+    s.failed = (unsigned long) bplus::sync::atomicLoad(&m_failed);
+    s.fixed = (unsigned long) bplus::sync::atomicLoad(&m_fixed);
+    s.submits = (unsigned long) bplus::sync::atomicLoad(&m_submits);
+    bplus::sync::Lock lock(m_mutex);
+    s.maxInFlight = m_maxInRing;
+    return s;
+}
+
+
+inline void
+AsyncFile::shutdown()
+{
+    {
+        bplus::sync::Lock lock(m_mutex);
+        if (!m_bShutdown) {
+            m_bShutdown = true;
+            if (m_pRing) ringWakeLocked();
+            else poolSubmitLocked();
+        }
+    }
+    if (m_bThreadRunning) {
+        m_thread.join();
+        m_bThreadRunning = false;
+    }
+    if (m_pPool) m_pPool->shutdown();
+}
+
+
+inline void
+AsyncFile::poolSubmitLocked()
+{
+    if (m_queued.empty()) return;
+    for (size_t i = 0; i < m_queued.size(); i++) {
+        m_pPool->submit(poolRun, m_queued[i]);
+    }
+    if (m_queued.size() > m_maxInRing) m_maxInRing = m_queued.size();
+    m_queued.clear();
+    bplus::sync::atomicAdd(&m_submits, 1);
+}
+
+
+inline void
+AsyncFile::poolRun(void * cookie)
+{
+    Op * op = (Op *) cookie;
+    ssize_t r;
+    do {
+        switch (op->kind) {
+            case OpRead:
+                r = pread(op->fd, op->buffer, op->n, (off_t) op->offset);
+                break;
+            case OpWrite:
+                r = pwrite(op->fd, op->buffer, op->n, (off_t) op->offset);
+                break;
+            case OpFsync:
+                r = ::fsync(op->fd);
+                break;
+            default:
+                r = 0;
+                break;
+        }
+    } while (r < 0 && errno == EINTR);
+    op->engine->finish(op, r < 0 ? -(long long) errno : (long long) r);
+}
+
+
+} // namespace io
+} // namespace bplus
+
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// IORING_OP_READ and friends arrived with this, in Linux 5.6
+#ifdef IORING_FEAT_RW_CUR_POS
+#define BP_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifdef BP_HAVE_IO_URING
+#include "bpasyncfileimpl_linux.h"
+#else
+
+// no io_uring: the thread pool does everything
+
+inline bool bplus::io::AsyncFile::ringInit() { return false; }
+inline void bplus::io::AsyncFile::ringDestroy() {}
+inline bool
+bplus::io::AsyncFile::ringRegister(const std::vector<Registered> &)
+{
+    return false;
+}
+inline void bplus::io::AsyncFile::ringQueueLocked(Op *) {}
+inline void bplus::io::AsyncFile::ringEnterLocked() {}
+inline void bplus::io::AsyncFile::ringWakeLocked() {}
+inline void * bplus::io::AsyncFile::ringThreadMain(void *) { return NULL; }
+inline void bplus::io::AsyncFile::ringReap() {}
+
+#endif
+
+#endif // BPASYNCFILEIMPL_H_
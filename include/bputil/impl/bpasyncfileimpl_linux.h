@@ -0,0 +1,309 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpasyncfileimpl_linux.h
+ *
+ *  Inline implementation file for bpasyncfile.h (io_uring version)
+ *
+ *  The ring is driven with the raw system calls rather than liburing,
+ *  which isn't installed everywhere services run.
+ *
+ *  Note: This file is included by bpasyncfileimpl.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPASYNCFILEIMPL_LINUX_H_
+#define BPASYNCFILEIMPL_LINUX_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+// the same on every architecture but alpha
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+
+
+namespace bplus {
+namespace io {
+
+
+struct AsyncFile::Ring
+{
+    int fd;
+    unsigned int sqEntries;
+    unsigned int unsubmitted;       // queued, not yet entered
+
+    void * sqMap;
+    size_t sqMapSize;
+    void * cqMap;                   // may be sqMap
+    size_t cqMapSize;
+    struct io_uring_sqe * sqes;
+    size_t sqesSize;
+
+    unsigned * sqTail;
+    unsigned * sqMask;
+    unsigned * sqArray;
+    unsigned * cqHead;
+    unsigned * cqTail;
+    unsigned * cqMask;
+    struct io_uring_cqe * cqes;
+};
+
+
+inline bool
+AsyncFile::ringInit()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // room for the queue and the shutdown no-op
+    int fd = (int) syscall(__NR_io_uring_setup, m_options.queueDepth + 1,
+                           &params);
+    if (fd < 0) return false;
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        return false;
+    }
+
+    Ring * r = new Ring;
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->sqEntries = params.sq_entries;
+    r->sqMapSize = params.sq_off.array
+        + params.sq_entries * sizeof(unsigned);
+    r->cqMapSize = params.cq_off.cqes
+        + params.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    bool bSingle = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (bSingle && r->cqMapSize > r->sqMapSize) {
+        r->sqMapSize = r->cqMapSize;
+    }
+    r->sqMap = mmap(NULL, r->sqMapSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sqMap == MAP_FAILED) r->sqMap = NULL;
+    if (bSingle) {
+        r->cqMap = r->sqMap;
+    } else {
+        r->cqMap = mmap(NULL, r->cqMapSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (r->cqMap == MAP_FAILED) r->cqMap = NULL;
+    }
+    void * sqes = mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    r->sqes = sqes == MAP_FAILED ? NULL : (struct io_uring_sqe *) sqes;
+
+    m_pRing = r;
+    if (!r->sqMap || !r->cqMap || !r->sqes) {
+        ringDestroy();
+        return false;
+    }
+
+    char * sq = (char *) r->sqMap;
+    r->sqTail = (unsigned *) (sq + params.sq_off.tail);
+    r->sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    r->sqArray = (unsigned *) (sq + params.sq_off.array);
+    char * cq = (char *) r->cqMap;
+    r->cqHead = (unsigned *) (cq + params.cq_off.head);
+    r->cqTail = (unsigned *) (cq + params.cq_off.tail);
+    r->cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return true;
+}
+
+
+inline void
+AsyncFile::ringDestroy()
+{
+    Ring * r = m_pRing;
+    if (!r) return;
+    if (r->sqes) munmap(r->sqes, r->sqesSize);
+    if (r->cqMap && r->cqMap != r->sqMap) munmap(r->cqMap, r->cqMapSize);
+    if (r->sqMap) munmap(r->sqMap, r->sqMapSize);
+    close(r->fd);
+    delete r;
+    m_pRing = NULL;
+}
+
+
+inline bool
+AsyncFile::ringRegister(const std::vector<Registered> & buffers)
+{
+    std::vector<struct iovec> iov(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+        iov[buffers[i].index].iov_base = buffers[i].p;
+        iov[buffers[i].index].iov_len = buffers[i].n;
+    }
+    return syscall(__NR_io_uring_register, m_pRing->fd,
+                   IORING_REGISTER_BUFFERS, iov.empty() ? NULL : &iov[0],
+                   (unsigned int) iov.size()) == 0;
+}
+
+
+inline void
+AsyncFile::ringQueueLocked(Op * op)
+{
+    Ring & r = *m_pRing;
+
+    // we're the only writer of the tail, so a plain load will do
+    unsigned int tail = *r.sqTail;
+    unsigned int index = tail & *r.sqMask;
+    struct io_uring_sqe * sqe = &r.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = op->fd;
+    sqe->user_data = (uint64_t) (uintptr_t) op;
+
+    bool bFixed = op->bufferIndex >= 0;
+    switch (op->kind) {
+        case OpRead:
+        case OpWrite:
+            if (op->kind == OpRead) {
+                sqe->opcode = bFixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            } else {
+                sqe->opcode = bFixed ? IORING_OP_WRITE_FIXED
+                                     : IORING_OP_WRITE;
+            }
+            sqe->addr = (uint64_t) (uintptr_t) op->buffer;
+            sqe->len = (uint32_t) op->n;
+            sqe->off = op->offset;
+            if (bFixed) sqe->buf_index = (uint16_t) op->bufferIndex;
+            break;
+        case OpFsync:
+            sqe->opcode = IORING_OP_FSYNC;
+            break;
+        case OpWake:
+            sqe->opcode = IORING_OP_NOP;
+            sqe->fd = -1;
+            break;
+    }
+    r.sqArray[index] = index;
+
+    // publish the entry before the tail that makes it visible
+    __atomic_store_n(r.sqTail, tail + 1, __ATOMIC_RELEASE);
+    r.unsubmitted++;
+
+    m_inRing++;
+    if (m_inRing > m_maxInRing) m_maxInRing = m_inRing;
+    if (bFixed) bplus::sync::atomicAdd(&m_fixed, 1);
+    if (r.unsubmitted >= r.sqEntries) ringEnterLocked();
+}
+
+
+inline void
+AsyncFile::ringEnterLocked()
+{
+    Ring & r = *m_pRing;
+    while (r.unsubmitted > 0) {
+        int n = (int) syscall(__NR_io_uring_enter, r.fd, r.unsubmitted,
+                              0, 0, NULL, 0);
+        if (n < 0 && errno == EINTR) continue;
+        // anything left over (EAGAIN, say) goes with the next enter
+        if (n <= 0) break;
+        bplus::sync::atomicAdd(&m_submits, 1);
+        r.unsubmitted -= (unsigned int) n;
+    }
+}
+
+
+inline void
+AsyncFile::ringWakeLocked()
+{
+    // a no-op wakes the reaper to notice we're stopping, should there
+    // be nothing else in flight
+    Op * op = new Op;
+    memset(op, 0, sizeof(*op));
+    op->kind = OpWake;
+    op->engine = this;
+    op->bufferIndex = -1;
+    ringQueueLocked(op);
+    ringEnterLocked();
+}
+
+
+inline void *
+AsyncFile::ringThreadMain(void * cookie)
+{
+    ((AsyncFile *) cookie)->ringReap();
+    return NULL;
+}
+
+
+inline void
+AsyncFile::ringReap()
+{
+    Ring & r = *m_pRing;
+    std::vector<std::pair<Op *, int> > done;
+    done.reserve(m_options.queueDepth + 1);
+
+    for (;;) {
+        // we're the only reader, and writer of the head
+        unsigned int head = *r.cqHead;
+        unsigned int tail = __atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            syscall(__NR_io_uring_enter, r.fd, 0, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0);
+            continue;
+        }
+
+        // the kernel orders our reads of the ops after their writes;
+        // this pairs with the count in start() to tell thread checkers
+        bplus::sync::atomicLoad(&m_started);
+
+        done.clear();
+        for (; head != tail; head++) {
+            struct io_uring_cqe * cqe = &r.cqes[head & *r.cqMask];
+            done.push_back(std::make_pair((Op *) (uintptr_t) cqe->user_data,
+                                          (int) cqe->res));
+        }
+        __atomic_store_n(r.cqHead, head, __ATOMIC_RELEASE);
+
+        for (size_t i = 0; i < done.size(); i++) {
+            if (done[i].first->kind == OpWake) delete done[i].first;
+            else finish(done[i].first, done[i].second);
+        }
+
+        bplus::sync::Lock lock(m_mutex);
+        m_inRing -= (unsigned int) done.size();
+        while (!m_backlog.empty() && m_inRing < m_options.queueDepth) {
+            ringQueueLocked(m_backlog.front());
+            m_backlog.pop_front();
+        }
+        ringEnterLocked();
+        if (m_bShutdown && m_inRing == 0 && m_backlog.empty()) break;
+    }
+}
+
+
+} // namespace io
+} // namespace bplus
+
+#endif // BPASYNCFILEIMPL_LINUX_H_
@@ -0,0 +1,171 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+/*
+ *  bpatomicimpl_unix.h
+ *
+ *  Inline implementation file for bpatomic.h (gcc/clang __atomic
+ *  builtins)
+ *
+ *  Note: This file is included by bpatomic.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+#ifndef BPATOMICIMPLUNIX_H
+#define BPATOMICIMPLUNIX_H
+
+namespace bplus { namespace sync { namespace detail {
+
+// MemoryOrder is always a constant at the call site, so once inlined
+// these switches fold away.
+inline int
+gccOrder(MemoryOrder o)
+{
+    switch (o) {
+        case MemoryOrderRelaxed: return __ATOMIC_RELAXED;
+        case MemoryOrderAcquire: return __ATOMIC_ACQUIRE;
+        case MemoryOrderRelease: return __ATOMIC_RELEASE;
+        case MemoryOrderAcqRel:  return __ATOMIC_ACQ_REL;
+        default:                 return __ATOMIC_SEQ_CST;
+    }
+}
+
+// loads may not have release semantics, stores may not have acquire
+inline int
+gccLoadOrder(MemoryOrder o)
+{
+    switch (o) {
+        case MemoryOrderRelaxed: return __ATOMIC_RELAXED;
+        case MemoryOrderAcquire:
+        case MemoryOrderRelease:
+        case MemoryOrderAcqRel:  return __ATOMIC_ACQUIRE;
+        default:                 return __ATOMIC_SEQ_CST;
+    }
+}
+
+inline int
+gccStoreOrder(MemoryOrder o)
+{
+    switch (o) {
+        case MemoryOrderRelaxed: return __ATOMIC_RELAXED;
+        case MemoryOrderAcquire:
+        case MemoryOrderRelease:
+        case MemoryOrderAcqRel:  return __ATOMIC_RELEASE;
+        default:                 return __ATOMIC_SEQ_CST;
+    }
+}
+
+// the failure order of a compare-exchange is the load half of o
+inline int
+gccFailOrder(MemoryOrder o)
+{
+    switch (o) {
+        case MemoryOrderRelaxed:
+        case MemoryOrderRelease: return __ATOMIC_RELAXED;
+        case MemoryOrderAcquire:
+        case MemoryOrderAcqRel:  return __ATOMIC_ACQUIRE;
+        default:                 return __ATOMIC_SEQ_CST;
+    }
+}
+
+}}}
+
+inline long
+bplus::sync::atomicLoad(const volatile long * p, MemoryOrder order)
+{
+    return __atomic_load_n(p, detail::gccLoadOrder(order));
+}
+
+inline void
+bplus::sync::atomicStore(volatile long * p, long v, MemoryOrder order)
+{
+    __atomic_store_n(p, v, detail::gccStoreOrder(order));
+}
+
+inline long
+bplus::sync::atomicExchange(volatile long * p, long v, MemoryOrder order)
+{
+    return __atomic_exchange_n(p, v, detail::gccOrder(order));
+}
+
+inline long
+bplus::sync::atomicAdd(volatile long * p, long d, MemoryOrder order)
+{
+    return __atomic_add_fetch(p, d, detail::gccOrder(order));
+}
+
+inline bool
+bplus::sync::atomicCompareExchange(volatile long * p, long expected,
+                                   long desired, MemoryOrder order)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, false,
+                                       detail::gccOrder(order),
+                                       detail::gccFailOrder(order));
+}
+
+inline void *
+bplus::sync::atomicLoadPtr(void * const volatile * p, MemoryOrder order)
+{
+    return __atomic_load_n(p, detail::gccLoadOrder(order));
+}
+
+inline void
+bplus::sync::atomicStorePtr(void * volatile * p, void * v,
+                            MemoryOrder order)
+{
+    __atomic_store_n(p, v, detail::gccStoreOrder(order));
+}
+
+inline void *
+bplus::sync::atomicExchangePtr(void * volatile * p, void * v,
+                               MemoryOrder order)
+{
+    return __atomic_exchange_n(p, v, detail::gccOrder(order));
+}
+
+inline bool
+bplus::sync::atomicCompareExchangePtr(void * volatile * p, void * expected,
+                                      void * desired, MemoryOrder order)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, false,
+                                       detail::gccOrder(order),
+                                       detail::gccFailOrder(order));
+}
+
+inline void
+bplus::sync::atomicFence(MemoryOrder order)
+{
+    __atomic_thread_fence(detail::gccOrder(order));
+}
+
+inline void
+bplus::sync::cpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause" ::: "memory");
+#elif defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+
+#endif // BPATOMICIMPLUNIX_H
@@ -0,0 +1,131 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+/*
+ *  bpatomicimpl_windows.h
+ *
+ *  Inline implementation file for bpatomic.h (windows version)
+ *
+ *  Note: This file is included by bpatomic.h.
+ *        It is not intended for direct inclusion by client code.
+ *
+ *  The Interlocked family are full barriers, so every order other than
+ *  relaxed is satisfied by them.  Plain volatile accesses have
+ *  acquire/release semantics under MSVC and are used for relaxed,
+ *  acquire and release loads and stores.
+ */
+#ifndef BPATOMICIMPLWINDOWS_H_
+#define BPATOMICIMPLWINDOWS_H_
+
+#include <windows.h>
+#include <intrin.h>
+
+inline long
+bplus::sync::atomicLoad(const volatile long * p, MemoryOrder order)
+{
+    if (order == MemoryOrderSeqCst) {
+        return InterlockedCompareExchange((volatile long *) p, 0, 0);
+    }
+    return *p;
+}
+
+inline void
+bplus::sync::atomicStore(volatile long * p, long v, MemoryOrder order)
+{
+    if (order == MemoryOrderSeqCst) {
+        InterlockedExchange(p, v);
+    } else {
+        *p = v;
+    }
+}
+
+inline long
+bplus::sync::atomicExchange(volatile long * p, long v, MemoryOrder)
+{
+    return InterlockedExchange(p, v);
+}
+
+inline long
+bplus::sync::atomicAdd(volatile long * p, long d, MemoryOrder)
+{
+    return InterlockedExchangeAdd(p, d) + d;
+}
+
+inline bool
+bplus::sync::atomicCompareExchange(volatile long * p, long expected,
+                                   long desired, MemoryOrder)
+{
+    return InterlockedCompareExchange(p, desired, expected) == expected;
+}
+
+inline void *
+bplus::sync::atomicLoadPtr(void * const volatile * p, MemoryOrder order)
+{
+    if (order == MemoryOrderSeqCst) {
+        return InterlockedCompareExchangePointer((void * volatile *) p,
+                                                 NULL, NULL);
+    }
+    return *p;
+}
+
+inline void
+bplus::sync::atomicStorePtr(void * volatile * p, void * v,
+                            MemoryOrder order)
+{
+    if (order == MemoryOrderSeqCst) {
+        InterlockedExchangePointer(p, v);
+    } else {
+        *p = v;
+    }
+}
+
+inline void *
+bplus::sync::atomicExchangePtr(void * volatile * p, void * v, MemoryOrder)
+{
+    return InterlockedExchangePointer(p, v);
+}
+
+inline bool
+bplus::sync::atomicCompareExchangePtr(void * volatile * p, void * expected,
+                                      void * desired, MemoryOrder)
+{
+    return InterlockedCompareExchangePointer(p, desired, expected)
+        == expected;
+}
+
+inline void
+bplus::sync::atomicFence(MemoryOrder order)
+{
+    if (order == MemoryOrderSeqCst) {
+        MemoryBarrier();
+    } else {
+        _ReadWriteBarrier();
+    }
+}
+
+inline void
+bplus::sync::cpuRelax()
+{
+    YieldProcessor();
+}
+
+
+#endif // BPATOMICIMPLWINDOWS_H_
@@ -0,0 +1,460 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/**
+ *  bpeventloopimpl_linux.h
+ * 
+ *  Inline implementation file for bpeventloop.h (epoll version)
+ *
+ *  Note: This file is included by bpeventloop.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+#ifndef BPEVENTLOOPIMPL_LINUX_H_
+#define BPEVENTLOOPIMPL_LINUX_H_
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "bputil/bptimeutil.h"
+
+
+namespace bplus {
+namespace io {
+
+
+inline unsigned int
+epollToEvents(uint32_t e)
+{
+    unsigned int events = 0;
+    if (e & (EPOLLIN | EPOLLPRI | EPOLLRDHUP)) events |= EventRead;
+    if (e & EPOLLOUT) events |= EventWrite;
+    if (e & EPOLLERR) events |= EventError;
+    if (e & EPOLLHUP) events |= EventHangup;
+    return events;
+}
+
+
+inline uint32_t
+eventsToEpoll(unsigned int events)
+{
+    uint32_t e = 0;
+    if (events & EventRead) e |= EPOLLIN | EPOLLRDHUP;
+    if (events & EventWrite) e |= EPOLLOUT;
+    return e;
+}
+
+
+inline
+EventLoop::EventLoop()
+    : m_epollFd(-1),
+      m_wakeFd(-1),
+      m_wakePending(0),
+      m_stopping(0),
+      m_loopThread(0),
+      m_nextTimerId(1),
+      m_bThreadRunning(false)
+{
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollFd >= 0 && m_wakeFd >= 0) {
+        // the wakeup descriptor is told apart by its NULL data pointer
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev);
+    }
+}
+
+
+inline
+EventLoop::~EventLoop()
+{
+    stop();
+    // posted after the loop returned, or to a loop that never ran
+    while (runPosted()) {}
+    for (size_t i = 0; i < m_watches.size(); i++) delete m_watches[i];
+    for (size_t i = 0; i < m_graveyard.size(); i++) delete m_graveyard[i];
+    if (m_wakeFd >= 0) close(m_wakeFd);
+    if (m_epollFd >= 0) close(m_epollFd);
+}
+
+
+inline bool
+EventLoop::valid() const
+{
+    return m_epollFd >= 0 && m_wakeFd >= 0;
+}
+
+
+inline bool
+EventLoop::start()
+{
+    return start(bplus::thread::ThreadOptions());
+}
+
+
+inline bool
+EventLoop::start(const bplus::thread::ThreadOptions & options)
+{
+    if (m_bThreadRunning) return true;
+    if (!valid()) return false;
+    bplus::thread::ThreadOptions opts = options;
+    if (opts.name.empty()) opts.name = "bp-evloop";
+    // cleared here rather than on the new thread, so a stop() right
+    // after we return isn't lost
+    bplus::sync::atomicStore(&m_stopping, 0);
+    m_bThreadRunning = m_thread.run(threadMain, this, opts);
+    return m_bThreadRunning;
+}
+
+
+inline void *
+EventLoop::threadMain(void * cookie)
+{
+    ((EventLoop *) cookie)->loop();
+    return NULL;
+}
+
+
+inline void
+EventLoop::stop()
+{
+    bplus::sync::atomicStore(&m_stopping, 1);
+    wake();
+    if (m_bThreadRunning && !isLoopThread()) {
+        m_thread.join();
+        m_bThreadRunning = false;
+    }
+}
+
+
+inline bool
+EventLoop::isLoopThread() const
+{
+    return bplus::sync::atomicLoad(&m_loopThread,
+                                   bplus::sync::MemoryOrderRelaxed)
+        == (long) pthread_self();
+}
+
+
+inline bool
+EventLoop::watch(int fd, unsigned int events, FdCallback cb,
+                 void * cookie)
+{
+    if (fd < 0) return false;
+
+    bplus::sync::Lock lock(m_mutex);
+    if ((size_t) fd >= m_watches.size()) m_watches.resize(fd + 1, NULL);
+
+    Watch * old = m_watches[fd];
+    Watch * w = new Watch;
+    w->fd = fd;
+    w->events = events;
+    w->cb = cb;
+    w->cookie = cookie;
+    w->bDead = false;
+
+    struct epoll_event ev;
+    ev.events = eventsToEpoll(events);
+    ev.data.ptr = w;
+    if (epoll_ctl(m_epollFd, old ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                  fd, &ev) != 0)
+    {
+        delete w;
+        return false;
+    }
+    if (old) {
+        // events already harvested may still point at it
+        old->bDead = true;
+        m_graveyard.push_back(old);
+    }
+    m_watches[fd] = w;
+    return true;
+}
+
+
+inline bool
+EventLoop::modify(int fd, unsigned int events)
+{
+    bplus::sync::Lock lock(m_mutex);
+    if (fd < 0 || (size_t) fd >= m_watches.size() || !m_watches[fd]) {
+        return false;
+    }
+    Watch * w = m_watches[fd];
+    struct epoll_event ev;
+    ev.events = eventsToEpoll(events);
+    ev.data.ptr = w;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &ev) != 0) return false;
+    w->events = events;
+    return true;
+}
+
+
+inline void
+EventLoop::unwatch(int fd)
+{
+    bplus::sync::Lock lock(m_mutex);
+    if (fd < 0 || (size_t) fd >= m_watches.size() || !m_watches[fd]) {
+        return;
+    }
+    Watch * w = m_watches[fd];
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, NULL);
+    w->bDead = true;
+    m_graveyard.push_back(w);
+    m_watches[fd] = NULL;
+}
+
+
+inline LoopTimerId
+EventLoop::runAfter(unsigned int msec, LoopFunc func, void * cookie)
+{
+    return addTimer(msec, 0, func, cookie);
+}
+
+
+inline LoopTimerId
+EventLoop::runEvery(unsigned int msec, LoopFunc func, void * cookie)
+{
+    return addTimer(msec, msec ? msec : 1, func, cookie);
+}
+
+
+inline LoopTimerId
+EventLoop::addTimer(unsigned int msec, unsigned int periodMsec,
+                    LoopFunc func, void * cookie)
+{
+    unsigned long long deadline = bplus::timeutil::monotonicMicros()
+                                  + msec * 1000ULL;
+    Timer t;
+    t.func = func;
+    t.cookie = cookie;
+    t.periodMicros = periodMsec * 1000ULL;
+
+    LoopTimerId id;
+    bool bFirst;
+    {
+        bplus::sync::Lock lock(m_mutex);
+        id = m_nextTimerId++;
+        m_timers[TimerKey(deadline, id)] = t;
+        m_timerDeadlines[id] = deadline;
+        bFirst = m_timers.begin()->first.second == id;
+    }
+    // the loop may be sleeping past the new deadline
+    if (bFirst && !isLoopThread()) wake();
+    return id;
+}
+
+
+inline bool
+EventLoop::cancelTimer(LoopTimerId id)
+{
+    bplus::sync::Lock lock(m_mutex);
+    std::map<LoopTimerId, unsigned long long>::iterator it =
+        m_timerDeadlines.find(id);
+    if (it == m_timerDeadlines.end()) return false;
+    m_timers.erase(TimerKey(it->second, id));
+    m_timerDeadlines.erase(it);
+    return true;
+}
+
+
+inline void
+EventLoop::post(LoopFunc func, void * cookie)
+{
+    Posted p;
+    p.func = func;
+    p.cookie = cookie;
+    {
+        bplus::sync::Lock lock(m_mutex);
+        m_posted.push_back(p);
+    }
+    wake();
+}
+
+
+inline void
+EventLoop::wake()
+{
+    // one write per loop iteration is enough
+    if (bplus::sync::atomicExchange(&m_wakePending, 1) == 0) {
+        uint64_t one = 1;
+        ssize_t n = write(m_wakeFd, &one, sizeof(one));
+        (void) n;
+    }
+}
+
+
+inline int
+EventLoop::nextTimeout()
+{
+    bplus::sync::Lock lock(m_mutex);
+    if (!m_posted.empty()) return 0;
+    if (m_timers.empty()) return -1;
+
+    unsigned long long next = m_timers.begin()->first.first;
+    unsigned long long now = bplus::timeutil::monotonicMicros();
+    if (next <= now) return 0;
+    // round up, epoll's resolution is a millisecond
+    unsigned long long msec = (next - now + 999) / 1000;
+    return msec > 0x7fffffff ? 0x7fffffff : (int) msec;
+}
+
+
+// Returns false if there was nothing to run.  Posted functions own
+// their cookies (see bploopcompletion.h), so even when stopping every
+// one taken from the queue is run.
+inline bool
+EventLoop::runPosted()
+{
+    std::deque<Posted> posted;
+    {
+        bplus::sync::Lock lock(m_mutex);
+        posted.swap(m_posted);
+    }
+    for (size_t i = 0; i < posted.size(); i++) {
+        posted[i].func(posted[i].cookie);
+    }
+    return !posted.empty();
+}
+
+
+inline void
+EventLoop::runTimers()
+{
+    unsigned long long now = bplus::timeutil::monotonicMicros();
+    for (;;) {
+        Timer t;
+        {
+            bplus::sync::Lock lock(m_mutex);
+            if (m_timers.empty()) return;
+            std::map<TimerKey, Timer>::iterator it = m_timers.begin();
+            if (it->first.first > now) return;
+
+            unsigned long long next = it->first.first;
+            LoopTimerId id = it->first.second;
+            t = it->second;
+            m_timers.erase(it);
+            if (t.periodMicros) {
+                // skip missed periods rather than firing in a burst
+                next += ((now - next) / t.periodMicros + 1) * t.periodMicros;
+                m_timers[TimerKey(next, id)] = t;
+                m_timerDeadlines[id] = next;
+            } else {
+                m_timerDeadlines.erase(id);
+            }
+        }
+        if (bplus::sync::atomicLoad(&m_stopping)) return;
+        t.func(t.cookie);
+    }
+}
+
+
+inline void
+EventLoop::dispatch(Watch * w, unsigned int events)
+{
+    FdCallback cb;
+    void * cookie;
+    {
+        bplus::sync::Lock lock(m_mutex);
+        if (w->bDead) return;
+        // errors and hangups are always of interest
+        events &= w->events | EventError | EventHangup;
+        cb = w->cb;
+        cookie = w->cookie;
+    }
+    if (events) cb(w->fd, events, cookie);
+}
+
+
+inline void
+EventLoop::run()
+{
+    bplus::sync::atomicStore(&m_stopping, 0);
+    loop();
+}
+
+
+inline void
+EventLoop::loop()
+{
+    if (!valid()) return;
+    bplus::sync::atomicStore(&m_loopThread, (long) pthread_self());
+
+    const int kMaxEvents = 64;
+    struct epoll_event events[kMaxEvents];
+
+    while (!bplus::sync::atomicLoad(&m_stopping)) {
+        int n = epoll_wait(m_epollFd, events, kMaxEvents, nextTimeout());
+        if (n < 0 && errno != EINTR) break;
+
+        bool bWoken = false;
+        for (int i = 0; i < n; i++) {
+            if (bplus::sync::atomicLoad(&m_stopping)) break;
+            if (events[i].data.ptr == NULL) {
+                bWoken = true;
+                continue;
+            }
+            dispatch((Watch *) events[i].data.ptr,
+                     epollToEvents(events[i].events));
+        }
+        if (bWoken) {
+            uint64_t count;
+            ssize_t r = read(m_wakeFd, &count, sizeof(count));
+            (void) r;
+            // clear after draining so a wake() racing with us writes
+            // again and isn't lost
+            bplus::sync::atomicStore(&m_wakePending, 0);
+        }
+
+        runPosted();
+        runTimers();
+
+        // no harvested event refers to a dead watch any more
+        bplus::sync::Lock lock(m_mutex);
+        for (size_t i = 0; i < m_graveyard.size(); i++) {
+            delete m_graveyard[i];
+        }
+        m_graveyard.clear();
+    }
+
+    // what was posted before stop() still runs, here on the loop thread
+    while (runPosted()) {}
+
+    // timers that haven't fired don't carry over into another run()
+    {
+        bplus::sync::Lock lock(m_mutex);
+        m_timers.clear();
+        m_timerDeadlines.clear();
+    }
+
+    bplus::sync::atomicStore(&m_loopThread, 0);
+}
+
+
+} // namespace io
+} // namespace bplus
+
+#endif // BPEVENTLOOPIMPL_LINUX_H_
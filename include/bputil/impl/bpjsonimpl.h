@@ -0,0 +1,415 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpjsonimpl.h
+ *
+ *  Inline implementation file for bpjson.h.
+ *
+ *  Note: This file is included by bpjson.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPJSONIMPL_H_
+#define BPJSONIMPL_H_
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bputil/bpstrutil.h"
+#include "bputil/bputf8.h"
+
+
+namespace bplus {
+namespace json {
+namespace detail {
+
+
+class Parser
+{
+  public:
+    Parser(const StringView& s) : m_p(s.data()), m_pEnd(s.end()),
+                                  m_pBegin(s.data()) {}
+
+    Object* parseDocument(std::string* psError)
+    {
+        Object* pObj = parseValue(0);
+        if (pObj) {
+            skipSpace();
+            if (m_p != m_pEnd) {
+                delete pObj;
+                pObj = NULL;
+                fail("trailing characters");
+            }
+        }
+        if (!pObj && psError) *psError = m_sError;
+        return pObj;
+    }
+
+  private:
+    enum { s_maxDepth = 256 };
+
+    void fail(const char* cszWhat)
+    {
+        if (!m_sError.empty()) return;
+        char buf[128];
+        snprintf(buf, sizeof(buf), "offset %lu: %s",
+                 (unsigned long) (m_p - m_pBegin), cszWhat);
+        m_sError = buf;
+    }
+
+    void skipSpace()
+    {
+        while (m_p != m_pEnd && (*m_p == ' ' || *m_p == '\t'
+                                 || *m_p == '\n' || *m_p == '\r')) {
+            ++m_p;
+        }
+    }
+
+    bool literal(const char* csz)
+    {
+        size_t n = strlen(csz);
+        if ((size_t) (m_pEnd - m_p) < n || memcmp(m_p, csz, n) != 0) {
+            return false;
+        }
+        m_p += n;
+        return true;
+    }
+
+    Object* parseValue(unsigned int nDepth)
+    {
+        skipSpace();
+        if (m_p == m_pEnd) {
+            fail("unexpected end of input");
+            return NULL;
+        }
+        if (nDepth > s_maxDepth) {
+            fail("nested too deeply");
+            return NULL;
+        }
+        switch (*m_p) {
+            case '{': return parseMap(nDepth);
+            case '[': return parseList(nDepth);
+            case '"': {
+                std::string s;
+                if (!parseString(s)) return NULL;
+                return new String(s);
+            }
+            case 't': if (literal("true")) return new Bool(true); break;
+            case 'f': if (literal("false")) return new Bool(false); break;
+            case 'n': if (literal("null")) return new Null; break;
+            default:
+                if (*m_p == '-' || (*m_p >= '0' && *m_p <= '9')) {
+                    return parseNumber();
+                }
+                break;
+        }
+        fail("unexpected character");
+        return NULL;
+    }
+
+    Object* parseMap(unsigned int nDepth)
+    {
+        ++m_p;
+        Map* pMap = new Map;
+        skipSpace();
+        if (m_p != m_pEnd && *m_p == '}') {
+            ++m_p;
+            return pMap;
+        }
+        for (;;) {
+            skipSpace();
+            std::string sKey;
+            if (m_p == m_pEnd || *m_p != '"') {
+                fail("expected a key");
+                break;
+            }
+            if (!parseString(sKey)) break;
+            skipSpace();
+            if (m_p == m_pEnd || *m_p != ':') {
+                fail("expected ':'");
+                break;
+            }
+            ++m_p;
+            Object* pVal = parseValue(nDepth + 1);
+            if (!pVal) break;
+            pMap->add(sKey, pVal);
+            skipSpace();
+            if (m_p != m_pEnd && *m_p == ',') {
+                ++m_p;
+            } else if (m_p != m_pEnd && *m_p == '}') {
+                ++m_p;
+                return pMap;
+            } else {
+                fail("expected ',' or '}'");
+                break;
+            }
+        }
+        delete pMap;
+        return NULL;
+    }
+
+    Object* parseList(unsigned int nDepth)
+    {
+        ++m_p;
+        List* pList = new List;
+        skipSpace();
+        if (m_p != m_pEnd && *m_p == ']') {
+            ++m_p;
+            return pList;
+        }
+        for (;;) {
+            Object* pVal = parseValue(nDepth + 1);
+            if (!pVal) break;
+            pList->append(pVal);
+            skipSpace();
+            if (m_p != m_pEnd && *m_p == ',') {
+                ++m_p;
+            } else if (m_p != m_pEnd && *m_p == ']') {
+                ++m_p;
+                return pList;
+            } else {
+                fail("expected ',' or ']'");
+                break;
+            }
+        }
+        delete pList;
+        return NULL;
+    }
+
+    bool parseHex4(unsigned int& u)
+    {
+        if (m_pEnd - m_p < 4) return false;
+        u = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *m_p++;
+            u <<= 4;
+            if (c >= '0' && c <= '9') u |= c - '0';
+            else if (c >= 'a' && c <= 'f') u |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') u |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool parseString(std::string& sOut)
+    {
+        ++m_p;
+        for (;;) {
+            // copy the run up to the next quote, escape or control
+            const char* pRun = m_p;
+            while (m_p != m_pEnd && *m_p != '"' && *m_p != '\\'
+                   && (unsigned char) *m_p >= 0x20) {
+                ++m_p;
+            }
+            sOut.append(pRun, m_p - pRun);
+            if (m_p == m_pEnd) {
+                fail("unterminated string");
+                return false;
+            }
+            char c = *m_p++;
+            if (c == '"') return true;
+            if (c != '\\') {
+                --m_p;
+                fail("control character in string");
+                return false;
+            }
+            if (m_p == m_pEnd) {
+                fail("unterminated string");
+                return false;
+            }
+            switch (*m_p++) {
+                case '"':  sOut += '"'; break;
+                case '\\': sOut += '\\'; break;
+                case '/':  sOut += '/'; break;
+                case 'b':  sOut += '\b'; break;
+                case 'f':  sOut += '\f'; break;
+                case 'n':  sOut += '\n'; break;
+                case 'r':  sOut += '\r'; break;
+                case 't':  sOut += '\t'; break;
+                case 'u': {
+                    unsigned int cp;
+                    if (!parseHex4(cp)) {
+                        fail("bad \\u escape");
+                        return false;
+                    }
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        unsigned int lo;
+                        if (!literal("\\u") || !parseHex4(lo)
+                            || lo < 0xDC00 || lo > 0xDFFF) {
+                            fail("unpaired surrogate");
+                            return false;
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                        fail("unpaired surrogate");
+                        return false;
+                    }
+                    strutil::detail::appendUtf8(sOut, cp);
+                    break;
+                }
+                default:
+                    fail("bad escape");
+                    return false;
+            }
+        }
+    }
+
+    Object* parseNumber()
+    {
+        const char* pStart = m_p;
+        bool bIntegral = true;
+        if (*m_p == '-') ++m_p;
+        if (m_p == m_pEnd || *m_p < '0' || *m_p > '9') {
+            fail("bad number");
+            return NULL;
+        }
+        if (*m_p == '0') {
+            ++m_p;
+        } else {
+            while (m_p != m_pEnd && *m_p >= '0' && *m_p <= '9') ++m_p;
+        }
+        if (m_p != m_pEnd && *m_p == '.') {
+            bIntegral = false;
+            ++m_p;
+            if (m_p == m_pEnd || *m_p < '0' || *m_p > '9') {
+                fail("bad number");
+                return NULL;
+            }
+            while (m_p != m_pEnd && *m_p >= '0' && *m_p <= '9') ++m_p;
+        }
+        if (m_p != m_pEnd && (*m_p == 'e' || *m_p == 'E')) {
+            bIntegral = false;
+            ++m_p;
+            if (m_p != m_pEnd && (*m_p == '+' || *m_p == '-')) ++m_p;
+            if (m_p == m_pEnd || *m_p < '0' || *m_p > '9') {
+                fail("bad number");
+                return NULL;
+            }
+            while (m_p != m_pEnd && *m_p >= '0' && *m_p <= '9') ++m_p;
+        }
+
+        // strtoll and strtod want a terminator
+        std::string sNum(pStart, m_p - pStart);
+        if (bIntegral) {
+            errno = 0;
+            long long n = strtoll(sNum.c_str(), NULL, 10);
+            if (errno != ERANGE) return new Integer(n);
+        }
+        return new Double(strtod(sNum.c_str(), NULL));
+    }
+
+    const char*     m_p;
+    const char*     m_pEnd;
+    const char*     m_pBegin;
+    std::string     m_sError;
+};
+
+
+} // detail
+
+
+inline Object*
+parse(const StringView& sIn, std::string* psError)
+{
+    detail::Parser parser(sIn);
+    return parser.parseDocument(psError);
+}
+
+
+inline void
+serialize(const BPElement* elem, std::string& sOut)
+{
+    if (!elem) {
+        sOut += "null";
+        return;
+    }
+
+    char buf[64];
+    switch (elem->type) {
+        case BPTNull:
+        case BPTAny:
+            sOut += "null";
+            break;
+        case BPTBoolean:
+            sOut += elem->value.booleanVal ? "true" : "false";
+            break;
+        case BPTInteger:
+        case BPTCallBack:
+            snprintf(buf, sizeof(buf), "%lld", elem->value.integerVal);
+            sOut += buf;
+            break;
+        case BPTDouble: {
+            double d = elem->value.doubleVal;
+            if (d != d || d - d != 0) {
+                sOut += "null";
+                break;
+            }
+            snprintf(buf, sizeof(buf), "%.17g", d);
+            sOut += buf;
+            // keep it a Double when read back
+            if (!strpbrk(buf, ".eE")) sOut += ".0";
+            break;
+        }
+        case BPTString:
+            strutil::quoteJsonString(StringView(elem->value.stringVal), sOut);
+            break;
+        case BPTNativePath:
+        case BPTWritableNativePath:
+#if defined(WIN32) || defined(WINDOWS) || defined(_WINDOWS)
+            strutil::quoteJsonString(
+                StringView(strutil::wideToUtf8(elem->value.pathVal)), sOut);
+#else
+            strutil::quoteJsonString(StringView(elem->value.pathVal), sOut);
+#endif
+            break;
+        case BPTMap: {
+            sOut += '{';
+            const BPMap& m = elem->value.mapVal;
+            for (unsigned int i = 0; i < m.size; i++) {
+                if (i) sOut += ',';
+                strutil::quoteJsonString(StringView(m.elements[i].key), sOut);
+                sOut += ':';
+                serialize(m.elements[i].value, sOut);
+            }
+            sOut += '}';
+            break;
+        }
+        case BPTList: {
+            sOut += '[';
+            const BPList& l = elem->value.listVal;
+            for (unsigned int i = 0; i < l.size; i++) {
+                if (i) sOut += ',';
+                serialize(l.elements[i], sOut);
+            }
+            sOut += ']';
+            break;
+        }
+    }
+}
+
+
+} // json
+} // bplus
+
+
+#endif // BPJSONIMPL_H_
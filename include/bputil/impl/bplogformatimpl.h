@@ -0,0 +1,205 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bplogformatimpl.h
+ *
+ *  Inline implementation file for bplogformat.h.
+ *
+ *  Note: This file is included by bplogformat.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPLOGFORMATIMPL_H_
+#define BPLOGFORMATIMPL_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+
+namespace bplus {
+namespace logging {
+namespace detail {
+
+
+// snprintf one value onto sOut, retrying with a bigger buffer if needed
+template <class T>
+void
+appendFormatted(std::string & sOut, const std::string & sSpec, T v)
+{
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), sSpec.c_str(), v);
+    if (n >= 0 && n < (int) sizeof(buf)) {
+        sOut.append(buf, n);
+        return;
+    }
+
+    // n is the length needed, or on some platforms just -1
+    size_t nSize = n > 0 ? (size_t) n + 1 : sizeof(buf) * 2;
+    std::vector<char> big;
+    for (;;) {
+        big.resize(nSize);
+        n = snprintf(&big[0], nSize, sSpec.c_str(), v);
+        if (n >= 0 && (size_t) n < nSize) {
+            sOut.append(&big[0], n);
+            return;
+        }
+        if (nSize >= 1024 * 1024) return;
+        nSize = n > 0 ? (size_t) n + 1 : nSize * 2;
+    }
+}
+
+
+inline std::string
+argToString(const Arg & a)
+{
+    std::string s;
+    switch (a.type) {
+        case Arg::TypeInt:     appendFormatted(s, "%lld", a.val.i); break;
+        case Arg::TypeUInt:    appendFormatted(s, "%llu", a.val.u); break;
+        case Arg::TypeDouble:  appendFormatted(s, "%g", a.val.d); break;
+        case Arg::TypeString:  s.assign(a.val.s, a.len); break;
+        case Arg::TypePointer: appendFormatted(s, "%p", a.val.p); break;
+    }
+    return s;
+}
+
+
+inline long long
+argToInt(const Arg & a)
+{
+    switch (a.type) {
+        case Arg::TypeInt:     return a.val.i;
+        case Arg::TypeUInt:    return (long long) a.val.u;
+        case Arg::TypeDouble:  return (long long) a.val.d;
+        case Arg::TypeString:  return 0;
+        case Arg::TypePointer: return (long long) (size_t) a.val.p;
+    }
+    return 0;
+}
+
+
+inline double
+argToDouble(const Arg & a)
+{
+    switch (a.type) {
+        case Arg::TypeInt:     return (double) a.val.i;
+        case Arg::TypeUInt:    return (double) a.val.u;
+        case Arg::TypeDouble:  return a.val.d;
+        default:               return 0.0;
+    }
+}
+
+
+} // detail
+
+
+inline void
+format(std::string & sOut, const char * fmt,
+       const Arg * args, unsigned int nArgs)
+{
+    if (fmt == NULL) return;
+
+    unsigned int iArg = 0;
+    const char * p = fmt;
+    while (*p) {
+        if (*p != '%') {
+            const char * run = p;
+            while (*p && *p != '%') ++p;
+            sOut.append(run, p - run);
+            continue;
+        }
+
+        const char * spec = p++;
+        if (*p == '%') {
+            sOut += '%';
+            ++p;
+            continue;
+        }
+
+        while (*p && strchr("-+ #0", *p)) ++p;
+        while (*p >= '0' && *p <= '9') ++p;
+        if (*p == '.') {
+            ++p;
+            while (*p >= '0' && *p <= '9') ++p;
+        }
+        const char * lengthMods = p;
+        while (*p && strchr("hlLqjzt", *p)) ++p;
+        char conv = *p;
+        if (conv == 0 || iArg >= nArgs || !strchr("diuxXofFeEgGaAcsp", conv)) {
+            // nothing we can fill: copy the spec through
+            if (conv) ++p;
+            sOut.append(spec, p - spec);
+            continue;
+        }
+        ++p;
+
+        const Arg & a = args[iArg++];
+        std::string sSpec(spec, lengthMods - spec);
+        switch (conv) {
+            case 'd': case 'i':
+                sSpec += "lld";
+                detail::appendFormatted(sOut, sSpec, detail::argToInt(a));
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                sSpec += "ll";
+                sSpec += conv;
+                detail::appendFormatted(
+                    sOut, sSpec, (unsigned long long) detail::argToInt(a));
+                break;
+            case 'c':
+                sSpec += 'c';
+                detail::appendFormatted(sOut, sSpec,
+                                        (int) detail::argToInt(a));
+                break;
+            case 'p':
+                sSpec += 'p';
+                detail::appendFormatted(
+                    sOut, sSpec,
+                    a.type == Arg::TypePointer
+                        ? a.val.p : (const void *) (size_t) detail::argToInt(a));
+                break;
+            case 's': {
+                sSpec += 's';
+                std::string s = detail::argToString(a);
+                if (sSpec == "%s") {
+                    sOut += s;
+                } else {
+                    detail::appendFormatted(sOut, sSpec, s.c_str());
+                }
+                break;
+            }
+            default:
+                sSpec += conv;
+                detail::appendFormatted(sOut, sSpec, detail::argToDouble(a));
+                break;
+        }
+    }
+}
+
+
+} // logging
+} // bplus
+
+
+#endif // BPLOGFORMATIMPL_H_
@@ -0,0 +1,59 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpmappedfileimpl.h
+ *
+ *  Inline implementation file for bpmappedfile.h (portable parts)
+ *
+ *  Note: This file is included by bpmappedfile.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPMAPPEDFILEIMPL_H_
+#define BPMAPPEDFILEIMPL_H_
+
+
+inline
+bplus::io::MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+inline bool
+bplus::io::MappedFile::openArgument(const bplus::Object & arg, Mode mode,
+                                    std::string * psError)
+{
+    if (arg.type() != BPTNativePath && arg.type() != BPTWritableNativePath) {
+        if (psError) *psError = "argument is not a path";
+        return false;
+    }
+    if (mode == ReadWrite && arg.type() != BPTWritableNativePath) {
+        if (psError) *psError = "path argument is not writable";
+        return false;
+    }
+    return open((tPathString) arg, mode, psError);
+}
+
+
+#endif // BPMAPPEDFILEIMPL_H_
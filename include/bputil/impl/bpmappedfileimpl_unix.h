@@ -0,0 +1,179 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpmappedfileimpl_unix.h
+ *
+ *  Inline implementation file for bpmappedfile.h (unix version)
+ *
+ *  Note: This file is included by bpmappedfile.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPMAPPEDFILEIMPLUNIX_H_
+#define BPMAPPEDFILEIMPLUNIX_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "bputil/bpstrutil.h"
+
+
+namespace bplus {
+namespace io {
+namespace detail {
+
+inline bool
+mapFailed(const char * cszWhat, std::string * psError)
+{
+    int nErr = errno;
+    if (psError) {
+        *psError = std::string(cszWhat) + ": "
+            + bplus::strutil::errorString(nErr);
+    }
+    return false;
+}
+
+} // namespace detail
+} // namespace io
+} // namespace bplus
+
+
+inline
+bplus::io::MappedFile::MappedFile() :
+    m_bOpen(false), m_mode(ReadOnly), m_pData(NULL), m_nSize(0)
+{
+}
+
+
+inline bool
+bplus::io::MappedFile::open(const tPathString & path, Mode mode,
+                            std::string * psError)
+{
+    close();
+
+    int fd = ::open(path.c_str(), mode == ReadWrite ? O_RDWR : O_RDONLY);
+    if (fd < 0) return detail::mapFailed("open", psError);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        detail::mapFailed("fstat", psError);
+        ::close(fd);
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        if (psError) *psError = "not a regular file";
+        ::close(fd);
+        return false;
+    }
+    if ((unsigned long long) st.st_size > (unsigned long long) (size_t) -1) {
+        if (psError) *psError = "file too large to map";
+        ::close(fd);
+        return false;
+    }
+
+    // A mapping of no bytes is an error, so an empty file just has no
+    // data.  The mapping holds its own reference to the file.
+    if (st.st_size > 0) {
+        int prot = PROT_READ | (mode == ReadWrite ? PROT_WRITE : 0);
+        void * p = mmap(NULL, (size_t) st.st_size, prot, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            detail::mapFailed("mmap", psError);
+            ::close(fd);
+            return false;
+        }
+        m_pData = (char *) p;
+    }
+    ::close(fd);
+    m_nSize = (size_t) st.st_size;
+    m_mode = mode;
+    m_bOpen = true;
+    return true;
+}
+
+
+inline bool
+bplus::io::MappedFile::create(const tPathString & path, size_t nBytes,
+                              std::string * psError)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) return detail::mapFailed("open", psError);
+    bool bOk = ftruncate(fd, (off_t) nBytes) == 0;
+    if (!bOk) detail::mapFailed("ftruncate", psError);
+    ::close(fd);
+    return bOk && open(path, ReadWrite, psError);
+}
+
+
+inline void
+bplus::io::MappedFile::close()
+{
+    if (m_pData) munmap(m_pData, m_nSize);
+    m_pData = NULL;
+    m_nSize = 0;
+    m_mode = ReadOnly;
+    m_bOpen = false;
+}
+
+
+inline bool
+bplus::io::MappedFile::advise(Advice advice, size_t offset, size_t nBytes)
+{
+    if (!m_pData || offset >= m_nSize) return false;
+    if (nBytes > m_nSize - offset) nBytes = m_nSize - offset;
+
+    int nAdvice;
+    switch (advice) {
+        case Normal:        nAdvice = MADV_NORMAL; break;
+        case Sequential:    nAdvice = MADV_SEQUENTIAL; break;
+        case Random:        nAdvice = MADV_RANDOM; break;
+        case WillNeed:      nAdvice = MADV_WILLNEED; break;
+        case DontNeed:      nAdvice = MADV_DONTNEED; break;
+#ifdef MADV_HUGEPAGE
+        case HugePage:      nAdvice = MADV_HUGEPAGE; break;
+#endif
+        default:            return false;
+    }
+
+    // madvise wants a page aligned start.
+    size_t nPage = (size_t) sysconf(_SC_PAGESIZE);
+    size_t nSlack = offset % nPage;
+    return madvise(m_pData + offset - nSlack, nBytes + nSlack, nAdvice) == 0;
+}
+
+
+inline bool
+bplus::io::MappedFile::flush()
+{
+    if (m_mode != ReadWrite) return false;
+    return !m_pData || msync(m_pData, m_nSize, MS_SYNC) == 0;
+}
+
+
+#endif // BPMAPPEDFILEIMPLUNIX_H_
@@ -0,0 +1,197 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpmappedfileimpl_windows.h
+ *
+ *  Inline implementation file for bpmappedfile.h (windows version)
+ *
+ *  Note: This file is included by bpmappedfile.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPMAPPEDFILEIMPLWINDOWS_H_
+#define BPMAPPEDFILEIMPLWINDOWS_H_
+
+#include <stdio.h>
+#include <windows.h>
+
+
+namespace bplus {
+namespace io {
+namespace detail {
+
+inline bool
+mapFailed(const char * cszWhat, std::string * psError)
+{
+    if (psError) {
+        char buf[64];
+        _snprintf(buf, sizeof(buf), " failed (error %lu)",
+                  (unsigned long) GetLastError());
+        *psError = std::string(cszWhat) + buf;
+    }
+    return false;
+}
+
+// PrefetchVirtualMemory is Windows 8 and later, so it's looked up.
+struct MemoryRange
+{
+    void * address;
+    SIZE_T nBytes;
+};
+typedef BOOL (WINAPI * PrefetchFn)(HANDLE, ULONG_PTR, MemoryRange *, ULONG);
+
+} // namespace detail
+} // namespace io
+} // namespace bplus
+
+
+inline
+bplus::io::MappedFile::MappedFile() :
+    m_bOpen(false), m_mode(ReadOnly), m_pData(NULL), m_nSize(0),
+    m_hFile(INVALID_HANDLE_VALUE)
+{
+}
+
+
+inline bool
+bplus::io::MappedFile::open(const tPathString & path, Mode mode,
+                            std::string * psError)
+{
+    close();
+
+    DWORD dwAccess = GENERIC_READ | (mode == ReadWrite ? GENERIC_WRITE : 0);
+    HANDLE hFile = CreateFileW(path.c_str(), dwAccess,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return detail::mapFailed("CreateFile", psError);
+    }
+
+    LARGE_INTEGER li;
+    if (!GetFileSizeEx(hFile, &li)) {
+        detail::mapFailed("GetFileSizeEx", psError);
+        CloseHandle(hFile);
+        return false;
+    }
+    if ((unsigned long long) li.QuadPart > (unsigned long long) (size_t) -1) {
+        if (psError) *psError = "file too large to map";
+        CloseHandle(hFile);
+        return false;
+    }
+
+    // Mapping an empty file fails, so it just has no data.  The view
+    // holds its own reference to the mapping.
+    if (li.QuadPart > 0) {
+        HANDLE hMapping = CreateFileMappingW(
+            hFile, NULL, mode == ReadWrite ? PAGE_READWRITE : PAGE_READONLY,
+            0, 0, NULL);
+        if (!hMapping) {
+            detail::mapFailed("CreateFileMapping", psError);
+            CloseHandle(hFile);
+            return false;
+        }
+        m_pData = (char *) MapViewOfFile(
+            hMapping, mode == ReadWrite ? FILE_MAP_WRITE : FILE_MAP_READ,
+            0, 0, 0);
+        if (!m_pData) detail::mapFailed("MapViewOfFile", psError);
+        CloseHandle(hMapping);
+        if (!m_pData) {
+            CloseHandle(hFile);
+            return false;
+        }
+    }
+    if (mode == ReadWrite) {
+        m_hFile = hFile;
+    } else {
+        CloseHandle(hFile);
+    }
+    m_nSize = (size_t) li.QuadPart;
+    m_mode = mode;
+    m_bOpen = true;
+    return true;
+}
+
+
+inline bool
+bplus::io::MappedFile::create(const tPathString & path, size_t nBytes,
+                              std::string * psError)
+{
+    close();
+
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                               FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return detail::mapFailed("CreateFile", psError);
+    }
+    LARGE_INTEGER li;
+    li.QuadPart = (LONGLONG) nBytes;
+    bool bOk = SetFilePointerEx(hFile, li, NULL, FILE_BEGIN)
+               && SetEndOfFile(hFile);
+    if (!bOk) detail::mapFailed("SetEndOfFile", psError);
+    CloseHandle(hFile);
+    return bOk && open(path, ReadWrite, psError);
+}
+
+
+inline void
+bplus::io::MappedFile::close()
+{
+    if (m_pData) UnmapViewOfFile(m_pData);
+    if (m_hFile != INVALID_HANDLE_VALUE) CloseHandle((HANDLE) m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_pData = NULL;
+    m_nSize = 0;
+    m_mode = ReadOnly;
+    m_bOpen = false;
+}
+
+
+inline bool
+bplus::io::MappedFile::advise(Advice advice, size_t offset, size_t nBytes)
+{
+    if (!m_pData || offset >= m_nSize) return false;
+    if (nBytes > m_nSize - offset) nBytes = m_nSize - offset;
+
+    // Only read ahead has an equivalent here.
+    if (advice == Normal) return true;
+    if (advice != WillNeed) return false;
+    static detail::PrefetchFn s_pfnPrefetch = (detail::PrefetchFn)
+        GetProcAddress(GetModuleHandleW(L"kernel32.dll"),
+                       "PrefetchVirtualMemory");
+    if (!s_pfnPrefetch) return false;
+    detail::MemoryRange range = { m_pData + offset, nBytes };
+    return s_pfnPrefetch(GetCurrentProcess(), 1, &range, 0) != FALSE;
+}
+
+
+inline bool
+bplus::io::MappedFile::flush()
+{
+    if (m_mode != ReadWrite) return false;
+    if (m_pData && !FlushViewOfFile(m_pData, 0)) return false;
+    return FlushFileBuffers((HANDLE) m_hFile) != FALSE;
+}
+
+
+#endif // BPMAPPEDFILEIMPLWINDOWS_H_
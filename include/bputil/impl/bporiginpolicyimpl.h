@@ -0,0 +1,334 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bporiginpolicyimpl.h
+ *
+ *  Inline implementation file for bporiginpolicy.h.
+ *
+ *  Note: This file is included by bporiginpolicy.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPORIGINPOLICYIMPL_H_
+#define BPORIGINPOLICYIMPL_H_
+
+#include <ctype.h>
+
+
+namespace bplus {
+namespace url {
+
+
+inline OriginPolicy::OriginPolicy() :
+    m_nodes( 1 ),
+    m_anyHost(),
+    m_nRules( 0 ),
+    m_nAllowRules( 0 )
+{
+}
+
+
+inline bool OriginPolicy::allow( const std::string& sPattern )
+{
+    return addRule( sPattern, false );
+}
+
+
+inline bool OriginPolicy::deny( const std::string& sPattern )
+{
+    return addRule( sPattern, true );
+}
+
+
+inline void OriginPolicy::clear()
+{
+    m_nodes.assign( 1, Node() );
+    m_anyHost.clear();
+    m_nRules = 0;
+    m_nAllowRules = 0;
+}
+
+
+inline bool OriginPolicy::addRule( const std::string& sPattern, bool bDeny )
+{
+    StringView s( sPattern );
+    Rule rule;
+    rule.port = -1;
+    rule.bDeny = bDeny;
+
+    size_t nSep = s.find( "://" );
+    if (nSep != std::string::npos)
+    {
+        StringView sScheme = s.substr( 0, nSep );
+        if (sScheme.empty())
+            return false;
+        if (sScheme != "*")
+        {
+            for (size_t i = 0; i < sScheme.size(); i++)
+                rule.scheme += (char) tolower( (unsigned char) sScheme[i] );
+        }
+        s.removePrefix( nSep + 3 );
+    }
+
+    size_t nColon = s.find( ':' );
+    if (nColon != std::string::npos)
+    {
+        StringView sPort = s.substr( nColon + 1 );
+        s = s.substr( 0, nColon );
+        if (sPort != "*")
+        {
+            if (sPort.empty() || sPort.size() > 5)
+                return false;
+            int port = 0;
+            for (size_t i = 0; i < sPort.size(); i++)
+            {
+                if (!isdigit( (unsigned char) sPort[i] ))
+                    return false;
+                port = port * 10 + (sPort[i] - '0');
+            }
+            if (port > 65535)
+                return false;
+            rule.port = port;
+        }
+    }
+
+    if (!s.empty() && s[s.size() - 1] == '.')
+        s.removeSuffix( 1 );
+    if (s.empty())
+        return false;
+
+    if (s == "*")
+    {
+        m_anyHost.push_back( rule );
+    }
+    else
+    {
+        bool bSubdomains = s.startsWith( "*." );
+        if (bSubdomains)
+            s.removePrefix( 2 );
+        if (s.empty() || s.find( '*' ) != std::string::npos)
+            return false;
+
+        // check every label is non-empty before touching the trie
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            if (s[i] == '.' && (i == 0 || s[i - 1] == '.'))
+                return false;
+        }
+
+        size_t nNode = 0;
+        size_t nEnd = s.size();
+        for (;;)
+        {
+            size_t nDot = s.substr( 0, nEnd ).rfind( '.' );
+            size_t nStart = (nDot == std::string::npos) ? 0 : nDot + 1;
+            std::string sLabel;
+            for (size_t i = nStart; i < nEnd; i++)
+                sLabel += (char) tolower( (unsigned char) s[i] );
+
+            size_t nAt = 0;
+            size_t nChild = findChild( nNode, sLabel, &nAt );
+            if (nChild == 0)
+            {
+                nChild = m_nodes.size();
+                m_nodes.push_back( Node() );
+                m_nodes[nNode].children.insert(
+                    m_nodes[nNode].children.begin() + nAt,
+                    std::make_pair( sLabel, nChild ) );
+            }
+            nNode = nChild;
+
+            if (nStart == 0)
+                break;
+            nEnd = nStart - 1;
+        }
+
+        if (bSubdomains)
+            m_nodes[nNode].subdomains.push_back( rule );
+        else
+            m_nodes[nNode].exact.push_back( rule );
+    }
+
+    m_nRules++;
+    if (!bDeny)
+        m_nAllowRules++;
+    return true;
+}
+
+
+// Returns the child of nNode labelled sLabel, or 0 (the root, which is
+// nobody's child) with *pnInsertAt set to where it would go.
+inline size_t OriginPolicy::findChild( size_t nNode,
+                                       const StringView& sLabel,
+                                       size_t* pnInsertAt ) const
+{
+    const std::vector< std::pair<std::string, size_t> >& children =
+        m_nodes[nNode].children;
+    size_t nLo = 0;
+    size_t nHi = children.size();
+    while (nLo < nHi)
+    {
+        size_t nMid = nLo + (nHi - nLo) / 2;
+        int cmp = StringView( children[nMid].first ).compare( sLabel );
+        if (cmp == 0)
+            return children[nMid].second;
+        if (cmp < 0)
+            nLo = nMid + 1;
+        else
+            nHi = nMid;
+    }
+    if (pnInsertAt)
+        *pnInsertAt = nLo;
+    return 0;
+}
+
+
+inline void OriginPolicy::check( const tRules& rules, const Origin& origin,
+                                 bool& bAllowed, bool& bDenied )
+{
+    for (size_t i = 0; i < rules.size(); i++)
+    {
+        const Rule& r = rules[i];
+        if ((r.port == -1 || r.port == origin.port)
+            && (r.scheme.empty() || r.scheme == origin.scheme))
+        {
+            if (r.bDeny)
+                bDenied = true;
+            else
+                bAllowed = true;
+        }
+    }
+}
+
+
+inline bool OriginPolicy::isAllowed( const Origin& origin ) const
+{
+    if (m_nRules == 0)
+        return true;
+    if (!origin.valid())
+        return false;
+
+    // Normalize as Origin::assign does, for Origins filled in by hand:
+    // drop one trailing dot and lowercase, into a buffer rather than
+    // the heap.  A host that still has an empty label ("..", a leading
+    // or second trailing dot) isn't a name any rule could be meant for;
+    // let it through and it could dodge a deny rule for the host it
+    // resolves to.
+    char szHost[256];
+    size_t nHost = origin.host.size();
+    if (nHost > 0 && origin.host[nHost - 1] == '.')
+        nHost--;
+    if (nHost >= sizeof(szHost))
+        return false;
+    for (size_t i = 0; i < nHost; i++)
+    {
+        char c = origin.host[i];
+        if (c == '.' && (i == 0 || i + 1 == nHost || szHost[i - 1] == '.'))
+            return false;
+        szHost[i] = (char) tolower( (unsigned char) c );
+    }
+
+    bool bAllowed = false;
+    bool bDenied = false;
+    check( m_anyHost, origin, bAllowed, bDenied );
+
+    // Walk the host's labels right to left.  The trie's labels are
+    // lowercase too.
+    StringView sHost( szHost, nHost );
+    size_t nNode = 0;
+    size_t nEnd = sHost.size();
+    while (nEnd > 0 && !bDenied)
+    {
+        if (nNode != 0)
+            check( m_nodes[nNode].subdomains, origin, bAllowed, bDenied );
+
+        size_t nDot = sHost.substr( 0, nEnd ).rfind( '.' );
+        size_t nStart = (nDot == std::string::npos) ? 0 : nDot + 1;
+        nNode = findChild( nNode, sHost.substr( nStart, nEnd - nStart ),
+                           NULL );
+        if (nNode == 0)
+            break;
+        if (nStart == 0)
+        {
+            check( m_nodes[nNode].exact, origin, bAllowed, bDenied );
+            break;
+        }
+        nEnd = nStart - 1;
+    }
+
+    if (bDenied)
+        return false;
+    return m_nAllowRules == 0 || bAllowed;
+}
+
+
+inline OriginPolicyTable::~OriginPolicyTable()
+{
+    for (size_t i = 0; i < m_entries.size(); i++)
+        delete m_entries[i].second;
+}
+
+
+inline size_t OriginPolicyTable::lowerBound( const StringView& sName ) const
+{
+    size_t nLo = 0;
+    size_t nHi = m_entries.size();
+    while (nLo < nHi)
+    {
+        size_t nMid = nLo + (nHi - nLo) / 2;
+        if (StringView( m_entries[nMid].first ) < sName)
+            nLo = nMid + 1;
+        else
+            nHi = nMid;
+    }
+    return nLo;
+}
+
+
+inline OriginPolicy& OriginPolicyTable::get( const std::string& sName )
+{
+    size_t n = lowerBound( sName );
+    if (n == m_entries.size() || m_entries[n].first != sName)
+    {
+        m_entries.insert( m_entries.begin() + n,
+                          std::make_pair( sName, new OriginPolicy ) );
+    }
+    return *m_entries[n].second;
+}
+
+
+inline const OriginPolicy*
+OriginPolicyTable::find( const StringView& sName ) const
+{
+    size_t n = lowerBound( sName );
+    if (n == m_entries.size() || StringView( m_entries[n].first ) != sName)
+        return NULL;
+    return m_entries[n].second;
+}
+
+
+} // namespace url
+} // namespace bplus
+
+
+#endif // BPORIGINPOLICYIMPL_H_
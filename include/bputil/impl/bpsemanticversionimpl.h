@@ -29,6 +29,7 @@
 #ifndef BPSEMANTICVERSIONIMPL_H_
 #define BPSEMANTICVERSIONIMPL_H_
 
+#include <algorithm>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -38,10 +39,17 @@
 #endif
 
 using bplus::SemanticVersion;
+using bplus::VersionIndex;
+
+#define BP_SV_MAJOR_SHIFT 48
+#define BP_SV_MINOR_SHIFT 32
+#define BP_SV_MICRO_SHIFT 16
+#define BP_SV_NANO_SHIFT 0
+#define BP_SV_FIELD_MAX 0xffff
 
 inline 
 SemanticVersion::SemanticVersion()
-    : m_major(-1), m_minor(-1), m_micro(-1), m_nano(-1)
+    : m_ordinal(0), m_mask(0)
 {
 }
 
@@ -54,128 +62,108 @@ SemanticVersion::~SemanticVersion()
 inline SemanticVersion&
 SemanticVersion::operator=(const SemanticVersion& in)
 {
-    m_major = in.m_major;
-    m_minor = in.m_minor;    
-    m_micro = in.m_micro;
-    m_nano = in.m_nano;
+    m_ordinal = in.m_ordinal;
+    m_mask = in.m_mask;
     return *this;
 }
 
 
+inline int
+SemanticVersion::getField(unsigned int shift) const
+{
+    if (!((m_mask >> shift) & BP_SV_FIELD_MAX)) return -1;
+    return (int) ((m_ordinal >> shift) & BP_SV_FIELD_MAX);
+}
+
+
+inline void
+SemanticVersion::setField(unsigned int shift, int value)
+{
+    tOrdinal field = (tOrdinal) BP_SV_FIELD_MAX << shift;
+    m_ordinal &= ~field;
+    if (value < 0) {
+        m_mask &= ~field;
+    } else {
+        if (value > BP_SV_FIELD_MAX) value = BP_SV_FIELD_MAX;
+        m_ordinal |= (tOrdinal) value << shift;
+        m_mask |= field;
+    }
+}
+
+
 inline int
 SemanticVersion::majorVer() const
 {
-    return m_major;
+    return getField(BP_SV_MAJOR_SHIFT);
 }
 
 
 inline void
 SemanticVersion::setMajor(int major)
 {
-    m_major = major;
+    setField(BP_SV_MAJOR_SHIFT, major);
 }
 
 
 inline int
 SemanticVersion::minorVer() const
 {
-    return m_minor;
+    return getField(BP_SV_MINOR_SHIFT);
 }
 
 
 inline void
 SemanticVersion::setMinor(int minor)
 {
-    m_minor = minor;
+    setField(BP_SV_MINOR_SHIFT, minor);
 }
 
 
 inline int
 SemanticVersion::microVer() const
 {
-    return m_micro;
+    return getField(BP_SV_MICRO_SHIFT);
 }
 
 
 inline void
 SemanticVersion::setMicro(int micro)
 {
-    m_micro = micro;
+    setField(BP_SV_MICRO_SHIFT, micro);
 }
 
 
 inline int
 SemanticVersion::nanoVer() const
 {
-    return m_nano;
+    return getField(BP_SV_NANO_SHIFT);
 }
 
 
 inline void
 SemanticVersion::setNano(int nano)
 {
-    m_nano = nano;
+    setField(BP_SV_NANO_SHIFT, nano);
 }
 
 
 inline int
 SemanticVersion::compare(const SemanticVersion& other) const
 {
-    int rv = 0;
-
-    // compare major
-    if (m_major >= 0 && other.m_major >=0) {
-        rv = (m_major > other.m_major) ? 1 : ((m_major < other.m_major) ? -1 : 0);
-    }
-
-    // compare minor
-    if (rv == 0) {
-        if (m_minor >= 0 && other.m_minor >= 0) {
-            rv = (m_minor > other.m_minor) ? 1 :
-                 ((m_minor < other.m_minor) ? -1 : 0);
-        }
-    }
-
-    // compare micro
-    if (rv == 0) {
-        if (m_micro >= 0 && other.m_micro >= 0) {
-            rv = (m_micro > other.m_micro) ? 1 :
-                 ((m_micro < other.m_micro) ? -1 : 0);
-        }
-    }
-
-     // compare nano
-     if (rv == 0) {
-         if (m_nano >= 0 && other.m_nano >= 0) {
-            rv = (m_nano > other.m_nano) ? 1 :
-                 ((m_nano < other.m_nano) ? -1 : 0);
-         }
-     }
-
-     return rv;
+    // Fields that are a wildcard on either side drop out of the
+    // comparison; the rest compare lexicographically, major first,
+    // which is just integer order on the packed values.
+    tOrdinal m = m_mask & other.m_mask;
+    tOrdinal a = m_ordinal & m;
+    tOrdinal b = other.m_ordinal & m;
+    return (a > b) - (a < b);
 }
 
 
 inline bool
 SemanticVersion::match(const SemanticVersion& other) const
 {
-    if (m_major >= 0 && other.m_major >= 0 && m_major != other.m_major) {
-        return false;
-    }
-
-    if (m_minor >= 0 && other.m_minor >= 0 && m_minor != other.m_minor) {
-        return false;
-    }
-
-    if (m_micro >= 0 && other.m_micro >= 0 && m_micro != other.m_micro) {
-        return false;
-    }
-
-    if (m_nano >= 0 && other.m_nano >= 0 && m_nano != other.m_nano) {
-        return false;
-    }
-
-    return true;
+    return ((m_ordinal ^ other.m_ordinal) & m_mask & other.m_mask) == 0;
 }
 
 
@@ -205,13 +193,25 @@ unsigned int cv_lex(const char* str, int& off)
     return CV_ERROR;
 }
 
+// the number at str, or -1 if it doesn't fit in a version field
+inline
+int cv_field(const char* str)
+{
+    int n = 0;
+    for (; *str >= '0' && *str <= '9'; str++) {
+        n = n * 10 + (*str - '0');
+        if (n > BP_SV_FIELD_MAX) return -1;
+    }
+    return n;
+}
+
 
 inline bool
 SemanticVersion::parse(const char* version)
 {
     if (version == NULL || !strlen(version)) return true;
     
-    int off, nxt, rv;
+    int off, nxt, rv, n;
     off = nxt = 0;
 
     // parse through the string
@@ -219,7 +219,9 @@ SemanticVersion::parse(const char* version)
     // major version
     rv = cv_lex(version, nxt);
     if (rv != CV_NUMBER) return false;
-    m_major = atoi(version);
+    n = cv_field(version);
+    if (n < 0) return false;
+    setMajor(n);
 
     // dot
     rv = cv_lex(version, nxt);
@@ -230,7 +232,9 @@ SemanticVersion::parse(const char* version)
         off = nxt;
         rv = cv_lex(version, nxt);
         if (rv != CV_NUMBER) return false;
-        m_minor = atoi(version + off);
+        n = cv_field(version + off);
+        if (n < 0) return false;
+        setMinor(n);
 
         // dot
         rv = cv_lex(version, nxt);
@@ -241,7 +245,9 @@ SemanticVersion::parse(const char* version)
             off = nxt;
             rv = cv_lex(version, nxt);
             if (rv != CV_NUMBER) return false;
-            m_micro = atoi(version + off);
+            n = cv_field(version + off);
+            if (n < 0) return false;
+            setMicro(n);
         }
 
         // dot
@@ -253,7 +259,9 @@ SemanticVersion::parse(const char* version)
             off = nxt;
             rv = cv_lex(version, nxt);
             if (rv != CV_NUMBER) return false;
-            m_nano = atoi(version + off);
+            n = cv_field(version + off);
+            if (n < 0) return false;
+            setNano(n);
         }
     }
 
@@ -274,24 +282,24 @@ SemanticVersion::asString(void) const
     const int bufSize = 50;
     char buf[bufSize];
     std::string str;
-    if (m_major >= 0) {
-        snprintf(buf, bufSize, "%d", m_major);
+    if (majorVer() >= 0) {
+        snprintf(buf, bufSize, "%d", majorVer());
         str.append(buf);
         
-        if (m_minor >= 0) {
+        if (minorVer() >= 0) {
             str.append(".");
-            snprintf(buf, bufSize, "%d", m_minor);
+            snprintf(buf, bufSize, "%d", minorVer());
             str.append(buf);    
 
-            if (m_micro >= 0) {
+            if (microVer() >= 0) {
                 str.append(".");
-                snprintf(buf, bufSize, "%d", m_micro);
+                snprintf(buf, bufSize, "%d", microVer());
                 str.append(buf);
             }
 
-            if (m_nano >= 0) {
+            if (nanoVer() >= 0) {
                 str.append(".");
-                snprintf(buf, bufSize, "%d", m_nano);
+                snprintf(buf, bufSize, "%d", nanoVer());
                 str.append(buf);
             }
         }
@@ -325,5 +333,98 @@ SemanticVersion::isNewerMatch(const SemanticVersion& current,
 }
 
 
+inline
+VersionIndex::VersionIndex()
+    : m_ordinals(), m_masks(), m_ids(), m_nPartial(0)
+{
+}
+
+
+inline void
+VersionIndex::add(const SemanticVersion& version, size_t id)
+{
+    // after any equal ordinals, so the later of equal candidates wins
+    size_t at = std::upper_bound(m_ordinals.begin(), m_ordinals.end(),
+                                 version.ordinal()) - m_ordinals.begin();
+    m_ordinals.insert(m_ordinals.begin() + at, version.ordinal());
+    m_masks.insert(m_masks.begin() + at, version.mask());
+    m_ids.insert(m_ids.begin() + at, id);
+    if (version.mask() != ~(SemanticVersion::tOrdinal) 0) m_nPartial++;
+}
+
+
+inline void
+VersionIndex::reserve(size_t n)
+{
+    m_ordinals.reserve(n);
+    m_masks.reserve(n);
+    m_ids.reserve(n);
+}
+
+
+inline void
+VersionIndex::clear()
+{
+    m_ordinals.clear();
+    m_masks.clear();
+    m_ids.clear();
+    m_nPartial = 0;
+}
+
+
+inline bool
+VersionIndex::resolve(const SemanticVersion& wantver,
+                      const SemanticVersion& wantminver,
+                      size_t& oId) const
+{
+    typedef SemanticVersion::tOrdinal tOrdinal;
+    const tOrdinal wv = wantver.ordinal(), wm = wantver.mask();
+    const tOrdinal mv = wantminver.ordinal(), mm = wantminver.mask();
+    const size_t n = m_ordinals.size();
+
+    // When every candidate is fully specified and wantver only fixes
+    // leading fields ("2", "2.1", ...), the matches are a contiguous run
+    // of the sorted candidates.  Its newest member is the answer unless
+    // it is below wantminver, in which case they all are -- so long as
+    // wantminver also sets only leading fields, making that compare
+    // monotonic in the ordinal.
+    tOrdinal free = ~wm, minFree = ~mm;
+    if (m_nPartial == 0 && (free & (free + 1)) == 0
+        && (minFree & (minFree + 1)) == 0) {
+        size_t hi = std::upper_bound(m_ordinals.begin(), m_ordinals.end(),
+                                     wv | free) - m_ordinals.begin();
+        if (hi == 0 || m_ordinals[hi - 1] < wv) return false;
+        if ((m_ordinals[hi - 1] & mm) < mv) return false;
+        oId = m_ids[hi - 1];
+        return true;
+    }
+
+    // Otherwise do what a loop over isNewerMatch would, with each test
+    // a masked compare on the packed values.
+    bool bFound = false;
+    tOrdinal gv = 0, gm = 0;        // what we've got so far, initially unset
+    for (size_t i = 0; i < n; i++) {
+        tOrdinal v = m_ordinals[i], m = m_masks[i];
+        tOrdinal gcm = m & gm, mcm = m & mm;
+        bool bNewer = (v & gcm) >= (gv & gcm);
+        bool bMatch = ((v ^ wv) & m & wm) == 0;
+        bool bMin = (v & mcm) >= (mv & mcm);
+        if (bNewer & bMatch & bMin) {
+            gv = v;
+            gm = m;
+            oId = m_ids[i];
+            bFound = true;
+        }
+    }
+    return bFound;
+}
+
+
+#undef BP_SV_MAJOR_SHIFT
+#undef BP_SV_MINOR_SHIFT
+#undef BP_SV_MICRO_SHIFT
+#undef BP_SV_NANO_SHIFT
+#undef BP_SV_FIELD_MAX
+
 #endif // BPSEMANTICVERSIONIMPL_H_
 
@@ -33,6 +33,9 @@
  */
 #include <algorithm>
 #include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
 #include <ios>
 #include <iostream>
 #include <iterator>
@@ -107,7 +110,10 @@ utf8ToWide(const std::string& sIn)
         CFRelease(cfStr);
     }
 #elif defined(LINUX)
-    assert("utf8ToWide not implemented on linux" == NULL);
+    // wchar_t is UTF-32 here
+    if (!detail::decodeUtf8<detail::Utf32Units>(sIn, rval, NULL)) {
+        rval.clear();
+    }
 #else
     unsupported platform;
 #endif
@@ -170,7 +176,9 @@ wideToUtf8(const std::wstring& wsIn)
 		CFRelease(theString);
     }
 #elif defined(LINUX)
-    assert("utf8ToWide not implemented on linux" == NULL);
+    if (!detail::encodeUtf32(wsIn.data(), wsIn.size(), rval, NULL)) {
+        rval.clear();
+    }
 #else
     unsupported platform;
 #endif
@@ -184,12 +192,122 @@ replace(std::string& sTarget,
         const std::string& sOld,
         const std::string& sNew)
 {
-    std::string::size_type nMatch = 0;
-    while ((nMatch = sTarget.find( sOld, nMatch )) != std::string::npos)
+    if (!sOld.empty()) {
+        replace( sTarget, Needle( sOld ), sNew );
+    }
+}
+
+
+inline
+Needle::Needle(const StringView& pattern) :
+    m_pattern( pattern.toString() )
+{
+    size_t n = m_pattern.size();
+    for (unsigned int i = 0; i < 256; i++) {
+        m_skip[i] = n ? n : 1;
+    }
+    // distance from each char's last occurrence (ignoring the final
+    // position) to the end of the pattern
+    for (size_t i = 0; i + 1 < n; i++) {
+        m_skip[(unsigned char) m_pattern[i]] = n - 1 - i;
+    }
+}
+
+
+inline size_t
+Needle::find(const StringView& hay, size_t from) const
+{
+    size_t n = m_pattern.size();
+    if (n <= 1) {
+        return n ? hay.find( m_pattern[0], from )
+                 : (from <= hay.size() ? from : std::string::npos);
+    }
+
+    const unsigned char* h = (const unsigned char*) hay.data();
+    const char* p = m_pattern.data();
+    unsigned char last = (unsigned char) p[n - 1];
+    size_t i = from;
+    while (i + n <= hay.size()) {
+        unsigned char c = h[i + n - 1];
+        if (c == last && memcmp( h + i, p, n - 1 ) == 0) {
+            return i;
+        }
+        i += m_skip[c];
+    }
+    return std::string::npos;
+}
+
+
+inline size_t
+replace(std::string& sTarget,
+        const Needle& needle,
+        const StringView& sNew)
+{
+    size_t nOld = needle.size();
+    size_t nNew = sNew.size();
+    if (nOld == 0 || sTarget.empty()) return 0;
+
+    size_t nLen = sTarget.size();
+    size_t nStart = 0;      // where the unprocessed input begins
+    if (nNew > nOld) {
+        // Grow once, then move the input to the end so the compaction
+        // below can write ahead of where it reads.
+        size_t nMatches = 0;
+        for (size_t i = needle.find( sTarget ); i != std::string::npos;
+             i = needle.find( sTarget, i + nOld ))
+        {
+            nMatches++;
+        }
+        if (nMatches == 0) return 0;
+        nStart = nMatches * (nNew - nOld);
+        sTarget.resize( nLen + nStart );
+        char* d = &sTarget[0];
+        memmove( d + nStart, d, nLen );
+    }
+
+    char* d = &sTarget[0];
+    StringView in( d + nStart, nLen );
+    size_t r = 0, w = 0, nCount = 0;
+    for (size_t m = needle.find( in ); m != std::string::npos;
+         m = needle.find( in, r ))
     {
-        sTarget.replace( nMatch, sOld.length(), sNew );
-        nMatch += sNew.length();
+        memmove( d + w, d + nStart + r, m - r );
+        w += m - r;
+        memcpy( d + w, sNew.data(), nNew );
+        w += nNew;
+        r = m + nOld;
+        nCount++;
     }
+    memmove( d + w, d + nStart + r, nLen - r );
+    w += nLen - r;
+    sTarget.resize( w );
+    return nCount;
+}
+
+
+inline
+Splitter::Splitter(const StringView& str, const StringView& delim) :
+    m_rest( str ),
+    m_delim( delim ),
+    m_bDone( false )
+{
+}
+
+
+inline bool
+Splitter::next(StringView& oPiece)
+{
+    if (m_bDone) return false;
+
+    size_t i = m_delim.empty() ? std::string::npos : m_rest.find( m_delim );
+    if (i == std::string::npos) {
+        oPiece = m_rest;
+        m_bDone = true;
+    } else {
+        oPiece = m_rest.substr( 0, i );
+        m_rest.removePrefix( i + m_delim.size() );
+    }
+    return true;
 }
 
 
@@ -199,17 +317,10 @@ split(const std::string& str,
 {
     std::vector<std::string> vsRet;
     
-//  boost::iter_split( vsRet, str, 
-//                     boost::first_finder( delim, boost::is_iequal() ) );
-    unsigned int offset = 0;
-    unsigned int delimIndex = 0;
-    delimIndex = str.find(delim, offset);
-    while (delimIndex != std::string::npos) {
-        vsRet.push_back(str.substr(offset, delimIndex - offset));
-        offset += delimIndex - offset + delim.length();
-        delimIndex = str.find(delim, offset);
+    Splitter sp( str, delim );
+    for (StringView piece; sp.next( piece ); ) {
+        vsRet.push_back( piece.toString() );
     }
-    vsRet.push_back(str.substr(offset));
 
     return vsRet;
 }
@@ -225,6 +336,52 @@ splitAndTrim( const std::string& str,
 }
 
 
+inline size_t
+join( const StringView* pieces, size_t nPieces,
+      const StringView& sSep,
+      char* buf, size_t bufSize )
+{
+    size_t nTotal = 0;
+    for (size_t i = 0; i < nPieces; ++i) {
+        if (i > 0) {
+            if (nTotal < bufSize) {
+                size_t n = std::min( sSep.size(), bufSize - nTotal );
+                memcpy( buf + nTotal, sSep.data(), n );
+            }
+            nTotal += sSep.size();
+        }
+        if (nTotal < bufSize) {
+            size_t n = std::min( pieces[i].size(), bufSize - nTotal );
+            memcpy( buf + nTotal, pieces[i].data(), n );
+        }
+        nTotal += pieces[i].size();
+    }
+    if (bufSize > 0) {
+        buf[nTotal < bufSize ? nTotal : bufSize - 1] = 0;
+    }
+    return nTotal;
+}
+
+
+inline void
+join( const std::vector<StringView>& vIn,
+      const StringView& sSep,
+      std::string& sOut )
+{
+    size_t nLen = sOut.size();
+    for (size_t i = 0; i < vIn.size(); ++i) {
+        nLen += vIn[i].size() + (i > 0 ? sSep.size() : 0);
+    }
+    sOut.reserve( nLen );
+    for (size_t i = 0; i < vIn.size(); ++i) {
+        if (i > 0) {
+            sOut.append( sSep.data(), sSep.size() );
+        }
+        sOut.append( vIn[i].data(), vIn[i].size() );
+    }
+}
+
+
 inline std::string
 join( const std::vector<std::string>& vsIn, const std::string& sSep )
 {
@@ -260,6 +417,41 @@ inline bool isEqualNoCase( const std::string& s1, const std::string& s2)
 }
 
 
+// strerror_r comes in two flavours: XSI returns an int and always
+// fills buf, GNU returns the message, which may not be in buf.
+inline const char*
+strerrorResult( int, const char* buf )
+{
+    return buf;
+}
+
+inline const char*
+strerrorResult( const char* psz, const char* )
+{
+    return psz;
+}
+
+
+inline std::string
+errorString( int nErr )
+{
+    char buf[256];
+    buf[0] = 0;
+#ifdef WIN32
+    strerror_s( buf, sizeof(buf), nErr );
+    const char* psz = buf;
+#else
+    const char* psz = strerrorResult( strerror_r( nErr, buf, sizeof(buf) ),
+                                      buf );
+#endif
+    if (psz && *psz) return psz;
+
+    char num[32];
+    sprintf( num, "error %d", nErr );
+    return num;
+}
+
+
 // Adaptable functor that tests a char for space-ness.
 // See Meyers "Effective STL", Item 40.
 struct IsSpace : public std::unary_function<int, bool>
@@ -271,6 +463,31 @@ struct IsSpace : public std::unary_function<int, bool>
 };
         
 
+inline StringView
+trimLeftView( const StringView& sIn )
+{
+    size_t i = 0;
+    while (i < sIn.size() && isspace( (unsigned char) sIn[i] )) ++i;
+    return sIn.substr( i );
+}
+
+
+inline StringView
+trimRightView( const StringView& sIn )
+{
+    size_t n = sIn.size();
+    while (n > 0 && isspace( (unsigned char) sIn[n - 1] )) --n;
+    return sIn.substr( 0, n );
+}
+
+
+inline StringView
+trimView( const StringView& sIn )
+{
+    return trimLeftView( trimRightView( sIn ) );
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 /// Trims whitespace from the beginning and end of a string.
 /// @param  sIn The string to trim.
@@ -358,46 +575,88 @@ matchesWildcard(const std::string& s,
 */
 
 
-inline std::string 
-quoteJsonString(const std::string& str)
+namespace detail {
+
+// Number of leading bytes of p[0..n) that may appear unescaped in a
+// JSON string, i.e. anything but '"', '\\' and 0x00-0x1f.
+inline size_t
+jsonCleanPrefix(const unsigned char* p, size_t n)
 {
-    const char* s = str.c_str();
-    if (std::strpbrk(s, "\"\\\b\f\n\r\t") == NULL) {
-        return std::string("\"") + s + "\"";
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i ctl32 = _mm256_set1_epi8(0x1f);
+    const __m256i quote32 = _mm256_set1_epi8('"');
+    const __m256i bslash32 = _mm256_set1_epi8('\\');
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (p + i));
+        // v <= 0x1f (unsigned) iff max(v, 0x1f) == 0x1f
+        __m256i m = _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctl32), ctl32);
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, quote32));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, bslash32));
+        if (_mm256_movemask_epi8(m)) break;
     }
-    
-    unsigned maxsize = strlen(s)*2 + 3;
-    std::string result;
-    result.reserve(maxsize);
-    result += "\"";
-    for (const char* c=s; *c != 0; ++c){
-        switch (*c) {
-            case '\"':
-                result += "\\\"";
-                break;
-            case '\\':
-                result += "\\\\";
-                break;
-            case '\b':
-                result += "\\b";
-                break;
-            case '\f':
-                result += "\\f";
-                break;
-            case '\n':
-                result += "\\n";
-                break;
-            case '\r':
-                result += "\\r";
-                break;
-            case '\t':
-                result += "\\t";
-                break;
-            default:
-                result += *c;
+#endif
+#if defined(BP_HAVE_SSE2)
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (p + i));
+        __m128i m = _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl);
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, quote));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, bslash));
+        if (_mm_movemask_epi8(m)) break;
+    }
+#endif
+    while (i < n && p[i] >= 0x20 && p[i] != '"' && p[i] != '\\') ++i;
+    return i;
+}
+
+} // detail
+
+
+inline void
+quoteJsonString(const StringView& sIn, std::string& sOut)
+{
+    static const char s_hex[] = "0123456789abcdef";
+
+    const unsigned char* p = (const unsigned char*) sIn.data();
+    size_t n = sIn.size();
+    sOut.reserve(sOut.size() + n + 2);
+    sOut += '"';
+
+    size_t i = 0;
+    while (i < n) {
+        size_t nClean = detail::jsonCleanPrefix(p + i, n - i);
+        sOut.append((const char*) p + i, nClean);
+        i += nClean;
+        if (i == n) break;
+
+        unsigned char c = p[i++];
+        switch (c) {
+            case '"':  sOut.append("\\\"", 2); break;
+            case '\\': sOut.append("\\\\", 2); break;
+            case '\b': sOut.append("\\b", 2); break;
+            case '\f': sOut.append("\\f", 2); break;
+            case '\n': sOut.append("\\n", 2); break;
+            case '\r': sOut.append("\\r", 2); break;
+            case '\t': sOut.append("\\t", 2); break;
+            default: {
+                char buf[6] = { '\\', 'u', '0', '0',
+                                s_hex[c >> 4], s_hex[c & 0xf] };
+                sOut.append(buf, 6);
             }
         }
-    result += "\"";
+    }
+    sOut += '"';
+}
+
+
+inline std::string 
+quoteJsonString(const std::string& str)
+{
+    std::string result;
+    quoteJsonString(StringView(str), result);
     return result;
 }
 
@@ -0,0 +1,255 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+/*
+ *  bpsyncimpl.h
+ *
+ *  Inline implementation file for bpsync.h: the primitives built
+ *  portably on top of Mutex, Condition and the atomics.
+ *
+ *  Note: This file is included by bpsync.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+#ifndef BPSYNCIMPL_H_
+#define BPSYNCIMPL_H_
+
+
+////////////////////////////////////////////////////////////////////////
+// Semaphore
+
+inline bplus::sync::Semaphore::Semaphore(unsigned int initial)
+    : m_count( (long) initial ), m_wakeups( 0 )
+{
+}
+
+inline void
+bplus::sync::Semaphore::post(unsigned int n)
+{
+    long prev = atomicAdd(&m_count, (long) n, MemoryOrderRelease) - n;
+    if (prev >= 0) return;
+
+    // -prev threads are blocked or about to block, wake up to n
+    unsigned long toWake = (unsigned long) -prev;
+    if (toWake > n) toWake = n;
+    Lock lock(m_mutex);
+    m_wakeups += toWake;
+    for (unsigned long i = 0; i < toWake; i++) m_cond.signal();
+}
+
+inline void
+bplus::sync::Semaphore::wait()
+{
+    if (atomicAdd(&m_count, -1, MemoryOrderAcquire) >= 0) return;
+    (void) slowWait(false, 0);
+}
+
+inline bool
+bplus::sync::Semaphore::tryWait()
+{
+    long c = atomicLoad(&m_count, MemoryOrderRelaxed);
+    while (c > 0) {
+        if (atomicCompareExchange(&m_count, c, c - 1, MemoryOrderAcquire)) {
+            return true;
+        }
+        c = atomicLoad(&m_count, MemoryOrderRelaxed);
+    }
+    return false;
+}
+
+inline bool
+bplus::sync::Semaphore::timeWait(unsigned int msec)
+{
+    return waitUntil(bplus::timeutil::monotonicMicros()
+                     + (unsigned long long) msec * 1000);
+}
+
+inline bool
+bplus::sync::Semaphore::waitUntil(unsigned long long deadline)
+{
+    if (atomicAdd(&m_count, -1, MemoryOrderAcquire) >= 0) return true;
+    return slowWait(true, deadline);
+}
+
+inline bool
+bplus::sync::Semaphore::slowWait(bool bTimed, unsigned long long deadline)
+{
+    Lock lock(m_mutex);
+    for (;;) {
+        if (m_wakeups > 0) {
+            m_wakeups--;
+            return true;
+        }
+        if (!bTimed) {
+            m_cond.wait(&m_mutex);
+        } else if (!m_cond.waitUntil(&m_mutex, deadline)
+                   && m_wakeups == 0)
+        {
+            // timed out.  withdraw the unit we claimed, unless a post
+            // has already counted us -- its wakeup is on the way (it
+            // needs the mutex we hold), so take it.
+            long c = atomicLoad(&m_count, MemoryOrderRelaxed);
+            while (c < 0) {
+                if (atomicCompareExchange(&m_count, c, c + 1)) return false;
+                c = atomicLoad(&m_count, MemoryOrderRelaxed);
+            }
+            bTimed = false;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// Latch
+
+inline bplus::sync::Latch::Latch(unsigned int count)
+    : m_count( (long) count )
+{
+}
+
+inline void
+bplus::sync::Latch::countDown(unsigned int n)
+{
+    long now = atomicAdd(&m_count, -(long) n, MemoryOrderAcqRel);
+    // only the call that crosses zero wakes the waiters
+    if (now <= 0 && now + (long) n > 0) {
+        Lock lock(m_mutex);
+        m_cond.broadcast();
+    }
+}
+
+inline bool
+bplus::sync::Latch::tryWait() const
+{
+    return atomicLoad(&m_count, MemoryOrderAcquire) <= 0;
+}
+
+inline void
+bplus::sync::Latch::wait()
+{
+    if (tryWait()) return;
+    Lock lock(m_mutex);
+    while (!tryWait()) m_cond.wait(&m_mutex);
+}
+
+inline bool
+bplus::sync::Latch::timeWait(unsigned int msec)
+{
+    return waitUntil(bplus::timeutil::monotonicMicros()
+                     + (unsigned long long) msec * 1000);
+}
+
+inline bool
+bplus::sync::Latch::waitUntil(unsigned long long deadline)
+{
+    if (tryWait()) return true;
+    Lock lock(m_mutex);
+    while (!tryWait()) {
+        if (!m_cond.waitUntil(&m_mutex, deadline)) return tryWait();
+    }
+    return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// Barrier
+
+inline bplus::sync::Barrier::Barrier(unsigned int count)
+    : m_count( count ? count : 1 ), m_waiting( 0 ), m_generation( 0 )
+{
+}
+
+inline bool
+bplus::sync::Barrier::arriveAndWait()
+{
+    Lock lock(m_mutex);
+    unsigned long gen = m_generation;
+    if (++m_waiting == m_count) {
+        m_waiting = 0;
+        m_generation++;
+        m_cond.broadcast();
+        return true;
+    }
+    while (gen == m_generation) m_cond.wait(&m_mutex);
+    return false;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// Event
+
+inline bplus::sync::Event::Event(bool bAutoReset, bool bInitiallySet)
+    : m_set( bInitiallySet ? 1 : 0 ), m_bAutoReset( bAutoReset )
+{
+}
+
+inline void
+bplus::sync::Event::set()
+{
+    Lock lock(m_mutex);
+    atomicStore(&m_set, 1, MemoryOrderRelease);
+    if (m_bAutoReset) m_cond.signal();
+    else m_cond.broadcast();
+}
+
+inline void
+bplus::sync::Event::reset()
+{
+    Lock lock(m_mutex);
+    atomicStore(&m_set, 0, MemoryOrderRelease);
+}
+
+inline bool
+bplus::sync::Event::isSet() const
+{
+    return atomicLoad(&m_set, MemoryOrderAcquire) != 0;
+}
+
+inline void
+bplus::sync::Event::wait()
+{
+    // a set manual reset event needs no lock
+    if (!m_bAutoReset && isSet()) return;
+    Lock lock(m_mutex);
+    while (!m_set) m_cond.wait(&m_mutex);
+    if (m_bAutoReset) atomicStore(&m_set, 0, MemoryOrderRelaxed);
+}
+
+inline bool
+bplus::sync::Event::timeWait(unsigned int msec)
+{
+    return waitUntil(bplus::timeutil::monotonicMicros()
+                     + (unsigned long long) msec * 1000);
+}
+
+inline bool
+bplus::sync::Event::waitUntil(unsigned long long deadline)
+{
+    if (!m_bAutoReset && isSet()) return true;
+    Lock lock(m_mutex);
+    while (!m_set) {
+        if (!m_cond.waitUntil(&m_mutex, deadline) && !m_set) return false;
+    }
+    if (m_bAutoReset) atomicStore(&m_set, 0, MemoryOrderRelaxed);
+    return true;
+}
+
+
+#endif // BPSYNCIMPL_H_
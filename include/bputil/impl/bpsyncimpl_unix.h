@@ -35,95 +35,201 @@
 #define BPSYNCIMPLUNIX_H
 
 #include <pthread.h>
-#include <sys/time.h>
+#include <time.h>
 #include <stdlib.h>
 
 inline bplus::sync::Mutex::Mutex()
 {
-    pthread_mutex_t * mtx =
-        (pthread_mutex_t *) calloc(sizeof(pthread_mutex_t), 1);
-    pthread_mutex_init(mtx, NULL);
-    m_osDep = (void *) mtx;
+    pthread_mutex_init(&m_osDep, NULL);
 }
 
 inline bplus::sync::Mutex::~Mutex()
 {
-    pthread_mutex_destroy((pthread_mutex_t *) m_osDep);
-    free(m_osDep); 
+    pthread_mutex_destroy(&m_osDep);
 }
 
 inline void
 bplus::sync::Mutex::lock()
 {
-    pthread_mutex_lock((pthread_mutex_t *) m_osDep);  
+    pthread_mutex_lock(&m_osDep);
+}
+
+inline bool
+bplus::sync::Mutex::tryLock()
+{
+    return pthread_mutex_trylock(&m_osDep) == 0;
 }
 
 inline void
 bplus::sync::Mutex::unlock()
 {
-    pthread_mutex_unlock((pthread_mutex_t *) m_osDep);  
+    pthread_mutex_unlock(&m_osDep);
+}
+
+inline bplus::sync::AdaptiveMutex::AdaptiveMutex(unsigned int spinCount)
+    : m_spinCount( spinCount )
+{
+    pthread_mutex_init(&m_osDep, NULL);
+    // spinning can't help when the holder can't be running
+    if (bplus::thread::Thread::hardwareConcurrency() < 2) m_spinCount = 0;
+}
+
+inline bplus::sync::AdaptiveMutex::~AdaptiveMutex()
+{
+    pthread_mutex_destroy(&m_osDep);
+}
+
+inline void
+bplus::sync::AdaptiveMutex::lock()
+{
+    // back off exponentially between attempts so spinners don't keep
+    // stealing the mutex's cache line from the holder
+    unsigned int pause = 1;
+    for (unsigned int i = 0; i < m_spinCount; i += pause) {
+        if (pthread_mutex_trylock(&m_osDep) == 0) return;
+        for (unsigned int j = 0; j < pause; j++) cpuRelax();
+        if (pause < 16) pause *= 2;
+    }
+    pthread_mutex_lock(&m_osDep);
+}
+
+inline bool
+bplus::sync::AdaptiveMutex::tryLock()
+{
+    return pthread_mutex_trylock(&m_osDep) == 0;
+}
+
+inline void
+bplus::sync::AdaptiveMutex::unlock()
+{
+    pthread_mutex_unlock(&m_osDep);
+}
+
+inline bplus::sync::RWLock::RWLock()
+{
+#if defined(__GLIBC__)
+    // glibc prefers readers by default, which lets a steady stream of
+    // readers starve writers indefinitely
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(
+        &attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&m_osDep, &attr);
+    pthread_rwlockattr_destroy(&attr);
+#else
+    pthread_rwlock_init(&m_osDep, NULL);
+#endif
+}
+
+inline bplus::sync::RWLock::~RWLock()
+{
+    pthread_rwlock_destroy(&m_osDep);
+}
+
+inline void
+bplus::sync::RWLock::lockShared()
+{
+    pthread_rwlock_rdlock(&m_osDep);
+}
+
+inline bool
+bplus::sync::RWLock::tryLockShared()
+{
+    return pthread_rwlock_tryrdlock(&m_osDep) == 0;
+}
+
+inline void
+bplus::sync::RWLock::unlockShared()
+{
+    pthread_rwlock_unlock(&m_osDep);
+}
+
+inline void
+bplus::sync::RWLock::lock()
+{
+    pthread_rwlock_wrlock(&m_osDep);
+}
+
+inline bool
+bplus::sync::RWLock::tryLock()
+{
+    return pthread_rwlock_trywrlock(&m_osDep) == 0;
+}
+
+inline void
+bplus::sync::RWLock::unlock()
+{
+    pthread_rwlock_unlock(&m_osDep);
 }
 
 inline bplus::sync::Condition::Condition()
 {
-    pthread_cond_t * c =
-        (pthread_cond_t *) calloc(sizeof(pthread_cond_t), 1);
-    pthread_cond_init(c, NULL);
-    m_osDep = (void *) c;
+#ifdef __APPLE__
+    // darwin lacks pthread_condattr_setclock, waitUntil() uses
+    // relative waits instead
+    pthread_cond_init(&m_osDep, NULL);
+#else
+    // measure deadlines against the monotonic clock so wall clock
+    // adjustments don't cause early or late wakeups
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&m_osDep, &attr);
+    pthread_condattr_destroy(&attr);
+#endif
 }
 
 inline bplus::sync::Condition::~Condition()
 {
-    pthread_cond_destroy((pthread_cond_t *) m_osDep);
-    free(m_osDep);
+    pthread_cond_destroy(&m_osDep);
 }
 
 inline void
 bplus::sync::Condition::broadcast()
 {
-  pthread_cond_broadcast((pthread_cond_t *) m_osDep);
+    pthread_cond_broadcast(&m_osDep);
 }
 
 inline void
 bplus::sync::Condition::signal()
 {
-    pthread_cond_signal((pthread_cond_t *) m_osDep);
+    pthread_cond_signal(&m_osDep);
 }
 
 inline void
 bplus::sync::Condition::wait(bplus::sync::Mutex * m)
 {
-    pthread_cond_wait((pthread_cond_t *) m_osDep,
-                      (pthread_mutex_t *) m->m_osDep);
+    pthread_cond_wait(&m_osDep, &m->m_osDep);
 }
 
 inline bool
 bplus::sync::Condition::timeWait(Mutex * m, unsigned int msec)
 {
-    int ret;
+    return waitUntil(m, bplus::timeutil::monotonicMicros()
+                        + (unsigned long long) msec * 1000);
+}
 
-/* POSIX.1b structure for a time value.  This is like a `struct timeval' but
-   has nanoseconds instead of microseconds.  
-      struct timespec 
-      {
-        __time_t tv_sec;             Seconds.  
-        long int tv_nsec;            Nanoseconds.  
-      };
-  */ 
-    {
-        struct timespec ts;
-        struct timeval  tv;
-
-        gettimeofday(&tv,NULL);
-        msec += (tv.tv_usec/1000);
-        ts.tv_sec = tv.tv_sec + msec/1000;
-        ts.tv_nsec = (msec % 1000) * 1000000;
-        ret = pthread_cond_timedwait((pthread_cond_t *) m_osDep,
-                                     (pthread_mutex_t *) m->m_osDep, &ts);
-    }
+inline bool
+bplus::sync::Condition::waitUntil(Mutex * m, unsigned long long deadline)
+{
+    int ret;
+    struct timespec ts;
+
+#ifdef __APPLE__
+    unsigned long long now = bplus::timeutil::monotonicMicros();
+    unsigned long long rel = (deadline > now) ? deadline - now : 0;
+    ts.tv_sec = (time_t) (rel / 1000000);
+    ts.tv_nsec = (long) (rel % 1000000) * 1000;
+    ret = pthread_cond_timedwait_relative_np(&m_osDep, &m->m_osDep, &ts);
+#else
+    // monotonicMicros() reads CLOCK_MONOTONIC, the clock we set above
+    ts.tv_sec = (time_t) (deadline / 1000000);
+    ts.tv_nsec = (long) (deadline % 1000000) * 1000;
+    ret = pthread_cond_timedwait(&m_osDep, &m->m_osDep, &ts);
+#endif
 
     // return of zero means success, a signal was recieved, nonzero means
-    // error, we assume timeout. 
+    // error, we assume timeout.
     return (ret == 0);
 }
 
@@ -40,111 +40,158 @@
 
 inline bplus::sync::Mutex::Mutex()
 {
-    CRITICAL_SECTION * cs =
-        (CRITICAL_SECTION *) calloc(1, sizeof(CRITICAL_SECTION));
-    InitializeCriticalSection(cs);
-    m_osDep = (void *) cs;
+    InitializeCriticalSection(&m_osDep);
 }
 
 inline bplus::sync::Mutex::~Mutex()
 {
-    DeleteCriticalSection((CRITICAL_SECTION *) m_osDep);
+    DeleteCriticalSection(&m_osDep);
 }
 
 inline void
 bplus::sync::Mutex::lock()
 {
-    EnterCriticalSection((CRITICAL_SECTION *) m_osDep);
+    EnterCriticalSection(&m_osDep);
+}
+
+inline bool
+bplus::sync::Mutex::tryLock()
+{
+    return TryEnterCriticalSection(&m_osDep) != 0;
 }
 
 inline void
 bplus::sync::Mutex::unlock()
 {
-    LeaveCriticalSection((CRITICAL_SECTION *) m_osDep);
+    LeaveCriticalSection(&m_osDep);
 }
 
-struct Win32Condition {
-    /* This Win32 condition solution is detailed on:
-     *   http://www.cs.wustl.edu/~schmidt/win32-cv-1.html */
-    HANDLE e[2]; /* 0 is signal, 1 is broadcast */
-    unsigned int i;
-    CRITICAL_SECTION lock;
-};
+// critical sections already spin before waiting on their event,
+// and ignore the spin count on single processor machines
+inline bplus::sync::AdaptiveMutex::AdaptiveMutex(unsigned int spinCount)
+    : m_spinCount( spinCount )
+{
+    InitializeCriticalSectionAndSpinCount(&m_osDep, spinCount);
+}
 
-inline bplus::sync::Condition::Condition()
+inline bplus::sync::AdaptiveMutex::~AdaptiveMutex()
 {
-    Win32Condition * c =
-        (Win32Condition *) malloc(sizeof(struct Win32Condition));
-    InitializeCriticalSection(&(c->lock));
-    c->i = 0;
-    c->e[0] = CreateEvent(NULL, false, false, NULL);
-    c->e[1] = CreateEvent(NULL, true, false, NULL);
-    m_osDep = (void *) c;
+    DeleteCriticalSection(&m_osDep);
 }
 
-inline bplus::sync::Condition::~Condition()
+inline void
+bplus::sync::AdaptiveMutex::lock()
 {
-    Win32Condition * c = (Win32Condition *) m_osDep;
-    CloseHandle(c->e[0]);
-    CloseHandle(c->e[1]);
-    DeleteCriticalSection(&c->lock);
-    free(c);
+    EnterCriticalSection(&m_osDep);
+}
+
+inline bool
+bplus::sync::AdaptiveMutex::tryLock()
+{
+    return TryEnterCriticalSection(&m_osDep) != 0;
 }
 
 inline void
-bplus::sync::Condition::broadcast()
+bplus::sync::AdaptiveMutex::unlock()
+{
+    LeaveCriticalSection(&m_osDep);
+}
+
+// slim reader/writer locks need Vista or later
+inline bplus::sync::RWLock::RWLock()
 {
-    Win32Condition * c = (Win32Condition *) m_osDep;
+    InitializeSRWLock(&m_osDep);
+}
 
-    int haveWait;
-    EnterCriticalSection(&(c->lock));
-    haveWait = (c->i > 0);
-    LeaveCriticalSection(&(c->lock));
-    if (haveWait) SetEvent(c->e[1]);
+inline bplus::sync::RWLock::~RWLock()
+{
 }
 
 inline void
-bplus::sync::Condition::signal()
+bplus::sync::RWLock::lockShared()
 {
-    Win32Condition * c = (Win32Condition *) m_osDep;
+    AcquireSRWLockShared(&m_osDep);
+}
 
-    int haveWait;
-    EnterCriticalSection(&(c->lock));
-    haveWait = (c->i > 0);
-    LeaveCriticalSection(&(c->lock));
-    if (haveWait) SetEvent(c->e[0]);
+inline bool
+bplus::sync::RWLock::tryLockShared()
+{
+    return TryAcquireSRWLockShared(&m_osDep) != 0;
 }
 
 inline void
-bplus::sync::Condition::wait(bplus::sync::Mutex * m)
+bplus::sync::RWLock::unlockShared()
 {
-    timeWait(m, 0);
+    ReleaseSRWLockShared(&m_osDep);
+}
+
+inline void
+bplus::sync::RWLock::lock()
+{
+    AcquireSRWLockExclusive(&m_osDep);
 }
 
 inline bool
-bplus::sync::Condition::timeWait(bplus::sync::Mutex * m, unsigned int msecs)
+bplus::sync::RWLock::tryLock()
 {
-    Win32Condition * c = (Win32Condition *) m_osDep;
+    return TryAcquireSRWLockExclusive(&m_osDep) != 0;
+}
 
-    int result, lastWaiter;
+inline void
+bplus::sync::RWLock::unlock()
+{
+    ReleaseSRWLockExclusive(&m_osDep);
+}
 
-    /* increment the number of waiters */
-    EnterCriticalSection(&(c->lock));
-    c->i++;
-    LeaveCriticalSection(&(c->lock));
-    m->unlock();
-    result = WaitForMultipleObjects(2, c->e, false, msecs ? msecs : INFINITE);
+// condition variables, like slim reader/writer locks, need Vista.
+// Their timeouts are relative intervals, unaffected by clock changes.
+inline bplus::sync::Condition::Condition()
+{
+    InitializeConditionVariable(&m_osDep);
+}
 
-    EnterCriticalSection(&(c->lock));
-    (c->i)--;
-    lastWaiter = ((result == (WAIT_OBJECT_0 + 1)) && ((c->i) == 0)); 
-    LeaveCriticalSection(&(c->lock));
+inline bplus::sync::Condition::~Condition()
+{
+}
 
-    if (lastWaiter) ResetEvent(c->e[1]);
+inline void
+bplus::sync::Condition::broadcast()
+{
+    WakeAllConditionVariable(&m_osDep);
+}
 
-    m->lock();
+inline void
+bplus::sync::Condition::signal()
+{
+    WakeConditionVariable(&m_osDep);
+}
+
+inline void
+bplus::sync::Condition::wait(bplus::sync::Mutex * m)
+{
+    SleepConditionVariableCS(&m_osDep, &m->m_osDep, INFINITE);
+}
 
-    return false;
+inline bool
+bplus::sync::Condition::timeWait(bplus::sync::Mutex * m, unsigned int msecs)
+{
+    // an INFINITE timeout would never return
+    if (msecs == INFINITE) msecs--;
+    return SleepConditionVariableCS(&m_osDep, &m->m_osDep, msecs) != 0;
+}
+
+inline bool
+bplus::sync::Condition::waitUntil(bplus::sync::Mutex * m,
+                                  unsigned long long deadline)
+{
+    unsigned long long now = bplus::timeutil::monotonicMicros();
+    if (deadline <= now) {
+        return timeWait(m, 0);
+    }
+    // round up so we never wake before the deadline
+    unsigned long long msecs = (deadline - now + 999) / 1000;
+    if (msecs >= INFINITE) msecs = INFINITE - 1;
+    return timeWait(m, (unsigned int) msecs);
 }
 
 
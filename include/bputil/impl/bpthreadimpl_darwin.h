@@ -34,9 +34,17 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #include <assert.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
 
 
 namespace bplus {
@@ -52,9 +60,14 @@ inline static void blockSignal(int cig)
   pthread_sigmask(SIG_BLOCK, &ss, NULL);
 }
 
+struct PosixThreadData {
+  pthread_t thr;
+  unsigned int tid;
+};
+
 inline Thread::Thread()
 {
-    m_osSpecific = (void *) calloc(1, sizeof(pthread_t));
+    m_osSpecific = (void *) calloc(1, sizeof(PosixThreadData));
 }
 
 inline Thread::~Thread()
@@ -66,8 +79,37 @@ inline Thread::~Thread()
 struct barDat_t {
   StartRoutine runme;
   void *arg;
+  const ThreadOptions *opts;
+  // the new thread reports its OS id, and is done with opts, once
+  // 'started' is set
+  unsigned int tid;
+  bool started;
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;
 };
 
+inline static void applyOptions(const ThreadOptions & opts)
+{
+    if (!opts.name.empty()) {
+        Thread::setCurrentThreadName(opts.name);
+    }
+#ifdef __linux__
+    if (opts.affinityMask) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (unsigned int i = 0; i < 64 && i < CPU_SETSIZE; i++) {
+            if (opts.affinityMask & (1ULL << i)) CPU_SET(i, &cpus);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    if (opts.nice) {
+        // linux threads each have their own nice value
+        setpriority(PRIO_PROCESS, (id_t) Thread::currentThreadID(),
+                    opts.nice);
+    }
+#endif
+}
+
 inline static void *blockAndRun(void *arg1)
 {
   struct barDat_t *bdptr = (struct barDat_t *) arg1;
@@ -75,7 +117,14 @@ inline static void *blockAndRun(void *arg1)
   void *arg = bdptr->arg;
 
   blockSignal(SIGINT);
-  free(bdptr);
+  if (bdptr->opts) applyOptions(*bdptr->opts);
+
+  // after this, bdptr belongs to the spawning thread again
+  pthread_mutex_lock(&bdptr->mtx);
+  bdptr->tid = Thread::currentThreadID();
+  bdptr->started = true;
+  pthread_cond_signal(&bdptr->cond);
+  pthread_mutex_unlock(&bdptr->mtx);
 
   return runme(arg);
 }
@@ -83,18 +132,48 @@ inline static void *blockAndRun(void *arg1)
 inline bool
 Thread::run(StartRoutine startFunc, void * cookie)
 {
+    return run(startFunc, cookie, ThreadOptions());
+}
+
+inline bool
+Thread::run(StartRoutine startFunc, void * cookie,
+            const ThreadOptions & options)
+{
+    PosixThreadData * td = (PosixThreadData *) m_osSpecific;
     int rsz = -1;
-    struct barDat_t *bdptr;
+    struct barDat_t bd;
+
+    bd.runme = startFunc;
+    bd.arg = cookie;
+    bd.opts = &options;
+    bd.tid = 0;
+    bd.started = false;
+    pthread_mutex_init(&bd.mtx, NULL);
+    pthread_cond_init(&bd.cond, NULL);
 
-    bdptr = (barDat_t *) malloc(sizeof(struct barDat_t));
-    assert(bdptr != NULL);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (options.stackSize) {
+        size_t sz = options.stackSize;
+        if (sz < (size_t) PTHREAD_STACK_MIN) sz = PTHREAD_STACK_MIN;
+        long page = sysconf(_SC_PAGESIZE);
+        if (page > 0) sz = (sz + page - 1) / page * page;
+        pthread_attr_setstacksize(&attr, sz);
+    }
 
-    bdptr->runme = startFunc;
-    bdptr->arg = cookie;
-    rsz = pthread_create((pthread_t *) m_osSpecific, NULL,
-                         blockAndRun, bdptr);
+    rsz = pthread_create(&td->thr, &attr, blockAndRun, &bd);
+    pthread_attr_destroy(&attr);
 
-    if (rsz != 0) free(bdptr);
+    // wait for the thread to take its options and report its id, so
+    // neither needs to outlive this call
+    if (rsz == 0) {
+        pthread_mutex_lock(&bd.mtx);
+        while (!bd.started) pthread_cond_wait(&bd.cond, &bd.mtx);
+        pthread_mutex_unlock(&bd.mtx);
+        td->tid = bd.tid;
+    }
+    pthread_cond_destroy(&bd.cond);
+    pthread_mutex_destroy(&bd.mtx);
 
     return (rsz == 0);
 }
@@ -102,25 +181,70 @@ Thread::run(StartRoutine startFunc, void * cookie)
 inline void
 Thread::detach()
 {
-    pthread_detach(*((pthread_t *) m_osSpecific));
+    pthread_detach(((PosixThreadData *) m_osSpecific)->thr);
 }
 
 inline void
 Thread::join()
 {
-    pthread_join(*((pthread_t *) m_osSpecific), NULL);
+    pthread_join(((PosixThreadData *) m_osSpecific)->thr, NULL);
 }
 
 inline unsigned int
 Thread::ID()
 {
-    return (unsigned int) *((pthread_t *) m_osSpecific);
+    return ((PosixThreadData *) m_osSpecific)->tid;
 }
 
 inline unsigned int
 Thread::currentThreadID()
 {
-    return (unsigned int) pthread_self();
+#if defined(__linux__)
+    return (unsigned int) syscall(SYS_gettid);
+#elif defined(__APPLE__)
+    unsigned long long tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    return (unsigned int) tid;
+#else
+    return (unsigned int) (size_t) pthread_self();
+#endif
+}
+
+inline void
+Thread::setCurrentThreadName(const std::string & name)
+{
+#if defined(__linux__)
+    char buf[16];
+    strncpy(buf, name.c_str(), sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+    pthread_setname_np(pthread_self(), buf);
+#elif defined(__APPLE__)
+    pthread_setname_np(name.c_str());
+#else
+    (void) name;
+#endif
+}
+
+inline unsigned int
+Thread::hardwareConcurrency()
+{
+#ifdef __linux__
+    // honour the process's cpuset: taskset, containers, ThreadOptions
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+        int nAllowed = CPU_COUNT(&cpus);
+        if (nAllowed > 0) return (unsigned int) nAllowed;
+    }
+#endif
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (unsigned int) n : 1;
+}
+
+inline void
+Thread::yield()
+{
+    sched_yield();
 }
 
 
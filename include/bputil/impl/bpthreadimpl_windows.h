@@ -63,14 +63,66 @@ inline Thread::~Thread()
 
 inline bool
 Thread::run(StartRoutine startFunc, void * cookie)
+{
+    return run(startFunc, cookie, ThreadOptions());
+}
+
+inline int
+niceToWinPriority(int nice)
+{
+    if (nice <= -15) return THREAD_PRIORITY_HIGHEST;
+    if (nice < 0) return THREAD_PRIORITY_ABOVE_NORMAL;
+    if (nice >= 15) return THREAD_PRIORITY_LOWEST;
+    if (nice > 0) return THREAD_PRIORITY_BELOW_NORMAL;
+    return THREAD_PRIORITY_NORMAL;
+}
+
+inline void
+setThreadNameByHandle(HANDLE h, const std::string & name)
+{
+    // SetThreadDescription appeared in Windows 10 1607
+    typedef HRESULT (WINAPI *SetDescFunc)(HANDLE, PCWSTR);
+    static SetDescFunc s_setDesc = (SetDescFunc)
+        GetProcAddress(GetModuleHandleA("kernel32.dll"),
+                       "SetThreadDescription");
+    if (!s_setDesc) return;
+
+    int len = MultiByteToWideChar(CP_UTF8, 0, name.c_str(), -1, NULL, 0);
+    if (len <= 0) return;
+    wchar_t * wname = (wchar_t *) malloc(len * sizeof(wchar_t));
+    if (!wname) return;
+    MultiByteToWideChar(CP_UTF8, 0, name.c_str(), -1, wname, len);
+    s_setDesc(h, wname);
+    free(wname);
+}
+
+inline bool
+Thread::run(StartRoutine startFunc, void * cookie,
+            const ThreadOptions & options)
 {
     WinThreadData * td = (WinThreadData *) m_osSpecific;
 
-    td->thrHndl = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) startFunc, cookie, 0,
-                               &(td->id));
+    // start suspended so attributes are in place before it runs
+    DWORD flags = CREATE_SUSPENDED;
+    if (options.stackSize) flags |= STACK_SIZE_PARAM_IS_A_RESERVATION;
+    td->thrHndl = CreateThread(NULL, options.stackSize,
+                               (LPTHREAD_START_ROUTINE) startFunc, cookie,
+                               flags, &(td->id));
 
     if (!td->thrHndl) return false;
-    
+
+    if (!options.name.empty()) {
+        setThreadNameByHandle(td->thrHndl, options.name);
+    }
+    if (options.affinityMask) {
+        SetThreadAffinityMask(td->thrHndl,
+                              (DWORD_PTR) options.affinityMask);
+    }
+    if (options.nice) {
+        SetThreadPriority(td->thrHndl, niceToWinPriority(options.nice));
+    }
+    ResumeThread(td->thrHndl);
+
     return true;
 }
 
@@ -102,6 +154,27 @@ Thread::currentThreadID()
     return (unsigned int) GetCurrentThreadId();
 }
 
+inline void
+Thread::setCurrentThreadName(const std::string & name)
+{
+    setThreadNameByHandle(GetCurrentThread(), name);
+}
+
+inline unsigned int
+Thread::hardwareConcurrency()
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (si.dwNumberOfProcessors > 0) ?
+        (unsigned int) si.dwNumberOfProcessors : 1;
+}
+
+inline void
+Thread::yield()
+{
+    SwitchToThread();
+}
+
 
 } // namespace thread
 } // namespace bplus
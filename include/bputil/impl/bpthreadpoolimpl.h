@@ -0,0 +1,704 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/**
+ *  bpthreadpoolimpl.h
+ * 
+ *  Inline implementation file for bpthreadpool.h.
+ *
+ *  Note: This file is included by bpthreadpool.h.
+ *        It is not intended for direct inclusion by client code.
+ *
+ *  The deque follows "Correct and Efficient Work-Stealing for Weak
+ *  Memory Models" (Le, Pop, Cohen, Zappa Nardelli; PPoPP 2013).
+ */
+#ifndef BPTHREADPOOLIMPL_H_
+#define BPTHREADPOOLIMPL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdexcept>
+#include <string>
+#if __cplusplus >= 201103L
+#include <exception>
+#endif
+
+#ifdef WIN32
+#define BP_THREAD_LOCAL __declspec(thread)
+#else
+#define BP_THREAD_LOCAL __thread
+#endif
+
+
+namespace bplus {
+namespace thread {
+
+
+////////////////////////////////////////////////////////////////////////
+// WorkDeque -- a Chase-Lev deque.  The owning worker calls push() and
+// pop(), any thread may call steal().
+
+class Pool::WorkDeque
+{
+  public:
+    WorkDeque();
+    ~WorkDeque();
+
+    void push(Task * task);
+    Task * pop();
+
+    /** a hint only: a task may be in the middle of being taken */
+    bool empty() const;
+
+    /** take the oldest task.  Returns NULL if the deque is empty or if
+     *  another thread won a race for the task (bAbort set). */
+    Task * steal(bool & bAbort);
+
+  private:
+    struct Array {
+        long size;     // a power of two
+        void * volatile * slots;
+    };
+
+    Array * grow(Array * a, long bottom, long top);
+
+    // top and bottom live on separate cache lines, thieves hammer top.
+    volatile long m_top;
+    char m_pad1[64 - sizeof(long)];
+    volatile long m_bottom;
+    char m_pad2[64 - sizeof(long)];
+    Array * volatile m_array;
+
+    // Arrays replaced by grow() may still be read by in-flight thieves,
+    // so they are kept until the deque goes away.
+    std::vector<Array *> m_retired;
+};
+
+
+inline
+Pool::WorkDeque::WorkDeque()
+    : m_top(0), m_bottom(0)
+{
+    Array * a = new Array;
+    a->size = 64;
+    a->slots = (void * volatile *) calloc(a->size, sizeof(void *));
+    m_array = a;
+}
+
+inline
+Pool::WorkDeque::~WorkDeque()
+{
+    m_retired.push_back((Array *) m_array);
+    for (unsigned int i = 0; i < m_retired.size(); i++) {
+        free((void *) m_retired[i]->slots);
+        delete m_retired[i];
+    }
+}
+
+inline Pool::WorkDeque::Array *
+Pool::WorkDeque::grow(Array * a, long bottom, long top)
+{
+    Array * na = new Array;
+    na->size = a->size * 2;
+    na->slots = (void * volatile *) calloc(na->size, sizeof(void *));
+    for (long i = top; i < bottom; i++) {
+        na->slots[i & (na->size - 1)] = a->slots[i & (a->size - 1)];
+    }
+    m_retired.push_back(a);
+    sync::atomicStorePtr((void * volatile *) &m_array, na,
+                         sync::MemoryOrderRelease);
+    return na;
+}
+
+inline void
+Pool::WorkDeque::push(Task * task)
+{
+    long b = m_bottom;
+    long t = sync::atomicLoad(&m_top, sync::MemoryOrderAcquire);
+    Array * a = (Array *) m_array;
+    if (b - t > a->size - 1) {
+        a = grow(a, b, t);
+    }
+    a->slots[b & (a->size - 1)] = task;
+    // publish the slot before the new bottom
+    sync::atomicStore(&m_bottom, b + 1, sync::MemoryOrderRelease);
+}
+
+inline Task *
+Pool::WorkDeque::pop()
+{
+    long b = m_bottom - 1;
+    Array * a = (Array *) m_array;
+    sync::atomicStore(&m_bottom, b, sync::MemoryOrderRelease);
+    sync::atomicFence();
+    long t = sync::atomicLoad(&m_top, sync::MemoryOrderAcquire);
+
+    Task * task = NULL;
+    if (t <= b) {
+        task = (Task *) a->slots[b & (a->size - 1)];
+        if (t == b) {
+            // last element, race against thieves for it
+            if (!sync::atomicCompareExchange(&m_top, t, t + 1)) task = NULL;
+            sync::atomicStore(&m_bottom, b + 1, sync::MemoryOrderRelease);
+        }
+    } else {
+        sync::atomicStore(&m_bottom, b + 1, sync::MemoryOrderRelease);
+    }
+    return task;
+}
+
+inline bool
+Pool::WorkDeque::empty() const
+{
+    return sync::atomicLoad(&m_bottom, sync::MemoryOrderAcquire)
+        <= sync::atomicLoad(&m_top, sync::MemoryOrderAcquire);
+}
+
+inline Task *
+Pool::WorkDeque::steal(bool & bAbort)
+{
+    bAbort = false;
+    long t = sync::atomicLoad(&m_top, sync::MemoryOrderAcquire);
+    sync::atomicFence();
+    long b = sync::atomicLoad(&m_bottom, sync::MemoryOrderAcquire);
+
+    if (t >= b) return NULL;
+
+    Array * a = (Array *) sync::atomicLoadPtr((void * volatile *) &m_array,
+                                              sync::MemoryOrderAcquire);
+    Task * task = (Task *) a->slots[t & (a->size - 1)];
+    if (!sync::atomicCompareExchange(&m_top, t, t + 1)) {
+        bAbort = true;
+        return NULL;
+    }
+    return task;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// Worker
+
+struct Pool::Worker
+{
+    Pool * pool;
+    unsigned int index;
+    unsigned int rng;
+    WorkDeque deque;
+    Thread thread;
+};
+
+
+////////////////////////////////////////////////////////////////////////
+// Fork/join helpers
+
+/** the chunks of a fork/join still running, and the first exception
+ *  one of them threw.  The joining thread parks on it when there's
+ *  nothing to help with. */
+class PoolJoin
+{
+  public:
+    PoolJoin(long nPending)
+        : m_pending(nPending), m_finished(0), m_bFailed(false) {}
+
+    /** the last chunk may still be signalling; let it finish first */
+    ~PoolJoin()
+    {
+        bplus::sync::Lock lock(m_mutex);
+    }
+
+    bool done() const
+    {
+        return sync::atomicLoad(&m_finished, sync::MemoryOrderAcquire) != 0;
+    }
+
+    /** a chunk has finished */
+    void chunkDone()
+    {
+        if (sync::atomicAdd(&m_pending, -1) > 0) return;
+        bplus::sync::Lock lock(m_mutex);
+        sync::atomicStore(&m_finished, 1, sync::MemoryOrderRelease);
+        m_cond.signal();
+    }
+
+    /** call from a catch block: keeps the exception if it's first */
+    void chunkFailed()
+    {
+#if __cplusplus >= 201103L
+        std::exception_ptr pError = std::current_exception();
+#else
+        std::string sError = "unknown exception";
+        try {
+            throw;
+        } catch (const std::exception & e) {
+            sError = e.what();
+        } catch (...) {
+        }
+#endif
+        bplus::sync::Lock lock(m_mutex);
+        if (m_bFailed) return;
+        m_bFailed = true;
+#if __cplusplus >= 201103L
+        m_pError = pError;
+#else
+        m_sError = sError;
+#endif
+    }
+
+    /** wait up to msec for the last chunk, or for a chance to help */
+    void park(unsigned int msec)
+    {
+        bplus::sync::Lock lock(m_mutex);
+        if (!done()) m_cond.timeWait(&m_mutex, msec);
+    }
+
+    /** once done, rethrow the first exception, if any */
+    void rethrow()
+    {
+        if (!m_bFailed) return;
+#if __cplusplus >= 201103L
+        std::rethrow_exception(m_pError);
+#else
+        throw std::runtime_error(m_sError);
+#endif
+    }
+
+  private:
+    volatile long m_pending;
+    volatile long m_finished;       // set under m_mutex
+    bplus::sync::Mutex m_mutex;
+    bplus::sync::Condition m_cond;
+    bool m_bFailed;
+#if __cplusplus >= 201103L
+    std::exception_ptr m_pError;
+#else
+    std::string m_sError;
+#endif
+};
+
+
+template <class Body>
+class PoolRangeTask : public Task
+{
+  public:
+    PoolRangeTask()
+        : m_pBody(NULL), m_begin(0), m_end(0), m_pJoin(NULL) {}
+
+    void init(const Body * pBody, size_t begin, size_t end,
+              PoolJoin * pJoin)
+    {
+        m_pBody = pBody;
+        m_begin = begin;
+        m_end = end;
+        m_pJoin = pJoin;
+    }
+
+    virtual void run()
+    {
+        try {
+            (*m_pBody)(m_begin, m_end);
+        } catch (...) {
+            m_pJoin->chunkFailed();
+        }
+        m_pJoin->chunkDone();
+    }
+
+  private:
+    const Body * m_pBody;
+    size_t m_begin;
+    size_t m_end;
+    PoolJoin * m_pJoin;
+};
+
+
+// One chunk's partial result.  The padding keeps neighbouring chunks'
+// results, written by different workers, off each other's cache lines
+// (and a vector of these is no vector<bool>).
+template <class T>
+struct PoolReduceSlot
+{
+    explicit PoolReduceSlot(const T & v) : value(v) {}
+    T value;
+    char pad[64];
+};
+
+
+template <class T, class Body>
+class PoolReduceChunks
+{
+  public:
+    PoolReduceChunks(const Body & body,
+                     std::vector< PoolReduceSlot<T> > & partials,
+                     size_t begin, size_t end, size_t grain)
+        : m_body(body), m_partials(partials),
+          m_begin(begin), m_end(end), m_grain(grain) {}
+
+    void operator()(size_t chunkBegin, size_t chunkEnd) const
+    {
+        for (size_t c = chunkBegin; c < chunkEnd; c++) {
+            size_t b = m_begin + c * m_grain;
+            size_t e = (m_end - b > m_grain) ? b + m_grain : m_end;
+            m_partials[c].value = m_body(b, e);
+        }
+    }
+
+  private:
+    const Body & m_body;
+    std::vector< PoolReduceSlot<T> > & m_partials;
+    size_t m_begin;
+    size_t m_end;
+    size_t m_grain;
+};
+
+
+class PoolFunctionTask : public Task
+{
+  public:
+    PoolFunctionTask(void (*func)(void *), void * cookie)
+        : m_func(func), m_cookie(cookie) {}
+    virtual void run() { m_func(m_cookie); }
+  private:
+    void (*m_func)(void *);
+    void * m_cookie;
+};
+
+
+////////////////////////////////////////////////////////////////////////
+// Pool
+
+inline
+Pool::Pool(unsigned int nWorkers)
+    : m_sleepers(0), m_stopping(0), m_stopped(false)
+{
+    init(nWorkers, ThreadOptions());
+}
+
+inline
+Pool::Pool(unsigned int nWorkers, const ThreadOptions & workerOptions)
+    : m_sleepers(0), m_stopping(0), m_stopped(false)
+{
+    init(nWorkers, workerOptions);
+}
+
+inline void
+Pool::init(unsigned int nWorkers, const ThreadOptions & workerOptions)
+{
+    if (nWorkers == 0) nWorkers = Thread::hardwareConcurrency();
+
+    // All workers must exist before any of them starts stealing.
+    for (unsigned int i = 0; i < nWorkers; i++) {
+        Worker * w = new Worker;
+        w->pool = this;
+        w->index = i;
+        w->rng = 2654435761u * (i + 1);
+        m_workers.push_back(w);
+    }
+    ThreadOptions opts = workerOptions;
+    std::string sBase = opts.name.empty() ? "bp-pool" : opts.name;
+    for (unsigned int i = 0; i < nWorkers; i++) {
+        char buf[16];
+        sprintf(buf, "-%u", i);
+        opts.name = sBase + buf;
+        bool bStarted = m_workers[i]->thread.run(workerMain, m_workers[i],
+                                                 opts);
+        assert(bStarted);
+        (void) bStarted;
+    }
+}
+
+inline
+Pool::~Pool()
+{
+    shutdown();
+}
+
+inline unsigned int
+Pool::workerCount() const
+{
+    return m_workers.size();
+}
+
+inline Pool::Worker *&
+Pool::currentWorker()
+{
+    static BP_THREAD_LOCAL Worker * s_pWorker = NULL;
+    return s_pWorker;
+}
+
+inline void
+Pool::submit(Task * task)
+{
+    assert(task != NULL);
+    task->m_autoDelete = true;
+    if (m_stopped) {
+        execute(task);
+        return;
+    }
+    push(task);
+}
+
+inline void
+Pool::submit(void (*func)(void *), void * cookie)
+{
+    submit(new PoolFunctionTask(func, cookie));
+}
+
+inline void
+Pool::push(Task * task)
+{
+    Worker * self = currentWorker();
+    if (self != NULL && self->pool == this) {
+        self->deque.push(task);
+    } else {
+        bplus::sync::Lock lock(m_mutex);
+        m_injected.push_back(task);
+    }
+    wakeOne();
+}
+
+inline void
+Pool::wakeOne()
+{
+    // Sleepers register under m_mutex before re-checking for work, so
+    // either they see the task just pushed or we see them here.
+    sync::atomicFence();
+    if (sync::atomicLoad(&m_sleepers, sync::MemoryOrderAcquire) > 0) {
+        bplus::sync::Lock lock(m_mutex);
+        m_cond.signal();
+    }
+}
+
+inline Task *
+Pool::findWork(Worker * self)
+{
+    Task * task = NULL;
+
+    if (self != NULL) task = self->deque.pop();
+
+    if (task == NULL && !m_workers.empty()) {
+        unsigned int n = m_workers.size();
+        unsigned int start = 0;
+        if (self != NULL) {
+            // xorshift, so thieves spread out over victims
+            self->rng ^= self->rng << 13;
+            self->rng ^= self->rng >> 17;
+            self->rng ^= self->rng << 5;
+            start = self->rng % n;
+        }
+        bool bAbort = true;
+        while (task == NULL && bAbort) {
+            bAbort = false;
+            for (unsigned int i = 0; i < n && task == NULL; i++) {
+                Worker * victim = m_workers[(start + i) % n];
+                if (victim == self) continue;
+                bool bLost = false;
+                task = victim->deque.steal(bLost);
+                bAbort = bAbort || bLost;
+            }
+        }
+    }
+
+    if (task == NULL) {
+        bplus::sync::Lock lock(m_mutex);
+        if (!m_injected.empty()) {
+            task = m_injected.front();
+            m_injected.pop_front();
+        }
+    }
+
+    return task;
+}
+
+// Caller holds m_mutex.  Work is counted where it sits rather than in
+// a shared counter every push and pop would have to touch.
+inline bool
+Pool::hasWork() const
+{
+    if (!m_injected.empty()) return true;
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+        if (!m_workers[i]->deque.empty()) return true;
+    }
+    return false;
+}
+
+inline void
+Pool::execute(Task * task)
+{
+    bool bDelete = task->m_autoDelete;
+    try {
+        task->run();
+    } catch (...) {
+        // An exception escaping a worker thread would terminate the
+        // process.  Tasks are expected to handle their own errors.
+    }
+    if (bDelete) delete task;
+}
+
+inline void
+Pool::helpUntil(PoolJoin & join)
+{
+    Worker * self = currentWorker();
+    if (self != NULL && self->pool != this) self = NULL;
+
+    // With nothing to help with, spin briefly, then yield, then park
+    // until the last chunk finishes, looking for work now and then.
+    unsigned int idle = 0;
+    while (!join.done()) {
+        Task * task = findWork(self);
+        if (task != NULL) {
+            execute(task);
+            idle = 0;
+        } else if (++idle < 64) {
+            sync::cpuRelax();
+        } else if (idle < 80) {
+            Thread::yield();
+        } else {
+            join.park(1);
+        }
+    }
+}
+
+inline void *
+Pool::workerMain(void * cookie)
+{
+    Worker * self = (Worker *) cookie;
+    Pool * pool = self->pool;
+    currentWorker() = self;
+
+    for (;;) {
+        Task * task = pool->findWork(self);
+        if (task != NULL) {
+            pool->execute(task);
+            continue;
+        }
+
+        bplus::sync::Lock lock(pool->m_mutex);
+        sync::atomicAdd(&pool->m_sleepers, 1);
+        if (!pool->hasWork()) {
+            if (sync::atomicLoad(&pool->m_stopping,
+                                 sync::MemoryOrderAcquire)) {
+                sync::atomicAdd(&pool->m_sleepers, -1);
+                break;
+            }
+            pool->m_cond.wait(&pool->m_mutex);
+        }
+        sync::atomicAdd(&pool->m_sleepers, -1);
+    }
+
+    currentWorker() = NULL;
+    return NULL;
+}
+
+inline void
+Pool::shutdown()
+{
+    if (m_stopped) return;
+    assert(currentWorker() == NULL || currentWorker()->pool != this);
+
+    {
+        bplus::sync::Lock lock(m_mutex);
+        sync::atomicStore(&m_stopping, 1, sync::MemoryOrderRelease);
+        m_cond.broadcast();
+    }
+
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+        m_workers[i]->thread.join();
+    }
+
+    m_stopped = true;
+
+    // Workers only exit once nothing is queued, but be thorough.
+    Task * task;
+    while ((task = findWork(NULL)) != NULL) execute(task);
+
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+        delete m_workers[i];
+    }
+    m_workers.clear();
+}
+
+template <class Body>
+inline void
+Pool::parallelFor(size_t begin, size_t end, size_t grain, const Body & body)
+{
+    if (end <= begin) return;
+    if (grain == 0) grain = 1;
+
+    size_t nChunks = (end - begin - 1) / grain + 1;
+    if (nChunks == 1 || m_stopped) {
+        for (size_t b = begin; b < end; b += grain) {
+            body(b, (end - b > grain) ? b + grain : end);
+        }
+        return;
+    }
+
+    // Fork all but the first chunk, run that one here, then help out
+    // until the rest are done.
+    std::vector< PoolRangeTask<Body> > tasks(nChunks - 1);
+    PoolJoin join((long) (nChunks - 1));
+    for (size_t c = 1; c < nChunks; c++) {
+        size_t b = begin + c * grain;
+        tasks[c - 1].init(&body, b, (end - b > grain) ? b + grain : end,
+                          &join);
+        push(&tasks[c - 1]);
+    }
+
+    try {
+        body(begin, begin + grain);
+    } catch (...) {
+        // forked chunks reference 'body' and 'join', so they must
+        // finish before we unwind.
+        helpUntil(join);
+        throw;
+    }
+    helpUntil(join);
+    join.rethrow();
+}
+
+template <class T, class Body, class Join>
+inline T
+Pool::parallelReduce(size_t begin, size_t end, size_t grain,
+                     const T & identity, const Body & body,
+                     const Join & join)
+{
+    if (end <= begin) return identity;
+    if (grain == 0) grain = 1;
+
+    size_t nChunks = (end - begin - 1) / grain + 1;
+    std::vector< PoolReduceSlot<T> > partials(nChunks,
+                                              PoolReduceSlot<T>(identity));
+    PoolReduceChunks<T, Body> chunks(body, partials, begin, end, grain);
+    parallelFor(0, nChunks, 1, chunks);
+
+    T result = identity;
+    for (size_t c = 0; c < nChunks; c++) {
+        result = join(result, partials[c].value);
+    }
+    return result;
+}
+
+
+} // namespace thread
+} // namespace bplus
+
+
+#endif // BPTHREADPOOLIMPL_H_
@@ -0,0 +1,496 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/**
+ *  bptimerwheelimpl.h
+ * 
+ *  Inline implementation file for bptimerwheel.h.
+ *
+ *  Note: This file is included by bptimerwheel.h.
+ *        It is not intended for direct inclusion by client code.
+ *
+ *  Slot selection and cascading follow the classic Linux kernel timer
+ *  wheel: a timer lives on the lowest level whose span covers its
+ *  distance from the current tick, and each time a level wraps the
+ *  next slot of the level above is redistributed downwards.
+ */
+#ifndef BPTIMERWHEELIMPL_H_
+#define BPTIMERWHEELIMPL_H_
+
+#include "bputil/bptimeutil.h"
+
+
+namespace bplus {
+namespace thread {
+
+
+inline
+TimerWheel::TimerWheel(unsigned int tickMsec)
+    : m_tickMicros((tickMsec ? tickMsec : 1) * 1000ULL),
+      m_startMicros(bplus::timeutil::monotonicMicros()),
+      m_tick(0),
+      m_sleepUntil((unsigned long long) -1),
+      m_freeList(-1),
+      m_count(0),
+      m_bRunning(false),
+      m_bStopping(false)
+{
+    for (unsigned int i = 0; i < kLevels; i++) m_occupied[i] = 0;
+    for (unsigned int i = 0; i < kLevels * kSlots; i++) m_heads[i] = -1;
+}
+
+
+inline
+TimerWheel::~TimerWheel()
+{
+    stop();
+
+    // a wheel that never ran still owes its timers' cookies
+    {
+        bplus::sync::Lock lock(m_mutex);
+        for (size_t i = 0; i < m_nodes.size(); i++) {
+            if (m_nodes[i].state == NodePending) {
+                unlink((int) i);
+                discard((int) i);
+            }
+        }
+    }
+    disposeDiscarded();
+}
+
+
+inline bool
+TimerWheel::start()
+{
+    return start(ThreadOptions());
+}
+
+
+inline bool
+TimerWheel::start(const ThreadOptions & options)
+{
+    ThreadOptions opts = options;
+    if (opts.name.empty()) opts.name = "bp-timers";
+
+    bplus::sync::Lock lock(m_mutex);
+    if (m_bRunning) return true;
+    m_bStopping = false;
+    m_bRunning = m_thread.run(threadMain, this, opts);
+    return m_bRunning;
+}
+
+
+inline void
+TimerWheel::stop()
+{
+    {
+        bplus::sync::Lock lock(m_mutex);
+        if (!m_bRunning) return;
+        m_bStopping = true;
+        m_cond.signal();
+    }
+    m_thread.join();
+
+    {
+        bplus::sync::Lock lock(m_mutex);
+        m_bRunning = false;
+        for (size_t i = 0; i < m_nodes.size(); i++) {
+            if (m_nodes[i].state == NodePending) {
+                unlink((int) i);
+                discard((int) i);
+            }
+        }
+    }
+    // unlocked: disposers may well cancel other timers
+    disposeDiscarded();
+}
+
+
+// Caller holds m_mutex.  Frees a timer that will never fire, keeping
+// its cookie for disposal.
+inline void
+TimerWheel::discard(int ix)
+{
+    Node & n = m_nodes[ix];
+    if (n.dispose) {
+        Discarded d;
+        d.dispose = n.dispose;
+        d.cookie = n.cookie;
+        m_discarded.push_back(d);
+    }
+    freeNode(ix);
+}
+
+
+inline void
+TimerWheel::disposeDiscarded()
+{
+    std::vector<Discarded> v;
+    {
+        bplus::sync::Lock lock(m_mutex);
+        v.swap(m_discarded);
+    }
+    for (size_t i = 0; i < v.size(); i++) v[i].dispose(v[i].cookie);
+}
+
+
+inline TimerId
+TimerWheel::schedule(unsigned int delayMsec, TimerFunc func, void * cookie)
+{
+    return add(delayMsec, 0, func, cookie, NULL);
+}
+
+
+inline TimerId
+TimerWheel::schedule(unsigned int delayMsec, TimerFunc func, void * cookie,
+                     TimerFunc dispose)
+{
+    return add(delayMsec, 0, func, cookie, dispose);
+}
+
+
+inline TimerId
+TimerWheel::schedulePeriodic(unsigned int periodMsec, TimerFunc func,
+                             void * cookie)
+{
+    return add(periodMsec, periodMsec ? periodMsec : 1, func, cookie, NULL);
+}
+
+
+inline TimerId
+TimerWheel::add(unsigned int delayMsec, unsigned int periodMsec,
+                TimerFunc func, void * cookie, TimerFunc dispose)
+{
+    // the first tick that begins after the delay has fully elapsed,
+    // so we never fire early
+    unsigned long long target = bplus::timeutil::monotonicMicros()
+        - m_startMicros + delayMsec * 1000ULL;
+    unsigned long long expires = target / m_tickMicros + 1;
+
+    bplus::sync::Lock lock(m_mutex);
+    int ix = allocNode();
+    Node & n = m_nodes[ix];
+    n.func = func;
+    n.dispose = dispose;
+    n.cookie = cookie;
+    n.expires = expires;
+    n.period = 0;
+    if (periodMsec) {
+        n.period = (periodMsec * 1000ULL + m_tickMicros - 1) / m_tickMicros;
+    }
+    n.state = NodePending;
+    n.bCancelled = false;
+    link(ix);
+
+    if (n.expires < m_sleepUntil) m_cond.signal();
+    return ((TimerId) n.gen << 32) | (TimerId) ix;
+}
+
+
+inline bool
+TimerWheel::cancel(TimerId id)
+{
+    unsigned int ix = (unsigned int) (id & 0xffffffff);
+    unsigned int gen = (unsigned int) (id >> 32);
+
+    bplus::sync::Lock lock(m_mutex);
+    if (ix >= m_nodes.size() || m_nodes[ix].gen != gen) return false;
+
+    Node & n = m_nodes[ix];
+    if (n.state == NodePending) {
+        unlink((int) ix);
+        freeNode((int) ix);
+        return true;
+    }
+    if (n.state == NodeDue && !n.bCancelled) {
+        // expired but its callback hasn't started
+        n.bCancelled = true;
+        return true;
+    }
+    if (n.state == NodeRunning && !n.bCancelled) {
+        n.bCancelled = true;
+        return n.period != 0;
+    }
+    return false;
+}
+
+
+inline size_t
+TimerWheel::pending()
+{
+    bplus::sync::Lock lock(m_mutex);
+    return m_count;
+}
+
+
+inline int
+TimerWheel::allocNode()
+{
+    if (m_freeList < 0) {
+        Node n;
+        n.gen = 1;
+        n.state = NodeFree;
+        n.next = -1;
+        m_nodes.push_back(n);
+        m_freeList = (int) m_nodes.size() - 1;
+    }
+    int ix = m_freeList;
+    m_freeList = m_nodes[ix].next;
+    return ix;
+}
+
+
+inline void
+TimerWheel::freeNode(int ix)
+{
+    Node & n = m_nodes[ix];
+    n.state = NodeFree;
+    // a new generation invalidates outstanding ids for this node
+    if (++n.gen == 0) n.gen = 1;
+    n.next = m_freeList;
+    m_freeList = ix;
+}
+
+
+inline void
+TimerWheel::link(int ix)
+{
+    Node & n = m_nodes[ix];
+    if (n.expires < m_tick) n.expires = m_tick;
+
+    unsigned long long delta = n.expires - m_tick;
+    unsigned long long pos = n.expires;
+    unsigned int level = 0;
+    while (level < kLevels - 1 &&
+           delta >= (1ULL << (kLevelBits * (level + 1))))
+    {
+        level++;
+    }
+    if (delta >= (1ULL << (kLevelBits * kLevels))) {
+        // beyond the last level.  park it in the furthest slot, it
+        // is placed again each time that slot cascades.
+        pos = m_tick + (1ULL << (kLevelBits * kLevels)) - 1;
+    }
+    unsigned int slot = (unsigned int) (pos >> (kLevelBits * level))
+                        & (kSlots - 1);
+
+    n.slot = (int) (level * kSlots + slot);
+    n.prev = -1;
+    n.next = m_heads[n.slot];
+    if (n.next >= 0) m_nodes[n.next].prev = ix;
+    m_heads[n.slot] = ix;
+    m_occupied[level] |= 1ULL << slot;
+    m_count++;
+}
+
+
+inline void
+TimerWheel::unlink(int ix)
+{
+    Node & n = m_nodes[ix];
+    if (n.prev >= 0) m_nodes[n.prev].next = n.next;
+    else m_heads[n.slot] = n.next;
+    if (n.next >= 0) m_nodes[n.next].prev = n.prev;
+    if (m_heads[n.slot] < 0) {
+        m_occupied[n.slot / kSlots] &= ~(1ULL << (n.slot % kSlots));
+    }
+    m_count--;
+}
+
+
+inline void
+TimerWheel::cascade(unsigned int level, unsigned int slot)
+{
+    int s = (int) (level * kSlots + slot);
+    int ix = m_heads[s];
+    m_heads[s] = -1;
+    m_occupied[level] &= ~(1ULL << slot);
+    while (ix >= 0) {
+        int next = m_nodes[ix].next;
+        m_count--;
+        link(ix);
+        ix = next;
+    }
+}
+
+
+inline void
+TimerWheel::advance(unsigned long long now)
+{
+    while (m_tick <= now && !m_bStopping) {
+        if (m_count == 0) {
+            m_tick = now + 1;
+            break;
+        }
+
+        // when the lowest levels are empty nothing can fire or cascade
+        // until the next turn of the lowest occupied level, skip there
+        unsigned int level = 0;
+        while (level < kLevels && m_occupied[level] == 0) level++;
+        if (level > 0) {
+            unsigned long long mask = (1ULL << (kLevelBits * level)) - 1;
+            if (m_tick & mask) {
+                unsigned long long next = (m_tick | mask) + 1;
+                m_tick = (next < now + 1) ? next : now + 1;
+                continue;
+            }
+        }
+
+        unsigned int slot = (unsigned int) (m_tick & (kSlots - 1));
+        if (slot == 0) {
+            for (unsigned int l = 1; l < kLevels; l++) {
+                unsigned int s = (unsigned int)
+                    (m_tick >> (kLevelBits * l)) & (kSlots - 1);
+                cascade(l, s);
+                if (s != 0) break;
+            }
+        }
+        // move on before firing so that timers scheduled for "now" from
+        // a callback land in a slot still to be processed
+        m_tick++;
+        fireSlot(slot);
+    }
+}
+
+
+inline void
+TimerWheel::fireSlot(unsigned int slot)
+{
+    // detach the whole slot first.  callbacks run unlocked, and the
+    // timers still waiting their turn must stay cancellable.
+    m_due.clear();
+    for (int ix = m_heads[slot]; ix >= 0; ix = m_nodes[ix].next) {
+        m_nodes[ix].state = NodeDue;
+        m_due.push_back(ix);
+        m_count--;
+    }
+    m_heads[slot] = -1;
+    m_occupied[0] &= ~(1ULL << slot);
+
+    for (size_t i = 0; i < m_due.size(); i++) {
+        int ix = m_due[i];
+        Node & n = m_nodes[ix];
+        if (n.bCancelled) {
+            freeNode(ix);
+            continue;
+        }
+        if (m_bStopping) {
+            discard(ix);
+            continue;
+        }
+        n.state = NodeRunning;
+        TimerFunc func = n.func;
+        void * cookie = n.cookie;
+
+        m_mutex.unlock();
+        func(cookie);
+        m_mutex.lock();
+
+        // m_nodes may have grown while we were unlocked
+        Node & after = m_nodes[ix];
+        if (after.period == 0 || after.bCancelled || m_bStopping) {
+            freeNode(ix);
+        } else {
+            after.state = NodePending;
+            after.expires += after.period;
+            unsigned long long now = nowTick();
+            if (after.expires <= now) {
+                after.expires += ((now - after.expires) / after.period + 1)
+                                 * after.period;
+            }
+            link(ix);
+        }
+    }
+}
+
+
+inline bool
+TimerWheel::nextWakeTick(unsigned long long & oTick) const
+{
+    if (m_count == 0) return false;
+
+    unsigned long long best = (unsigned long long) -1;
+    if (m_occupied[0]) {
+        unsigned int from = (unsigned int) (m_tick & (kSlots - 1));
+        unsigned long long rot = (m_occupied[0] >> from)
+            | (from ? m_occupied[0] << (kSlots - from) : 0);
+        unsigned int d = 0;
+        while (!(rot & 1)) { rot >>= 1; d++; }
+        best = m_tick + d;
+    }
+    // the next turn of the lowest occupied upper level may cascade
+    // timers down
+    for (unsigned int l = 1; l < kLevels; l++) {
+        if (m_occupied[l]) {
+            unsigned long long mask = (1ULL << (kLevelBits * l)) - 1;
+            unsigned long long turn = (m_tick + mask) & ~mask;
+            if (turn < best) best = turn;
+            break;
+        }
+    }
+    oTick = best;
+    return true;
+}
+
+
+inline unsigned long long
+TimerWheel::nowTick() const
+{
+    return (bplus::timeutil::monotonicMicros() - m_startMicros)
+           / m_tickMicros;
+}
+
+
+inline void *
+TimerWheel::threadMain(void * cookie)
+{
+    ((TimerWheel *) cookie)->run();
+    return NULL;
+}
+
+
+inline void
+TimerWheel::run()
+{
+    bplus::sync::Lock lock(m_mutex);
+    while (!m_bStopping) {
+        m_sleepUntil = 0;
+        advance(nowTick());
+        if (m_bStopping) break;
+
+        unsigned long long wake;
+        if (nextWakeTick(wake)) {
+            m_sleepUntil = wake;
+            (void) m_cond.waitUntil(&m_mutex,
+                                    m_startMicros + wake * m_tickMicros);
+        } else {
+            m_sleepUntil = (unsigned long long) -1;
+            m_cond.wait(&m_mutex);
+        }
+    }
+}
+
+
+} // namespace thread
+} // namespace bplus
+
+#endif // BPTIMERWHEELIMPL_H_
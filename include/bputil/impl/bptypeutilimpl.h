@@ -30,6 +30,7 @@
  */
 
 #include <assert.h>
+#include <sstream>
 #include "bputil/bpstrutil.h"
 
 
@@ -125,12 +126,12 @@ Object::get(const char * path) const
 
     if (path == NULL) return obj;
     
-    std::vector<std::string> paths =
-        strutil::split(std::string(path), "/");
+    // walk the path a segment at a time, without copying it
+    strutil::Splitter sp(path, "/");
 
     obj = this;
 
-    for (unsigned int i = 0; i < paths.size(); i++) {
+    for (StringView seg; sp.next(seg); ) {
         if (obj->type() != BPTMap) {
             obj = NULL;
             break;
@@ -139,7 +140,7 @@ Object::get(const char * path) const
         obj = NULL;
         for (unsigned int j = 0; j < oldobj->e.value.mapVal.size; j++)
         {
-            if (!paths[i].compare(oldobj->e.value.mapVal.elements[j].key))
+            if (seg.equals(oldobj->e.value.mapVal.elements[j].key))
             {
                 obj = static_cast<const Map *>(oldobj)->values[j];
                 break;
@@ -933,4 +934,56 @@ List::operator std::vector<const Object *>() const
 }
 
 
+inline bool
+validateUtf8(const BPElement * elem, std::string * psBadPath)
+{
+    if (elem == NULL) return true;
+
+    switch (elem->type) {
+        case BPTString:
+            if (elem->value.stringVal
+                && !strutil::isValidUtf8(elem->value.stringVal)) {
+                if (psBadPath) psBadPath->clear();
+                return false;
+            }
+            break;
+        case BPTMap:
+            for (unsigned int i = 0; i < elem->value.mapVal.size; i++) {
+                const BPMapElem & me = elem->value.mapVal.elements[i];
+                if (me.key && !strutil::isValidUtf8(me.key)) {
+                    // don't echo the bad bytes back
+                    if (psBadPath) psBadPath->assign("<key>");
+                    return false;
+                }
+                if (!validateUtf8(me.value, psBadPath)) {
+                    if (psBadPath) {
+                        std::string s(me.key ? me.key : "");
+                        if (!psBadPath->empty()) s.append("/" + *psBadPath);
+                        psBadPath->swap(s);
+                    }
+                    return false;
+                }
+            }
+            break;
+        case BPTList:
+            for (unsigned int i = 0; i < elem->value.listVal.size; i++) {
+                if (!validateUtf8(elem->value.listVal.elements[i],
+                                  psBadPath)) {
+                    if (psBadPath) {
+                        std::stringstream ss;
+                        ss << i;
+                        if (!psBadPath->empty()) ss << "/" << *psBadPath;
+                        *psBadPath = ss.str();
+                    }
+                    return false;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+
 } // namespace bplus
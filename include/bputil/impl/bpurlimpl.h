@@ -66,7 +66,7 @@ inline bool isUrl( const std::string& sIn )
 }
 
 
-inline int portFromScheme( const std::string& sScheme ) 
+inline int portFromScheme( const StringView& sScheme ) 
 {
     // TODO: build a table here to handle more than http!
     if (sScheme == "http")
@@ -397,6 +397,212 @@ inline void Url::setFrag( const std::string& sFrag )
 }
 
 
+inline UrlView::UrlView() :
+    m_url(),
+    m_nPort( -1 ),
+    m_bExplicitPort( false )
+{
+    Range r = { 0, 0 };
+    m_scheme = m_host = m_path = m_query = m_frag = r;
+}
+
+
+inline bool UrlView::parse( const StringView& sIn, const char** pcszErr )
+{
+    const char* cszErr = NULL;
+    Range empty = { 0, 0 };
+    m_url = sIn;
+    m_scheme = m_host = m_path = m_query = m_frag = empty;
+    m_nPort = -1;
+    m_bExplicitPort = false;
+
+    const char* p = sIn.data();
+    size_t n = sIn.size();
+    size_t i = 0;
+
+    /* scheme = 1*( alpha | digit | "+" | "-" | "." ) */
+    while (i < n && (isalnum( (unsigned char) p[i] )
+                     || p[i] == '+' || p[i] == '-' || p[i] == '.'))
+        i++;
+
+    if (n == 0)
+        cszErr = "empty input";
+    else if (i == n || p[i] != ':')
+        cszErr = "expect ':' after string";
+    else if (n - i < 3 || p[i+1] != '/' || p[i+2] != '/')
+        cszErr = "expect '//'";
+    if (cszErr)
+    {
+        if (pcszErr) *pcszErr = cszErr;
+        return false;
+    }
+    m_scheme.len = (unsigned int) i;
+    i += 3;
+
+    // authority runs to the first '/', '?' or '#'
+    size_t nAuth = i;
+    size_t nAuthEnd = i;
+    while (nAuthEnd < n && p[nAuthEnd] != '/' && p[nAuthEnd] != '?'
+           && p[nAuthEnd] != '#')
+    {
+        // drop any userinfo
+        if (p[nAuthEnd] == '@') nAuth = nAuthEnd + 1;
+        nAuthEnd++;
+    }
+
+    size_t nHostEnd = nAuth;
+    while (nHostEnd < nAuthEnd && p[nHostEnd] != ':')
+        nHostEnd++;
+    m_host.pos = (unsigned int) nAuth;
+    m_host.len = (unsigned int) (nHostEnd - nAuth);
+
+    if (nHostEnd < nAuthEnd)
+    {
+        size_t nDigits = nAuthEnd - nHostEnd - 1;
+        int port = 0;
+        for (size_t j = nHostEnd + 1; j < nAuthEnd; j++)
+        {
+            if (!isdigit( (unsigned char) p[j] ))
+            {
+                nDigits = 0;
+                break;
+            }
+            port = port * 10 + (p[j] - '0');
+            if (port > 65535) break;
+        }
+        if (nDigits == 0 || nDigits > 5)
+            cszErr = "port is malformed";
+        else if (port > 65535)
+            cszErr = "port is out of range";
+        if (cszErr)
+        {
+            if (pcszErr) *pcszErr = cszErr;
+            return false;
+        }
+        m_nPort = port;
+        m_bExplicitPort = true;
+    }
+    else
+    {
+        m_nPort = portFromScheme( scheme() );
+    }
+
+    i = nAuthEnd;
+    m_path.pos = (unsigned int) i;
+    while (i < n && p[i] != '?' && p[i] != '#')
+        i++;
+    m_path.len = (unsigned int) (i - m_path.pos);
+
+    if (i < n && p[i] == '?')
+    {
+        m_query.pos = (unsigned int) ++i;
+        while (i < n && p[i] != '#')
+            i++;
+        m_query.len = (unsigned int) (i - m_query.pos);
+    }
+
+    if (i < n)
+    {
+        m_frag.pos = (unsigned int) (i + 1);
+        m_frag.len = (unsigned int) (n - i - 1);
+    }
+
+    return true;
+}
+
+
+inline bool Origin::assign( const UrlView& url )
+{
+    StringView sScheme = url.scheme();
+    StringView sHost = url.host();
+    if (sScheme.empty())
+    {
+        *this = Origin();
+        return false;
+    }
+
+    scheme.resize( sScheme.size() );
+    for (size_t i = 0; i < sScheme.size(); i++)
+        scheme[i] = (char) tolower( (unsigned char) sScheme[i] );
+
+    // ignore the trailing dot of a fully qualified host
+    if (!sHost.empty() && sHost[sHost.size() - 1] == '.')
+        sHost.removeSuffix( 1 );
+    host.resize( sHost.size() );
+    for (size_t i = 0; i < sHost.size(); i++)
+        host[i] = (char) tolower( (unsigned char) sHost[i] );
+
+    port = url.hasExplicitPort() ? url.port() : portFromScheme( scheme );
+    return true;
+}
+
+
+inline std::string Origin::toString() const
+{
+    std::string s = scheme + "://" + host;
+    if (port != -1 && port != portFromScheme( scheme ))
+    {
+        std::stringstream ss;
+        ss << ":" << port;
+        s.append( ss.str() );
+    }
+    return s;
+}
+
+
+inline OriginCache::OriginCache( size_t nMaxEntries ) :
+    m_lock(),
+    m_map(),
+    m_nMaxEntries( nMaxEntries ? nMaxEntries : 1 )
+{
+}
+
+
+inline bool OriginCache::lookup( const std::string& sUrl, Origin& oOrigin )
+{
+    {
+        bplus::sync::ReadLock rl( m_lock );
+        tOriginMap::const_iterator it = m_map.find( sUrl );
+        if (it != m_map.end())
+        {
+            oOrigin = it->second;
+            return oOrigin.valid();
+        }
+    }
+
+    // Parse outside the lock.  Racing threads may both parse the same
+    // url; they produce the same result.
+    UrlView url;
+    Origin o;
+    if (url.parse( sUrl ))
+        (void) o.assign( url );
+
+    {
+        bplus::sync::WriteLock wl( m_lock );
+        if (m_map.size() >= m_nMaxEntries)
+            m_map.clear();
+        m_map[sUrl] = o;
+    }
+
+    oOrigin = o;
+    return oOrigin.valid();
+}
+
+
+inline size_t OriginCache::size() const
+{
+    bplus::sync::ReadLock rl( m_lock );
+    return m_map.size();
+}
+
+
+inline void OriginCache::clear()
+{
+    bplus::sync::WriteLock wl( m_lock );
+    m_map.clear();
+}
+
+
 } // namespace url
 } // namespace bp
 
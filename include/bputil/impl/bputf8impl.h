@@ -0,0 +1,299 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bputf8impl.h
+ *
+ *  Inline implementation file for bputf8.h.
+ *
+ *  Note: This file is included by bputf8.h.
+ *        It is not intended for direct inclusion by client code.
+ */
+
+#ifndef BPUTF8IMPL_H_
+#define BPUTF8IMPL_H_
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BP_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+namespace bplus {
+namespace strutil {
+namespace detail {
+
+
+// Number of leading bytes of p[0..n) below 0x80.
+inline size_t
+asciiPrefix(const unsigned char* p, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (p + i));
+        if (_mm256_movemask_epi8(v)) break;
+    }
+#endif
+#if defined(BP_HAVE_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (p + i));
+        if (_mm_movemask_epi8(v)) break;
+    }
+#endif
+    while (i < n && p[i] < 0x80) ++i;
+    return i;
+}
+
+
+// Decode the multibyte sequence at p[0..n), where p[0] >= 0x80.
+// Returns its length, or 0 if it is malformed.
+inline size_t
+decodeSequence(const unsigned char* p, size_t n, unsigned int& cp)
+{
+    unsigned char c = p[0];
+    if (c < 0xC2) {
+        // stray continuation byte, or overlong two byte form
+        return 0;
+    }
+    if (c < 0xE0) {
+        if (n < 2 || (p[1] & 0xC0) != 0x80) return 0;
+        cp = ((c & 0x1F) << 6) | (p[1] & 0x3F);
+        return 2;
+    }
+    if (c < 0xF0) {
+        if (n < 3 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80) {
+            return 0;
+        }
+        cp = ((c & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+        if (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+        return 3;
+    }
+    if (c < 0xF5) {
+        if (n < 4 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80
+            || (p[3] & 0xC0) != 0x80) {
+            return 0;
+        }
+        cp = ((c & 0x07) << 18) | ((p[1] & 0x3F) << 12)
+             | ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+        if (cp < 0x10000 || cp > 0x10FFFF) return 0;
+        return 4;
+    }
+    return 0;
+}
+
+
+struct Utf16Units
+{
+    template <class C>
+    static void put(C& out, unsigned int cp)
+    {
+        typedef typename C::value_type tUnit;
+        if (cp < 0x10000) {
+            out.push_back(tUnit(cp));
+        } else {
+            cp -= 0x10000;
+            out.push_back(tUnit(0xD800 + (cp >> 10)));
+            out.push_back(tUnit(0xDC00 + (cp & 0x3FF)));
+        }
+    }
+};
+
+
+struct Utf32Units
+{
+    template <class C>
+    static void put(C& out, unsigned int cp)
+    {
+        out.push_back(typename C::value_type(cp));
+    }
+};
+
+
+// Decode sIn onto the end of out, which is any sequence container of
+// integral code units (std::vector, std::wstring).
+template <class Units, class C>
+bool
+decodeUtf8(const StringView& sIn, C& out, size_t* pBadOffset)
+{
+    const unsigned char* p = (const unsigned char*) sIn.data();
+    size_t n = sIn.size();
+    size_t nOrig = out.size();
+    out.reserve(nOrig + n);
+
+    size_t i = 0;
+    while (i < n) {
+        size_t nAscii = asciiPrefix(p + i, n - i);
+        out.insert(out.end(), p + i, p + i + nAscii);
+        i += nAscii;
+        if (i == n) break;
+
+        unsigned int cp = 0;
+        size_t nLen = decodeSequence(p + i, n - i, cp);
+        if (nLen == 0) {
+            out.resize(nOrig);
+            if (pBadOffset) *pBadOffset = i;
+            return false;
+        }
+        Units::put(out, cp);
+        i += nLen;
+    }
+    return true;
+}
+
+
+inline void
+appendUtf8(std::string& sOut, unsigned int cp)
+{
+    if (cp < 0x80) {
+        sOut += char(cp);
+    } else if (cp < 0x800) {
+        sOut += char(0xC0 | (cp >> 6));
+        sOut += char(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        sOut += char(0xE0 | (cp >> 12));
+        sOut += char(0x80 | ((cp >> 6) & 0x3F));
+        sOut += char(0x80 | (cp & 0x3F));
+    } else {
+        sOut += char(0xF0 | (cp >> 18));
+        sOut += char(0x80 | ((cp >> 12) & 0x3F));
+        sOut += char(0x80 | ((cp >> 6) & 0x3F));
+        sOut += char(0x80 | (cp & 0x3F));
+    }
+}
+
+
+// Encode UTF-32 units (unsigned int, or a 32 bit wchar_t) onto sOut.
+template <class T>
+bool
+encodeUtf32(const T* pUnits, size_t nUnits, std::string& sOut,
+            size_t* pBadOffset)
+{
+    size_t nOrig = sOut.size();
+    sOut.reserve(nOrig + nUnits);
+    for (size_t i = 0; i < nUnits; ++i) {
+        unsigned int cp = (unsigned int) pUnits[i];
+        if (cp < 0x80) {
+            sOut += char(cp);
+            continue;
+        }
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            sOut.resize(nOrig);
+            if (pBadOffset) *pBadOffset = i;
+            return false;
+        }
+        appendUtf8(sOut, cp);
+    }
+    return true;
+}
+
+
+} // detail
+
+
+inline bool
+isValidUtf8(const StringView& sIn, size_t* pBadOffset)
+{
+    const unsigned char* p = (const unsigned char*) sIn.data();
+    size_t n = sIn.size();
+    size_t i = 0;
+    while (i < n) {
+        i += detail::asciiPrefix(p + i, n - i);
+        if (i == n) break;
+        unsigned int cp;
+        size_t nLen = detail::decodeSequence(p + i, n - i, cp);
+        if (nLen == 0) {
+            if (pBadOffset) *pBadOffset = i;
+            return false;
+        }
+        i += nLen;
+    }
+    return true;
+}
+
+
+inline bool
+utf8ToUtf16(const StringView& sIn,
+            std::vector<unsigned short>& out,
+            size_t* pBadOffset)
+{
+    return detail::decodeUtf8<detail::Utf16Units>(sIn, out, pBadOffset);
+}
+
+
+inline bool
+utf8ToUtf32(const StringView& sIn,
+            std::vector<unsigned int>& out,
+            size_t* pBadOffset)
+{
+    return detail::decodeUtf8<detail::Utf32Units>(sIn, out, pBadOffset);
+}
+
+
+inline bool
+utf16ToUtf8(const unsigned short* pUnits, size_t nUnits,
+            std::string& sOut,
+            size_t* pBadOffset)
+{
+    size_t nOrig = sOut.size();
+    sOut.reserve(nOrig + nUnits);
+    for (size_t i = 0; i < nUnits; ++i) {
+        unsigned int cp = pUnits[i];
+        if (cp < 0x80) {
+            sOut += char(cp);
+            continue;
+        }
+        if (cp >= 0xD800 && cp <= 0xDFFF) {
+            // must be a high surrogate followed by a low one
+            if (cp > 0xDBFF || i + 1 == nUnits
+                || pUnits[i + 1] < 0xDC00 || pUnits[i + 1] > 0xDFFF) {
+                sOut.resize(nOrig);
+                if (pBadOffset) *pBadOffset = i;
+                return false;
+            }
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (pUnits[i + 1] - 0xDC00);
+            ++i;
+        }
+        detail::appendUtf8(sOut, cp);
+    }
+    return true;
+}
+
+
+inline bool
+utf32ToUtf8(const unsigned int* pUnits, size_t nUnits,
+            std::string& sOut,
+            size_t* pBadOffset)
+{
+    return detail::encodeUtf32(pUnits, nUnits, sOut, pBadOffset);
+}
+
+
+} // strutil
+} // bplus
+
+
+#endif // BPUTF8IMPL_H_
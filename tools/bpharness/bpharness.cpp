@@ -0,0 +1,478 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpharness.cpp
+ *
+ *  Drives a service's shared library without the BrowserPlus daemon,
+ *  for load tests and regression benchmarks.  The harness loads the
+ *  library, allocates instances and keeps a fixed number of calls to
+ *  one function outstanding, invoking from a single thread as the
+ *  daemon's main thread does.  It reports throughput, latency
+ *  percentiles (invoke to postResults/postError) and memory use.
+ *
+ *  usage: bpharness [options] service.so function
+ *  Run with no arguments for the options.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "servicehost.h"
+#include "bputil/bpjson.h"
+#include "bputil/bpstrutil.h"
+#include "bputil/bptimeutil.h"
+
+
+using bpharness::parseCount;
+using bpharness::percentile;
+using bpharness::readFile;
+
+
+namespace {
+
+
+struct Options
+{
+    Options() :
+        nInstances( 1 ), nConcurrency( 1 ), nCalls( 1000 ),
+        nWarmup( 100 ), nTimeoutMsec( 10000 ), sArgs( "{}" ),
+        bShowLog( false ), bShowResults( false ), bJson( false ) {}
+
+    std::string     sLibPath;
+    std::string     sFunction;
+    unsigned int    nInstances;
+    unsigned int    nConcurrency;
+    unsigned int    nCalls;
+    unsigned int    nWarmup;
+    unsigned int    nTimeoutMsec;
+    std::string     sArgs;              // JSON
+    std::string     sServiceDir;
+    std::string     sWorkDir;
+    bpharness::ClientContext ctx;
+    bool            bShowLog;
+    bool            bShowResults;
+    bool            bJson;
+};
+
+
+struct Results
+{
+    Results() : nOk( 0 ), nErrors( 0 ), nTimeouts( 0 ), nMicros( 0 ) {}
+
+    unsigned long long  nOk;
+    unsigned long long  nErrors;
+    unsigned long long  nTimeouts;
+    unsigned long long  nMicros;        // wall time of the measured run
+    std::vector<unsigned long long> latencies;  // micros
+    std::string         sFirstError;
+    std::string         sFirstResults;
+};
+
+
+void
+usage()
+{
+    fprintf( stderr,
+"usage: bpharness [options] service.so function\n"
+"  --args JSON          arguments, a JSON object (default {})\n"
+"  --args-file PATH     arguments from a file: an object, or an array\n"
+"                       of objects used in turn\n"
+"  --instances N        instances to allocate (default 1)\n"
+"  --concurrency N      calls kept outstanding (default 1)\n"
+"  --calls N            measured calls (default 1000)\n"
+"  --warmup N           unmeasured calls made first (default 100)\n"
+"  --timeout MSEC       cancel calls taking longer (default 10000)\n"
+"  --service-dir DIR    service directory (default: the library's)\n"
+"  --work-dir DIR       where data and temp dirs are made\n"
+"                       (default: a new directory under /tmp)\n"
+"  --uri URI            client URI (default http://localhost)\n"
+"  --show-log           print service log lines to stderr\n"
+"  --show-results       print the first results and error\n"
+"  --json               print the report as JSON\n" );
+}
+
+
+bool
+parseOptions( int argc, char** argv, Options& opts )
+{
+    std::vector<const char*> vPositional;
+    for (int i = 1; i < argc; i++) {
+        std::string sOpt = argv[i];
+        if (sOpt.compare( 0, 2, "--" ) != 0) {
+            vPositional.push_back( argv[i] );
+            continue;
+        }
+        if (sOpt == "--show-log") { opts.bShowLog = true; continue; }
+        if (sOpt == "--show-results") { opts.bShowResults = true; continue; }
+        if (sOpt == "--json") { opts.bJson = true; continue; }
+
+        if (i + 1 >= argc) {
+            fprintf( stderr, "%s needs a value\n", argv[i] );
+            return false;
+        }
+        const char* cszVal = argv[++i];
+        bool bOk = true;
+        if (sOpt == "--args") opts.sArgs = cszVal;
+        else if (sOpt == "--args-file") {
+            opts.sArgs.clear();
+            bOk = readFile( cszVal, opts.sArgs );
+        }
+        else if (sOpt == "--instances") bOk = parseCount( cszVal, opts.nInstances );
+        else if (sOpt == "--concurrency") bOk = parseCount( cszVal, opts.nConcurrency );
+        else if (sOpt == "--calls") bOk = parseCount( cszVal, opts.nCalls );
+        else if (sOpt == "--warmup") bOk = parseCount( cszVal, opts.nWarmup );
+        else if (sOpt == "--timeout") bOk = parseCount( cszVal, opts.nTimeoutMsec );
+        else if (sOpt == "--service-dir") opts.sServiceDir = cszVal;
+        else if (sOpt == "--work-dir") opts.sWorkDir = cszVal;
+        else if (sOpt == "--uri") opts.ctx.uri = cszVal;
+        else {
+            fprintf( stderr, "unknown option %s\n", argv[i - 1] );
+            return false;
+        }
+        if (!bOk) {
+            fprintf( stderr, "bad value for %s: %s\n", argv[i - 1], cszVal );
+            return false;
+        }
+    }
+
+    if (vPositional.size() != 2) return false;
+    if (opts.nInstances == 0 || opts.nConcurrency == 0) {
+        fprintf( stderr, "--instances and --concurrency must be positive\n" );
+        return false;
+    }
+    opts.sLibPath = vPositional[0];
+    opts.sFunction = vPositional[1];
+    if (opts.sServiceDir.empty()) {
+        size_t nSlash = opts.sLibPath.rfind( '/' );
+        opts.sServiceDir = nSlash == std::string::npos
+                           ? "." : opts.sLibPath.substr( 0, nSlash );
+    }
+    return true;
+}
+
+
+// Parse the argument payloads: one map, or a list of maps.
+bool
+loadPayloads( const std::string& sJson,
+              std::vector<bplus::Object*>& vPayloads )
+{
+    std::string sError;
+    bplus::Object* pRoot = bplus::json::parse( sJson, &sError );
+    if (!pRoot) {
+        fprintf( stderr, "bad arguments JSON: %s\n", sError.c_str() );
+        return false;
+    }
+    if (pRoot->type() == BPTMap) {
+        vPayloads.push_back( pRoot );
+        return true;
+    }
+    if (pRoot->type() == BPTList) {
+        const bplus::List* pList = (const bplus::List*) pRoot;
+        for (unsigned int i = 0; i < pList->size(); i++) {
+            if (pList->value( i )->type() != BPTMap) break;
+            vPayloads.push_back( pList->value( i )->clone() );
+        }
+        bool bOk = !vPayloads.empty()
+                   && vPayloads.size() == pList->size();
+        delete pRoot;
+        if (bOk) return true;
+    } else {
+        delete pRoot;
+    }
+    fprintf( stderr, "arguments must be an object or a list of objects\n" );
+    return false;
+}
+
+
+const BPFunctionDefinition*
+findFunction( const BPServiceDefinition* pDef, const std::string& sName )
+{
+    for (unsigned int i = 0; i < pDef->numFunctions; i++) {
+        if (sName == pDef->functions[i].functionName) {
+            return &pDef->functions[i];
+        }
+    }
+    return NULL;
+}
+
+
+// JSON has no callbacks or paths, so convert integers and strings to
+// them where the function's definition asks for them.
+void
+coercePayload( bplus::Map& args, const BPFunctionDefinition* pFunc )
+{
+    for (unsigned int i = 0; i < pFunc->numArguments; i++) {
+        const BPArgumentDefinition& def = pFunc->arguments[i];
+        const bplus::Object* pVal = args.value( def.name );
+        if (!pVal) continue;
+        if (def.type == BPTCallBack && pVal->type() == BPTInteger) {
+            BPCallBack cb = ((const bplus::Integer*) pVal)->value();
+            args.add( def.name, new bplus::CallBack( cb ) );
+        } else if ((def.type == BPTNativePath
+                    || def.type == BPTWritableNativePath)
+                   && pVal->type() == BPTString) {
+            std::string sPath = *pVal;
+            if (def.type == BPTNativePath) {
+                args.add( def.name, new bplus::Path( sPath ) );
+            } else {
+                args.add( def.name, new bplus::WritablePath( sPath ) );
+            }
+        }
+    }
+}
+
+
+// Make nCalls calls keeping nConcurrency outstanding, spread over the
+// instances round robin.  Latencies are kept if res.latencies has
+// room reserved for them.
+void
+runCalls( bpharness::ServiceHost& host, const Options& opts,
+          const std::vector<bplus::Object*>& vPayloads,
+          unsigned int nCalls, unsigned int& tidNext, Results& res )
+{
+    struct Pending
+    {
+        unsigned long long  start;
+        unsigned int        nInstance;
+    };
+    std::map<unsigned int, Pending> pending;
+    std::vector<bpharness::Completion> vDone;
+    unsigned int nIssued = 0;
+    unsigned long long nTimeout = opts.nTimeoutMsec * 1000ULL;
+
+    while (nIssued < nCalls || !pending.empty()) {
+        while (nIssued < nCalls && pending.size() < opts.nConcurrency) {
+            unsigned int tid = tidNext++;
+            Pending& p = pending[tid];
+            p.nInstance = nIssued % host.instanceCount();
+            p.start = bplus::timeutil::monotonicMicros();
+            const bplus::Object* pArgs = vPayloads[nIssued % vPayloads.size()];
+            nIssued++;
+            host.invoke( p.nInstance, tid, opts.sFunction.c_str(),
+                         pArgs->elemPtr() );
+        }
+
+        vDone.clear();
+        host.pump( 10, vDone );
+        for (size_t i = 0; i < vDone.size(); i++) {
+            const bpharness::Completion& c = vDone[i];
+            std::map<unsigned int, Pending>::iterator it =
+                pending.find( c.tid );
+            if (it == pending.end()) continue;      // late, or unknown
+            if (c.bError) {
+                res.nErrors++;
+                if (res.sFirstError.empty()) {
+                    res.sFirstError = c.sError;
+                    if (!c.sVerboseError.empty()) {
+                        res.sFirstError += ": " + c.sVerboseError;
+                    }
+                }
+            } else {
+                res.nOk++;
+                if (res.sFirstResults.empty()) res.sFirstResults = c.sResults;
+            }
+            if (res.latencies.size() < res.latencies.capacity()) {
+                res.latencies.push_back( c.micros - it->second.start );
+            }
+            pending.erase( it );
+        }
+
+        unsigned long long now = bplus::timeutil::monotonicMicros();
+        std::map<unsigned int, Pending>::iterator it = pending.begin();
+        while (it != pending.end()) {
+            if (now - it->second.start > nTimeout) {
+                host.cancel( it->second.nInstance, it->first );
+                res.nTimeouts++;
+                pending.erase( it++ );
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+
+void
+report( const Options& opts, const BPServiceDefinition* pDef,
+        Results& res, const bpharness::HostCounters& counters,
+        unsigned long nRssStart, unsigned long nRssLoaded,
+        unsigned long nRssEnd, unsigned long nRssPeak )
+{
+    std::sort( res.latencies.begin(), res.latencies.end() );
+    double dMean = 0;
+    for (size_t i = 0; i < res.latencies.size(); i++) {
+        dMean += (double) res.latencies[i];
+    }
+    if (!res.latencies.empty()) dMean /= res.latencies.size();
+    double dSecs = res.nMicros / 1e6;
+    double dRate = dSecs > 0 ? (res.nOk + res.nErrors) / dSecs : 0;
+    char szVersion[64];
+    snprintf( szVersion, sizeof(szVersion), "%u.%u.%u", pDef->majorVersion,
+              pDef->minorVersion, pDef->microVersion );
+
+    if (!opts.bJson) {
+        printf( "service:     %s %s (%s)\n", pDef->serviceName, szVersion,
+                opts.sLibPath.c_str() );
+        printf( "function:    %s, %u instances, concurrency %u\n",
+                opts.sFunction.c_str(), opts.nInstances, opts.nConcurrency );
+        printf( "calls:       %llu ok, %llu errors, %llu timeouts in %.3f s"
+                ", %.1f calls/s\n", res.nOk, res.nErrors, res.nTimeouts,
+                dSecs, dRate );
+        printf( "latency us:  mean %.1f  p50 %llu  p90 %llu  p99 %llu"
+                "  p99.9 %llu  max %llu\n", dMean,
+                percentile( res.latencies, 50 ),
+                percentile( res.latencies, 90 ),
+                percentile( res.latencies, 99 ),
+                percentile( res.latencies, 99.9 ),
+                percentile( res.latencies, 100 ) );
+        printf( "posted:      %llu callbacks, %llu log lines, %llu prompts,"
+                " %llu main thread calls\n", counters.callbacks,
+                counters.logLines, counters.prompts,
+                counters.mainThreadCalls );
+        printf( "memory kB:   rss %lu at start, %lu loaded, %lu at end,"
+                " peak %lu\n", nRssStart, nRssLoaded, nRssEnd, nRssPeak );
+        if (opts.bShowResults) {
+            printf( "results:     %s\n", res.sFirstResults.c_str() );
+        }
+        if (!res.sFirstError.empty()) {
+            printf( "first error: %s\n", res.sFirstError.c_str() );
+        }
+        return;
+    }
+
+    std::string s = "{\"service\":";
+    bplus::strutil::quoteJsonString( pDef->serviceName, s );
+    s += ",\"version\":";
+    bplus::strutil::quoteJsonString( szVersion, s );
+    s += ",\"function\":";
+    bplus::strutil::quoteJsonString( opts.sFunction, s );
+    char buf[512];
+    snprintf( buf, sizeof(buf),
+              ",\"instances\":%u,\"concurrency\":%u"
+              ",\"ok\":%llu,\"errors\":%llu,\"timeouts\":%llu"
+              ",\"seconds\":%.6f,\"callsPerSec\":%.1f"
+              ",\"latencyUs\":{\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu"
+              ",\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+              opts.nInstances, opts.nConcurrency, res.nOk, res.nErrors,
+              res.nTimeouts, dSecs, dRate, dMean,
+              percentile( res.latencies, 50 ),
+              percentile( res.latencies, 90 ),
+              percentile( res.latencies, 99 ),
+              percentile( res.latencies, 99.9 ),
+              percentile( res.latencies, 100 ) );
+    s += buf;
+    snprintf( buf, sizeof(buf),
+              ",\"callbacks\":%llu,\"logLines\":%llu,\"prompts\":%llu"
+              ",\"mainThreadCalls\":%llu"
+              ",\"memoryKb\":{\"start\":%lu,\"loaded\":%lu,\"end\":%lu"
+              ",\"peak\":%lu}",
+              counters.callbacks, counters.logLines, counters.prompts,
+              counters.mainThreadCalls, nRssStart, nRssLoaded, nRssEnd,
+              nRssPeak );
+    s += buf;
+    if (opts.bShowResults) {
+        s += ",\"results\":";
+        s += res.sFirstResults.empty() ? "null" : res.sFirstResults;
+    }
+    if (!res.sFirstError.empty()) {
+        s += ",\"firstError\":";
+        bplus::strutil::quoteJsonString( res.sFirstError, s );
+    }
+    s += "}";
+    printf( "%s\n", s.c_str() );
+}
+
+
+} // anonymous namespace
+
+
+int
+main( int argc, char** argv )
+{
+    Options opts;
+    if (!parseOptions( argc, argv, opts )) {
+        usage();
+        return 2;
+    }
+
+    std::vector<bplus::Object*> vPayloads;
+    if (!loadPayloads( opts.sArgs, vPayloads )) return 2;
+
+    if (!bpharness::makeWorkDir( "bpharness", opts.sWorkDir, opts.ctx )) {
+        perror( "mkdtemp" );
+        return 1;
+    }
+    opts.ctx.clientPid = (int) getpid();
+
+    unsigned long nRssStart = bpharness::procStatusKb( "VmRSS" );
+
+    bpharness::ServiceHost host;
+    host.setLogStream( opts.bShowLog ? stderr : NULL );
+    host.setCaptureResults( opts.bShowResults );
+
+    std::string sError;
+    if (!host.load( opts.sLibPath, sError )
+        || !host.initialize( opts.sServiceDir, sError )
+        || !host.allocate( opts.nInstances, opts.ctx, sError )) {
+        fprintf( stderr, "%s: %s\n", opts.sLibPath.c_str(), sError.c_str() );
+        return 1;
+    }
+    const BPFunctionDefinition* pFunc =
+        findFunction( host.definition(), opts.sFunction );
+    if (!pFunc) {
+        fprintf( stderr, "%s has no function %s\n",
+                 host.definition()->serviceName, opts.sFunction.c_str() );
+        return 1;
+    }
+    for (size_t i = 0; i < vPayloads.size(); i++) {
+        coercePayload( *(bplus::Map*) vPayloads[i], pFunc );
+    }
+
+    unsigned long nRssLoaded = bpharness::procStatusKb( "VmRSS" );
+
+    unsigned int tidNext = 1;
+    Results warm;
+    runCalls( host, opts, vPayloads, opts.nWarmup, tidNext, warm );
+
+    Results res;
+    res.latencies.reserve( opts.nCalls );
+    unsigned long long nStart = bplus::timeutil::monotonicMicros();
+    runCalls( host, opts, vPayloads, opts.nCalls, tidNext, res );
+    res.nMicros = bplus::timeutil::monotonicMicros() - nStart;
+    if (res.sFirstError.empty()) res.sFirstError = warm.sFirstError;
+
+    unsigned long nRssEnd = bpharness::procStatusKb( "VmRSS" );
+    unsigned long nRssPeak = bpharness::procStatusKb( "VmHWM" );
+    report( opts, host.definition(), res, host.counters(),
+            nRssStart, nRssLoaded, nRssEnd, nRssPeak );
+
+    host.shutdown();
+    for (size_t i = 0; i < vPayloads.size(); i++) delete vPayloads[i];
+    return res.nErrors || res.nTimeouts ? 3 : 0;
+}
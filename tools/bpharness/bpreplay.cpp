@@ -0,0 +1,583 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bpreplay.cpp
+ *
+ *  Replays an invocation trace (see Service::enableInvocationTrace())
+ *  against a service's shared library, for performance regression
+ *  tests on real traffic.  Calls are made with their recorded
+ *  arguments, from a single thread as the daemon's main thread does,
+ *  either as fast as the service will take them, with a fixed number
+ *  outstanding, or on the trace's own schedule.  Each replayed call is
+ *  checked against how it ended when recorded -- the error, or the
+ *  encoded size of the results -- and the report gives throughput,
+ *  latency percentiles overall and per function, and the mismatches.
+ *
+ *  usage: bpreplay [options] service.so trace
+ *  Run with no arguments for the options.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "servicehost.h"
+#include "bpservice/bpinvocationtrace.h"
+#include "bputil/bpstrutil.h"
+#include "bputil/bptimeutil.h"
+
+
+using bplus::service::InvocationTrace;
+using bpharness::parseCount;
+using bpharness::percentile;
+using bpharness::readFile;
+
+
+namespace {
+
+
+struct Options
+{
+    Options() :
+        bOriginalTiming( false ), nConcurrency( 1 ), nTimeoutMsec( 10000 ),
+        nShowMismatches( 10 ), bShowLog( false ), bJson( false ) {}
+
+    std::string     sLibPath;
+    std::string     sTracePath;
+    bool            bOriginalTiming;
+    unsigned int    nConcurrency;
+    unsigned int    nTimeoutMsec;
+    unsigned int    nShowMismatches;
+    std::string     sServiceDir;
+    std::string     sWorkDir;
+    bpharness::ClientContext ctx;
+    bool            bShowLog;
+    bool            bJson;
+};
+
+
+// A recorded call and how it ended.
+struct Call
+{
+    enum Outcome { Unknown, Results, Error };
+
+    Call() : micros( 0 ), instanceId( 0 ), pArgs( NULL ),
+             outcome( Unknown ), nResultsBytes( 0 ) {}
+
+    unsigned long long  micros;
+    unsigned int        instanceId;
+    std::string         function;
+    bplus::Object*      pArgs;
+    Outcome             outcome;
+    unsigned long long  nResultsBytes;
+    std::string         sError;
+};
+
+
+struct Trace
+{
+    Trace() : nCallbacks( 0 ) {}
+    ~Trace()
+    {
+        for (size_t i = 0; i < calls.size(); i++) delete calls[i].pArgs;
+    }
+
+    std::string         sService;
+    std::string         sVersion;
+    std::vector<Call>   calls;
+    unsigned long long  nCallbacks;
+};
+
+
+struct FunctionStats
+{
+    FunctionStats() : nCalls( 0 ), nErrors( 0 ), nMismatches( 0 ) {}
+
+    unsigned long long  nCalls;
+    unsigned long long  nErrors;
+    unsigned long long  nMismatches;
+    std::vector<unsigned long long> latencies;  // micros
+};
+
+
+struct Results
+{
+    Results() : nOk( 0 ), nErrors( 0 ), nTimeouts( 0 ), nUnchecked( 0 ),
+                nMismatches( 0 ), nMaxLagMicros( 0 ), nMicros( 0 ) {}
+
+    unsigned long long  nOk;
+    unsigned long long  nErrors;
+    unsigned long long  nTimeouts;
+    unsigned long long  nUnchecked;     // no recorded outcome
+    unsigned long long  nMismatches;
+    unsigned long long  nMaxLagMicros;  // behind schedule, original timing
+    unsigned long long  nMicros;
+    std::vector<unsigned long long> latencies;
+    std::map<std::string, FunctionStats> functions;
+    std::vector<std::string> vMismatches;  // descriptions, the first few
+};
+
+
+void
+usage()
+{
+    fprintf( stderr,
+"usage: bpreplay [options] service.so trace\n"
+"  --timing MODE        fast: as fast as the service allows (default)\n"
+"                       original: on the trace's own schedule\n"
+"  --concurrency N      calls kept outstanding with fast timing\n"
+"                       (default 1)\n"
+"  --timeout MSEC       cancel calls taking longer (default 10000)\n"
+"  --show-mismatches N  describe the first N mismatches (default 10)\n"
+"  --service-dir DIR    service directory (default: the library's)\n"
+"  --work-dir DIR       where data and temp dirs are made\n"
+"                       (default: a new directory under /tmp)\n"
+"  --uri URI            client URI (default http://localhost)\n"
+"  --show-log           print service log lines to stderr\n"
+"  --json               print the report as JSON\n" );
+}
+
+
+bool
+parseOptions( int argc, char** argv, Options& opts )
+{
+    std::vector<const char*> vPositional;
+    for (int i = 1; i < argc; i++) {
+        std::string sOpt = argv[i];
+        if (sOpt.compare( 0, 2, "--" ) != 0) {
+            vPositional.push_back( argv[i] );
+            continue;
+        }
+        if (sOpt == "--show-log") { opts.bShowLog = true; continue; }
+        if (sOpt == "--json") { opts.bJson = true; continue; }
+
+        if (i + 1 >= argc) {
+            fprintf( stderr, "%s needs a value\n", argv[i] );
+            return false;
+        }
+        const char* cszVal = argv[++i];
+        bool bOk = true;
+        if (sOpt == "--timing") {
+            bOk = !strcmp( cszVal, "fast" ) || !strcmp( cszVal, "original" );
+            opts.bOriginalTiming = !strcmp( cszVal, "original" );
+        }
+        else if (sOpt == "--concurrency") bOk = parseCount( cszVal, opts.nConcurrency );
+        else if (sOpt == "--timeout") bOk = parseCount( cszVal, opts.nTimeoutMsec );
+        else if (sOpt == "--show-mismatches") bOk = parseCount( cszVal, opts.nShowMismatches );
+        else if (sOpt == "--service-dir") opts.sServiceDir = cszVal;
+        else if (sOpt == "--work-dir") opts.sWorkDir = cszVal;
+        else if (sOpt == "--uri") opts.ctx.uri = cszVal;
+        else {
+            fprintf( stderr, "unknown option %s\n", argv[i - 1] );
+            return false;
+        }
+        if (!bOk) {
+            fprintf( stderr, "bad value for %s: %s\n", argv[i - 1], cszVal );
+            return false;
+        }
+    }
+
+    if (vPositional.size() != 2) return false;
+    if (opts.nConcurrency == 0) {
+        fprintf( stderr, "--concurrency must be positive\n" );
+        return false;
+    }
+    opts.sLibPath = vPositional[0];
+    opts.sTracePath = vPositional[1];
+    if (opts.sServiceDir.empty()) {
+        size_t nSlash = opts.sLibPath.rfind( '/' );
+        opts.sServiceDir = nSlash == std::string::npos
+                           ? "." : opts.sLibPath.substr( 0, nSlash );
+    }
+    return true;
+}
+
+
+// Read the calls, and pair each with how it ended.  A trace cut short
+// (the service was killed, say) loads up to its last whole record.
+bool
+loadTrace( const std::string& sPath, Trace& trace )
+{
+    std::string sData;
+    if (!readFile( sPath.c_str(), sData )) {
+        fprintf( stderr, "can't read %s\n", sPath.c_str() );
+        return false;
+    }
+    InvocationTrace::Reader reader( sData.data(), sData.size() );
+    if (!reader.valid()) {
+        fprintf( stderr, "%s is not an invocation trace\n", sPath.c_str() );
+        return false;
+    }
+    trace.sService = reader.service();
+    trace.sVersion = reader.version();
+
+    // Open calls by recorded tid.
+    std::map<unsigned int, size_t> open;
+    InvocationTrace::Reader::Record rec;
+    while (reader.next( rec )) {
+        if (rec.kind == InvocationTrace::KindInvoke) {
+            open[rec.tid] = trace.calls.size();
+            trace.calls.push_back( Call() );
+            Call& c = trace.calls.back();
+            c.micros = rec.micros;
+            c.instanceId = rec.instanceId;
+            c.function = rec.function;
+            c.pArgs = rec.pArgs;
+            rec.pArgs = NULL;
+            continue;
+        }
+        if (rec.kind == InvocationTrace::KindCallback) {
+            trace.nCallbacks++;
+            continue;
+        }
+        std::map<unsigned int, size_t>::iterator it = open.find( rec.tid );
+        if (it == open.end()) continue;
+        Call& c = trace.calls[it->second];
+        if (rec.kind == InvocationTrace::KindResults) {
+            c.outcome = Call::Results;
+            c.nResultsBytes = rec.size;
+        } else {
+            c.outcome = Call::Error;
+            c.sError = rec.error;
+        }
+        open.erase( it );
+    }
+    return true;
+}
+
+
+// Compare a replayed call's end with the recorded one.  Returns false,
+// with a description, on a mismatch.
+bool
+matches( const Call& call, const bpharness::Completion& done,
+         std::string& sWhy )
+{
+    char buf[256];
+    if (call.outcome == Call::Results && !done.bError) {
+        if (call.nResultsBytes == done.nResultsBytes) return true;
+        snprintf( buf, sizeof(buf), "results of %llu bytes, recorded %llu",
+                  done.nResultsBytes, call.nResultsBytes );
+        sWhy = buf;
+        return false;
+    }
+    if (call.outcome == Call::Error && done.bError) {
+        if (call.sError == done.sError) return true;
+        sWhy = "error " + done.sError + ", recorded " + call.sError;
+        return false;
+    }
+    if (done.bError) {
+        sWhy = "error " + done.sError + ", recorded results";
+    } else {
+        sWhy = "results, recorded error " + call.sError;
+    }
+    return false;
+}
+
+
+void
+noteMismatch( const Options& opts, Results& res, FunctionStats& fs,
+              unsigned int nCall, const Call& call, const std::string& sWhy )
+{
+    res.nMismatches++;
+    fs.nMismatches++;
+    if (res.vMismatches.size() < opts.nShowMismatches) {
+        char buf[64];
+        snprintf( buf, sizeof(buf), "call %u ", nCall );
+        res.vMismatches.push_back( buf + call.function + ": " + sWhy );
+    }
+}
+
+
+void
+replay( bpharness::ServiceHost& host, const Options& opts,
+        const Trace& trace, Results& res )
+{
+    struct Pending
+    {
+        unsigned long long  start;
+        unsigned int        nInstance;
+        unsigned int        nCall;
+    };
+    std::map<unsigned int, Pending> pending;
+    std::map<unsigned int, unsigned int> instances;     // recorded -> ours
+    std::vector<bpharness::Completion> vDone;
+    unsigned long long nTimeout = opts.nTimeoutMsec * 1000ULL;
+    unsigned int tidNext = 1;
+    size_t nNext = 0;
+
+    unsigned long long nStart = bplus::timeutil::monotonicMicros();
+    unsigned long long nTraceStart =
+        trace.calls.empty() ? 0 : trace.calls[0].micros;
+
+    while (nNext < trace.calls.size() || !pending.empty()) {
+        unsigned long long now = bplus::timeutil::monotonicMicros();
+        unsigned int nWaitMsec = 10;
+        while (nNext < trace.calls.size()) {
+            const Call& call = trace.calls[nNext];
+            if (opts.bOriginalTiming) {
+                unsigned long long due =
+                    nStart + (call.micros - nTraceStart);
+                if (now < due) {
+                    // round up: a wait of 0 would just spin
+                    unsigned long long nMsec = (due - now + 999) / 1000;
+                    if (nMsec < nWaitMsec) nWaitMsec = (unsigned int) nMsec;
+                    break;
+                }
+                if (now - due > res.nMaxLagMicros) {
+                    res.nMaxLagMicros = now - due;
+                }
+            } else if (pending.size() >= opts.nConcurrency) {
+                break;
+            }
+
+            std::map<unsigned int, unsigned int>::iterator itInst =
+                instances.find( call.instanceId );
+            if (itInst == instances.end()) {
+                std::string sError;
+                if (!host.allocate( 1, opts.ctx, sError )) {
+                    fprintf( stderr, "allocate failed: %s\n",
+                             sError.c_str() );
+                    exit( 1 );
+                }
+                itInst = instances.insert( std::make_pair(
+                             call.instanceId,
+                             host.instanceCount() - 1 ) ).first;
+            }
+
+            unsigned int tid = tidNext++;
+            Pending& p = pending[tid];
+            p.nInstance = itInst->second;
+            p.nCall = (unsigned int) nNext++;
+            p.start = bplus::timeutil::monotonicMicros();
+            host.invoke( p.nInstance, tid, call.function.c_str(),
+                         call.pArgs->elemPtr() );
+        }
+
+        vDone.clear();
+        host.pump( nWaitMsec, vDone );
+        for (size_t i = 0; i < vDone.size(); i++) {
+            const bpharness::Completion& c = vDone[i];
+            std::map<unsigned int, Pending>::iterator it =
+                pending.find( c.tid );
+            if (it == pending.end()) continue;      // late, or unknown
+            const Call& call = trace.calls[it->second.nCall];
+            FunctionStats& fs = res.functions[call.function];
+            unsigned long long nLatency = c.micros - it->second.start;
+            fs.nCalls++;
+            fs.latencies.push_back( nLatency );
+            res.latencies.push_back( nLatency );
+            if (c.bError) {
+                res.nErrors++;
+                fs.nErrors++;
+            } else {
+                res.nOk++;
+            }
+            std::string sWhy;
+            if (call.outcome == Call::Unknown) {
+                res.nUnchecked++;
+            } else if (!matches( call, c, sWhy )) {
+                noteMismatch( opts, res, fs, it->second.nCall, call, sWhy );
+            }
+            pending.erase( it );
+        }
+
+        now = bplus::timeutil::monotonicMicros();
+        std::map<unsigned int, Pending>::iterator it = pending.begin();
+        while (it != pending.end()) {
+            if (now - it->second.start > nTimeout) {
+                const Call& call = trace.calls[it->second.nCall];
+                host.cancel( it->second.nInstance, it->first );
+                res.nTimeouts++;
+                res.functions[call.function].nCalls++;
+                if (call.outcome != Call::Unknown) {
+                    noteMismatch( opts, res, res.functions[call.function],
+                                  it->second.nCall, call, "timed out" );
+                }
+                pending.erase( it++ );
+            } else {
+                ++it;
+            }
+        }
+    }
+    res.nMicros = bplus::timeutil::monotonicMicros() - nStart;
+}
+
+
+void
+report( const Options& opts, const BPServiceDefinition* pDef,
+        const Trace& trace, Results& res,
+        const bpharness::HostCounters& counters, unsigned int nInstances )
+{
+    std::sort( res.latencies.begin(), res.latencies.end() );
+    std::map<std::string, FunctionStats>::iterator it;
+    for (it = res.functions.begin(); it != res.functions.end(); ++it) {
+        std::sort( it->second.latencies.begin(),
+                   it->second.latencies.end() );
+    }
+    double dSecs = res.nMicros / 1e6;
+    double dRate = dSecs > 0 ? (res.nOk + res.nErrors) / dSecs : 0;
+    char szVersion[64];
+    snprintf( szVersion, sizeof(szVersion), "%u.%u.%u", pDef->majorVersion,
+              pDef->minorVersion, pDef->microVersion );
+    const char* cszTiming = opts.bOriginalTiming ? "original" : "fast";
+
+    if (!opts.bJson) {
+        printf( "service:     %s %s (%s)\n", pDef->serviceName, szVersion,
+                opts.sLibPath.c_str() );
+        printf( "trace:       %s %s, %lu calls (%s)\n",
+                trace.sService.c_str(), trace.sVersion.c_str(),
+                (unsigned long) trace.calls.size(),
+                opts.sTracePath.c_str() );
+        if (opts.bOriginalTiming) {
+            printf( "timing:      original, %u instances, max lag %llu us\n",
+                    nInstances, res.nMaxLagMicros );
+        } else {
+            printf( "timing:      fast, %u instances, concurrency %u\n",
+                    nInstances, opts.nConcurrency );
+        }
+        printf( "calls:       %llu ok, %llu errors, %llu timeouts in %.3f s"
+                ", %.1f calls/s\n", res.nOk, res.nErrors, res.nTimeouts,
+                dSecs, dRate );
+        printf( "checked:     %llu mismatches, %llu unchecked\n",
+                res.nMismatches, res.nUnchecked );
+        printf( "callbacks:   %llu, recorded %llu\n",
+                counters.callbacks, trace.nCallbacks );
+        printf( "latency us:  p50 %llu  p90 %llu  p99 %llu  max %llu\n",
+                percentile( res.latencies, 50 ),
+                percentile( res.latencies, 90 ),
+                percentile( res.latencies, 99 ),
+                percentile( res.latencies, 100 ) );
+        for (it = res.functions.begin(); it != res.functions.end(); ++it) {
+            const FunctionStats& fs = it->second;
+            printf( "  %-20s %8llu calls %6llu errors %6llu mismatches"
+                    "  p50 %llu  p99 %llu\n", it->first.c_str(),
+                    fs.nCalls, fs.nErrors, fs.nMismatches,
+                    percentile( fs.latencies, 50 ),
+                    percentile( fs.latencies, 99 ) );
+        }
+        for (size_t i = 0; i < res.vMismatches.size(); i++) {
+            printf( "mismatch:    %s\n", res.vMismatches[i].c_str() );
+        }
+        return;
+    }
+
+    std::string s = "{\"service\":";
+    bplus::strutil::quoteJsonString( pDef->serviceName, s );
+    s += ",\"version\":";
+    bplus::strutil::quoteJsonString( szVersion, s );
+    s += ",\"traceService\":";
+    bplus::strutil::quoteJsonString( trace.sService, s );
+    s += ",\"traceVersion\":";
+    bplus::strutil::quoteJsonString( trace.sVersion, s );
+    s += ",\"timing\":";
+    bplus::strutil::quoteJsonString( cszTiming, s );
+    char buf[512];
+    snprintf( buf, sizeof(buf),
+              ",\"instances\":%u,\"concurrency\":%u,\"maxLagUs\":%llu"
+              ",\"calls\":%lu,\"ok\":%llu,\"errors\":%llu,\"timeouts\":%llu"
+              ",\"mismatches\":%llu,\"unchecked\":%llu"
+              ",\"callbacks\":%llu,\"recordedCallbacks\":%llu"
+              ",\"seconds\":%.6f,\"callsPerSec\":%.1f"
+              ",\"latencyUs\":{\"p50\":%llu,\"p90\":%llu,\"p99\":%llu"
+              ",\"max\":%llu}",
+              nInstances, opts.nConcurrency, res.nMaxLagMicros,
+              (unsigned long) trace.calls.size(), res.nOk, res.nErrors,
+              res.nTimeouts, res.nMismatches, res.nUnchecked,
+              counters.callbacks, trace.nCallbacks, dSecs, dRate,
+              percentile( res.latencies, 50 ),
+              percentile( res.latencies, 90 ),
+              percentile( res.latencies, 99 ),
+              percentile( res.latencies, 100 ) );
+    s += buf;
+    s += ",\"functions\":{";
+    for (it = res.functions.begin(); it != res.functions.end(); ++it) {
+        const FunctionStats& fs = it->second;
+        if (it != res.functions.begin()) s += ",";
+        bplus::strutil::quoteJsonString( it->first, s );
+        snprintf( buf, sizeof(buf),
+                  ":{\"calls\":%llu,\"errors\":%llu,\"mismatches\":%llu"
+                  ",\"p50\":%llu,\"p99\":%llu}",
+                  fs.nCalls, fs.nErrors, fs.nMismatches,
+                  percentile( fs.latencies, 50 ),
+                  percentile( fs.latencies, 99 ) );
+        s += buf;
+    }
+    s += "},\"firstMismatches\":[";
+    for (size_t i = 0; i < res.vMismatches.size(); i++) {
+        if (i) s += ",";
+        bplus::strutil::quoteJsonString( res.vMismatches[i], s );
+    }
+    s += "]}";
+    printf( "%s\n", s.c_str() );
+}
+
+
+} // anonymous namespace
+
+
+int
+main( int argc, char** argv )
+{
+    Options opts;
+    if (!parseOptions( argc, argv, opts )) {
+        usage();
+        return 2;
+    }
+
+    Trace trace;
+    if (!loadTrace( opts.sTracePath, trace )) return 2;
+
+    if (!bpharness::makeWorkDir( "bpreplay", opts.sWorkDir, opts.ctx )) {
+        perror( "mkdtemp" );
+        return 1;
+    }
+    opts.ctx.clientPid = (int) getpid();
+
+    bpharness::ServiceHost host;
+    host.setLogStream( opts.bShowLog ? stderr : NULL );
+
+    std::string sError;
+    if (!host.load( opts.sLibPath, sError )
+        || !host.initialize( opts.sServiceDir, sError )) {
+        fprintf( stderr, "%s: %s\n", opts.sLibPath.c_str(), sError.c_str() );
+        return 1;
+    }
+    if (trace.sService != host.definition()->serviceName) {
+        fprintf( stderr, "warning: trace is of %s, not %s\n",
+                 trace.sService.c_str(), host.definition()->serviceName );
+    }
+
+    Results res;
+    res.latencies.reserve( trace.calls.size() );
+    replay( host, opts, trace, res );
+    report( opts, host.definition(), trace, res, host.counters(),
+            host.instanceCount() );
+
+    host.shutdown();
+    return res.nMismatches || res.nTimeouts ? 3 : 0;
+}
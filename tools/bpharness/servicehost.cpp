@@ -0,0 +1,412 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  servicehost.cpp
+ *
+ *  Implementation of ServiceHost.
+ */
+
+#include "servicehost.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "bpservice/bpinvocationtrace.h"
+#include "bputil/bpjson.h"
+#include "bputil/bptimeutil.h"
+
+
+namespace bpharness {
+
+
+ServiceHost* ServiceHost::s_pCurrent = NULL;
+
+
+ServiceHost::ServiceHost() :
+    m_pLib( NULL ),
+    m_pEntryPoints( NULL ),
+    m_pDefinition( NULL ),
+    m_bInitialized( false ),
+    m_bCaptureResults( false ),
+    m_pLogStream( NULL ),
+    m_pPromptResponse( NULL )
+{
+    m_coreFuncs.postResults = cPostResults;
+    m_coreFuncs.postError = cPostError;
+    m_coreFuncs.log = cLog;
+    m_coreFuncs.invoke = cInvoke;
+    m_coreFuncs.prompt = cPrompt;
+    m_coreFuncs.invokeOnMainThread = cInvokeOnMainThread;
+    s_pCurrent = this;
+}
+
+
+ServiceHost::~ServiceHost()
+{
+    shutdown();
+    // Leave the library loaded: services may have left threads or
+    // atexit handlers behind that still point into it.
+    delete m_pPromptResponse;
+    s_pCurrent = NULL;
+}
+
+
+bool
+ServiceHost::load( const std::string& sLibPath, std::string& sError )
+{
+    m_pLib = dlopen( sLibPath.c_str(), RTLD_NOW | RTLD_LOCAL );
+    if (!m_pLib) {
+        const char* cszErr = dlerror();
+        sError = cszErr ? cszErr : "dlopen failed";
+        return false;
+    }
+
+    typedef const BPPFunctionTable* (*GetEntryPointsFunc)( void );
+    GetEntryPointsFunc pfnGet =
+        (GetEntryPointsFunc) dlsym( m_pLib, "BPPGetEntryPoints" );
+    if (!pfnGet) {
+        sError = "no BPPGetEntryPoints in " + sLibPath;
+        return false;
+    }
+    m_pEntryPoints = pfnGet();
+    if (!m_pEntryPoints || !m_pEntryPoints->initializeFunc
+        || !m_pEntryPoints->allocateFunc || !m_pEntryPoints->invokeFunc) {
+        sError = "incomplete entry point table";
+        return false;
+    }
+    return true;
+}
+
+
+bool
+ServiceHost::initialize( const std::string& sServiceDir, std::string& sError )
+{
+    m_pDefinition = m_pEntryPoints->initializeFunc(
+        &m_coreFuncs, (BPPath) sServiceDir.c_str(),
+        (BPPath) sServiceDir.c_str(), NULL );
+    if (!m_pDefinition) {
+        sError = "initialize returned no service definition";
+        return false;
+    }
+    m_sServiceDir = sServiceDir;
+    m_bInitialized = true;
+    return true;
+}
+
+
+bool
+ServiceHost::allocate( unsigned int nInstances, const ClientContext& ctx,
+                       std::string& sError )
+{
+    for (unsigned int i = 0; i < nInstances; i++) {
+        void* pInst = NULL;
+        int nRet = m_pEntryPoints->allocateFunc(
+            &pInst, (BPString) ctx.uri.c_str(),
+            (BPPath) m_sServiceDir.c_str(),
+            (BPPath) ctx.dataDir.c_str(), (BPPath) ctx.tempDir.c_str(),
+            (BPString) ctx.locale.c_str(), (BPString) ctx.userAgent.c_str(),
+            ctx.clientPid );
+        if (nRet != 0) {
+            char buf[64];
+            snprintf( buf, sizeof(buf), "allocate failed (%d)", nRet );
+            sError = buf;
+            return false;
+        }
+        m_instances.push_back( pInst );
+    }
+    return true;
+}
+
+
+void
+ServiceHost::invoke( unsigned int nInstance, unsigned int tid,
+                     const char* cszFunction, const BPElement* pArgs )
+{
+    m_pEntryPoints->invokeFunc( m_instances[nInstance], cszFunction,
+                                tid, pArgs );
+}
+
+
+void
+ServiceHost::cancel( unsigned int nInstance, unsigned int tid )
+{
+    if (m_pEntryPoints->cancelFunc) {
+        m_pEntryPoints->cancelFunc( m_instances[nInstance], tid );
+    }
+}
+
+
+void
+ServiceHost::pump( unsigned int nMsec, std::vector<Completion>& vDone )
+{
+    std::deque<Posted> posted;
+    {
+        bplus::sync::Lock lock( m_lock );
+        if (m_posted.empty() && nMsec) {
+            m_cond.timeWait( &m_lock, nMsec );
+        }
+        posted.swap( m_posted );
+    }
+
+    // Prompt and main thread callbacks may post more; they'll be picked
+    // up next time round.
+    for (size_t i = 0; i < posted.size(); i++) {
+        Posted& p = posted[i];
+        switch (p.kind) {
+            case Posted::Done:
+                vDone.push_back( p.done );
+                break;
+            case Posted::Prompt: {
+                bplus::Null null;
+                const BPElement* pResponse = m_pPromptResponse
+                    ? m_pPromptResponse->elemPtr() : null.elemPtr();
+                p.promptCallback( p.promptContext, p.promptId, pResponse );
+                break;
+            }
+            case Posted::MainThread:
+                p.mainThreadCallback();
+                break;
+        }
+    }
+}
+
+
+void
+ServiceHost::shutdown()
+{
+    if (m_pEntryPoints && m_pEntryPoints->destroyFunc) {
+        for (size_t i = 0; i < m_instances.size(); i++) {
+            m_pEntryPoints->destroyFunc( m_instances[i] );
+        }
+    }
+    m_instances.clear();
+    if (m_bInitialized && m_pEntryPoints->shutdownFunc) {
+        m_pEntryPoints->shutdownFunc();
+    }
+    m_bInitialized = false;
+}
+
+
+void
+ServiceHost::setPromptResponse( bplus::Object* pResponse )
+{
+    delete m_pPromptResponse;
+    m_pPromptResponse = pResponse;
+}
+
+
+HostCounters
+ServiceHost::counters() const
+{
+    HostCounters c;
+    c.callbacks = m_nCallbacks.load();
+    c.logLines = m_nLogLines.load();
+    c.prompts = m_nPrompts.load();
+    c.mainThreadCalls = m_nMainThreadCalls.load();
+    return c;
+}
+
+
+void
+ServiceHost::post( const Posted& p )
+{
+    bplus::sync::Lock lock( m_lock );
+    m_posted.push_back( p );
+    m_cond.signal();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Core functions.  These may be called from any thread.
+//
+
+void
+ServiceHost::cPostResults( unsigned int tid, const BPElement* pResults )
+{
+    Posted p;
+    p.kind = Posted::Done;
+    p.done.micros = bplus::timeutil::monotonicMicros();
+    p.done.tid = tid;
+    p.done.bError = false;
+    p.done.nResultsBytes =
+        bplus::service::InvocationTrace::encodedSize( pResults );
+    if (s_pCurrent->m_bCaptureResults) {
+        bplus::json::serialize( pResults, p.done.sResults );
+    }
+    s_pCurrent->post( p );
+}
+
+
+void
+ServiceHost::cPostError( unsigned int tid, const char* cszError,
+                         const char* cszVerbose )
+{
+    Posted p;
+    p.kind = Posted::Done;
+    p.done.micros = bplus::timeutil::monotonicMicros();
+    p.done.tid = tid;
+    p.done.bError = true;
+    p.done.sError = cszError ? cszError : "(generic error)";
+    p.done.sVerboseError = cszVerbose ? cszVerbose : "";
+    s_pCurrent->post( p );
+}
+
+
+void
+ServiceHost::cLog( unsigned int level, const char* fmt, ... )
+{
+    s_pCurrent->m_nLogLines.increment( bplus::sync::MemoryOrderRelaxed );
+    FILE* pStream = s_pCurrent->m_pLogStream;
+    if (!pStream) return;
+
+    char buf[1024];
+    va_list ap;
+    va_start( ap, fmt );
+    vsnprintf( buf, sizeof(buf), fmt, ap );
+    va_end( ap );
+    fprintf( pStream, "[service log %u] %s\n", level, buf );
+}
+
+
+void
+ServiceHost::cInvoke( unsigned int, BPCallBack, const BPElement* )
+{
+    s_pCurrent->m_nCallbacks.increment( bplus::sync::MemoryOrderRelaxed );
+}
+
+
+unsigned int
+ServiceHost::cPrompt( unsigned int, const BPPath, const BPElement*,
+                      BPUserResponseCallbackFuncPtr cb, void* pContext )
+{
+    static bplus::sync::AtomicCounter s_nPromptIds;
+    s_pCurrent->m_nPrompts.increment( bplus::sync::MemoryOrderRelaxed );
+    unsigned int id = (unsigned int) s_nPromptIds.increment();
+    if (cb) {
+        Posted p;
+        p.kind = Posted::Prompt;
+        p.promptCallback = cb;
+        p.promptContext = pContext;
+        p.promptId = id;
+        s_pCurrent->post( p );
+    }
+    return id;
+}
+
+
+void
+ServiceHost::cInvokeOnMainThread( BPCMainThreadCallbackPtr cb )
+{
+    s_pCurrent->m_nMainThreadCalls.increment(
+        bplus::sync::MemoryOrderRelaxed );
+    if (!cb) return;
+    Posted p;
+    p.kind = Posted::MainThread;
+    p.mainThreadCallback = cb;
+    s_pCurrent->post( p );
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+unsigned long
+procStatusKb( const char* cszField )
+{
+    FILE* f = fopen( "/proc/self/status", "r" );
+    if (!f) return 0;
+    char line[256];
+    size_t nField = strlen( cszField );
+    unsigned long nKb = 0;
+    while (fgets( line, sizeof(line), f )) {
+        if (strncmp( line, cszField, nField ) == 0 && line[nField] == ':') {
+            nKb = strtoul( line + nField + 1, NULL, 10 );
+            break;
+        }
+    }
+    fclose( f );
+    return nKb;
+}
+
+
+bool
+parseCount( const char* csz, unsigned int& n )
+{
+    char* pEnd = NULL;
+    errno = 0;
+    unsigned long v = strtoul( csz, &pEnd, 10 );
+    if (errno || !*csz || *pEnd || v > UINT_MAX) return false;
+    n = (unsigned int) v;
+    return true;
+}
+
+
+bool
+readFile( const char* cszPath, std::string& sOut )
+{
+    FILE* f = fopen( cszPath, "rb" );
+    if (!f) return false;
+    char buf[64 * 1024];
+    size_t n;
+    while ((n = fread( buf, 1, sizeof(buf), f )) > 0) sOut.append( buf, n );
+    bool bOk = !ferror( f );
+    fclose( f );
+    return bOk;
+}
+
+
+unsigned long long
+percentile( const std::vector<unsigned long long>& vSorted, double dPct )
+{
+    if (vSorted.empty()) return 0;
+    size_t n = (size_t) ceil( dPct / 100.0 * vSorted.size() );
+    if (n > 0) n--;
+    if (n >= vSorted.size()) n = vSorted.size() - 1;
+    return vSorted[n];
+}
+
+
+bool
+makeWorkDir( const char* cszTool, std::string& sWorkDir, ClientContext& ctx )
+{
+    if (sWorkDir.empty()) {
+        std::string sTemplate = std::string( "/tmp/" ) + cszTool + "-XXXXXX";
+        std::vector<char> vName( sTemplate.begin(), sTemplate.end() );
+        vName.push_back( 0 );
+        if (!mkdtemp( &vName[0] )) return false;
+        sWorkDir = &vName[0];
+    }
+    ctx.dataDir = sWorkDir + "/data";
+    ctx.tempDir = sWorkDir + "/temp";
+    mkdir( ctx.dataDir.c_str(), 0700 );
+    mkdir( ctx.tempDir.c_str(), 0700 );
+    return true;
+}
+
+
+} // bpharness
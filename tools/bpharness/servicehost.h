@@ -0,0 +1,227 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  servicehost.h
+ *
+ *  Loads a service's shared library and plays the part of the
+ *  BrowserPlus daemon towards it: supplies the BPCFunctionTable,
+ *  allocates instances and invokes functions.  Everything the service
+ *  posts back -- results, errors, callbacks, prompts and main thread
+ *  requests -- is timestamped on arrival and queued for the driving
+ *  thread, which plays the daemon's main thread and handles them in
+ *  pump().
+ *
+ *  Only one ServiceHost may exist at a time, since the core functions
+ *  handed to the service are plain C functions.  Linux only.
+ */
+
+#ifndef BPHARNESS_SERVICEHOST_H_
+#define BPHARNESS_SERVICEHOST_H_
+
+#include <stdio.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "bpserviceapi/bpcfunctions.h"
+#include "bpserviceapi/bppfunctions.h"
+#include "bputil/bpatomic.h"
+#include "bputil/bpsync.h"
+#include "bputil/bptypeutil.h"
+
+
+namespace bpharness {
+
+
+// What bppAllocate is told about the client.
+struct ClientContext
+{
+    ClientContext() :
+        uri( "http://localhost" ), locale( "en_US" ),
+        userAgent( "bpharness" ), clientPid( 0 ) {}
+
+    std::string     uri;
+    std::string     dataDir;
+    std::string     tempDir;
+    std::string     locale;
+    std::string     userAgent;
+    int             clientPid;
+};
+
+
+// The end of a call: postResults() or postError().
+struct Completion
+{
+    Completion() : tid( 0 ), micros( 0 ), bError( false ),
+                   nResultsBytes( 0 ) {}
+
+    unsigned int        tid;
+    unsigned long long  micros;         // monotonic, at arrival
+    bool                bError;
+    std::string         sError;
+    std::string         sVerboseError;
+    std::string         sResults;       // JSON, if captureResults() on
+    unsigned long long  nResultsBytes;  // InvocationTrace::encodedSize
+};
+
+
+struct HostCounters
+{
+    unsigned long long  callbacks;      // invoke() calls
+    unsigned long long  logLines;
+    unsigned long long  prompts;
+    unsigned long long  mainThreadCalls;
+};
+
+
+class ServiceHost
+{
+public:
+    ServiceHost();
+    ~ServiceHost();         // shuts down and unloads
+
+    // dlopen the library and fetch its entry points.
+    bool            load( const std::string& sLibPath, std::string& sError );
+
+    // Call the service's initialize function.  sServiceDir is also
+    // passed as the dependent dir.
+    bool            initialize( const std::string& sServiceDir,
+                                std::string& sError );
+
+    // The definition returned by initialize().
+    const BPServiceDefinition* definition() const { return m_pDefinition; }
+    const BPPFunctionTable* entryPoints() const { return m_pEntryPoints; }
+
+    // Allocate nInstances more instances.
+    bool            allocate( unsigned int nInstances,
+                              const ClientContext& ctx,
+                              std::string& sError );
+    unsigned int    instanceCount() const
+                        { return (unsigned int) m_instances.size(); }
+
+    // Start a call.  Its Completion is delivered by pump(), possibly
+    // before invoke() returns.
+    void            invoke( unsigned int nInstance, unsigned int tid,
+                            const char* cszFunction,
+                            const BPElement* pArgs );
+    void            cancel( unsigned int nInstance, unsigned int tid );
+
+    // Handle everything the service has posted, waiting up to nMsec for
+    // something to arrive.  Completions are appended to vDone.
+    void            pump( unsigned int nMsec,
+                          std::vector<Completion>& vDone );
+
+    // Destroy the instances and call the service's shutdown function.
+    void            shutdown();
+
+    // Keep results as JSON in each Completion.  Off by default.
+    void            setCaptureResults( bool bCapture )
+                        { m_bCaptureResults = bCapture; }
+
+    // Print service log lines here as they arrive; NULL (the default)
+    // only counts them.
+    void            setLogStream( FILE* pStream ) { m_pLogStream = pStream; }
+
+    // Answer prompts with a copy of this (takes ownership); Null if unset.
+    void            setPromptResponse( bplus::Object* pResponse );
+
+    HostCounters    counters() const;
+
+private:
+    struct Posted
+    {
+        enum Kind { Done, Prompt, MainThread };
+        Kind                            kind;
+        Completion                      done;
+        BPUserResponseCallbackFuncPtr   promptCallback;
+        void*                           promptContext;
+        unsigned int                    promptId;
+        BPCMainThreadCallbackPtr        mainThreadCallback;
+    };
+
+    void            post( const Posted& p );
+
+    static void     cPostResults( unsigned int tid, const BPElement* pResults );
+    static void     cPostError( unsigned int tid, const char* cszError,
+                                const char* cszVerbose );
+    static void     cLog( unsigned int level, const char* fmt, ... );
+    static void     cInvoke( unsigned int tid, BPCallBack cb,
+                             const BPElement* pParams );
+    static unsigned int cPrompt( unsigned int tid, const BPPath pathToDialog,
+                                 const BPElement* pArgs,
+                                 BPUserResponseCallbackFuncPtr cb,
+                                 void* pContext );
+    static void     cInvokeOnMainThread( BPCMainThreadCallbackPtr cb );
+
+    static ServiceHost* s_pCurrent;
+
+    void*                       m_pLib;
+    const BPPFunctionTable*     m_pEntryPoints;
+    const BPServiceDefinition*  m_pDefinition;
+    BPCFunctionTable            m_coreFuncs;
+    std::string                 m_sServiceDir;
+    std::vector<void*>          m_instances;
+    bool                        m_bInitialized;
+    bool                        m_bCaptureResults;
+    FILE*                       m_pLogStream;
+    bplus::Object*              m_pPromptResponse;
+
+    bplus::sync::Mutex          m_lock;
+    bplus::sync::Condition      m_cond;
+    std::deque<Posted>          m_posted;           // under m_lock
+
+    bplus::sync::AtomicCounter  m_nCallbacks;
+    bplus::sync::AtomicCounter  m_nLogLines;
+    bplus::sync::AtomicCounter  m_nPrompts;
+    bplus::sync::AtomicCounter  m_nMainThreadCalls;
+
+    ServiceHost( const ServiceHost& );
+    ServiceHost& operator=( const ServiceHost& );
+};
+
+
+// A field of /proc/self/status in kB, e.g. "VmRSS" or "VmHWM"; 0 if
+// unavailable.
+unsigned long   procStatusKb( const char* cszField );
+
+// Parse a whole string as a decimal unsigned int.
+bool            parseCount( const char* csz, unsigned int& n );
+
+// Append a file's contents to sOut.
+bool            readFile( const char* cszPath, std::string& sOut );
+
+// The dPct'th percentile of sorted samples, 0 if there are none.
+unsigned long long percentile( const std::vector<unsigned long long>& vSorted,
+                               double dPct );
+
+// Point ctx's data and temp dirs into sWorkDir and create them.  An
+// empty sWorkDir becomes a fresh /tmp/<cszTool>-XXXXXX.  False, with
+// errno set, if that can't be made.
+bool            makeWorkDir( const char* cszTool, std::string& sWorkDir,
+                             ClientContext& ctx );
+
+
+} // bpharness
+
+
+#endif // BPHARNESS_SERVICEHOST_H_
@@ -0,0 +1,209 @@
+/**
+ * ***** BEGIN LICENSE BLOCK *****
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * The Original Code is BrowserPlus (tm).
+ * 
+ * The Initial Developer of the Original Code is Yahoo!.
+ * Portions created by Yahoo! are Copyright (c) 2010 Yahoo! Inc.
+ * All rights reserved.
+ * 
+ * Contributor(s): 
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ *  bplogdecode.cpp
+ *
+ *  Renders BinaryLog segment files (*.bplog) written by Service::blog()
+ *  as text, or as one JSON object per line with --json.
+ *
+ *  usage: bplogdecode [--json] file.bplog ...
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "bpserviceapi/bpcfunctions.h"
+#include "bpservice/bpbinarylog.h"
+
+
+using bplus::service::BinaryLog;
+
+
+static const char*
+levelName( unsigned int level )
+{
+    switch (level) {
+        case BP_DEBUG: return "DEBUG";
+        case BP_INFO:  return "INFO";
+        case BP_WARN:  return "WARN";
+        case BP_ERROR: return "ERROR";
+        case BP_FATAL: return "FATAL";
+    }
+    return "?";
+}
+
+
+static bool
+readFile( const char* cszPath, std::vector<char>& vData )
+{
+    FILE* f = fopen( cszPath, "rb" );
+    if (!f) return false;
+    char buf[64 * 1024];
+    size_t n;
+    while ((n = fread( buf, 1, sizeof(buf), f )) > 0) {
+        vData.insert( vData.end(), buf, buf + n );
+    }
+    bool bOk = !ferror( f );
+    fclose( f );
+    return bOk;
+}
+
+
+// "2010-03-04 05:06:07.123456", UTC
+static std::string
+timeString( unsigned long long wallMicros )
+{
+    time_t secs = (time_t) (wallMicros / 1000000);
+    struct tm tmUtc;
+#ifdef WIN32
+    gmtime_s( &tmUtc, &secs );
+#else
+    gmtime_r( &secs, &tmUtc );
+#endif
+    char buf[64];
+    size_t n = strftime( buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tmUtc );
+    snprintf( buf + n, sizeof(buf) - n, ".%06u",
+              (unsigned int) (wallMicros % 1000000) );
+    return buf;
+}
+
+
+static std::string
+message( const BinaryLog::Reader::Event& e )
+{
+    std::string sMsg;
+    const bplus::logging::Arg* pArgs = e.args.empty() ? NULL : &e.args[0];
+    if (e.pSite) {
+        bplus::logging::format( sMsg, e.pSite->fmt.c_str(), pArgs,
+                                (unsigned int) e.args.size() );
+    } else {
+        // No definition for the site: show the raw arguments.
+        char buf[64];
+        snprintf( buf, sizeof(buf), "<site %u>", e.siteId );
+        sMsg = buf;
+        for (size_t i = 0; i < e.args.size(); i++) {
+            sMsg += " ";
+            bplus::logging::format( sMsg, "%s", &e.args[i], 1 );
+        }
+    }
+    return sMsg;
+}
+
+
+static void
+printText( const BinaryLog::Reader::Event& e )
+{
+    printf( "%s %-5s [tid %u, instance %u] %s",
+            timeString( e.wallMicros ).c_str(),
+            e.pSite ? levelName( e.pSite->level ) : "?",
+            e.tid, e.instanceId, message( e ).c_str() );
+    if (e.pSite) {
+        printf( " (%s:%u)", e.pSite->file.c_str(), e.pSite->line );
+    }
+    printf( "\n" );
+}
+
+
+static void
+printJson( const BinaryLog::Reader::Event& e )
+{
+    std::string s = "{\"time\":";
+    bplus::strutil::quoteJsonString( timeString( e.wallMicros ), s );
+
+    char buf[128];
+    snprintf( buf, sizeof(buf),
+              ",\"micros\":%llu,\"tid\":%u,\"instance\":%u,\"site\":%u",
+              e.wallMicros, e.tid, e.instanceId, e.siteId );
+    s += buf;
+    if (e.pSite) {
+        s += ",\"level\":";
+        bplus::strutil::quoteJsonString( levelName( e.pSite->level ), s );
+        s += ",\"file\":";
+        bplus::strutil::quoteJsonString( e.pSite->file, s );
+        snprintf( buf, sizeof(buf), ",\"line\":%u", e.pSite->line );
+        s += buf;
+        s += ",\"format\":";
+        bplus::strutil::quoteJsonString( e.pSite->fmt, s );
+    }
+
+    s += ",\"args\":[";
+    for (size_t i = 0; i < e.args.size(); i++) {
+        const bplus::logging::Arg& a = e.args[i];
+        if (i) s += ",";
+        if (a.type == bplus::logging::Arg::TypeString) {
+            bplus::strutil::quoteJsonString(
+                bplus::StringView( a.val.s, a.len ), s );
+        } else if (a.type == bplus::logging::Arg::TypePointer) {
+            std::string sPtr;
+            bplus::logging::format( sPtr, "%p", &a, 1 );
+            bplus::strutil::quoteJsonString( sPtr, s );
+        } else {
+            bplus::logging::format( s, "%s", &a, 1 );
+        }
+    }
+    s += "],\"message\":";
+    bplus::strutil::quoteJsonString( message( e ), s );
+    s += "}";
+    printf( "%s\n", s.c_str() );
+}
+
+
+int
+main( int argc, char** argv )
+{
+    bool bJson = false;
+    int nFirst = 1;
+    if (argc > 1 && strcmp( argv[1], "--json" ) == 0) {
+        bJson = true;
+        nFirst = 2;
+    }
+    if (nFirst >= argc) {
+        fprintf( stderr, "usage: %s [--json] file.bplog ...\n", argv[0] );
+        return 2;
+    }
+
+    int nRet = 0;
+    for (int i = nFirst; i < argc; i++) {
+        std::vector<char> vData;
+        if (!readFile( argv[i], vData ) || vData.empty()) {
+            fprintf( stderr, "%s: can't read\n", argv[i] );
+            nRet = 1;
+            continue;
+        }
+        BinaryLog::Reader reader( &vData[0], vData.size() );
+        if (!reader.valid()) {
+            fprintf( stderr, "%s: not a binary log segment\n", argv[i] );
+            nRet = 1;
+            continue;
+        }
+        BinaryLog::Reader::Event e;
+        while (reader.next( e )) {
+            if (bJson) printJson( e );
+            else printText( e );
+        }
+    }
+    return nRet;
+}